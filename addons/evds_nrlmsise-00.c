@@ -22,63 +22,226 @@
 ////////////////////////////////////////////////////////////////////////////////
 /// @page EVDS_Callback_NRLMSISE_00 NRLMSISE-00 Earth atmospheric model
 ///
+/// Atmospheric data callback (EVDS_NRLMSISE_00_GetAtmosphericData()) which evaluates
+/// the NRLMSISE-00 model directly, and atmosphere cache (EVDS_NRLMSISE_00_CreateCache())
+/// which tabulates the model and interpolates it at query time.
 ///
+/// Space weather is read from the following variables of the planet:
+/// Variable				| Description
+/// ------------------------|-------------------------------------------------------
+/// nrlmsise-00_ap0..6		| Magnetic index (daily and 3-hour values, 4.0 by default)
+/// nrlmsise-00_f107		| Solar 10.7 cm flux for previous day (150 by default)
+/// nrlmsise-00_f107a		| 81-day average of solar 10.7 cm flux (150 by default)
+///
+/// Day of year and universal time are derived from the system time.
 ////////////////////////////////////////////////////////////////////////////////
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
 #include <evds.h>
 #include <nrlmsise-00.h>
 #include "evds_nrlmsise-00.h"
 
+#ifdef _WIN32
+#	include <windows.h>
+#endif
+
+//Table is rebuilt when universal time changes by this much (seconds)
+#define EVDS_NRLMSISE_00_CACHE_REBUILD_TIME 3600.0
+
 
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief Callback that returns atmospheric data according to NRLMSISE-00
+/// @brief Inputs of the NRLMSISE-00 model which are not related to position.
 ////////////////////////////////////////////////////////////////////////////////
-int EVDS_NRLMSISE_00_GetAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_ENVIRONMENT_ATMOSPHERE* atmosphere) {
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_NRLMSISE_00_INPUTS_TAG {
+	EVDS_REAL ap[7];						//Magnetic index
+	EVDS_REAL f107;							//Solar flux for previous day
+	EVDS_REAL f107a;						//81-day average of solar flux
+	int year;								//Year
+	int doy;								//Day of year
+	EVDS_REAL sec;							//Seconds in day (universal time)
+} EVDS_NRLMSISE_00_INPUTS;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Tabulated atmosphere.
+///
+/// Nodes are stored by altitude layer, latitude and local solar time. Every node holds
+/// logarithm of density and temperature.
+///
+/// Version is incremented before the table is rebuilt and once it is complete, so it is
+/// odd while the table is being written. Queries check that version did not change while
+/// they were reading the table.
+////////////////////////////////////////////////////////////////////////////////
+typedef struct EVDS_NRLMSISE_00_TABLE_TAG {
+	EVDS_NRLMSISE_00_INPUTS inputs;			//Inputs for which table was built
+	EVDS_REAL* nodes;						//Nodes of the table
+	volatile long version;					//Version of the table (odd while being rebuilt)
+} EVDS_NRLMSISE_00_TABLE;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Atmosphere cache for a single planet.
+///
+/// Two tables are kept: one is used by queries, the other one is being rebuilt by
+/// the background thread, one altitude layer at a time. Index of the table used by
+/// queries is replaced when the rebuilt table is complete, queries do not take any locks.
+///
+/// The background thread never reads system time or variables of the planet. Inputs
+/// are read by the thread which requests the rebuild, and the background thread
+/// builds table for the latest snapshot of inputs.
+////////////////////////////////////////////////////////////////////////////////
+struct EVDS_NRLMSISE_00_CACHE_TAG {
+	EVDS_OBJECT* earth;						//Planet for which atmosphere is cached
+	EVDS_SYSTEM* system;					//System of the planet
+	EVDS_GEODETIC_DATUM datum;				//Datum used to find geodetic coordinates
+	EVDS_VARIABLE* ap[7];					//Magnetic index variables (or 0)
+	EVDS_VARIABLE* f107;					//Solar flux variable (or 0)
+	EVDS_VARIABLE* f107a;					//Average solar flux variable (or 0)
+
+	int altitudes;							//Number of altitude layers
+	int latitudes;							//Number of nodes in latitude
+	int times;								//Number of nodes in local solar time
+	EVDS_REAL altitude_step;				//Step between altitude layers (m)
+	EVDS_REAL latitude_step;				//Step between latitudes (degrees)
+	EVDS_REAL time_step;					//Step between local solar times (hours)
+
+	EVDS_NRLMSISE_00_TABLE tables[2];		//Tables of the atmosphere
+	volatile long current;					//Table used by queries (-1 if none is ready)
+	int building;							//Table being rebuilt
+	int building_layer;						//Next layer of the table being built (-1 if none)
+	long building_request;					//Request for which table is being rebuilt
+
+	EVDS_NRLMSISE_00_INPUTS request;		//Latest snapshot of inputs
+	volatile long request_version;			//Incremented every time a snapshot of inputs is taken
+	volatile long built_version;			//Latest request for which table is up to date
+
+	volatile int running;					//Is background thread requested to run
+	volatile int worker_running;			//Is background thread still running
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID lock;						//Lock for the snapshot of inputs
+#endif
+};
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Atomically add to a value shared with the background thread.
+///
+/// Also acts as a full memory barrier, so adding zero reads the latest value.
+////////////////////////////////////////////////////////////////////////////////
+long EVDS_InternalNRLMSISE_00_Add(volatile long* value, long delta) {
+#ifndef EVDS_SINGLETHREADED
+#	ifdef _WIN32
+	return InterlockedExchangeAdd(value,delta) + delta;
+#	else
+	return __sync_add_and_fetch(value,delta);
+#	endif
+#else
+	*value += delta;
+	return *value;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Convert MJD time into year, day of year and seconds in day.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalNRLMSISE_00_GetDate(EVDS_REAL mjd, int* year, int* doy, EVDS_REAL* sec) {
+	long days = (long)floor(mjd);
+	long z,era,doe,yoe,day_of_march_year;
+	int leap;
+	*sec = (mjd - days)*86400.0;
+
+	//Civil year from number of days since 1 March 0000 (years are counted from March)
+	z = days - 40587 + 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era*146097;
+	yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	day_of_march_year = doe - (365*yoe + yoe/4 - yoe/100);
+	*year = (int)(yoe + era*400) + (day_of_march_year >= 306 ? 1 : 0);
+
+	//Day of year counted from 1 January
+	leap = ((*year % 4 == 0) && ((*year % 100 != 0) || (*year % 400 == 0))) ? 1 : 0;
+	if (day_of_march_year >= 306) {
+		*doy = (int)(day_of_march_year - 306) + 1;
+	} else {
+		*doy = (int)day_of_march_year + 59 + leap + 1;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Read inputs of the model which are not related to position.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalNRLMSISE_00_ReadInputs(EVDS_SYSTEM* system, EVDS_VARIABLE** ap,
+										 EVDS_VARIABLE* f107, EVDS_VARIABLE* f107a,
+										 EVDS_NRLMSISE_00_INPUTS* inputs) {
+	EVDS_REAL mjd;
 	int i;
-	EVDS_REAL value;
-	EVDS_VARIABLE* variable;
 
+	for (i = 0; i < 7; i++) {
+		inputs->ap[i] = 4.0;
+		if (ap[i]) EVDS_Variable_GetReal(ap[i],&inputs->ap[i]);
+	}
+	inputs->f107 = 150.0;
+	inputs->f107a = 150.0;
+	if (f107) EVDS_Variable_GetReal(f107,&inputs->f107);
+	if (f107a) EVDS_Variable_GetReal(f107a,&inputs->f107a);
+
+	EVDS_System_GetTime(system,&mjd);
+	EVDS_InternalNRLMSISE_00_GetDate(mjd,&inputs->year,&inputs->doy,&inputs->sec);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find variables with space weather inputs of the planet.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalNRLMSISE_00_GetVariables(EVDS_OBJECT* earth, EVDS_VARIABLE** ap,
+										   EVDS_VARIABLE** f107, EVDS_VARIABLE** f107a) {
+	int i;
+	for (i = 0; i < 7; i++) {
+		char variable_name[256];
+		sprintf(variable_name,"nrlmsise-00_ap%d",i);
+		if (EVDS_Object_GetVariable(earth,variable_name,&ap[i]) != EVDS_OK) ap[i] = 0;
+	}
+	if (EVDS_Object_GetVariable(earth,"nrlmsise-00_f107",f107) != EVDS_OK) *f107 = 0;
+	if (EVDS_Object_GetVariable(earth,"nrlmsise-00_f107a",f107a) != EVDS_OK) *f107a = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate NRLMSISE-00 model.
+///
+/// Latitude, longitude are in degrees, altitude is in meters, local solar time is in hours.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalNRLMSISE_00_Evaluate(EVDS_NRLMSISE_00_INPUTS* inputs,
+									   EVDS_REAL latitude, EVDS_REAL longitude, EVDS_REAL altitude,
+									   EVDS_REAL local_time, EVDS_REAL* density, EVDS_REAL* temperature) {
 	struct nrlmsise_output output;
 	struct nrlmsise_input input;
 	struct nrlmsise_flags flags;
 	struct ap_array aph;
-	EVDS_REAL latitude,longitude,altitude;
-
-	//Read position
-	EVDS_Vector_ToGeographicCoordinates(earth,r,&latitude,&longitude,&altitude);
+	int i;
 
 	//Setup input for the model
-	//input.year = 1900+cur_time->tm_year;
-	//input.doy = cur_time->tm_yday;
-	//input.sec = cur_time->tm_sec+cur_time->tm_min*60+cur_time->tm_hour*3600;
+	input.year = inputs->year;
+	input.doy = inputs->doy;
+	input.sec = inputs->sec;
 	input.alt = altitude*1e-3;
 	input.g_lat = latitude;
 	input.g_long = longitude;
-	//input.lst = input.sec/3600.0 + input.g_long/15.0;
-
-	//Read AP indexes
-	for (i = 0; i < 7; i++) {
-		char variable_name[256];
-		sprintf(variable_name,"nrlmsise-00_ap%d",i);
-
-		aph.a[i] = 4.0;
-		EVDS_Object_GetRealVariable(earth,variable_name,&value,&variable);
-		if (variable) aph.a[i] = value;
-	}
+	input.lst = local_time;
+	input.f107 = inputs->f107;
+	input.f107A = inputs->f107a;
+	for (i = 0; i < 7; i++) aph.a[i] = inputs->ap[i];
 	input.ap = aph.a[0];
 	input.ap_a = &aph;
 
-	//Read f107/f107a
-	input.f107 = 150.0;
-	input.f107A = 150.0;
-	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_f107",&value,&variable);
-	if (variable) input.f107 = value;
-	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_f107a",&value,&variable);
-	if (variable) input.f107A = value;
-
 	//Setup switches
 	for (i = 0; i < 24; i++) flags.switches[i] = 1;
 	flags.switches[0] = 0; //Output data in meters
@@ -90,35 +253,429 @@ int EVDS_NRLMSISE_00_GetAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS
 	} else { //Effective density
 		gtd7d(&input, &flags, &output);
 	}
+	*density = output.d[5]*1e3;
+	*temperature = output.t[1];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Callback that returns atmospheric data according to NRLMSISE-00
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_NRLMSISE_00_GetAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_ENVIRONMENT_ATMOSPHERE* atmosphere) {
+	EVDS_SYSTEM* system;
+	EVDS_VARIABLE* ap[7];
+	EVDS_VARIABLE* f107;
+	EVDS_VARIABLE* f107a;
+	EVDS_NRLMSISE_00_INPUTS inputs;
+	EVDS_GEODETIC_COORDINATE position;
+	EVDS_REAL local_time;
+
+	//Read position and inputs of the model
+	EVDS_Geodetic_FromVector(&position,r,0);
+	EVDS_Object_GetSystem(earth,&system);
+	EVDS_InternalNRLMSISE_00_GetVariables(earth,ap,&f107,&f107a);
+	EVDS_InternalNRLMSISE_00_ReadInputs(system,ap,f107,f107a,&inputs);
+	local_time = fmod(inputs.sec/3600.0 + position.longitude/15.0 + 24.0,24.0);
+
+	//Read back
+	EVDS_InternalNRLMSISE_00_Evaluate(&inputs,position.latitude,position.longitude,position.elevation,
+		local_time,&atmosphere->density,&atmosphere->temperature);
+	atmosphere->pressure = 287*atmosphere->temperature*atmosphere->density;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute one altitude layer of the table.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalNRLMSISE_00_BuildLayer(EVDS_NRLMSISE_00_CACHE* cache, EVDS_NRLMSISE_00_TABLE* table, int layer) {
+	int i,j;
+	for (i = 0; i < cache->latitudes; i++) {
+		for (j = 0; j < cache->times; j++) {
+			EVDS_REAL* node = &table->nodes[2*((layer*cache->latitudes + i)*cache->times + j)];
+			EVDS_REAL latitude = -90.0 + i*cache->latitude_step;
+			EVDS_REAL local_time = j*cache->time_step;
+			EVDS_REAL longitude = fmod(15.0*(local_time - table->inputs.sec/3600.0) + 540.0,360.0) - 180.0;
+			EVDS_REAL density,temperature;
+
+			EVDS_InternalNRLMSISE_00_Evaluate(&table->inputs,latitude,longitude,layer*cache->altitude_step,
+				local_time,&density,&temperature);
+			node[0] = log(density > 0.0 ? density : 1e-300);
+			node[1] = temperature;
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if table must be rebuilt for the given inputs.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalNRLMSISE_00_IsOutdated(EVDS_NRLMSISE_00_INPUTS* table_inputs, EVDS_NRLMSISE_00_INPUTS* inputs) {
+	int i;
+	for (i = 0; i < 7; i++) {
+		if (table_inputs->ap[i] != inputs->ap[i]) return 1;
+	}
+	if (table_inputs->f107 != inputs->f107) return 1;
+	if (table_inputs->f107a != inputs->f107a) return 1;
+	if (table_inputs->doy != inputs->doy) return 1;
+	if (table_inputs->year != inputs->year) return 1;
+	if (fabs(table_inputs->sec - inputs->sec) > EVDS_NRLMSISE_00_CACHE_REBUILD_TIME) return 1;
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Take a snapshot of inputs and request the table to be rebuilt for them.
+///
+/// Inputs are read by the calling thread, so the background thread never reads system
+/// time or variables of the planet.
+///
+/// @returns Version of the request
+////////////////////////////////////////////////////////////////////////////////
+long EVDS_InternalNRLMSISE_00_Request(EVDS_NRLMSISE_00_CACHE* cache) {
+	EVDS_NRLMSISE_00_INPUTS inputs;
+	long request;
+
+	EVDS_InternalNRLMSISE_00_ReadInputs(cache->system,cache->ap,cache->f107,cache->f107a,&inputs);
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(cache->lock);
+#endif
+	memcpy(&cache->request,&inputs,sizeof(EVDS_NRLMSISE_00_INPUTS));
+	request = ++cache->request_version;
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(cache->lock);
+#endif
+	return request;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Do a single step of rebuilding the table.
+///
+/// Starts rebuilding if a new snapshot of inputs differs from inputs of the current table,
+/// computes next altitude layer otherwise. When the table is complete, it replaces the
+/// table used by queries.
+///
+/// @returns 1 if there is more work to do, 0 if table is up to date
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalNRLMSISE_00_UpdateStep(EVDS_NRLMSISE_00_CACHE* cache) {
+	EVDS_NRLMSISE_00_TABLE* table;
+
+	//Start rebuilding the table for the latest snapshot of inputs
+	if (cache->building_layer < 0) {
+		EVDS_NRLMSISE_00_INPUTS inputs;
+		long request;
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(cache->lock);
+#endif
+		memcpy(&inputs,&cache->request,sizeof(EVDS_NRLMSISE_00_INPUTS));
+		request = cache->request_version;
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(cache->lock);
+#endif
+		if (request == cache->built_version) return 0;
+
+		//Table is only rebuilt if inputs have changed enough
+		if ((cache->current >= 0) && 
+			(!EVDS_InternalNRLMSISE_00_IsOutdated(&cache->tables[cache->current].inputs,&inputs))) {
+			cache->built_version = request;
+			return 0;
+		}
+
+		//Queries which still read this table will fall back to the model
+		cache->building = (cache->current == 0) ? 1 : 0;
+		cache->building_request = request;
+		table = &cache->tables[cache->building];
+		EVDS_InternalNRLMSISE_00_Add(&table->version,1);
+		memcpy(&table->inputs,&inputs,sizeof(EVDS_NRLMSISE_00_INPUTS));
+		cache->building_layer = 0;
+	}
+
+	//Compute next layer
+	table = &cache->tables[cache->building];
+	EVDS_InternalNRLMSISE_00_BuildLayer(cache,table,cache->building_layer);
+	cache->building_layer++;
+
+	//Start using complete table (version is updated with a barrier before the table is published)
+	if (cache->building_layer >= cache->altitudes) {
+		EVDS_InternalNRLMSISE_00_Add(&table->version,1);
+		cache->current = cache->building;
+		cache->built_version = cache->building_request;
+		cache->building_layer = -1;
+		return 0;
+	}
+	return 1;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Background thread that rebuilds the table when inputs change.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalThread_NRLMSISE_00_Worker(EVDS_NRLMSISE_00_CACHE* cache) {
+	while (cache->running) {
+		if (!EVDS_InternalNRLMSISE_00_UpdateStep(cache)) {
+			SIMC_Thread_Sleep(0.1);
+		}
+	}
+	cache->worker_running = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create atmosphere cache for the planet.
+///
+/// The cache tabulates density and temperature on a grid of altitude, geodetic latitude
+/// and local solar time for the current space weather and date. Queries interpolate the
+/// table (trilinear interpolation of logarithm of density and of temperature) instead of
+/// evaluating the model. Queries above the table evaluate the model directly.
+///
+/// The table is rebuilt by a background thread when the space weather inputs change, or
+/// when universal time changes by more than an hour. The previous table is used until the
+/// new one is complete, and the model is evaluated directly until the first table is ready.
+///
+/// Inputs of the model are only read by EVDS_NRLMSISE_00_UpdateCache(), which must be
+/// called after space weather variables change. Queries request a rebuild on their own
+/// when universal time moves away from the time of the table.
+///
+/// Cache sets the "atmospheric_data" callback of the planet, and is stored as userdata of
+/// the planet (see EVDS_Object_SetUserdata()), so queries find it without any locks.
+/// The following variables of the planet define size of the table:
+/// Variable							| Description
+/// ------------------------------------|-------------------------------------------------
+/// nrlmsise-00_cache.altitude			| Highest altitude in the table (1000 km by default)
+/// nrlmsise-00_cache.altitude_step		| Step in altitude (10 km by default)
+/// nrlmsise-00_cache.latitude_step		| Step in latitude (10 degrees by default)
+/// nrlmsise-00_cache.time_step			| Step in local solar time (1 hour by default)
+///
+/// Caches must not be created or destroyed while atmospheric data is being queried.
+///
+/// @param[in] earth Planet for which atmosphere is cached
+/// @param[out] p_cache Pointer to the new cache
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "earth" or "p_cache" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER Steps of the table are not positive
+/// @retval EVDS_ERROR_MEMORY Unable to allocate the table
+/// @retval EVDS_ERROR_BAD_STATE Planet is initialized and has no "atmospheric_data" variable
+/// @retval EVDS_ERROR_BAD_STATE Userdata of the planet is already used
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_NRLMSISE_00_CreateCache(EVDS_OBJECT* earth, EVDS_NRLMSISE_00_CACHE** p_cache) {
+	EVDS_NRLMSISE_00_CACHE* cache;
+	EVDS_VARIABLE* variable = 0;
+	EVDS_REAL altitude = 1000e3;
+	void* userdata;
+	int i,node_count;
+	int error_code;
+	if (!earth) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_cache) return EVDS_ERROR_BAD_PARAMETER;
+	EVDS_ERRCHECK(EVDS_Object_GetUserdata(earth,&userdata));
+	if (userdata) return EVDS_ERROR_BAD_STATE;
+
+	//Create cache
+	cache = (EVDS_NRLMSISE_00_CACHE*)malloc(sizeof(EVDS_NRLMSISE_00_CACHE));
+	if (!cache) return EVDS_ERROR_MEMORY;
+	memset(cache,0,sizeof(EVDS_NRLMSISE_00_CACHE));
+	cache->earth = earth;
+	cache->current = -1;
+	cache->building_layer = -1;
+	EVDS_Object_GetSystem(earth,&cache->system);
+	EVDS_Geodetic_DatumFromObject(&cache->datum,earth);
+	EVDS_InternalNRLMSISE_00_GetVariables(earth,cache->ap,&cache->f107,&cache->f107a);
+
+	//Size of the table
+	cache->altitude_step = 10e3;
+	cache->latitude_step = 10.0;
+	cache->time_step = 1.0;
+	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_cache.altitude",&altitude,&variable);
+	if (!variable) altitude = 1000e3;
+	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_cache.altitude_step",&cache->altitude_step,&variable);
+	if (!variable) cache->altitude_step = 10e3;
+	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_cache.latitude_step",&cache->latitude_step,&variable);
+	if (!variable) cache->latitude_step = 10.0;
+	EVDS_Object_GetRealVariable(earth,"nrlmsise-00_cache.time_step",&cache->time_step,&variable);
+	if (!variable) cache->time_step = 1.0;
+	if ((cache->altitude_step <= 0.0) || (cache->latitude_step <= 0.0) || (cache->time_step <= 0.0) ||
+		(altitude <= 0.0)) {
+		free(cache);
+		return EVDS_ERROR_BAD_PARAMETER;
+	}
+	cache->altitudes = (int)ceil(altitude/cache->altitude_step) + 1;
+	cache->latitudes = (int)ceil(180.0/cache->latitude_step) + 1;
+	cache->times = (int)ceil(24.0/cache->time_step);
+	cache->latitude_step = 180.0/(cache->latitudes-1);
+	cache->time_step = 24.0/cache->times;
+
+	//Allocate tables
+	node_count = cache->altitudes*cache->latitudes*cache->times;
+	for (i = 0; i < 2; i++) {
+		cache->tables[i].nodes = (EVDS_REAL*)malloc(2*node_count*sizeof(EVDS_REAL));
+		if (!cache->tables[i].nodes) {
+			if (cache->tables[0].nodes) free(cache->tables[0].nodes);
+			free(cache);
+			return EVDS_ERROR_MEMORY;
+		}
+	}
+
+	//Use cache for atmospheric data of the planet
+	if (EVDS_Object_GetVariable(earth,"atmospheric_data",&variable) != EVDS_OK) {
+		error_code = EVDS_Object_AddVariable(earth,"atmospheric_data",EVDS_VARIABLE_TYPE_FUNCTION_PTR,&variable);
+		if (error_code != EVDS_OK) {
+			free(cache->tables[0].nodes);
+			free(cache->tables[1].nodes);
+			free(cache);
+			return error_code;
+		}
+	}
+	EVDS_Object_SetUserdata(earth,cache);
+	EVDS_Variable_SetFunctionPointer(variable,(void*)EVDS_NRLMSISE_00_GetCachedAtmosphericData);
+
+	//Build the table in background (or right away) for the current inputs
+#ifndef EVDS_SINGLETHREADED
+	cache->lock = SIMC_Lock_Create();
+	EVDS_InternalNRLMSISE_00_Request(cache);
+	cache->running = 1;
+	cache->worker_running = 1;
+	SIMC_Thread_Create(EVDS_InternalThread_NRLMSISE_00_Worker,cache);
+#else
+	EVDS_InternalNRLMSISE_00_Request(cache);
+	while (EVDS_InternalNRLMSISE_00_UpdateStep(cache));
+#endif
+
+	*p_cache = cache;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy atmosphere cache.
+///
+/// Waits until background thread finishes computing the current layer. Planet falls
+/// back to the direct evaluation of the model, and its userdata is cleared.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_NRLMSISE_00_DestroyCache(EVDS_NRLMSISE_00_CACHE* cache) {
+	EVDS_VARIABLE* variable;
+	if (!cache) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Stop background thread
+#ifndef EVDS_SINGLETHREADED
+	cache->running = 0;
+	while (cache->worker_running) SIMC_Thread_Sleep(0.001);
+	SIMC_Lock_Destroy(cache->lock);
+#endif
+
+	//Detach cache from the planet
+	if (EVDS_Object_GetVariable(cache->earth,"atmospheric_data",&variable) == EVDS_OK) {
+		EVDS_Variable_SetFunctionPointer(variable,(void*)EVDS_NRLMSISE_00_GetAtmosphericData);
+	}
+	EVDS_Object_SetUserdata(cache->earth,0);
+
+	free(cache->tables[0].nodes);
+	free(cache->tables[1].nodes);
+	free(cache);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Rebuild the table right away if inputs have changed.
+///
+/// Reads space weather variables and system time, and returns once the table is up to
+/// date for them (table is built by the background thread, or right away in single-threaded
+/// build). Must be called after space weather variables of the planet change.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_NRLMSISE_00_UpdateCache(EVDS_NRLMSISE_00_CACHE* cache) {
+	long request;
+	if (!cache) return EVDS_ERROR_BAD_PARAMETER;
+
+	request = EVDS_InternalNRLMSISE_00_Request(cache);
+#ifndef EVDS_SINGLETHREADED
+	if (cache->worker_running) {
+		while (cache->running && (EVDS_InternalNRLMSISE_00_Add(&cache->built_version,0) < request)) {
+			SIMC_Thread_Sleep(0.001);
+		}
+		return EVDS_OK;
+	}
+#endif
+	while (EVDS_InternalNRLMSISE_00_UpdateStep(cache) || (cache->built_version < request));
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Callback that returns atmospheric data interpolated from the atmosphere cache.
+///
+/// Falls back to EVDS_NRLMSISE_00_GetAtmosphericData() if planet has no cache, if the table
+/// is not ready yet, if position is above the table, or if the table was replaced while
+/// it was being read.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_NRLMSISE_00_GetCachedAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_ENVIRONMENT_ATMOSPHERE* atmosphere) {
+	EVDS_NRLMSISE_00_CACHE* cache;
+	EVDS_NRLMSISE_00_TABLE* table;
+	EVDS_NRLMSISE_00_INPUTS inputs;
+	EVDS_GEODETIC_COORDINATE position;
+	EVDS_REAL u,v,w,mjd,local_time;
+	EVDS_REAL value[2];
+	int i,j,k,i1,j1,k1,n;
+	long current,version;
+
+	//Get cache of the planet and the table published by the background thread
+	if ((EVDS_Object_GetUserdata(earth,(void**)&cache) != EVDS_OK) || (!cache)) {
+		return EVDS_NRLMSISE_00_GetAtmosphericData(earth,r,atmosphere);
+	}
+	current = cache->current;
+	if (current < 0) return EVDS_NRLMSISE_00_GetAtmosphericData(earth,r,atmosphere);
+	table = &cache->tables[current];
+	version = EVDS_InternalNRLMSISE_00_Add(&table->version,0);
+	if (version & 1) return EVDS_NRLMSISE_00_GetAtmosphericData(earth,r,atmosphere);
+
+	//Request new table if universal time has moved away from the table
+	memcpy(&inputs,&table->inputs,sizeof(EVDS_NRLMSISE_00_INPUTS));
+	EVDS_System_GetTime(cache->system,&mjd);
+	EVDS_InternalNRLMSISE_00_GetDate(mjd,&inputs.year,&inputs.doy,&inputs.sec);
+	if (EVDS_InternalNRLMSISE_00_IsOutdated(&table->inputs,&inputs) &&
+		(cache->request_version == cache->built_version)) {
+		EVDS_InternalNRLMSISE_00_Request(cache);
+	}
+
+	//Find position in the table
+	EVDS_Geodetic_FromVector(&position,r,&cache->datum);
+	u = position.elevation/cache->altitude_step;
+	if (u >= cache->altitudes-1) return EVDS_NRLMSISE_00_GetAtmosphericData(earth,r,atmosphere);
+	if (u < 0.0) u = 0.0;
+	v = (position.latitude + 90.0)/cache->latitude_step;
+	if (v < 0.0) v = 0.0;
+	if (v > cache->latitudes-1) v = cache->latitudes-1;
+	local_time = fmod(inputs.sec/3600.0 + position.longitude/15.0 + 48.0,24.0);
+	w = local_time/cache->time_step;
+
+	k = (int)u; if (k > cache->altitudes-2) k = cache->altitudes-2;
+	i = (int)v; if (i > cache->latitudes-2) i = cache->latitudes-2;
+	j = (int)w; if (j > cache->times-1) j = cache->times-1;
+	u -= k; v -= i; w -= j;
+	k1 = k+1;
+	i1 = i+1;
+	j1 = (j+1) % cache->times; //Local solar time wraps around
+
+	//Trilinear interpolation of logarithm of density and temperature
+	for (n = 0; n < 2; n++) {
+#define EVDS_NRLMSISE_00_NODE(K,I,J) table->nodes[2*(((K)*cache->latitudes + (I))*cache->times + (J)) + n]
+		value[n] =
+			(1-u)*((1-v)*((1-w)*EVDS_NRLMSISE_00_NODE(k ,i ,j) + w*EVDS_NRLMSISE_00_NODE(k ,i ,j1)) +
+				   (  v)*((1-w)*EVDS_NRLMSISE_00_NODE(k ,i1,j) + w*EVDS_NRLMSISE_00_NODE(k ,i1,j1))) +
+			(  u)*((1-v)*((1-w)*EVDS_NRLMSISE_00_NODE(k1,i ,j) + w*EVDS_NRLMSISE_00_NODE(k1,i ,j1)) +
+				   (  v)*((1-w)*EVDS_NRLMSISE_00_NODE(k1,i1,j) + w*EVDS_NRLMSISE_00_NODE(k1,i1,j1)));
+#undef EVDS_NRLMSISE_00_NODE
+	}
+
+	//Table must not have been rebuilt while it was read
+	if (EVDS_InternalNRLMSISE_00_Add(&table->version,0) != version) {
+		return EVDS_NRLMSISE_00_GetAtmosphericData(earth,r,atmosphere);
+	}
 
 	//Read back
-	atmosphere->density = output.d[5]*1e3;
-	atmosphere->pressure = 287*output.t[1]*output.d[5]*1e3;
-	atmosphere->temperature = output.t[1];
-	/*v->air.density_He	= 1e-3*output.d[0]*4.0/6.022e23;
-	v->air.density_O	= 1e-3*output.d[1]*16.0/6.022e23;
-	v->air.density_N2	= 1e-3*output.d[2]*28.0/6.022e23;
-	v->air.density_O2	= 1e-3*output.d[3]*32.0/6.022e23;
-	v->air.density_Ar	= 1e-3*output.d[4]*40.0/6.022e23;
-	v->air.density_H	= 1e-3*output.d[6]*1.0/6.022e23;
-	v->air.density_N	= 1e-3*output.d[7]*14.0/6.022e23;
-	v->air.density		= output.d[5]*1e3;
-	v->air.concentration_He	= output.d[0];
-	v->air.concentration_O	= output.d[1];
-	v->air.concentration_N2	= output.d[2];
-	v->air.concentration_O2	= output.d[3];
-	v->air.concentration_Ar	= output.d[4];
-	v->air.concentration_H	= output.d[6];
-	v->air.concentration_N	= output.d[7];
-	v->air.concentration = output.d[0]+output.d[1]+output.d[2]+
-	                       output.d[3]+output.d[4]+output.d[6]+
-	                       output.d[7];
-
-	v->air.temperature = output.t[1];
-	v->air.exospheric_temperature = output.t[0];
-	v->air.pressure = 287*output.t[1]*output.d[5]*1e3; //P = (R[air]T)/d
-
-	vmag = sqrt(v->sim.vx*v->sim.vx+v->sim.vy*v->sim.vy+v->sim.vz*v->sim.vz);
-	v->air.Q = (0.5)*vmag*vmag*v->air.density;*/
+	atmosphere->density = exp(value[0]);
+	atmosphere->temperature = value[1];
+	atmosphere->pressure = 287*atmosphere->temperature*atmosphere->density;
 	return EVDS_OK;
-}
\ No newline at end of file
+}
@@ -34,8 +34,19 @@ extern "C" {
 /// @{
 ////////////////////////////////////////////////////////////////////////////////
 
+/// Tabulated NRLMSISE-00 atmosphere of a planet
+typedef struct EVDS_NRLMSISE_00_CACHE_TAG EVDS_NRLMSISE_00_CACHE;
+
 // Atmospheric data callback
 int EVDS_NRLMSISE_00_GetAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_ENVIRONMENT_ATMOSPHERE* atmosphere);
+// Atmospheric data callback (interpolated from atmosphere cache)
+int EVDS_NRLMSISE_00_GetCachedAtmosphericData(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_ENVIRONMENT_ATMOSPHERE* atmosphere);
+// Create atmosphere cache for the planet
+int EVDS_NRLMSISE_00_CreateCache(EVDS_OBJECT* earth, EVDS_NRLMSISE_00_CACHE** p_cache);
+// Destroy atmosphere cache
+int EVDS_NRLMSISE_00_DestroyCache(EVDS_NRLMSISE_00_CACHE* cache);
+// Rebuild atmosphere cache right away if space weather or date has changed
+int EVDS_NRLMSISE_00_UpdateCache(EVDS_NRLMSISE_00_CACHE* cache);
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @}
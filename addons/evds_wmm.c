@@ -0,0 +1,468 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+/// @page EVDS_Callback_WMM World Magnetic Model
+///
+/// Magnetic field callback (EVDS_WMM_GetMagneticField()) which evaluates a spherical
+/// harmonics model of the planets main magnetic field, such as the World Magnetic Model
+/// (WMM) or a single epoch of the International Geomagnetic Reference Field (IGRF).
+///
+/// Coefficients are loaded by EVDS_WMM_CreateModel() from a file in the format of the
+/// WMM coefficients file (WMM.COF):
+/// ~~~
+///     2020.0            WMM-2020        12/10/2019
+///   1  0  -29404.5       0.0        6.7        0.0
+///   1  1   -1450.7    4652.9        7.7      -25.1
+///   ...
+/// 999999999999999999999999999999999999999999999999
+/// ~~~
+/// First line holds epoch of the model (decimal year), every following line holds degree,
+/// order, Schmidt semi-normalized Gauss coefficients \f$g_{nm}\f$, \f$h_{nm}\f$ (nT) and
+/// their secular variation (nT/year).
+///
+/// Coefficients are adjusted to the system time and converted for the recursion of
+/// associated Legendre functions only when date changes by more than a day. The field
+/// is returned in tesla, in planet coordinates.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <evds.h>
+#include "evds_wmm.h"
+
+//Coefficients are adjusted to the current time when date changes by this much (years)
+#define EVDS_WMM_UPDATE_TIME (1.0/365.25)
+//Reference radius of the geomagnetic models (m)
+#define EVDS_WMM_RADIUS 6371200.0
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Magnetic field model of a single planet.
+///
+/// Coefficients and terms of the recursions are stored in triangular arrays, term of
+/// degree \f$n\f$ and order \f$m\f$ is stored at index \f$n(n+1)/2 + m\f$.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+struct EVDS_WMM_MODEL_TAG {
+	EVDS_OBJECT* earth;						//Planet for which field is computed
+	EVDS_SYSTEM* system;					//System of the planet
+	int degree;								//Degree of the model
+	EVDS_REAL epoch;						//Epoch of the model (decimal year)
+
+	EVDS_REAL* g;							//Schmidt semi-normalized coefficients (T)
+	EVDS_REAL* h;
+	EVDS_REAL* dg;							//Secular variation of coefficients (T/year)
+	EVDS_REAL* dh;
+	EVDS_REAL* schmidt;						//Schmidt normalization factors
+	EVDS_REAL* k;							//Constants of the recursion of Legendre functions
+
+	EVDS_REAL time;							//Time for which coefficients were adjusted (decimal year)
+	EVDS_REAL* gt;							//Coefficients adjusted to time and multiplied by
+	EVDS_REAL* ht;							// normalization factors
+
+	EVDS_REAL* P;							//Associated Legendre functions (scratch)
+	EVDS_REAL* dP;							//Derivatives of associated Legendre functions (scratch)
+	EVDS_REAL* cos_m;						//Cosine of multiples of longitude (scratch)
+	EVDS_REAL* sin_m;						//Sine of multiples of longitude (scratch)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID lock;						//Lock for coefficients and scratch arrays
+#endif
+	struct EVDS_WMM_MODEL_TAG* next;		//Next model in the list of models
+};
+#endif
+
+//List of all magnetic field models
+EVDS_WMM_MODEL* EVDS_InternalWMM_Models = 0;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Adjust coefficients to the current system time if date has changed.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalWMM_Update(EVDS_WMM_MODEL* model) {
+	EVDS_REAL mjd,year,dt;
+	int i,count;
+
+	//Decimal year of the current time
+	EVDS_System_GetTime(model->system,&mjd);
+	year = 2000.0 + (mjd - 51544.5)/365.25;
+	if (fabs(year - model->time) < EVDS_WMM_UPDATE_TIME) return;
+
+	//Adjust coefficients
+	dt = year - model->epoch;
+	count = (model->degree+1)*(model->degree+2)/2;
+	for (i = 0; i < count; i++) {
+		model->gt[i] = model->schmidt[i]*(model->g[i] + dt*model->dg[i]);
+		model->ht[i] = model->schmidt[i]*(model->h[i] + dt*model->dh[i]);
+	}
+	model->time = year;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate magnetic field in the given position (planet coordinates).
+///
+/// Associated Legendre functions and their derivatives are computed by a single recursion
+/// which is shared by all three components of the field. Sines and cosines of multiples
+/// of longitude are computed by recursion as well, so evaluation needs no trigonometric
+/// functions.
+///
+/// Field at the poles is computed a small distance away from the pole.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalWMM_Evaluate(EVDS_WMM_MODEL* model, EVDS_REAL x, EVDS_REAL y, EVDS_REAL z,
+							   EVDS_REAL* bx, EVDS_REAL* by, EVDS_REAL* bz) {
+	EVDS_REAL* P = model->P;
+	EVDS_REAL* dP = model->dP;
+	EVDS_REAL r,rxy,cos_t,sin_t,cos_l,sin_l,ar,arn;
+	EVDS_REAL Br,Bt,Bp,Bh;
+	int n,m,i;
+
+	//Geocentric spherical coordinates (colatitude and longitude)
+	rxy = sqrt(x*x + y*y);
+	r = sqrt(rxy*rxy + z*z);
+	if (r <= 0.0) {
+		*bx = 0.0; *by = 0.0; *bz = 0.0;
+		return;
+	}
+	cos_t = z/r;
+	sin_t = rxy/r;
+	if (sin_t < 1e-10) sin_t = 1e-10;
+	cos_l = (rxy > 0.0) ? x/rxy : 1.0;
+	sin_l = (rxy > 0.0) ? y/rxy : 0.0;
+
+	//Multiples of longitude
+	model->cos_m[0] = 1.0;
+	model->sin_m[0] = 0.0;
+	for (m = 1; m <= model->degree; m++) {
+		model->cos_m[m] = model->cos_m[m-1]*cos_l - model->sin_m[m-1]*sin_l;
+		model->sin_m[m] = model->sin_m[m-1]*cos_l + model->cos_m[m-1]*sin_l;
+	}
+
+	//Associated Legendre functions (Gauss normalized) and their derivatives in colatitude
+	P[0] = 1.0;
+	dP[0] = 0.0;
+	for (n = 1; n <= model->degree; n++) {
+		for (m = 0; m <= n; m++) {
+			i = n*(n+1)/2+m;
+			if (n == m) {
+				int j = (n-1)*n/2+(m-1);
+				P[i] = sin_t*P[j];
+				dP[i] = sin_t*dP[j] + cos_t*P[j];
+			} else {
+				int j = (n-1)*n/2+m;
+				P[i] = cos_t*P[j];
+				dP[i] = cos_t*dP[j] - sin_t*P[j];
+				if (m <= n-2) {
+					j = (n-2)*(n-1)/2+m;
+					P[i] -= model->k[i]*P[j];
+					dP[i] -= model->k[i]*dP[j];
+				}
+			}
+		}
+	}
+
+	//Sum terms of the field in spherical components
+	Br = 0.0; Bt = 0.0; Bp = 0.0;
+	ar = EVDS_WMM_RADIUS/r;
+	arn = ar*ar;
+	for (n = 1; n <= model->degree; n++) {
+		arn *= ar;
+		for (m = 0; m <= n; m++) {
+			EVDS_REAL g,h,t;
+			i = n*(n+1)/2+m;
+			g = model->gt[i];
+			h = model->ht[i];
+			t = g*model->cos_m[m] + h*model->sin_m[m];
+			Br += arn*(n+1)*t*P[i];
+			Bt -= arn*t*dP[i];
+			Bp -= arn*m*(h*model->cos_m[m] - g*model->sin_m[m])*P[i];
+		}
+	}
+	Bp /= sin_t;
+
+	//Convert to planet coordinates
+	Bh = Br*sin_t + Bt*cos_t;
+	*bx = Bh*cos_l - Bp*sin_l;
+	*by = Bh*sin_l + Bp*cos_l;
+	*bz = Br*cos_t - Bt*sin_t;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Callback that returns magnetic field according to the model of the planet.
+///
+/// Field is zero if planet has no model.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_WMM_GetMagneticField(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_VECTOR* field) {
+	EVDS_WMM_MODEL* model;
+	EVDS_REAL bx,by,bz;
+
+	//Find model of the planet
+	model = EVDS_InternalWMM_Models;
+	while (model && (model->earth != earth)) model = model->next;
+	if (!model) {
+		EVDS_Vector_Set(field,EVDS_VECTOR_DIRECTION,earth,0.0,0.0,0.0);
+		return EVDS_OK;
+	}
+
+	//Evaluate model
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(model->lock);
+#endif
+	EVDS_InternalWMM_Update(model);
+	EVDS_InternalWMM_Evaluate(model,r->x,r->y,r->z,&bx,&by,&bz);
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(model->lock);
+#endif
+	EVDS_Vector_Set(field,EVDS_VECTOR_DIRECTION,earth,bx,by,bz);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute magnetic field in many positions at once.
+///
+/// Positions are given in planet coordinates as separate arrays of components, field is
+/// returned in planet coordinates (tesla). Coefficients are adjusted to the current time
+/// once for the whole batch.
+///
+/// @param[in] model Magnetic field model
+/// @param[in] count Number of positions
+/// @param[in] x Array of X coordinates of positions
+/// @param[in] y Array of Y coordinates of positions
+/// @param[in] z Array of Z coordinates of positions
+/// @param[out] bx Array of X components of magnetic field
+/// @param[out] by Array of Y components of magnetic field
+/// @param[out] bz Array of Z components of magnetic field
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "model" or one of the arrays is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_WMM_GetMagneticFieldBatch(EVDS_WMM_MODEL* model, int count,
+								   EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+								   EVDS_REAL* bx, EVDS_REAL* by, EVDS_REAL* bz) {
+	int i;
+	if (!model) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!x) || (!y) || (!z) || (!bx) || (!by) || (!bz)) return EVDS_ERROR_BAD_PARAMETER;
+
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(model->lock);
+#endif
+	EVDS_InternalWMM_Update(model);
+	for (i = 0; i < count; i++) {
+		EVDS_InternalWMM_Evaluate(model,x[i],y[i],z[i],&bx[i],&by[i],&bz[i]);
+	}
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(model->lock);
+#endif
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Free memory used by the model.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalWMM_Free(EVDS_WMM_MODEL* model) {
+	if (model->g) free(model->g);
+	if (model->h) free(model->h);
+	if (model->dg) free(model->dg);
+	if (model->dh) free(model->dh);
+	if (model->schmidt) free(model->schmidt);
+	if (model->k) free(model->k);
+	if (model->gt) free(model->gt);
+	if (model->ht) free(model->ht);
+	if (model->P) free(model->P);
+	if (model->dP) free(model->dP);
+	if (model->cos_m) free(model->cos_m);
+	if (model->sin_m) free(model->sin_m);
+	free(model);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Load magnetic field model of the planet from coefficients file.
+///
+/// Model is used for the magnetic field of the planet: the "magnetic_field" callback
+/// of the planet is set to EVDS_WMM_GetMagneticField(). Model must be created before
+/// the planet is initialized, unless the planet already has "magnetic_field" variable.
+///
+/// Models must not be created or destroyed while magnetic field is being queried.
+///
+/// @param[in] earth Planet for which magnetic field is computed
+/// @param[in] filename Path to the coefficients file
+/// @param[out] p_model Pointer to the new model
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "earth", "filename" or "p_model" is null
+/// @retval EVDS_ERROR_FILE Unable to open the file
+/// @retval EVDS_ERROR_SYNTAX File has no epoch or no coefficients
+/// @retval EVDS_ERROR_MEMORY Unable to allocate the model
+/// @retval EVDS_ERROR_BAD_STATE Planet is initialized and has no "magnetic_field" variable
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_WMM_CreateModel(EVDS_OBJECT* earth, const char* filename, EVDS_WMM_MODEL** p_model) {
+	EVDS_WMM_MODEL* model;
+	EVDS_VARIABLE* variable = 0;
+	FILE* file;
+	char line[256];
+	double epoch,g,h,dg,dh;
+	int n,m,i,count,degree = 0;
+	int error_code;
+	if (!earth) return EVDS_ERROR_BAD_PARAMETER;
+	if (!filename) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_model) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Read epoch and find degree of the model
+	file = fopen(filename,"r");
+	if (!file) return EVDS_ERROR_FILE;
+	if ((!fgets(line,255,file)) || (sscanf(line,"%lf",&epoch) != 1)) {
+		fclose(file);
+		return EVDS_ERROR_SYNTAX;
+	}
+	while (fgets(line,255,file) && (strncmp(line,"9999",4) != 0)) {
+		if ((sscanf(line,"%d %d %lf %lf %lf %lf",&n,&m,&g,&h,&dg,&dh) == 6) && (n > degree) && (m >= 0) && (m <= n)) {
+			degree = n;
+		}
+	}
+	if (degree == 0) {
+		fclose(file);
+		return EVDS_ERROR_SYNTAX;
+	}
+
+	//Create model
+	model = (EVDS_WMM_MODEL*)malloc(sizeof(EVDS_WMM_MODEL));
+	if (!model) {
+		fclose(file);
+		return EVDS_ERROR_MEMORY;
+	}
+	memset(model,0,sizeof(EVDS_WMM_MODEL));
+	model->earth = earth;
+	model->degree = degree;
+	model->epoch = epoch;
+	model->time = -1e9;
+	EVDS_Object_GetSystem(earth,&model->system);
+
+	count = (degree+1)*(degree+2)/2;
+	model->g = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->h = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->dg = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->dh = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->schmidt = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->k = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->gt = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->ht = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->P = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->dP = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	model->cos_m = (EVDS_REAL*)malloc((degree+1)*sizeof(EVDS_REAL));
+	model->sin_m = (EVDS_REAL*)malloc((degree+1)*sizeof(EVDS_REAL));
+	if ((!model->g) || (!model->h) || (!model->dg) || (!model->dh) || (!model->schmidt) || (!model->k) ||
+		(!model->gt) || (!model->ht) || (!model->P) || (!model->dP) || (!model->cos_m) || (!model->sin_m)) {
+		EVDS_InternalWMM_Free(model);
+		fclose(file);
+		return EVDS_ERROR_MEMORY;
+	}
+
+	//Read coefficients (missing coefficients are zero)
+	memset(model->g,0,count*sizeof(EVDS_REAL));
+	memset(model->h,0,count*sizeof(EVDS_REAL));
+	memset(model->dg,0,count*sizeof(EVDS_REAL));
+	memset(model->dh,0,count*sizeof(EVDS_REAL));
+	fseek(file,0,SEEK_SET);
+	fgets(line,255,file);
+	while (fgets(line,255,file) && (strncmp(line,"9999",4) != 0)) {
+		if ((sscanf(line,"%d %d %lf %lf %lf %lf",&n,&m,&g,&h,&dg,&dh) == 6) && (n >= 1) && (m >= 0) && (m <= n)) {
+			i = n*(n+1)/2+m;
+			model->g[i] = g*1e-9;
+			model->h[i] = h*1e-9;
+			model->dg[i] = dg*1e-9;
+			model->dh[i] = dh*1e-9;
+		}
+	}
+	fclose(file);
+
+	//Schmidt normalization factors and constants of the recursion
+	model->schmidt[0] = 1.0;
+	model->k[0] = 0.0;
+	for (n = 1; n <= degree; n++) {
+		i = n*(n+1)/2;
+		model->schmidt[i] = model->schmidt[(n-1)*n/2]*(2.0*n-1.0)/n;
+		for (m = 1; m <= n; m++) {
+			model->schmidt[i+m] = model->schmidt[i+m-1]*sqrt((n-m+1.0)*((m == 1) ? 2.0 : 1.0)/(n+m));
+		}
+		for (m = 0; m <= n; m++) {
+			model->k[i+m] = (n > 1) ? ((n-1.0)*(n-1.0) - m*m)/((2.0*n-1.0)*(2.0*n-3.0)) : 0.0;
+		}
+	}
+
+	//Use model for magnetic field of the planet
+#ifndef EVDS_SINGLETHREADED
+	model->lock = SIMC_Lock_Create();
+#endif
+	model->next = EVDS_InternalWMM_Models;
+	EVDS_InternalWMM_Models = model;
+	if (EVDS_Object_GetVariable(earth,"magnetic_field",&variable) != EVDS_OK) {
+		error_code = EVDS_Object_AddVariable(earth,"magnetic_field",EVDS_VARIABLE_TYPE_FUNCTION_PTR,&variable);
+		if (error_code != EVDS_OK) {
+			EVDS_InternalWMM_Models = model->next;
+#ifndef EVDS_SINGLETHREADED
+			SIMC_Lock_Destroy(model->lock);
+#endif
+			EVDS_InternalWMM_Free(model);
+			return error_code;
+		}
+	}
+	EVDS_Variable_SetFunctionPointer(variable,(void*)EVDS_WMM_GetMagneticField);
+
+	*p_model = model;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy magnetic field model.
+///
+/// Magnetic field of the planet becomes zero.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_WMM_DestroyModel(EVDS_WMM_MODEL* model) {
+	EVDS_WMM_MODEL** link;
+	EVDS_VARIABLE* variable;
+	if (!model) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Remove model from the list
+	link = &EVDS_InternalWMM_Models;
+	while (*link && (*link != model)) link = &(*link)->next;
+	if (*link) *link = model->next;
+	if (EVDS_Object_GetVariable(model->earth,"magnetic_field",&variable) == EVDS_OK) {
+		EVDS_Variable_SetFunctionPointer(variable,0);
+	}
+
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Destroy(model->lock);
+#endif
+	EVDS_InternalWMM_Free(model);
+	return EVDS_OK;
+}
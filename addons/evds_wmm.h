@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+///
+/// @brief External Vessel Dynamics Simulator - World Magnetic Model
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef EVDS_WMM_H
+#define EVDS_WMM_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ADDONS
+///
+/// @{
+////////////////////////////////////////////////////////////////////////////////
+
+/// Magnetic field model of a planet
+typedef struct EVDS_WMM_MODEL_TAG EVDS_WMM_MODEL;
+
+// Magnetic field callback
+int EVDS_WMM_GetMagneticField(EVDS_OBJECT* earth, EVDS_VECTOR* r, EVDS_VECTOR* field);
+// Compute magnetic field in many positions (given in planet coordinates)
+int EVDS_WMM_GetMagneticFieldBatch(EVDS_WMM_MODEL* model, int count,
+								   EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+								   EVDS_REAL* bx, EVDS_REAL* by, EVDS_REAL* bz);
+// Load magnetic field model of the planet from coefficients file
+int EVDS_WMM_CreateModel(EVDS_OBJECT* earth, const char* filename, EVDS_WMM_MODEL** p_model);
+// Destroy magnetic field model
+int EVDS_WMM_DestroyModel(EVDS_WMM_MODEL* model);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+#ifdef __cplusplus
+}
+#endif
+#endif
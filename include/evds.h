@@ -114,6 +114,9 @@ typedef struct EVDS_OBJECT_LOADEX_TAG EVDS_OBJECT_LOADEX;
 typedef struct EVDS_OBJECT_SAVEEX_TAG EVDS_OBJECT_SAVEEX;
 typedef struct EVDS_MESH_GENERATEEX_TAG EVDS_MESH_GENERATEEX;
 typedef struct EVDS_MESH_INTERNAL_TAG EVDS_MESH_INTERNAL;
+typedef struct EVDS_EVENT_TAG EVDS_EVENT;
+typedef struct EVDS_ENSEMBLE_TAG EVDS_ENSEMBLE;
+typedef struct EVDS_SNAPSHOT_TAG EVDS_SNAPSHOT;
 
 
 
@@ -365,6 +368,33 @@ typedef int EVDS_Callback_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EV
 ////////////////////////////////////////////////////////////////////////////////
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_EVENT
+/// @{
+
+/// Event function (write scalar "value" for the given "state", event happens when value changes sign)
+typedef int EVDS_Callback_EventFunction(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, void* userdata, EVDS_REAL* value);
+/// Called when event happens. Can update "state" of the object at the moment of event
+typedef int EVDS_Callback_Event(EVDS_OBJECT* object, EVDS_EVENT* event, EVDS_STATE_VECTOR* state, void* userdata);
+/// Single step of a propagator (propagate "state" of "object" by "delta_time")
+typedef void EVDS_Callback_PropagatorStep(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+										  EVDS_STATE_VECTOR* state, EVDS_REAL delta_time);
+
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENSEMBLE
+/// @{
+
+/// Called for every new member of the ensemble before its objects are initialized (can perturb variables)
+typedef int EVDS_Callback_EnsembleMember(EVDS_ENSEMBLE* ensemble, int index, EVDS_SYSTEM* system, void* userdata);
+
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @ingroup EVDS_SOLVER
 /// @brief Definition of a physics solver.
@@ -803,9 +833,28 @@ typedef struct EVDS_ENVIRONMENT_ATMOSPHERE_TAG {
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @ingroup EVDS_ENVIRONMENT
-/// @brief Structure describing the radiation environment (placeholder).
+/// @brief Structure describing the radiation environment.
+///
+/// The structure is filled out by the built-in star radiation and eclipse model (see
+/// EVDS_Environment_GetRadiationParameters()) or by the radiation model of the planet.
+/// Flux and pressure already account for shadows cast by planets.
+///
+/// Shadow function is the angular separation between center of the star and limb of the
+/// occluder, as seen from the position. It is positive when center of the star is visible,
+/// negative when it is hidden, and changes continuously, so it can be used as an event
+/// function (see EVDS_Event_CreateForShadow()). Shadow margin is the shortest distance
+/// the position must move relative to the occluder to enter or leave the penumbra (zero
+/// if position is inside the penumbra).
 ////////////////////////////////////////////////////////////////////////////////
 typedef struct EVDS_ENVIRONMENT_RADIATION_TAG {
+	EVDS_REAL flux;							///< Radiation flux [W/m2]
+	EVDS_REAL pressure;						///< Radiation pressure on an absorbing surface [Pa]
+	EVDS_REAL illumination;					///< Visible fraction of the star disk (0 in umbra, 1 in sunlight)
+	EVDS_VECTOR direction;					///< Unit vector pointing towards the star
+	EVDS_OBJECT* star;						///< Source of radiation (or null)
+	EVDS_OBJECT* occluder;					///< Planet closest to eclipsing the star (or null)
+	EVDS_REAL shadow_function;				///< Angular separation of star center from limb of the occluder [rad]
+	EVDS_REAL shadow_margin;				///< Distance to the nearest penumbra boundary [m]
 	void* userdata;							///< Pointer to user data 
 } EVDS_ENVIRONMENT_RADIATION;
 
@@ -963,6 +1012,15 @@ EVDS_API int EVDS_System_Destroy(EVDS_SYSTEM* system);
 EVDS_API int EVDS_System_SetTime(EVDS_SYSTEM* system, EVDS_REAL time);
 // Get EVDS system global time (MJD)
 EVDS_API int EVDS_System_GetTime(EVDS_SYSTEM* system, EVDS_REAL* time);
+// Set thresholds for automatic sleeping of objects (disabled by default)
+EVDS_API int EVDS_System_SetSleepThresholds(EVDS_SYSTEM* system, EVDS_REAL velocity, EVDS_REAL angular_velocity,
+											EVDS_REAL acceleration, EVDS_REAL time);
+// Enable deterministic (lockstep) execution mode
+EVDS_API int EVDS_System_SetDeterministic(EVDS_SYSTEM* system, int deterministic);
+// Enable tree-based computation of gravitational field (disabled by default)
+EVDS_API int EVDS_System_SetGravityTree(EVDS_SYSTEM* system, EVDS_REAL opening_angle);
+// Get hash of state vectors and variables of all objects (for detecting desynchronization between systems)
+EVDS_API int EVDS_System_GetStateHash(EVDS_SYSTEM* system, unsigned int* hash);
 
 // Get root inertial space object
 EVDS_API int EVDS_System_GetRootInertialSpace(EVDS_SYSTEM* system, EVDS_OBJECT** p_object);
@@ -1154,12 +1212,13 @@ EVDS_API int EVDS_Object_SetStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR*
 EVDS_API int EVDS_Object_GetPreviousStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector);
 // Get state vector interpolated between current and previous one
 EVDS_API int EVDS_Object_GetInterpolatedStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector, double t);
+// Get state vector interpolated at given time (from dense output of last steps)
+EVDS_API int EVDS_Object_GetStateVectorAtTime(EVDS_OBJECT* object, double mjd_time, EVDS_STATE_VECTOR* vector);
 
-//FIXME: future/unsupported API
 // Start rendering object (pass interpolated state vector or any preferred state vector to render from)
-//EVDS_API int EVDS_Object_StartRendering(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector);
+EVDS_API int EVDS_Object_StartRendering(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector);
 // End drawing object
-//EVDS_API int EVDS_Object_EndRendering(EVDS_OBJECT* object);
+EVDS_API int EVDS_Object_EndRendering(EVDS_OBJECT* object);
 
 // Shortcut to get center of mass position
 EVDS_API int EVDS_Object_GetCoMPosition(EVDS_OBJECT* object, EVDS_VECTOR* p_vector);
@@ -1197,6 +1256,21 @@ EVDS_API int EVDS_Object_SetSolverdata(EVDS_OBJECT* object, void* solverdata);
 // Get solverdata
 EVDS_API int EVDS_Object_GetSolverdata(EVDS_OBJECT* object, void** solverdata);
 
+// Put object to sleep (sleeping objects are not propagated)
+EVDS_API int EVDS_Object_Sleep(EVDS_OBJECT* object);
+// Wake up object and all its parents
+EVDS_API int EVDS_Object_Wake(EVDS_OBJECT* object);
+// Check if object is sleeping
+EVDS_API int EVDS_Object_IsSleeping(EVDS_OBJECT* object, int* is_sleeping);
+// Mark object as static (static objects always sleep)
+EVDS_API int EVDS_Object_SetStatic(EVDS_OBJECT* object, int is_static);
+// Declare that forces and torques of object do not depend on parent state within a step
+EVDS_API int EVDS_Object_SetStateIndependent(EVDS_OBJECT* object, int is_independent);
+// Update automatic sleeping state after object was propagated (for use in propagators)
+EVDS_API int EVDS_Object_UpdateSleeping(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, EVDS_REAL delta_time);
+// Advance time of a sleeping object without moving it (for use in propagators)
+EVDS_API int EVDS_Object_AdvanceSleeping(EVDS_OBJECT* object, EVDS_REAL delta_time);
+
 // Get system from object
 EVDS_API int EVDS_Object_GetSystem(EVDS_OBJECT* object, EVDS_SYSTEM** p_system);
 ////////////////////////////////////////////////////////////////////////////////
@@ -1210,6 +1284,100 @@ EVDS_API int EVDS_Object_GetSystem(EVDS_OBJECT* object, EVDS_SYSTEM** p_system);
 
 
 
+
+////////////////////////////////////////////////////////////////////////////////
+/// @defgroup EVDS_EVENT Event API
+/// @brief API for detecting events during propagation (see EVDS_EVENT)
+///
+/// @{
+////////////////////////////////////////////////////////////////////////////////
+// Add event defined by a scalar function of objects state vector
+EVDS_API int EVDS_Event_Create(EVDS_OBJECT* object, EVDS_Callback_EventFunction* function,
+							   EVDS_Callback_Event* callback, void* userdata, EVDS_EVENT** p_event);
+// Add event that happens when variable crosses the threshold value
+EVDS_API int EVDS_Event_CreateForVariable(EVDS_OBJECT* object, EVDS_VARIABLE* variable, EVDS_REAL threshold,
+										  EVDS_Callback_Event* callback, void* userdata, EVDS_EVENT** p_event);
+// Add event that happens when object enters or leaves a shadow of a planet
+EVDS_API int EVDS_Event_CreateForShadow(EVDS_OBJECT* object, EVDS_Callback_Event* callback, void* userdata,
+										EVDS_EVENT** p_event);
+// Remove event
+EVDS_API int EVDS_Event_Destroy(EVDS_EVENT* event);
+// Propagate objects state by delta_time, stopping exactly at events (for use in propagators)
+EVDS_API int EVDS_Event_Propagate(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object, EVDS_STATE_VECTOR* state,
+								  EVDS_REAL delta_time, EVDS_Callback_PropagatorStep* step);
+////////////////////////////////////////////////////////////////////////////////
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @defgroup EVDS_ENSEMBLE Ensemble API
+/// @brief API for running many dispersed copies of a system in parallel (see EVDS_ENSEMBLE)
+///
+/// @{
+////////////////////////////////////////////////////////////////////////////////
+// Create ensemble from a template system
+EVDS_API int EVDS_Ensemble_Create(EVDS_SYSTEM* template_system, EVDS_ENSEMBLE** p_ensemble);
+// Destroy ensemble and all its members
+EVDS_API int EVDS_Ensemble_Destroy(EVDS_ENSEMBLE* ensemble);
+// Add normally distributed dispersion to a variable (specified by reference)
+EVDS_API int EVDS_Ensemble_AddDispersion(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_REAL sigma);
+// Set callback called for every new member
+EVDS_API int EVDS_Ensemble_SetCallback_OnCreateMember(EVDS_ENSEMBLE* ensemble, EVDS_Callback_EnsembleMember* p_callback, void* userdata);
+// Create members of the ensemble
+EVDS_API int EVDS_Ensemble_Generate(EVDS_ENSEMBLE* ensemble, int count, unsigned int seed);
+// Get number of members
+EVDS_API int EVDS_Ensemble_GetMemberCount(EVDS_ENSEMBLE* ensemble, int* count);
+// Get number of worker threads
+EVDS_API int EVDS_Ensemble_GetWorkerCount(EVDS_ENSEMBLE* ensemble, int* count);
+// Get member system
+EVDS_API int EVDS_Ensemble_GetMember(EVDS_ENSEMBLE* ensemble, int index, EVDS_SYSTEM** p_system);
+// Solve all members in parallel
+EVDS_API int EVDS_Ensemble_Solve(EVDS_ENSEMBLE* ensemble, EVDS_REAL delta_time, int thread_count);
+// Gather values of a variable (specified by reference) from all members
+EVDS_API int EVDS_Ensemble_GetVariables(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_REAL* values);
+// Gather state vectors of an object (specified by reference) from all members
+EVDS_API int EVDS_Ensemble_GetStateVectors(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_STATE_VECTOR* vectors);
+////////////////////////////////////////////////////////////////////////////////
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @defgroup EVDS_SNAPSHOT Snapshot API
+/// @brief API for saving and restoring mutable state of the system in memory (see EVDS_SNAPSHOT)
+///
+/// @{
+////////////////////////////////////////////////////////////////////////////////
+// Create snapshot with a buffer preallocated for all initialized objects of the system
+EVDS_API int EVDS_Snapshot_Create(EVDS_SYSTEM* system, EVDS_SNAPSHOT** p_snapshot);
+// Create incremental snapshot which shares unchanged data with the base snapshot (copy-on-write)
+EVDS_API int EVDS_Snapshot_CreateIncremental(EVDS_SNAPSHOT* base, EVDS_SNAPSHOT** p_snapshot);
+// Destroy snapshot
+EVDS_API int EVDS_Snapshot_Destroy(EVDS_SNAPSHOT* snapshot);
+// Get size of data stored in the snapshot itself (not shared with the base snapshot)
+EVDS_API int EVDS_Snapshot_GetSize(EVDS_SNAPSHOT* snapshot, size_t* size);
+// Save state vectors and all mutable variables of the system into the snapshot
+EVDS_API int EVDS_System_Snapshot(EVDS_SYSTEM* system, EVDS_SNAPSHOT* snapshot);
+// Restore state vectors and all mutable variables of the system from the snapshot
+EVDS_API int EVDS_System_Restore(EVDS_SYSTEM* system, EVDS_SNAPSHOT* snapshot);
+////////////////////////////////////////////////////////////////////////////////
+/// @}
+////////////////////////////////////////////////////////////////////////////////
+
+
+
+
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @defgroup EVDS_VARIABLE Variable API
 /// @brief Implements API to work with variables (EVDS_VARIABLE)
@@ -1358,6 +1526,8 @@ EVDS_API void EVDS_StateVector_MultiplyByTimeAndAdd(EVDS_STATE_VECTOR* target, E
 													EVDS_STATE_VECTOR_DERIVATIVE* v, EVDS_REAL delta_time);
 // Interpolate between two state vectors
 EVDS_API void EVDS_StateVector_Interpolate(EVDS_STATE_VECTOR* target, EVDS_STATE_VECTOR* v1, EVDS_STATE_VECTOR* v2, EVDS_REAL t);
+// Interpolate between two state vectors (cubic Hermite spline for position and velocity)
+EVDS_API void EVDS_StateVector_InterpolateHermite(EVDS_STATE_VECTOR* target, EVDS_STATE_VECTOR* v1, EVDS_STATE_VECTOR* v2, EVDS_REAL t);
 
 // Set euler angles in a target coordinate system
 EVDS_API void EVDS_Quaternion_FromEuler(EVDS_QUATERNION* target, EVDS_OBJECT* target_coordinates, EVDS_REAL x, EVDS_REAL y, EVDS_REAL z);
@@ -1433,6 +1603,22 @@ EVDS_API int EVDS_Environment_GetMagneticField(EVDS_SYSTEM* system, EVDS_VECTOR*
 EVDS_API int EVDS_Environment_GetAtmosphericParameters(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_ENVIRONMENT_ATMOSPHERE* parameters);
 // Get radiation intensity (including energy spectrum)
 EVDS_API int EVDS_Environment_GetRadiationParameters(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_ENVIRONMENT_RADIATION* parameters);
+// Get gravitational field in many positions given in same coordinates
+EVDS_API int EVDS_Environment_GetGravitationalFieldBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+														 EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z, EVDS_REAL* phi,
+														 EVDS_REAL* gx, EVDS_REAL* gy, EVDS_REAL* gz);
+// Get magnetic field in many positions given in same coordinates
+EVDS_API int EVDS_Environment_GetMagneticFieldBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+													EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+													EVDS_REAL* bx, EVDS_REAL* by, EVDS_REAL* bz);
+// Get atmospheric parameters in many positions given in same coordinates
+EVDS_API int EVDS_Environment_GetAtmosphericParametersBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+															EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+															EVDS_ENVIRONMENT_ATMOSPHERE* parameters);
+// Get radiation parameters in many positions given in same coordinates
+EVDS_API int EVDS_Environment_GetRadiationParametersBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+														  EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+														  EVDS_ENVIRONMENT_RADIATION* parameters);
 ////////////////////////////////////////////////////////////////////////////////
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
@@ -1526,6 +1712,9 @@ EVDS_API int EVDS_Mesh_Destroy(EVDS_MESH* mesh);
 /// - @subpage EVDS_Propagator_ForwardEuler "Eulers forward integration" (for debugging purposes only)
 /// - @subpage EVDS_Propagator_RK4 "Runge-Kutta 4th order integration"
 /// - @subpage EVDS_Propagator_Heun "Heun's predictor-corrector integration"
+/// - @subpage EVDS_Propagator_Kepler "Analytic Kepler propagation" (two-body motion for coasting objects)
+/// - @subpage EVDS_Propagator_Encke "Encke/Cowell hybrid integration" (perturbed orbits)
+/// - @subpage EVDS_Propagator_ABM "Adams-Bashforth-Moulton 4th order integration" (multistep predictor-corrector)
 ////////////////////////////////////////////////////////////////////////////////
 /// @page EVDS_Addon_List List of Addons
 ///
@@ -1579,6 +1768,12 @@ EVDS_API int EVDS_Propagator_ForwardEuler_Register(EVDS_SYSTEM* system);
 EVDS_API int EVDS_Propagator_Heun_Register(EVDS_SYSTEM* system);
 // Runge-Kutta 4th order propagator
 EVDS_API int EVDS_Propagator_RK4_Register(EVDS_SYSTEM* system);
+// Analytic Kepler propagator (two-body motion for coasting objects)
+EVDS_API int EVDS_Propagator_Kepler_Register(EVDS_SYSTEM* system);
+// Encke/Cowell hybrid propagator (perturbed orbits)
+EVDS_API int EVDS_Propagator_Encke_Register(EVDS_SYSTEM* system);
+// Adams-Bashforth-Moulton 4th order multistep propagator
+EVDS_API int EVDS_Propagator_ABM_Register(EVDS_SYSTEM* system);
 
 // Update all vessels and detach them if required. Must be called by user to support "detach" variable for vessels.
 EVDS_API int EVDS_RigidBody_UpdateDetaching(EVDS_SYSTEM* system);
@@ -1607,7 +1802,10 @@ EVDS_Wiring_Register(system); \
 EVDS_Modifier_Register(system); \
 EVDS_Propagator_ForwardEuler_Register(system); \
 EVDS_Propagator_Heun_Register(system); \
-EVDS_Propagator_RK4_Register(system);
+EVDS_Propagator_RK4_Register(system); \
+EVDS_Propagator_Kepler_Register(system); \
+EVDS_Propagator_Encke_Register(system); \
+EVDS_Propagator_ABM_Register(system);
 ////////////////////////////////////////////////////////////////////////////////
 /// @}
 ////////////////////////////////////////////////////////////////////////////////
@@ -35,6 +35,20 @@ extern "C" {
 #define EVDS_ERRCHECK(expr) { int error_code = expr; if (error_code != EVDS_OK) return error_code; }
 #endif
 
+// Memory barrier for lockless data structures (hardware fence, also prevents compiler reordering)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_ARM) || defined(_M_ARM64)
+#define EVDS_MEMORY_BARRIER() __dmb(_ARM_BARRIER_ISH)
+#else
+#define EVDS_MEMORY_BARRIER() { _ReadWriteBarrier(); _mm_mfence(); _ReadWriteBarrier(); }
+#endif
+#elif defined(__GNUC__)
+#define EVDS_MEMORY_BARRIER() __sync_synchronize()
+#else
+#define EVDS_MEMORY_BARRIER()
+#endif
+
 // Compatibility with Windows systems
 #ifdef _WIN32
 #define snprintf _snprintf
@@ -178,6 +192,8 @@ struct EVDS_VARIABLE_TAG {
 	EVDS_VARIABLE* parent;					//Variable this variable belongs to (if nested)
 	EVDS_OBJECT* object;					//Object this parameter belongs to (0 if not a parameter)
 	EVDS_SYSTEM* system;					//System this variable belongs to
+	int mass_property;						//Changing this variable changes mass properties of the object
+	int gravity_property;					//Changing this variable changes gravitational field of the object
 
 	// User-defined data
 	void* userdata;
@@ -271,8 +287,33 @@ struct EVDS_VARIABLE_TAG {
 ///  - Objects must be initialized after loading. Initialization and all operations which
 ///     alter list of variables must be done only within the initializing thread (operations
 ///     with list of variables are not thread-safe).
+///
+/// Every EVDS_Object_SetStateVector() call publishes a dense output segment (state vectors at
+/// the start and at the end of the step) into a small ring buffer. Segments are guarded by
+/// sequence counters: the writer makes the counter odd while the segment is being written,
+/// readers retry if the counter was odd or changed while the segment was copied. This lets
+/// rendering and telemetry threads evaluate a smooth state (cubic Hermite spline for position,
+/// spherical quadrangle for orientation) at any time without taking the state lock.
+/// There must be only one thread writing the state vector of an object.
+///
+/// Objects track whether their mass properties have changed. Writing a new value into a mass-related
+/// variable (mass, cm, jx/jy/jz and their totals), moving a child relative to its parent, attaching
+/// or detaching a child marks the object and all its parents as dirty. Solvers which aggregate mass
+/// properties of children (see EVDS_Solver_RigidBody) only recompute them for dirty objects.
+/// Such solvers can also cache data per child, and rebuild it only when the children generation
+/// counter of the object has changed. The counter is incremented in the object and all its parents
+/// when a child is attached, detached or destroyed anywhere in the subtree, or when custom solving
+/// or integration callbacks of an object in the subtree are changed.
 ////////////////////////////////////////////////////////////////////////////////
 #ifndef DOXYGEN_INTERNAL_STRUCTS
+#define EVDS_DENSE_OUTPUT_SIZE	4
+
+typedef struct EVDS_DENSE_OUTPUT_SEGMENT_TAG {
+	volatile unsigned int sequence;			//Odd while the segment is being written
+	EVDS_STATE_VECTOR start;				//State vector at the start of the step
+	EVDS_STATE_VECTOR end;					//State vector at the end of the step
+} EVDS_DENSE_OUTPUT_SEGMENT;
+
 struct EVDS_OBJECT_TAG {
 	//Unique ID (numeric identifier for the object)
 	unsigned int uid;						//00000 - 99999 reserved for normal vessels
@@ -281,8 +322,11 @@ struct EVDS_OBJECT_TAG {
 	EVDS_STATE_VECTOR state;
 	// Previous state vector (used for interpolation when rendering)
 	EVDS_STATE_VECTOR previous_state;
-	// State in which object must be rendered
-	EVDS_STATE_VECTOR render_state;			//FIXME
+	// State in which object must be rendered (used by coordinate conversions in rendering thread)
+	EVDS_STATE_VECTOR render_state;
+	// Dense output for interpolation (see EVDS_Object_GetStateVectorAtTime())
+	EVDS_DENSE_OUTPUT_SEGMENT dense_output[EVDS_DENSE_OUTPUT_SIZE];
+	volatile unsigned int dense_output_head;	//Index of the latest segment
 
 	// Public object state, used by functions which are not the integrating thread
 #ifndef EVDS_SINGLETHREADED
@@ -306,6 +350,7 @@ struct EVDS_OBJECT_TAG {
 	SIMC_LIST* variables;					//List of variables
 	SIMC_LIST* children;					//Children objects
 	SIMC_LIST* raw_children;				//Children objects (raw list, including the uninitialized ones)
+	SIMC_LIST* events;						//Events which must be detected during propagation
 
 	// Initialization-related information
 	int initialized;						//Is object initialized
@@ -325,6 +370,28 @@ struct EVDS_OBJECT_TAG {
 	SIMC_LIST_ENTRY* type_entry;			//Entry in "type_list" linked list (used for removing it from list)
 	SIMC_LIST* type_list;					//List in which type is stored (or 0)
 
+	// Sleeping state
+	int is_static;							//Object never moves (always sleeping)
+	int sleeping;							//Object is not propagated until woken up
+	EVDS_REAL quiet_time;					//Time during which object stayed below sleep thresholds
+
+	// Mass properties tracking
+	volatile int mass_dirty;				//Mass properties of object or its children have changed
+	volatile int children_generation;		//Incremented every time object or any of its children changes structure
+	int state_independent;					//Forces and torques do not depend on parent state within a step
+	int active_generation;					//Children generation for which "is_active" was computed
+	int is_active;							//Object or its subtree has active behavior (see EVDS_Solver_RigidBody)
+
+	// Gravity parameters tracking
+	volatile int gravity_dirty;				//Parameters of gravitational field of the object have changed
+
+	// Snapshot tracking
+	long snapshot_version;					//Unique version of state, sleeping state and variables of the object
+
+	// State tracking
+	volatile long state_version;			//Unique version of public state of the object (see EVDS_InternalObject_InvalidateState())
+	int contains_planets;					//Object or one of its children is a planet (see EVDS_InternalObject_MarkPlanet())
+
 	// Callbacks
 	EVDS_Callback_Solve*		solve;		//Solve object/step state forward
 	EVDS_Callback_Integrate*	integrate;	//Return derivative of state vector for integration
@@ -338,6 +405,59 @@ struct EVDS_OBJECT_TAG {
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_EVENT
+/// @struct EVDS_EVENT
+/// @brief Event which is detected while the object state is propagated.
+///
+/// Event is defined by a scalar function of objects state vector (for example altitude
+/// above the surface minus target altitude, or dot product of position and velocity for
+/// apsis crossing). Event happens when this function changes sign. Propagators which
+/// support events (see EVDS_Event_Propagate()) will bracket the sign change within a step,
+/// find exact event time using Brent's method on the dense output (see 
+/// EVDS_StateVector_InterpolateHermite()), repeat the step up to the event time, invoke the
+/// callback and then propagate the remaining part of the step:
+/// ~~~{.c}
+///		int Altitude(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, void* userdata, EVDS_REAL* value) {
+///			EVDS_REAL r;
+///			EVDS_Vector_Length(&r,&state->position);
+///			*value = r - 6378e3 - 100e3;
+///			return EVDS_OK;
+///		}
+///		int OnAltitude(EVDS_OBJECT* object, EVDS_EVENT* event, EVDS_STATE_VECTOR* state, void* userdata) {
+///			printf("Crossed 100 km at MJD %f\n",state->time);
+///			return EVDS_OK;
+///		}
+///		EVDS_Event_Create(vessel,Altitude,OnAltitude,0,0);
+/// ~~~
+///
+/// Event can also be defined by a variable crossing a threshold value (for example remaining
+/// fuel mass reaching zero). Variables are updated when objects are solved, so such events are
+/// only detected between the propagator steps.
+///
+/// Events are checked only for objects which are directly propagated (children of propagator).
+/// The following propagators support events: @ref EVDS_Propagator_RK4 "RK4",
+/// @ref EVDS_Propagator_Heun "Heun", @ref EVDS_Propagator_ForwardEuler "forward Euler".
+///
+/// @note Events must only be created and destroyed from the thread which propagates the object,
+///       or when the object is not being propagated. Callback may destroy its own event.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+struct EVDS_EVENT_TAG {
+	EVDS_OBJECT* object;					//Object this event belongs to
+	EVDS_Callback_EventFunction* function;	//Event function (or 0 for variable events)
+	EVDS_VARIABLE* variable;				//Variable (for variable events)
+	EVDS_REAL threshold;					//Threshold value (for variable events)
+	EVDS_Callback_Event* callback;			//Callback called when event happens
+	void* userdata;							//User-defined data
+	int sign;								//Sign of event function after the last step (0 if unknown)
+	SIMC_LIST_ENTRY* entry;					//Entry in "object->events" list
+};
+#endif
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @ingroup EVDS_SYSTEM
 /// @struct EVDS_SYSTEM
@@ -393,6 +513,42 @@ struct EVDS_SYSTEM_TAG {
 	EVDS_OBJECT* inertial_space;				// Root inertial space
 	EVDS_REAL time;								// Global system time
 
+	// Thresholds for automatic sleeping of objects
+	EVDS_REAL sleep_velocity;					// Maximum velocity of a quiet object
+	EVDS_REAL sleep_angular_velocity;			// Maximum angular velocity of a quiet object
+	EVDS_REAL sleep_acceleration;				// Maximum acceleration of a quiet object
+	EVDS_REAL sleep_time;						// Time before quiet object falls asleep (0 if disabled)
+
+	// Deterministic (lockstep) execution mode
+	int deterministic;							// Objects are always initialized in a blocking way
+
+	// Tracking changes of public state vectors
+	volatile long state_generation;				// Last state version assigned to an object (incremented every time public state changes)
+	volatile long gravity_generation;			// Incremented every time set of objects or their gravity changes
+	volatile long planet_generation;			// Incremented every time public state of a planet (or of coordinates containing planets) changes
+	volatile long snapshot_version;				// Last version assigned to data of an object (see EVDS_SNAPSHOT)
+
+	// Tree of planets for approximate gravity computations
+	EVDS_REAL gravity_tree_angle;				// Opening angle (0 if tree is not used)
+	struct EVDS_GRAVITY_TREE_TAG* volatile gravity_tree; // Published tree (never modified, or 0)
+	struct EVDS_GRAVITY_TREE_TAG* gravity_tree_retired;	// Previously published tree (may still be in use)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID gravity_tree_lock;				// Lock for rebuilding the gravity tree
+#endif
+
+	// Index of spheres of influence for environment queries
+	struct EVDS_SOI_INDEX_TAG* volatile soi_index; // Published index (never modified, or 0)
+	struct EVDS_SOI_INDEX_TAG* soi_index_retired; // Previously published index (may still be in use)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID soi_index_lock;				// Lock for rebuilding the index of spheres of influence
+#endif
+
+	// Geometry of the star and planets which may cast shadows
+	struct EVDS_SHADOW_CACHE_TAG* shadow_cache;	// Cache built by the latest query (or 0)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID shadow_cache_lock;				// Lock for the shadow cache
+#endif
+
 	// User-defined data
 	void* userdata;
 };
@@ -401,6 +557,419 @@ struct EVDS_SYSTEM_TAG {
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENSEMBLE
+/// @struct EVDS_ENSEMBLE
+/// @brief Ensemble of systems created from a single template system.
+///
+/// Each member of the ensemble is a separate EVDS_SYSTEM, which contains copies of all objects
+/// in the root inertial space of the template system and its own copy of the template databases,
+/// so creating a member does not require parsing any files.
+///
+/// Members are solved in parallel by a pool of worker threads: each worker takes the next
+/// unsolved member under the ensemble lock until all members were solved.
+///
+/// Worker threads are created once and persist until the ensemble is destroyed. Between
+/// steps they are blocked on one of two gates (SRW locks), which the solving thread keeps
+/// write-locked. To start a step the gate of that step is opened, and the solving thread
+/// waits for the step to complete by write-locking the gate again. Steps alternate
+/// between the gates, so workers that completed a step block on the gate of the next one.
+/// When the ensemble is destroyed both gates are opened and the last exiting worker frees
+/// the ensemble.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_ENSEMBLE_DISPERSION_TAG {
+	char query[257];						//Reference to the dispersed variable
+	EVDS_REAL sigma;						//Standard deviation of the dispersion
+} EVDS_ENSEMBLE_DISPERSION;
+
+struct EVDS_ENSEMBLE_TAG {
+	EVDS_SYSTEM* template_system;			//System from which members are created
+	EVDS_SYSTEM** members;					//Member systems
+	int count;								//Number of members
+	SIMC_LIST* dispersions;					//List of dispersions (EVDS_ENSEMBLE_DISPERSION)
+
+	EVDS_Callback_EnsembleMember* OnCreateMember; //Called for every member before initialization
+	void* userdata;							//Userdata for the callback
+
+	// Current job for the worker threads
+	EVDS_REAL delta_time;					//Time step
+	int next_member;						//Next member to be solved
+	int thread_count;						//Number of threads solving the current step
+	int generation;							//Number of steps started (step N uses gate N%2)
+
+	// Worker threads
+	int worker_count;						//Number of running worker threads
+	int worker_index;						//Index for the next started worker thread
+	int stop;								//Set when workers must exit
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID lock;						//Lock for the job and worker counters
+	SIMC_SRW_ID gate[2];					//Gates which hold workers between steps
+#endif
+};
+#endif
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_SNAPSHOT
+/// @struct EVDS_SNAPSHOT
+/// @brief In-memory copy of the mutable state of the system.
+///
+/// Layout of the snapshot is computed once when snapshot is created: every initialized object
+/// gets a block in a single contiguous buffer, which holds its state vector, sleeping state
+/// and values of all its floating point, vector and quaternion variables (including nested ones).
+/// Saving and restoring the snapshot only copies memory according to this layout.
+///
+/// Incremental snapshot uses layout of its base snapshot. Every change to state vector, sleeping
+/// state or variables of an object assigns a new version (unique within the system) to the data
+/// of the object: EVDS_InternalObject_InvalidateSnapshot() is called by all functions which write
+/// them. Every block remembers the version of the data it holds, and restoring a block also
+/// restores the version. When an incremental snapshot is saved, only blocks of objects whose
+/// version differs from the base snapshot are copied into its own buffer, so unchanged objects
+/// are not even read. Unchanged blocks keep pointing to the data in the base snapshot.
+///
+/// String variables are not stored, since their size is not fixed and they cannot be kept in
+/// a preallocated layout. EVDS has no integer variable type; integer values are stored in
+/// floating point variables and are included in the snapshot.
+///
+/// Layout is only valid while no objects are created, initialized or destroyed.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_SNAPSHOT_OBJECT_STATE_TAG {
+	EVDS_STATE_VECTOR state;				//Objects state vector
+	EVDS_REAL quiet_time;					//Time spent below sleep thresholds
+	int sleeping;							//Is object sleeping
+} EVDS_SNAPSHOT_OBJECT_STATE;
+
+typedef struct EVDS_SNAPSHOT_BLOCK_TAG {
+	EVDS_OBJECT* object;					//Object stored in this block
+	size_t offset;							//Offset of the block in the buffer
+	size_t size;							//Size of the block
+	int first_variable;						//Index of first variable of the object
+	int variable_count;						//Number of variables of the object
+	unsigned char* data;					//Data of the block (in own buffer or in base snapshot)
+	long version;							//Version of the object data stored in the block
+} EVDS_SNAPSHOT_BLOCK;
+
+struct EVDS_SNAPSHOT_TAG {
+	EVDS_SYSTEM* system;					//System for which the snapshot was created
+	EVDS_SNAPSHOT* base;					//Base snapshot (for incremental snapshots)
+	int generation;							//Incremented every time snapshot is saved
+	int base_generation;					//Generation of base snapshot when this snapshot was saved
+
+	EVDS_SNAPSHOT_BLOCK* blocks;			//Blocks (one per object)
+	int block_count;						//Number of blocks
+	EVDS_VARIABLE** variables;				//Variables stored in the snapshot
+	int variable_count;						//Number of variables
+
+	unsigned char* buffer;					//Preallocated buffer
+	size_t size;							//Size of the buffer
+	size_t stored_size;						//Size of data stored in own buffer
+	EVDS_REAL time;							//System time
+	int saved;								//Was snapshot saved at least once
+};
+#endif
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_PLANET_POSITION
+/// @brief Position of the planet resolved by the latest query.
+///
+/// Position is resolved once in the coordinates of the query and reused by all following
+/// queries in same coordinates until the planet, the target coordinates or any of their
+/// parents publish a new state (see EVDS_InternalObject_GetStateVersion()).
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PLANET_POSITION_TAG {
+	EVDS_OBJECT* coordinates;				//Coordinates in which position was resolved (or 0)
+	long version;							//State version of the planet and coordinates when position was resolved
+	int oriented;							//Was orientation resolved along with position
+	EVDS_VECTOR position;					//Position of the planet
+	EVDS_QUATERNION orientation;			//Orientation of the planet
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID lock;						//Lock for the cached position
+#endif
+} EVDS_PLANET_POSITION;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_PLANET_GRAVITY
+/// @brief Parameters of planets gravitational field.
+///
+/// The descriptor is stored by the planet solver and is rebuilt from planets variables
+/// only when one of them changes (see EVDS_InternalPlanet_GetGravity()), so the
+/// gravitational field can be computed without looking up any variables.
+///
+/// A published descriptor (including its coefficients) is never modified. A new descriptor
+/// is built in a separate buffer and replaces the current one, the previous descriptor is
+/// only freed by the next rebuild. Queries may keep using the descriptor they got without
+/// any locks.
+///
+/// The gravity grid is not built along with the descriptor. It is built by the planet solver
+/// in a separate buffer and attached to the descriptor it was built for (see EVDS_PLANET_GRID),
+/// until then the field is computed directly.
+///
+/// Normalized spherical harmonics coefficients are stored in triangular arrays, coefficient
+/// \f$\bar{C}_{nm}\f$ is stored at index \f$n(n+1)/2 + m\f$.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PLANET_GRAVITY_TAG {
+	int has_mu;								//Gravitational parameter is defined (directly or by mass)
+	int has_j2;								//Second spherical harmonic is defined
+	int has_radius;							//Planet radius is defined
+	int has_rs;								//Sphere of influence is defined
+	EVDS_REAL mu;							//Gravitational parameter
+	EVDS_REAL j2;							//Second spherical harmonic
+	EVDS_REAL radius;						//Planet radius
+	EVDS_REAL rs;							//Sphere of influence
+	EVDS_Callback_GetGravitationalField* callback; //Custom gravitational field (or 0)
+
+	int degree;								//Degree of loaded spherical harmonics model (0 if not loaded)
+	int max_degree;							//Maximum degree used in computations (0 if not limited)
+	EVDS_REAL tolerance;					//Relative magnitude of terms at which series is truncated
+	EVDS_REAL harmonics_radius;				//Reference radius of spherical harmonics model
+	EVDS_REAL* C;							//Normalized cosine coefficients
+	EVDS_REAL* S;							//Normalized sine coefficients
+	EVDS_REAL zonal_C[6];					//Coefficients of J2-only model (up to degree 2)
+	EVDS_REAL zonal_S[6];					//Sine coefficients of J2-only model (always zero)
+
+	EVDS_REAL grid_altitude;				//Altitude covered by gravity grid (0 if grid is not used)
+	EVDS_REAL grid_step;					//Angular step of gravity grid (radians)
+	int grid_layers;						//Number of radial layers in gravity grid
+
+	long generation;						//Generation of the descriptor (incremented by every rebuild)
+	struct EVDS_PLANET_GRID_TAG* volatile grid; //Gravity grid built for this descriptor (or 0)
+
+	EVDS_PLANET_POSITION* position;			//Cached position of the planet (shared by all descriptors)
+} EVDS_PLANET_GRAVITY;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_PLANET_GRID
+/// @brief Precomputed gravity grid of the planet.
+///
+/// The grid is built by the planet solver (never by queries) from a published gravity
+/// descriptor, and then attached to that descriptor by a single pointer write. The grid is
+/// only used if its generation matches generation of the descriptor. Nodes are never modified
+/// after the grid is attached. If a rebuilt descriptor uses the same gravity model, the grid
+/// is passed on to it, otherwise the grid is freed along with the descriptor.
+///
+/// Nodes of the gravity grid are stored by layer, latitude and longitude. Every node holds
+/// four values: non-spherical part of the potential and of the acceleration (in planet-fixed
+/// coordinates).
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PLANET_GRID_TAG {
+	long generation;						//Generation of the descriptor for which grid was built
+	EVDS_REAL mu;							//Gravitational parameter of the model
+	EVDS_REAL altitude;						//Altitude covered by the grid
+	EVDS_REAL step;							//Angular step (radians)
+	int layers;								//Number of radial layers
+	int latitudes;							//Number of nodes in latitude
+	int longitudes;							//Number of nodes in longitude
+	EVDS_REAL radius;						//Radius of the lowest layer
+	EVDS_REAL error;						//Largest acceleration error found at centers of grid cells
+	EVDS_REAL* nodes;						//Nodes of the grid
+} EVDS_PLANET_GRID;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_PLANET_ATMOSPHERE
+/// @brief Parameters of built-in planet atmosphere model.
+///
+/// Atmosphere is made of layers in which temperature changes linearly with geopotential
+/// altitude. Constants of every layer (including pressure at its base) are precomputed when
+/// the descriptor is built, so atmosphere is computed without looking up any variables.
+/// Exponential atmosphere is stored as a single isothermal layer.
+///
+/// The descriptor is stored by the planet solver and rebuilt along with the gravity descriptor
+/// (see EVDS_InternalPlanet_GetAtmosphere()).
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+#define EVDS_PLANET_ATMOSPHERE_MAX_LAYERS 8
+
+typedef struct EVDS_PLANET_ATMOSPHERE_TAG {
+	int layers;								//Number of layers (0 if planet has no built-in atmosphere)
+	EVDS_REAL radius;						//Radius of the planet surface
+	EVDS_REAL inverse_geopotential_radius;	//Inverse of radius used to compute geopotential altitude (0 if not used)
+	EVDS_REAL gas_constant;					//Specific gas constant [J/(kg K)]
+	EVDS_REAL lapse_constant;				//Surface gravity divided by specific gas constant [K/m]
+	EVDS_REAL base_altitude[EVDS_PLANET_ATMOSPHERE_MAX_LAYERS];		//Geopotential altitude of layer base
+	EVDS_REAL base_temperature[EVDS_PLANET_ATMOSPHERE_MAX_LAYERS];	//Temperature at layer base
+	EVDS_REAL lapse_rate[EVDS_PLANET_ATMOSPHERE_MAX_LAYERS];		//Temperature gradient in the layer [K/m]
+	EVDS_REAL log_pressure[EVDS_PLANET_ATMOSPHERE_MAX_LAYERS];		//Logarithm of pressure at layer base
+	EVDS_REAL mole_fraction[EVDS_ENVIRONMENT_SPECIES_MAX];		//Fraction of every species by number
+	EVDS_REAL mass_fraction[EVDS_ENVIRONMENT_SPECIES_MAX];		//Fraction of every species by mass
+} EVDS_PLANET_ATMOSPHERE;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_EPHEMERIS
+/// @brief Chebyshev polynomial ephemeris of a single body.
+///
+/// Ephemeris file is mapped into memory, segments of coefficients are read directly from
+/// the mapping. Segment used by the previous evaluation is remembered, so consecutive
+/// evaluations only check that time is still inside of it.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+#define EVDS_EPHEMERIS_MAX_COEFFICIENTS 32
+
+typedef struct EVDS_EPHEMERIS_TAG {
+	void* data;								//Mapped file
+	size_t size;							//Size of the mapped file
+#ifdef _WIN32
+	void* file;								//Handle of the file
+	void* mapping;							//Handle of the file mapping
+#endif
+	double* coefficients;					//First coefficient of the first segment
+	EVDS_REAL start;						//Start of the first segment (MJD)
+	EVDS_REAL segment_length;				//Length of every segment (days)
+	int segments;							//Number of segments
+	int coefficients_count;					//Number of coefficients per component
+	int bodies;								//Number of bodies in the file
+	int body;								//Index of the body
+	volatile int segment;					//Segment used by the previous evaluation (-1 if none)
+} EVDS_EPHEMERIS;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_GRAVITY_TREE
+/// @brief Octree of planets used for approximate computation of gravitational field.
+///
+/// Planets which are point masses are sorted into an octree (Barnes-Hut tree). Every node of
+/// the tree stores total gravitational parameter and center of mass of planets inside it.
+/// Planets with any other gravity model are kept in a separate list and are always computed
+/// exactly.
+///
+/// Positions of planets are stored in the root inertial space, so the tree is shared by queries
+/// in all coordinates and a query only converts the query point. The tree is built once per
+/// change of planet states (see EVDS_InternalEnvironment_GetTree()) and is never modified
+/// after it is published.
+///
+/// Nodes are stored in a single array, children always follow their parents. Planets in a
+/// leaf form a linked list (a leaf only holds more than one planet at maximum depth).
+////////////////////////////////////////////////////////////////////////////////
+#define EVDS_GRAVITY_TREE_MAX_DEPTH 32 //Maximum depth of the gravity tree
+
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_GRAVITY_TREE_NODE_TAG {
+	EVDS_REAL center[3];					//Center of the node
+	EVDS_REAL size;							//Half of the node size
+	EVDS_REAL mu;							//Total gravitational parameter of planets in the node
+	EVDS_REAL cm[3];						//Center of mass of planets in the node
+	int children[8];						//Indices of child nodes (-1 if none)
+	int leaf;								//Is node a leaf
+	int planet;								//First planet in the leaf (-1 if none)
+} EVDS_GRAVITY_TREE_NODE;
+
+typedef struct EVDS_GRAVITY_TREE_TAG {
+	long planet_generation;					//Planet generation of the system when tree was built
+	long gravity_generation;				//Gravity generation of the system when tree was built
+
+	int planet_count;						//Number of planets in the tree
+	EVDS_OBJECT** planets;					//Planets in the tree
+	EVDS_REAL* positions;					//Positions of planets in root inertial space (three values per planet)
+	EVDS_REAL* mu;							//Gravitational parameters of planets
+	int* next;								//Next planet in the same leaf (-1 if none)
+
+	int exact_count;						//Number of planets computed exactly
+	EVDS_OBJECT** exact;					//Planets computed exactly
+
+	int node_count;							//Number of nodes
+	int node_capacity;						//Number of allocated nodes
+	EVDS_GRAVITY_TREE_NODE* nodes;			//Nodes of the tree (first node is the root)
+} EVDS_GRAVITY_TREE;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_SOI_INDEX
+/// @brief Hierarchy of spheres of influence of planets used to find planets relevant to a point.
+///
+/// Positions of planets are stored in the root inertial space, so a query only converts
+/// the query point. Every sphere of influence is a child of the smallest sphere which
+/// fully contains it. A query descends only into spheres which contain the query point,
+/// so planets in other parts of the hierarchy are never looked at.
+///
+/// Planets without sphere of influence are stored in a separate list and are relevant
+/// to every point.
+///
+/// The index is rebuilt every time a planet moves (see EVDS_InternalEnvironment_GetIndex()),
+/// so spheres of influence are stored without any margin. The index is never modified after
+/// it is published.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_SOI_INDEX_TAG {
+	long planet_generation;					//Planet generation of the system when index was built
+	long gravity_generation;				//Gravity generation of the system when index was built
+
+	int planet_count;						//Number of planets in the index
+	EVDS_OBJECT** planets;					//Planets in the index
+	EVDS_REAL* positions;					//Positions of planets in root inertial space (three values per planet)
+	EVDS_REAL* radii;						//Radii of spheres of influence (0 if not defined)
+	int* parent;							//Smallest sphere of influence containing this one (-1 if none)
+	int* first_child;						//First sphere of influence inside this one (-1 if none)
+	int* next;								//Next planet in the same list (-1 if none)
+
+	int first_root;							//First sphere of influence not contained in any other (-1 if none)
+	int first_global;						//First planet without sphere of influence (-1 if none)
+} EVDS_SOI_INDEX;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @ingroup EVDS_ENVIRONMENT
+/// @struct EVDS_SHADOW_CACHE
+/// @brief Geometry of the star and of planets which may eclipse it.
+///
+/// The star is the planet with the largest "radiation.luminosity", occluders are all other
+/// planets with "geometry.radius". Positions are stored in the root inertial space and are
+/// resolved once per step, so radiation queries made by every stage of the integrator only
+/// convert the query point.
+///
+/// Unit vectors from the star to every occluder are precomputed, so occluders which are
+/// not between the point and the star are rejected with a single dot product.
+////////////////////////////////////////////////////////////////////////////////
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_SHADOW_CACHE_TAG {
+	long state_generation;					//State generation of the system when cache was built
+	long gravity_generation;				//Gravity generation of the system when cache was built
+	int planet_count;						//Number of planets in the system when cache was built
+
+	EVDS_OBJECT* star;						//Source of radiation (or 0)
+	EVDS_REAL star_position[3];				//Position of the star in root inertial space
+	EVDS_REAL star_radius;					//Radius of the star (0 for point source)
+	EVDS_REAL luminosity;					//Total radiated power of the star [W]
+	int cylindrical;						//Use cylindrical shadow model instead of conical
+
+	int occluder_count;						//Number of occluders
+	EVDS_OBJECT** occluders;				//Planets which may cast a shadow
+	EVDS_REAL* positions;					//Positions of occluders in root inertial space (three values per occluder)
+	EVDS_REAL* axes;						//Unit vectors from the star to occluders (three values per occluder)
+	EVDS_REAL* distances;					//Distances from the star to occluders
+	EVDS_REAL* radii;						//Radii of occluders
+} EVDS_SHADOW_CACHE;
+#endif
+
+
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @ingroup EVDS_MESH
 /// @struct EVDS_MESH_INTERNAL
@@ -425,8 +994,66 @@ struct EVDS_MESH_INTERNAL_TAG {
 ////////////////////////////////////////////////////////////////////////////////
 // Internal API
 ////////////////////////////////////////////////////////////////////////////////
+// Create system (optionally sharing solvers and databases with a template system)
+int EVDS_InternalSystem_Create(EVDS_SYSTEM** p_system, EVDS_SYSTEM* template_system);
 // Destroy object internal data
 int EVDS_InternalObject_DestroyData(EVDS_OBJECT* object);
+// Publish objects state vector into dense output
+void EVDS_InternalObject_PublishState(EVDS_OBJECT* object, int continuous);
+// Mark mass properties of the object and all its parents as changed
+void EVDS_InternalObject_InvalidateMass(EVDS_OBJECT* object);
+// Mark structure of the object and all its parents as changed
+void EVDS_InternalObject_InvalidateChildren(EVDS_OBJECT* object);
+// Mark public state of the object as changed
+void EVDS_InternalObject_InvalidateState(EVDS_OBJECT* object);
+// Get latest state version of the object and all its parents
+long EVDS_InternalObject_GetStateVersion(EVDS_OBJECT* object);
+// Mark the object and all its parents as containing a planet
+void EVDS_InternalObject_MarkPlanet(EVDS_OBJECT* object);
+// Mark parameters of the objects gravitational field as changed
+void EVDS_InternalObject_InvalidateGravity(EVDS_OBJECT* object);
+// Mark data of the object stored in snapshots as changed
+void EVDS_InternalObject_InvalidateSnapshot(EVDS_OBJECT* object);
+// Read parameters of planets gravitational field from its variables
+void EVDS_InternalPlanet_ReadGravity(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity);
+// Get cached parameters of planets gravitational field
+int EVDS_InternalPlanet_GetGravity(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY** p_gravity);
+// Read parameters of built-in planet atmosphere from its variables
+void EVDS_InternalPlanet_ReadAtmosphere(EVDS_OBJECT* planet, EVDS_PLANET_ATMOSPHERE* atmosphere);
+// Get cached parameters of built-in planet atmosphere
+int EVDS_InternalPlanet_GetAtmosphere(EVDS_OBJECT* planet, EVDS_PLANET_ATMOSPHERE** p_atmosphere);
+// Load spherical harmonics coefficients of the planet
+int EVDS_InternalPlanet_LoadHarmonics(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity);
+// Precompute gravity grid for the gravity descriptor of the planet
+int EVDS_InternalPlanet_BuildGravityGrid(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity, EVDS_PLANET_GRID** p_grid);
+// Destroy gravity grid
+void EVDS_InternalPlanet_DestroyGravityGrid(EVDS_PLANET_GRID* grid);
+// Interpolate gravitational field from the gravity grid
+int EVDS_InternalPlanet_GetGridField(EVDS_PLANET_GRID* grid, EVDS_VECTOR* position,
+									 EVDS_REAL* phi, EVDS_VECTOR* field);
+// Destroy tree of planets
+void EVDS_InternalEnvironment_DestroyTree(EVDS_GRAVITY_TREE* tree);
+// Destroy index of spheres of influence
+void EVDS_InternalEnvironment_DestroyIndex(EVDS_SOI_INDEX* index);
+// Destroy cached geometry of the star and occluders
+void EVDS_InternalEnvironment_DestroyShadowCache(EVDS_SHADOW_CACHE* cache);
+// Find planets relevant to the given position and the planet which dominates in it
+int EVDS_InternalEnvironment_GetRelevantPlanets(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_REAL radius,
+												EVDS_OBJECT** planets, int capacity, int* count,
+												EVDS_OBJECT** p_dominant);
+// Compute gravitational field of a spherical harmonics model
+int EVDS_InternalEnvironment_GetHarmonicsField(EVDS_REAL* C, EVDS_REAL* S, int degree,
+											   EVDS_REAL mu, EVDS_REAL radius, EVDS_VECTOR* position,
+											   EVDS_REAL* phi, EVDS_VECTOR* field);
+// Map ephemeris file into memory
+int EVDS_InternalEphemeris_Load(const char* filename, int body, EVDS_EPHEMERIS* ephemeris);
+// Unmap ephemeris file
+void EVDS_InternalEphemeris_Unload(EVDS_EPHEMERIS* ephemeris);
+// Compute position and velocity of the body from ephemeris
+void EVDS_InternalEphemeris_Evaluate(EVDS_EPHEMERIS* ephemeris, EVDS_REAL mjd, EVDS_REAL* position, EVDS_REAL* velocity);
+// Compute built-in planet atmosphere at many altitudes
+void EVDS_InternalEnvironment_GetLayeredAtmosphere(EVDS_PLANET_ATMOSPHERE* atmosphere, int count, EVDS_REAL* altitude,
+												   EVDS_REAL* density, EVDS_REAL* pressure, EVDS_REAL* temperature);
 // Destroy variable internal data
 int EVDS_InternalVariable_DestroyData(EVDS_VARIABLE* variable);
 // Creates a new variable
@@ -437,6 +1064,18 @@ int EVDS_Variable_Copy(EVDS_VARIABLE* source, EVDS_VARIABLE* variable);
 int EVDS_InternalVariable_InitializeFunction(EVDS_VARIABLE* variable, EVDS_VARIABLE_FUNCTION* function);
 // Destroy function data
 int EVDS_InternalVariable_DestroyFunction(EVDS_VARIABLE* variable, EVDS_VARIABLE_FUNCTION* function);
+// Evaluate two-body position and velocity at time t from state at epoch
+void EVDS_InternalPropagator_Kepler_Evaluate(EVDS_REAL mu, EVDS_REAL alpha, EVDS_REAL period,
+											 EVDS_REAL* r0, EVDS_REAL* v0, EVDS_REAL t,
+											 EVDS_REAL* r, EVDS_REAL* v);
+// Get state of the central body in propagator coordinates
+void EVDS_InternalPropagator_Kepler_GetBodyState(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* body,
+												 EVDS_VECTOR* position, EVDS_VECTOR* velocity);
+// Check if object or any of its children produce thrust
+int EVDS_InternalPropagator_Kepler_IsPowered(EVDS_OBJECT* object);
+// Numerically integrate state of a powered object (RK4)
+void EVDS_InternalPropagator_Kepler_Numerical(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+											  EVDS_STATE_VECTOR* state, EVDS_REAL h);
 
 #ifndef EVDS_SINGLETHREADED
 // Set private state vector
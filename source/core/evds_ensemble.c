@@ -0,0 +1,616 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Uniformly distributed random number in (0,1] (xorshift generator)
+////////////////////////////////////////////////////////////////////////////////
+EVDS_REAL EVDS_InternalEnsemble_Random(unsigned int* state) {
+	unsigned int x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return ((EVDS_REAL)x + 1.0) / 4294967296.0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Normally distributed random number (Box-Muller transform)
+////////////////////////////////////////////////////////////////////////////////
+EVDS_REAL EVDS_InternalEnsemble_Gaussian(unsigned int* state) {
+	EVDS_REAL u1 = EVDS_InternalEnsemble_Random(state);
+	EVDS_REAL u2 = EVDS_InternalEnsemble_Random(state);
+	return sqrt(-2.0*log(u1))*cos(2.0*EVDS_PI*u2);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy all members of the ensemble
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnsemble_DestroyMembers(EVDS_ENSEMBLE* ensemble) {
+	int i;
+	for (i = 0; i < ensemble->count; i++) {
+		if (ensemble->members[i]) EVDS_System_Destroy(ensemble->members[i]);
+	}
+	if (ensemble->members) free(ensemble->members);
+	ensemble->members = 0;
+	ensemble->count = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Free ensemble data structure (after all members were destroyed)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnsemble_Free(EVDS_ENSEMBLE* ensemble) {
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Destroy(ensemble->lock);
+	SIMC_SRW_Destroy(ensemble->gate[0]);
+	SIMC_SRW_Destroy(ensemble->gate[1]);
+#endif
+	free(ensemble);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create a single member of the ensemble
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnsemble_CreateMember(EVDS_ENSEMBLE* ensemble, int index, unsigned int seed, EVDS_SYSTEM** p_system) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_SYSTEM* system;
+	EVDS_OBJECT* template_root;
+	EVDS_OBJECT* root;
+	unsigned int random_state;
+
+	//Create system and copy all objects from the template
+	EVDS_ERRCHECK(EVDS_InternalSystem_Create(p_system,ensemble->template_system));
+	system = *p_system;
+	EVDS_System_GetRootInertialSpace(ensemble->template_system,&template_root);
+	EVDS_System_GetRootInertialSpace(system,&root);
+	EVDS_ERRCHECK(EVDS_Object_CopyChildren(template_root,root));
+
+	//Apply dispersions (random sequence depends only on seed and member index)
+	random_state = (seed ^ 0x9E3779B9) + 0x85EBCA6B*(unsigned int)(index+1);
+	if (!random_state) random_state = 1;
+	entry = SIMC_List_GetFirst(ensemble->dispersions);
+	while (entry) {
+		EVDS_REAL value;
+		EVDS_VARIABLE* variable = 0;
+		EVDS_ENSEMBLE_DISPERSION* dispersion = (EVDS_ENSEMBLE_DISPERSION*)SIMC_List_GetData(ensemble->dispersions,entry);
+
+		EVDS_System_QueryByReference(root,dispersion->query,&variable,0);
+		if ((!variable) || (EVDS_Variable_GetReal(variable,&value) != EVDS_OK)) {
+			SIMC_List_Stop(ensemble->dispersions,entry);
+			return EVDS_ERROR_NOT_FOUND;
+		}
+		EVDS_Variable_SetReal(variable,value + dispersion->sigma*EVDS_InternalEnsemble_Gaussian(&random_state));
+		entry = SIMC_List_GetNext(ensemble->dispersions,entry);
+	}
+
+	//Let user modify the member
+	if (ensemble->OnCreateMember) {
+		EVDS_ERRCHECK(ensemble->OnCreateMember(ensemble,index,system,ensemble->userdata));
+	}
+
+	//Initialize all objects
+	entry = SIMC_List_GetFirst(root->raw_children);
+	while (entry) {
+		EVDS_Object_Initialize((EVDS_OBJECT*)SIMC_List_GetData(root->raw_children,entry),1);
+		entry = SIMC_List_GetNext(root->raw_children,entry);
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Solve members of the ensemble until all members of the current step are solved
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnsemble_SolveMembers(EVDS_ENSEMBLE* ensemble) {
+	int index;
+	while (1) {
+		SIMC_LIST* children;
+		SIMC_LIST_ENTRY* entry;
+		EVDS_OBJECT* root;
+
+		//Take next member
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(ensemble->lock);
+#endif
+		index = ensemble->next_member++;
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(ensemble->lock);
+#endif
+		if (index >= ensemble->count) break;
+
+		//Solve all objects in the root inertial space
+		EVDS_System_GetRootInertialSpace(ensemble->members[index],&root);
+		EVDS_Object_GetChildren(root,&children);
+		entry = SIMC_List_GetFirst(children);
+		while (entry) {
+			EVDS_Object_Solve((EVDS_OBJECT*)SIMC_List_GetData(children,entry),ensemble->delta_time);
+			entry = SIMC_List_GetNext(children,entry);
+		}
+	}
+}
+
+
+#ifndef EVDS_SINGLETHREADED
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Worker thread that solves members of the ensemble.
+///
+/// Worker waits on the gate of the next step, solves members while the gate is open
+/// and then moves on to the gate of the following step. The last worker to exit after
+/// EVDS_Ensemble_Destroy() frees the ensemble data structure.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalThread_Ensemble_Worker(EVDS_ENSEMBLE* ensemble) {
+	int index,step,last_worker;
+
+	//Worker index and the first step it can take part in
+	SIMC_Lock_Enter(ensemble->lock);
+	index = ensemble->worker_index++;
+	step = ensemble->generation;
+	SIMC_Lock_Leave(ensemble->lock);
+
+	while (1) {
+		SIMC_SRW_EnterRead(ensemble->gate[step % 2]);
+		if (ensemble->stop) {
+			SIMC_SRW_LeaveRead(ensemble->gate[step % 2]);
+			break;
+		}
+
+		//Gate is open only during the last started step
+		step = ensemble->generation - 1;
+		if (index < ensemble->thread_count - 1) {
+			EVDS_InternalEnsemble_SolveMembers(ensemble);
+		}
+		SIMC_SRW_LeaveRead(ensemble->gate[step % 2]);
+		step++;
+	}
+
+	//Worker has finished
+	SIMC_Lock_Enter(ensemble->lock);
+	ensemble->worker_count--;
+	last_worker = ensemble->worker_count == 0;
+	SIMC_Lock_Leave(ensemble->lock);
+	if (last_worker) EVDS_InternalEnsemble_Free(ensemble);
+}
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create new ensemble from a template system.
+///
+/// All objects in the root inertial space of the template system will be copied into
+/// every member of the ensemble by EVDS_Ensemble_Generate(). The template is loaded only
+/// once, members are created by copying objects in memory. Every member gets its own
+/// copy of the databases of the template system (see EVDS_InternalSystem_Create()), so
+/// members do not share any data with each other or with the template system.
+///
+/// Example of use:
+/// ~~~{.c}
+///		EVDS_ENSEMBLE* ensemble;
+///		EVDS_REAL masses[1000];
+///		EVDS_Object_LoadFromFile(root,"launch.evds",0); //Load template once
+///		EVDS_Ensemble_Create(system,&ensemble);
+///		EVDS_Ensemble_AddDispersion(ensemble,"/Vessel/mass",50.0);
+///		EVDS_Ensemble_Generate(ensemble,1000,12345);
+///		for (i = 0; i < 6000; i++) {
+///			EVDS_Ensemble_Solve(ensemble,0.1,8);
+///		}
+///		EVDS_Ensemble_GetVariables(ensemble,"/Vessel/mass",masses);
+///		EVDS_Ensemble_Destroy(ensemble);
+/// ~~~
+///
+/// @param[in] template_system System from which members are created
+/// @param[out] p_ensemble Pointer to the new ensemble will be written here
+///
+/// @returns Error code, pointer to ensemble
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "template_system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "p_ensemble" is null
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the ensemble
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_Create(EVDS_SYSTEM* template_system, EVDS_ENSEMBLE** p_ensemble) {
+	EVDS_ENSEMBLE* ensemble;
+	if (!template_system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_ensemble) return EVDS_ERROR_BAD_PARAMETER;
+
+	ensemble = (EVDS_ENSEMBLE*)malloc(sizeof(EVDS_ENSEMBLE));
+	*p_ensemble = ensemble;
+	if (!ensemble) return EVDS_ERROR_MEMORY;
+	memset(ensemble,0,sizeof(EVDS_ENSEMBLE));
+
+	ensemble->template_system = template_system;
+	SIMC_List_Create(&ensemble->dispersions,1);
+#ifndef EVDS_SINGLETHREADED
+	ensemble->lock = SIMC_Lock_Create();
+	ensemble->gate[0] = SIMC_SRW_Create();
+	ensemble->gate[1] = SIMC_SRW_Create();
+#endif
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy ensemble and all its member systems.
+///
+/// Worker threads are released through both gates and exit on their own. They do not
+/// access members after the ensemble is destroyed, so the call does not wait for them:
+/// the ensemble data structure is freed by the last exiting worker thread.
+///
+/// @param[in] ensemble Pointer to ensemble
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_Destroy(EVDS_ENSEMBLE* ensemble) {
+	SIMC_LIST_ENTRY* entry;
+	int worker_count = 0;
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+
+	EVDS_InternalEnsemble_DestroyMembers(ensemble);
+
+	entry = SIMC_List_GetFirst(ensemble->dispersions);
+	while (entry) {
+		free(SIMC_List_GetData(ensemble->dispersions,entry));
+		entry = SIMC_List_GetNext(ensemble->dispersions,entry);
+	}
+	SIMC_List_Destroy(ensemble->dispersions);
+
+#ifndef EVDS_SINGLETHREADED
+	//Open both gates under the lock, so no worker can exit before both gates are open
+	SIMC_Lock_Enter(ensemble->lock);
+	worker_count = ensemble->worker_count;
+	if (worker_count > 0) {
+		ensemble->stop = 1;
+		SIMC_SRW_LeaveWrite(ensemble->gate[0]);
+		SIMC_SRW_LeaveWrite(ensemble->gate[1]);
+	}
+	SIMC_Lock_Leave(ensemble->lock);
+#endif
+
+	//Free ensemble unless the last worker thread will do it
+	if (worker_count == 0) EVDS_InternalEnsemble_Free(ensemble);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add a normally distributed dispersion to a variable.
+///
+/// Every member created by EVDS_Ensemble_Generate() will have a random value with the given
+/// standard deviation added to the variable. The variable is specified by a reference from
+/// the root inertial space (see EVDS_System_QueryByReference()), for example "/Vessel/mass".
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] query Reference to the variable (null-terminated string, up to 256 characters)
+/// @param[in] sigma Standard deviation
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "query" is null
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the dispersion
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_AddDispersion(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_REAL sigma) {
+	EVDS_ENSEMBLE_DISPERSION* dispersion;
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!query) return EVDS_ERROR_BAD_PARAMETER;
+
+	dispersion = (EVDS_ENSEMBLE_DISPERSION*)malloc(sizeof(EVDS_ENSEMBLE_DISPERSION));
+	if (!dispersion) return EVDS_ERROR_MEMORY;
+	strncpy(dispersion->query,query,256); dispersion->query[256] = 0;
+	dispersion->sigma = sigma;
+	SIMC_List_Append(ensemble->dispersions,dispersion);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Set callback which is called for every new member of the ensemble.
+///
+/// The callback is called after dispersions were applied, but before the objects of
+/// the member are initialized. It can be used to apply arbitrary changes to the member.
+/// If callback returns an error, EVDS_Ensemble_Generate() will fail with this error.
+///
+/// Call with null callback pointer to disable.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] p_callback Pointer to the callback function (can be null)
+/// @param[in] userdata Userdata passed to the callback
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_SetCallback_OnCreateMember(EVDS_ENSEMBLE* ensemble, EVDS_Callback_EnsembleMember* p_callback, void* userdata) {
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	ensemble->OnCreateMember = p_callback;
+	ensemble->userdata = userdata;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create members of the ensemble.
+///
+/// Creates the given number of systems with copies of template objects, applies dispersions
+/// and initializes all objects. Any previously generated members are destroyed.
+///
+/// Random values used for dispersions only depend on the seed and index of the member, so the
+/// same member can be recreated later independently of the number of members.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] count Number of members
+/// @param[in] seed Seed for dispersions
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for members
+/// @retval EVDS_ERROR_NOT_FOUND Could not find a dispersed variable
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_Generate(EVDS_ENSEMBLE* ensemble, int count, unsigned int seed) {
+	int i;
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Remove old members
+	EVDS_InternalEnsemble_DestroyMembers(ensemble);
+	if (count == 0) return EVDS_OK;
+
+	//Create new members
+	ensemble->members = (EVDS_SYSTEM**)malloc(sizeof(EVDS_SYSTEM*)*count);
+	if (!ensemble->members) return EVDS_ERROR_MEMORY;
+	memset(ensemble->members,0,sizeof(EVDS_SYSTEM*)*count);
+	ensemble->count = count;
+
+	for (i = 0; i < count; i++) {
+		int error_code = EVDS_InternalEnsemble_CreateMember(ensemble,i,seed,&ensemble->members[i]);
+		if (error_code != EVDS_OK) {
+			EVDS_InternalEnsemble_DestroyMembers(ensemble);
+			return error_code;
+		}
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get number of members in the ensemble.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[out] count Number of members will be written here
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_GetMemberCount(EVDS_ENSEMBLE* ensemble, int* count) {
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!count) return EVDS_ERROR_BAD_PARAMETER;
+	*count = ensemble->count;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get number of worker threads of the ensemble.
+///
+/// Worker threads are created by EVDS_Ensemble_Solve() and are reused by all following
+/// steps, so the count is equal to the largest number of threads requested so far minus one
+/// (the solving thread is not counted).
+///
+/// @evds_st Always returns zero.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[out] count Number of worker threads will be written here
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_GetWorkerCount(EVDS_ENSEMBLE* ensemble, int* count) {
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!count) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(ensemble->lock);
+	*count = ensemble->worker_count;
+	SIMC_Lock_Leave(ensemble->lock);
+#else
+	*count = 0;
+#endif
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get system of a member of the ensemble.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] index Index of the member
+/// @param[out] p_system Pointer to member system will be written here
+///
+/// @returns Error code, pointer to system
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "p_system" is null
+/// @retval EVDS_ERROR_NOT_FOUND No member with this index
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_GetMember(EVDS_ENSEMBLE* ensemble, int index, EVDS_SYSTEM** p_system) {
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_system) return EVDS_ERROR_BAD_PARAMETER;
+	if ((index < 0) || (index >= ensemble->count)) return EVDS_ERROR_NOT_FOUND;
+	*p_system = ensemble->members[index];
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Solve all members of the ensemble in parallel.
+///
+/// Calls EVDS_Object_Solve() for all initialized objects in the root inertial space of
+/// every member. Members are distributed between the given number of worker threads
+/// (the calling thread is one of the workers). The call returns after all members
+/// were solved.
+///
+/// Worker threads are created by the first call which requests them and are reused by
+/// all following calls, so no threads are created per step. Workers are blocked while
+/// the ensemble is not being solved, and exit when the ensemble is destroyed.
+///
+/// @evds_mt The ensemble must be solved and destroyed from the same thread.
+///
+/// @evds_st Members are solved one by one in the calling thread.
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] delta_time Time step
+/// @param[in] thread_count Number of worker threads
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_Solve(EVDS_ENSEMBLE* ensemble, EVDS_REAL delta_time, int thread_count) {
+#ifndef EVDS_SINGLETHREADED
+	int step;
+#endif
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (thread_count < 1) thread_count = 1;
+	if (thread_count > ensemble->count) thread_count = ensemble->count;
+
+	//Start new job
+	ensemble->delta_time = delta_time;
+	ensemble->next_member = 0;
+	ensemble->thread_count = thread_count;
+#ifndef EVDS_SINGLETHREADED
+	if (thread_count > 1) {
+		//Both gates are closed by the solving thread before first worker starts
+		if (ensemble->worker_count == 0) {
+			SIMC_SRW_EnterWrite(ensemble->gate[0]);
+			SIMC_SRW_EnterWrite(ensemble->gate[1]);
+		}
+
+		//Start missing worker threads
+		while (ensemble->worker_count < thread_count-1) {
+			SIMC_Lock_Enter(ensemble->lock);
+			ensemble->worker_count++;
+			SIMC_Lock_Leave(ensemble->lock);
+			SIMC_Thread_Create(EVDS_InternalThread_Ensemble_Worker,ensemble);
+		}
+	}
+
+	//Open gate for the workers and solve members in this thread too
+	SIMC_Lock_Enter(ensemble->lock);
+	step = ensemble->generation++;
+	SIMC_Lock_Leave(ensemble->lock);
+	if (ensemble->worker_count > 0) SIMC_SRW_LeaveWrite(ensemble->gate[step % 2]);
+	EVDS_InternalEnsemble_SolveMembers(ensemble);
+
+	//Wait for workers to leave the gate
+	if (ensemble->worker_count > 0) SIMC_SRW_EnterWrite(ensemble->gate[step % 2]);
+#else
+	EVDS_InternalEnsemble_SolveMembers(ensemble);
+#endif
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Gather values of a variable from all members of the ensemble.
+///
+/// The variable is specified by a reference from the root inertial space (see
+/// EVDS_System_QueryByReference()).
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] query Reference to the variable (null-terminated string)
+/// @param[out] values Array for values of the variable (one per member)
+///
+/// @returns Error code, values of the variable
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "query" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "values" is null
+/// @retval EVDS_ERROR_NOT_FOUND Variable not found in one of the members
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_GetVariables(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_REAL* values) {
+	int i;
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!query) return EVDS_ERROR_BAD_PARAMETER;
+	if (!values) return EVDS_ERROR_BAD_PARAMETER;
+
+	for (i = 0; i < ensemble->count; i++) {
+		EVDS_OBJECT* root;
+		EVDS_VARIABLE* variable = 0;
+		EVDS_System_GetRootInertialSpace(ensemble->members[i],&root);
+		EVDS_System_QueryByReference(root,query,&variable,0);
+		if (!variable) return EVDS_ERROR_NOT_FOUND;
+		EVDS_ERRCHECK(EVDS_Variable_GetReal(variable,&values[i]));
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Gather state vectors of an object from all members of the ensemble.
+///
+/// The object is specified by a reference from the root inertial space (see
+/// EVDS_System_QueryByReference()), for example "/Propagator/Vessel".
+///
+/// @param[in] ensemble Pointer to ensemble
+/// @param[in] query Reference to the object (null-terminated string)
+/// @param[out] vectors Array for state vectors of the object (one per member)
+///
+/// @returns Error code, state vectors
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "ensemble" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "query" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "vectors" is null
+/// @retval EVDS_ERROR_NOT_FOUND Object not found in one of the members
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Ensemble_GetStateVectors(EVDS_ENSEMBLE* ensemble, const char* query, EVDS_STATE_VECTOR* vectors) {
+	int i;
+	if (!ensemble) return EVDS_ERROR_BAD_PARAMETER;
+	if (!query) return EVDS_ERROR_BAD_PARAMETER;
+	if (!vectors) return EVDS_ERROR_BAD_PARAMETER;
+
+	for (i = 0; i < ensemble->count; i++) {
+		EVDS_OBJECT* root;
+		EVDS_OBJECT* object = 0;
+		EVDS_VARIABLE* variable = 0;
+		EVDS_System_GetRootInertialSpace(ensemble->members[i],&root);
+		EVDS_System_QueryByReference(root,query,&variable,&object);
+		if ((!object) || (object == root) || (variable)) return EVDS_ERROR_NOT_FOUND;
+		EVDS_ERRCHECK(EVDS_Object_GetStateVector(object,&vectors[i]));
+	}
+	return EVDS_OK;
+}
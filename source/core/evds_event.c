@@ -0,0 +1,498 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+/// Accuracy of event time [sec]
+#define EVDS_EVENT_TIME_TOLERANCE		1e-6
+/// Maximum number of iterations of Brent's method
+#define EVDS_EVENT_MAX_ITERATIONS		64
+/// Maximum number of events that can happen within a single step
+#define EVDS_EVENT_MAX_PER_STEP			16
+/// Maximum number of corrections of event time using the propagated state
+#define EVDS_EVENT_MAX_REFINEMENTS		4
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get sign of the value
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEvent_Sign(EVDS_REAL value) {
+	if (value > 0.0) return 1;
+	if (value < 0.0) return -1;
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate event function in the dense output between two states at time t
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEvent_Evaluate(EVDS_EVENT* event, EVDS_STATE_VECTOR* state_0, EVDS_STATE_VECTOR* state_1,
+								EVDS_REAL t, EVDS_REAL h, EVDS_REAL* value) {
+	EVDS_STATE_VECTOR state;
+	EVDS_StateVector_InterpolateHermite(&state,state_0,state_1,t/h);
+	return event->function(event->object,&state,event->userdata,value);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find time at which event function crosses zero using Brent's method.
+///
+/// Returns time at which event function is already on the other side of zero
+/// (has same sign as "value_1").
+////////////////////////////////////////////////////////////////////////////////
+EVDS_REAL EVDS_InternalEvent_FindRoot(EVDS_EVENT* event, EVDS_STATE_VECTOR* state_0, EVDS_STATE_VECTOR* state_1,
+									  EVDS_REAL h, EVDS_REAL value_0, EVDS_REAL value_1) {
+	int i;
+	EVDS_REAL a = 0.0, b = h, c = h, d = h, e = h;
+	EVDS_REAL fa = value_0, fb = value_1, fc = value_1;
+	EVDS_REAL p,q,r,s,tol,xm,min1,min2;
+
+	for (i = 0; i < EVDS_EVENT_MAX_ITERATIONS; i++) {
+		//Keep root between b and c
+		if (EVDS_InternalEvent_Sign(fb) == EVDS_InternalEvent_Sign(fc)) {
+			c = a; fc = fa;
+			d = b - a; e = d;
+		}
+		if (fabs(fc) < fabs(fb)) {
+			a = b; b = c; c = a;
+			fa = fb; fb = fc; fc = fa;
+		}
+
+		//Check convergence
+		tol = 0.5*EVDS_EVENT_TIME_TOLERANCE;
+		xm = 0.5*(c - b);
+		if ((fabs(xm) <= tol) || (fb == 0.0)) break;
+
+		if ((fabs(e) >= tol) && (fabs(fa) > fabs(fb))) {
+			//Inverse quadratic interpolation (or secant method)
+			s = fb/fa;
+			if (a == c) {
+				p = 2.0*xm*s;
+				q = 1.0 - s;
+			} else {
+				q = fa/fc;
+				r = fb/fc;
+				p = s*(2.0*xm*q*(q - r) - (b - a)*(r - 1.0));
+				q = (q - 1.0)*(r - 1.0)*(s - 1.0);
+			}
+			if (p > 0.0) q = -q;
+			p = fabs(p);
+
+			//Accept interpolation only if it stays within bounds
+			min1 = 3.0*xm*q - fabs(tol*q);
+			min2 = fabs(e*q);
+			if (2.0*p < (min1 < min2 ? min1 : min2)) {
+				e = d;
+				d = p/q;
+			} else {
+				d = xm;
+				e = d;
+			}
+		} else { //Bisection
+			d = xm;
+			e = d;
+		}
+
+		//Move the best guess
+		a = b;
+		fa = fb;
+		if (fabs(d) > tol) {
+			b += d;
+		} else {
+			b += (xm > 0.0 ? tol : -tol);
+		}
+		if (EVDS_InternalEvent_Evaluate(event,state_0,state_1,b,h,&fb) != EVDS_OK) break;
+	}
+
+	//Return the end of bracket which lies after the crossing
+	if ((fb == 0.0) || (EVDS_InternalEvent_Sign(fb) == EVDS_InternalEvent_Sign(value_1))) {
+		return b;
+	} else {
+		return c;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate state up to the event and refine event time.
+///
+/// Dense output is only an approximation of the actual trajectory, so the event time is
+/// corrected with Newton iterations using event function of the actually propagated state
+/// (time derivative of the event function is taken from the dense output).
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEvent_Refine(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object, EVDS_EVENT* event,
+							   EVDS_STATE_VECTOR* state_0, EVDS_STATE_VECTOR* state_1, EVDS_STATE_VECTOR* state,
+							   EVDS_REAL h, EVDS_REAL* p_time, EVDS_Callback_PropagatorStep* step) {
+	int i;
+	EVDS_REAL time = *p_time;
+	EVDS_REAL value,value_before,value_after,slope,correction;
+	EVDS_REAL dt = 1e-3*h;
+
+	EVDS_StateVector_Copy(state,state_0);
+	if (time > 0.0) step(coordinate_system,object,state,time);
+	for (i = 0; i < EVDS_EVENT_MAX_REFINEMENTS; i++) {
+		if (event->function(object,state,event->userdata,&value) != EVDS_OK) break;
+
+		//Slope of the event function
+		if ((EVDS_InternalEvent_Evaluate(event,state_0,state_1,time-dt,h,&value_before) != EVDS_OK) ||
+			(EVDS_InternalEvent_Evaluate(event,state_0,state_1,time+dt,h,&value_after) != EVDS_OK)) break;
+		slope = (value_after - value_before)/(2.0*dt);
+		if (slope == 0.0) break;
+
+		//Correct event time
+		correction = -value/slope;
+		if (fabs(correction) < EVDS_EVENT_TIME_TOLERANCE) break;
+		if (time + correction < 0.0) correction = -time;
+		if (time + correction > h) correction = h - time;
+		if (correction == 0.0) break;
+		time += correction;
+
+		//Propagate again
+		EVDS_StateVector_Copy(state,state_0);
+		if (time > 0.0) step(coordinate_system,object,state,time);
+	}
+	*p_time = time;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find the earliest event within the step.
+///
+/// If no event happens during the step, signs of all event functions are updated.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEvent_Find(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state_0, EVDS_STATE_VECTOR* state_1, EVDS_REAL h,
+							EVDS_EVENT** p_event, EVDS_REAL* p_time, int* p_sign) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_EVENT* earliest_event = 0;
+	EVDS_REAL earliest_time = h;
+	int earliest_sign = 0;
+
+	//Check all events
+	entry = SIMC_List_GetFirst(object->events);
+	while (entry) {
+		EVDS_REAL value_0,value_1,time;
+		int sign_0,sign_1;
+		EVDS_EVENT* event = (EVDS_EVENT*)SIMC_List_GetData(object->events,entry);
+		entry = SIMC_List_GetNext(object->events,entry);
+		if (!event->function) continue;
+
+		//Evaluate event function at both ends of the step
+		if ((event->function(object,state_0,event->userdata,&value_0) != EVDS_OK) ||
+			(event->function(object,state_1,event->userdata,&value_1) != EVDS_OK)) continue;
+		sign_0 = EVDS_InternalEvent_Sign(value_0);
+		sign_1 = EVDS_InternalEvent_Sign(value_1);
+		if (event->sign == 0) event->sign = sign_0;
+
+		//Check if sign has changed since the last step
+		if ((sign_1 == 0) || (event->sign == 0) || (sign_1 == event->sign)) continue;
+		if (sign_0 == sign_1) {
+			time = 0.0;
+		} else {
+			time = EVDS_InternalEvent_FindRoot(event,state_0,state_1,h,value_0,value_1);
+		}
+		if ((!earliest_event) || (time < earliest_time)) {
+			earliest_event = event;
+			earliest_time = time;
+			earliest_sign = sign_1;
+		}
+	}
+
+	//Remember signs if step is accepted
+	if (!earliest_event) {
+		entry = SIMC_List_GetFirst(object->events);
+		while (entry) {
+			EVDS_REAL value;
+			EVDS_EVENT* event = (EVDS_EVENT*)SIMC_List_GetData(object->events,entry);
+			if (event->function && (event->function(object,state_1,event->userdata,&value) == EVDS_OK) &&
+				(EVDS_InternalEvent_Sign(value) != 0)) {
+				event->sign = EVDS_InternalEvent_Sign(value);
+			}
+			entry = SIMC_List_GetNext(object->events,entry);
+		}
+		return EVDS_ERROR_NOT_FOUND;
+	}
+
+	*p_event = earliest_event;
+	*p_time = earliest_time;
+	*p_sign = earliest_sign;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check variable events (one event is triggered per call)
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEvent_FindVariable(EVDS_OBJECT* object, EVDS_EVENT** p_event) {
+	SIMC_LIST_ENTRY* entry;
+
+	entry = SIMC_List_GetFirst(object->events);
+	while (entry) {
+		EVDS_REAL value;
+		int sign;
+		EVDS_EVENT* event = (EVDS_EVENT*)SIMC_List_GetData(object->events,entry);
+		if (event->variable && (EVDS_Variable_GetReal(event->variable,&value) == EVDS_OK)) {
+			sign = EVDS_InternalEvent_Sign(value - event->threshold);
+			if ((sign != 0) && (sign != event->sign)) {
+				if (event->sign != 0) {
+					event->sign = sign;
+					SIMC_List_Stop(object->events,entry);
+					*p_event = event;
+					return EVDS_OK;
+				}
+				event->sign = sign;
+			}
+		}
+		entry = SIMC_List_GetNext(object->events,entry);
+	}
+	return EVDS_ERROR_NOT_FOUND;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create a new event for the object, defined by a scalar function of its state vector.
+///
+/// Event happens when the event function changes its sign. The callback is called with
+/// state vector of the object at the moment of event. The callback may modify this state
+/// vector, propagation will continue from the modified state.
+///
+/// Event function must only depend on the state vector passed to it (and on any values that
+/// remain constant during the propagator step), since it is evaluated in the dense output
+/// between start and end of the step. See EVDS_EVENT for more information.
+///
+/// @param[in] object Object for which the event must be detected
+/// @param[in] function Event function
+/// @param[in] callback Callback which is called when event happens (can be null)
+/// @param[in] userdata Pointer passed to event function and callback
+/// @param[out] p_event Pointer to the new event will be written here (can be null)
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "function" is null
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the event
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Event_Create(EVDS_OBJECT* object, EVDS_Callback_EventFunction* function,
+					  EVDS_Callback_Event* callback, void* userdata, EVDS_EVENT** p_event) {
+	EVDS_EVENT* event;
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!function) return EVDS_ERROR_BAD_PARAMETER;
+
+	event = (EVDS_EVENT*)malloc(sizeof(EVDS_EVENT));
+	if (!event) return EVDS_ERROR_MEMORY;
+	memset(event,0,sizeof(EVDS_EVENT));
+	event->object = object;
+	event->function = function;
+	event->callback = callback;
+	event->userdata = userdata;
+	event->entry = SIMC_List_Append(object->events,event);
+
+	if (p_event) *p_event = event;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create a new event for the object, which happens when variable crosses the threshold.
+///
+/// Variables are not part of the state vector, so these events are only checked between
+/// the propagator steps (after the object was solved), and the state vector passed to callback
+/// is the state of the object at the beginning of the step.
+///
+/// @param[in] object Object for which the event must be detected
+/// @param[in] variable Floating-point variable which must be checked
+/// @param[in] threshold Threshold value
+/// @param[in] callback Callback which is called when event happens (can be null)
+/// @param[in] userdata Pointer passed to callback
+/// @param[out] p_event Pointer to the new event will be written here (can be null)
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "variable" is null
+/// @retval EVDS_ERROR_INVALID_TYPE Variable is not a floating point value
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the event
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Event_CreateForVariable(EVDS_OBJECT* object, EVDS_VARIABLE* variable, EVDS_REAL threshold,
+								 EVDS_Callback_Event* callback, void* userdata, EVDS_EVENT** p_event) {
+	EVDS_EVENT* event;
+	EVDS_REAL value;
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!variable) return EVDS_ERROR_BAD_PARAMETER;
+	if (variable->type != EVDS_VARIABLE_TYPE_FLOAT) return EVDS_ERROR_INVALID_TYPE;
+
+	event = (EVDS_EVENT*)malloc(sizeof(EVDS_EVENT));
+	if (!event) return EVDS_ERROR_MEMORY;
+	memset(event,0,sizeof(EVDS_EVENT));
+	event->object = object;
+	event->variable = variable;
+	event->threshold = threshold;
+	event->callback = callback;
+	event->userdata = userdata;
+
+	//Remember on which side of the threshold variable is now
+	EVDS_Variable_GetReal(variable,&value);
+	event->sign = EVDS_InternalEvent_Sign(value - threshold);
+	event->entry = SIMC_List_Append(object->events,event);
+
+	if (p_event) *p_event = event;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Event function for EVDS_Event_CreateForShadow()
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEvent_ShadowFunction(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, void* userdata, EVDS_REAL* value) {
+	EVDS_ENVIRONMENT_RADIATION radiation;
+	EVDS_ERRCHECK(EVDS_Environment_GetRadiationParameters(object->system,&state->position,&radiation));
+	*value = radiation.shadow_function;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create a new event for the object, which happens when it enters or leaves a shadow.
+///
+/// Event function is the shadow function of the radiation environment (see EVDS_ENVIRONMENT_RADIATION):
+/// the angular separation between center of the star and limb of the nearest occluder. Event
+/// happens when center of the star is eclipsed by a planet or appears from behind it, which
+/// lies in the middle of the penumbra.
+///
+/// Positions of the star and occluders remain fixed during the propagator step (see
+/// EVDS_Environment_GetRadiationParameters()), so the shadow function only depends on the state
+/// vector of the object and the moment of entry or exit is found precisely inside the step.
+///
+/// @param[in] object Object for which the event must be detected
+/// @param[in] callback Callback which is called when event happens (can be null)
+/// @param[in] userdata Pointer passed to callback
+/// @param[out] p_event Pointer to the new event will be written here (can be null)
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the event
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Event_CreateForShadow(EVDS_OBJECT* object, EVDS_Callback_Event* callback, void* userdata, EVDS_EVENT** p_event) {
+	return EVDS_Event_Create(object,EVDS_InternalEvent_ShadowFunction,callback,userdata,p_event);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove event from the object and free its memory.
+///
+/// @param[in] event Event to be removed
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "event" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Event_Destroy(EVDS_EVENT* event) {
+	if (!event) return EVDS_ERROR_BAD_PARAMETER;
+	SIMC_List_Remove(event->object->events,event->entry);
+	free(event);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate state of the object by delta_time, stopping exactly at events.
+///
+/// This function is used by propagators. The "step" callback must propagate the state vector
+/// by arbitrary time and must not keep any internal state between calls (the step may
+/// be repeated with a shorter time).
+///
+/// If object has no events, this function simply calls "step" once. Otherwise the step is
+/// performed, and if an event function changes sign during the step, the event time is found
+/// in the dense output using Brent's method. The step is then repeated up to the event time
+/// (which is corrected using the actually propagated state), event callback is called and
+/// the remaining part of the step is propagated in the same way.
+///
+/// Variable events are checked before the step starts.
+///
+/// @param[in] coordinate_system Propagator object
+/// @param[in] object Object which is being propagated
+/// @param[in,out] state Initial state of the object, final state will be written here
+/// @param[in] delta_time Time step
+/// @param[in] step Propagator step function
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "state" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "step" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Event_Propagate(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object, EVDS_STATE_VECTOR* state,
+						 EVDS_REAL delta_time, EVDS_Callback_PropagatorStep* step) {
+	int i,sign;
+	EVDS_REAL time;
+	EVDS_EVENT* event;
+	EVDS_STATE_VECTOR initial_state;
+	EVDS_STATE_VECTOR final_state;
+	SIMC_LIST_ENTRY* entry;
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!state) return EVDS_ERROR_BAD_PARAMETER;
+	if (!step) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Fast path: no events
+	entry = SIMC_List_GetFirst(object->events);
+	if (!entry) {
+		step(coordinate_system,object,state,delta_time);
+		return EVDS_OK;
+	}
+	SIMC_List_Stop(object->events,entry);
+
+	//Variable events
+	while (EVDS_InternalEvent_FindVariable(object,&event) == EVDS_OK) {
+		if (event->callback) event->callback(object,event,state,event->userdata);
+	}
+
+	//Propagate step by step, stopping at events
+	for (i = 0; i < EVDS_EVENT_MAX_PER_STEP; i++) {
+		EVDS_StateVector_Copy(&initial_state,state);
+		step(coordinate_system,object,state,delta_time);
+
+		//Check if any event happened
+		if (EVDS_InternalEvent_Find(object,&initial_state,state,delta_time,&event,&time,&sign) != EVDS_OK) {
+			return EVDS_OK;
+		}
+
+		//Repeat the step up to the event
+		EVDS_StateVector_Copy(&final_state,state);
+		EVDS_InternalEvent_Refine(coordinate_system,object,event,&initial_state,&final_state,state,
+			delta_time,&time,step);
+		event->sign = sign;
+		if (event->callback) event->callback(object,event,state,event->userdata);
+
+		//Propagate the remaining part of the step
+		delta_time -= time;
+		if (delta_time <= 0.0) return EVDS_OK;
+	}
+
+	//Too many events, finish step without detecting them
+	step(coordinate_system,object,state,delta_time);
+	return EVDS_OK;
+}
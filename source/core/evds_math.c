@@ -1071,9 +1071,62 @@ void EVDS_StateVector_Interpolate(EVDS_STATE_VECTOR* target, EVDS_STATE_VECTOR*
 	EVDS_Vector_Interpolate(&target->angular_velocity,&v1->angular_velocity,&v2->angular_velocity,t);
 	EVDS_Vector_Interpolate(&target->angular_acceleration,&v1->angular_acceleration,&v2->angular_acceleration,t);
 	EVDS_Quaternion_Interpolate(&target->orientation,&v1->orientation,&v2->orientation,t);
-	//FIXME: use slerp
+}
 
-	EVDS_Quaternion_Normalize(&target->orientation,&target->orientation);
+
+//Forward declaration
+void EVDS_InternalQuaternion_Squad(EVDS_QUATERNION* target, EVDS_QUATERNION* q1, EVDS_QUATERNION* q2,
+								   EVDS_VECTOR* w1, EVDS_VECTOR* w2, EVDS_REAL delta_time, EVDS_REAL t);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Interpolate between two state vectors using cubic Hermite spline.
+///
+/// Position is interpolated by a cubic polynomial which matches positions and velocities
+/// of both state vectors, velocity is the derivative of this polynomial:
+/// \f{eqnarray*}{
+///		\vec{r}(t) &=& (2t^3 - 3t^2 + 1) \vec{r}_1 + (t^3 - 2t^2 + t) \Delta t \vec{v}_1 +
+///						(-2t^3 + 3t^2) \vec{r}_2 + (t^3 - t^2) \Delta t \vec{v}_2 \\
+///		\vec{v}(t) &=& \frac{1}{\Delta t} \frac{d\vec{r}}{dt}
+/// \f}
+/// Orientation is interpolated by a spherical quadrangle curve which matches orientations
+/// and angular velocities of both state vectors (see EVDS_InternalQuaternion_Squad()).
+/// Remaining components are interpolated linearly (see EVDS_StateVector_Interpolate()).
+/// Time between state vectors \f$\Delta t\f$ is determined from their time.
+/// If both state vectors have the same time, linear interpolation is used.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_StateVector_InterpolateHermite(EVDS_STATE_VECTOR* target, EVDS_STATE_VECTOR* v1, EVDS_STATE_VECTOR* v2, EVDS_REAL t) {
+	EVDS_VECTOR position,velocity,difference;
+	EVDS_REAL t2,t3,dt;
+	if (t < 0.0) t = 0.0;
+	if (t > 1.0) t = 1.0;
+	t2 = t*t;
+	t3 = t2*t;
+	dt = (v2->time - v1->time)*86400.0;
+
+	//Interpolate everything linearly
+	EVDS_StateVector_Interpolate(target,v1,v2,t);
+	target->time = v1->time + (v2->time - v1->time)*t;
+	if (dt <= 0.0) return;
+
+	//Position along the cubic spline
+	EVDS_Vector_Multiply(&position,&v1->position,2*t3 - 3*t2 + 1);
+	EVDS_Vector_MultiplyAndAdd(&position,&position,&v2->position,-2*t3 + 3*t2);
+	EVDS_Vector_MultiplyByTimeAndAdd(&position,&position,&v1->velocity,(t3 - 2*t2 + t)*dt);
+	EVDS_Vector_MultiplyByTimeAndAdd(&position,&position,&v2->velocity,(t3 - t2)*dt);
+
+	//Velocity is derivative of the spline (difference of positions taken as a velocity-level vector)
+	EVDS_Vector_Subtract(&difference,&v2->position,&v1->position);
+	difference.derivative_level = EVDS_VECTOR_VELOCITY;
+	EVDS_Vector_Multiply(&velocity,&v1->velocity,3*t2 - 4*t + 1);
+	EVDS_Vector_MultiplyAndAdd(&velocity,&velocity,&v2->velocity,3*t2 - 2*t);
+	EVDS_Vector_MultiplyAndAdd(&velocity,&velocity,&difference,(6*t - 6*t2)/dt);
+
+	EVDS_Vector_Copy(&target->position,&position);
+	EVDS_Vector_Copy(&target->velocity,&velocity);
+
+	//Orientation along the spherical quadrangle curve
+	EVDS_InternalQuaternion_Squad(&target->orientation,&v1->orientation,&v2->orientation,
+		&v1->angular_velocity,&v2->angular_velocity,dt,t);
 }
 
 
@@ -1396,9 +1449,129 @@ void EVDS_Quaternion_MultiplyScalar(EVDS_QUATERNION* target, EVDS_QUATERNION* so
 
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Spherical quaternion interpolation.
+///
+/// Interpolates along the shortest arc between two orientations:
+/// \f[
+///		q(t) = \frac{\sin((1-t)\theta)}{\sin\theta} q_1 + \frac{\sin(t\theta)}{\sin\theta} q_2,
+///		\quad \cos\theta = q_1 \cdot q_2
+/// \f]
+/// If quaternions are almost equal, normalized linear interpolation is used instead.
+/// Both quaternions must be specified in the same coordinate system.
 ////////////////////////////////////////////////////////////////////////////////
 void EVDS_Quaternion_Interpolate(EVDS_QUATERNION* target, EVDS_QUATERNION* q1, EVDS_QUATERNION* q2, EVDS_REAL t) {
-	//FIXME
+	EVDS_REAL dot,theta,k1,k2,sign;
+	int i;
+
+	//Take the shortest path
+	dot = q1->q[0]*q2->q[0] + q1->q[1]*q2->q[1] + q1->q[2]*q2->q[2] + q1->q[3]*q2->q[3];
+	sign = 1.0;
+	if (dot < 0.0) {
+		dot = -dot;
+		sign = -1.0;
+	}
+
+	//Find interpolation coefficients
+	if (dot > 1.0 - 1e-9) {
+		k1 = 1.0 - t;
+		k2 = t;
+	} else {
+		theta = acos(dot);
+		k1 = sin((1.0-t)*theta)/sin(theta);
+		k2 = sin(t*theta)/sin(theta);
+	}
+
+	for (i = 0; i < 4; i++) {
+		target->q[i] = k1*q1->q[i] + sign*k2*q2->q[i];
+	}
+	target->coordinate_system = q1->coordinate_system;
+	EVDS_Quaternion_Normalize(target,target);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Quaternion logarithm (returns vector part, scalar part is zero).
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalQuaternion_Log(EVDS_REAL* v, EVDS_QUATERNION* q) {
+	EVDS_REAL s,k;
+	s = sqrt(q->q[1]*q->q[1] + q->q[2]*q->q[2] + q->q[3]*q->q[3]);
+	if (s < 1e-12) {
+		k = 1.0;
+	} else {
+		k = atan2(s,q->q[0])/s;
+	}
+	v[0] = k*q->q[1];
+	v[1] = k*q->q[2];
+	v[2] = k*q->q[3];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Quaternion exponent of a pure vector quaternion.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalQuaternion_Exp(EVDS_QUATERNION* target, EVDS_REAL* v) {
+	EVDS_REAL a,k;
+	a = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	if (a < 1e-12) {
+		k = 1.0;
+	} else {
+		k = sin(a)/a;
+	}
+	target->q[0] = cos(a);
+	target->q[1] = k*v[0];
+	target->q[2] = k*v[1];
+	target->q[3] = k*v[2];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Spherical quadrangle interpolation between two orientations with known angular velocities.
+///
+/// Inner control quaternions \f$a\f$, \f$b\f$ are chosen so the curve matches angular velocities
+/// \f$\omega_1\f$, \f$\omega_2\f$ at both ends (using the same convention as
+/// EVDS_StateVector_MultiplyByTimeAndAdd(), \f$\dot{q} = \frac{1}{2} q \cdot [0, \omega]\f$):
+/// \f{eqnarray*}{
+///		L &=& \log(q_1^{-1} q_2) \\
+///		a &=& q_1 \exp(\frac{1}{4} \omega_1 \Delta t - \frac{1}{2} L) \\
+///		b &=& q_2 \exp(\frac{1}{2} L - \frac{1}{4} \omega_2 \Delta t) \\
+///		q(t) &=& slerp(slerp(q_1,q_2,t),slerp(a,b,t),2t(1-t))
+/// \f}
+/// For a constant angular velocity \f$a = q_1\f$, \f$b = q_2\f$ and the result is exact.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalQuaternion_Squad(EVDS_QUATERNION* target, EVDS_QUATERNION* q1, EVDS_QUATERNION* q2,
+								   EVDS_VECTOR* w1, EVDS_VECTOR* w2, EVDS_REAL delta_time, EVDS_REAL t) {
+	EVDS_QUATERNION p,d,e,a,b,s1,s2;
+	EVDS_REAL L[3],v[3];
+	int i;
+
+	//Take the shortest path
+	EVDS_Quaternion_Copy(&p,q2);
+	if (q1->q[0]*p.q[0] + q1->q[1]*p.q[1] + q1->q[2]*p.q[2] + q1->q[3]*p.q[3] < 0.0) {
+		for (i = 0; i < 4; i++) p.q[i] = -p.q[i];
+	}
+
+	//Rotation over the interval
+	EVDS_Quaternion_MultiplyConjugatedQ(&d,q1,&p);
+	EVDS_InternalQuaternion_Log(L,&d);
+
+	//Inner control points
+	v[0] = 0.25*w1->x*delta_time - 0.5*L[0];
+	v[1] = 0.25*w1->y*delta_time - 0.5*L[1];
+	v[2] = 0.25*w1->z*delta_time - 0.5*L[2];
+	EVDS_InternalQuaternion_Exp(&e,v);
+	e.coordinate_system = q1->coordinate_system;
+	EVDS_Quaternion_Multiply(&a,q1,&e);
+
+	v[0] = 0.5*L[0] - 0.25*w2->x*delta_time;
+	v[1] = 0.5*L[1] - 0.25*w2->y*delta_time;
+	v[2] = 0.5*L[2] - 0.25*w2->z*delta_time;
+	EVDS_InternalQuaternion_Exp(&e,v);
+	e.coordinate_system = q1->coordinate_system;
+	EVDS_Quaternion_Multiply(&b,&p,&e);
+
+	//Interpolate
+	EVDS_Quaternion_Interpolate(&s1,q1,&p,t);
+	EVDS_Quaternion_Interpolate(&s2,&a,&b,t);
+	EVDS_Quaternion_Interpolate(target,&s1,&s2,2.0*t*(1.0-t));
 }
 
 
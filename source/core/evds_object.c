@@ -43,6 +43,9 @@ int EVDS_InternalCallback_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_O
 		EVDS_Object_Solve(child,delta_time);
 		entry = SIMC_List_GetNext(object->children,entry);
 	}
+
+	//All children are up to date
+	object->mass_dirty = 0;
 	return EVDS_OK;
 }
 
@@ -502,11 +505,14 @@ void EVDS_InternalThread_Initialize_Object(EVDS_OBJECT* object) {
 	if (EVDS_System_GetObjectsByType(object->system,object->type,&objects_list) == EVDS_OK) {
 		object->type_entry = SIMC_List_Append(objects_list,object);
 		object->type_list = objects_list;
+		EVDS_InternalObject_InvalidateGravity(object);
 	}
 
 	//Add to list of parent's children
 	if (object->parent) {		
 		object->parent_entry = SIMC_List_Append(object->parent->children,object);
+		EVDS_InternalObject_InvalidateChildren(object->parent);
+		EVDS_InternalObject_InvalidateMass(object->parent);
 	}
 }
 
@@ -570,6 +576,8 @@ void EVDS_InternalThread_Initialize_Object(EVDS_OBJECT* object) {
 ///
 /// @evds_st Always blocking, ignores value of "is_blocking"
 ///
+/// @note Initialization is always blocking in deterministic mode (see EVDS_System_SetDeterministic()).
+///
 /// @param[in] object Object to be initialized
 /// @param[in] is_blocking Should object block current threads execution with its initialization
 ///
@@ -583,7 +591,7 @@ int EVDS_Object_Initialize(EVDS_OBJECT* object, int is_blocking) {
 	if (object->initialized) return EVDS_ERROR_BAD_STATE;
 
 #ifndef EVDS_SINGLETHREADED
-	if (is_blocking) {
+	if (is_blocking || object->system->deterministic) {
 		EVDS_InternalThread_Initialize_Object(object);
 	} else {
 		object->create_thread = SIMC_THREAD_BAD_ID;
@@ -660,6 +668,11 @@ int EVDS_Object_Destroy(EVDS_OBJECT* object) {
 	if (object->parent && object->rparent_entry) SIMC_List_Remove(object->parent->raw_children,object->rparent_entry);
 	if (object->type_entry) SIMC_List_Remove(object->type_list,object->type_entry);
 #endif
+	if (object->parent && object->parent_entry) {
+		EVDS_InternalObject_InvalidateChildren(object->parent);
+		EVDS_InternalObject_InvalidateMass(object->parent);
+	}
+	if (object->type_entry) EVDS_InternalObject_InvalidateGravity(object);
 
 	//Request all children destroyed first (stop iteration so the raw children list will not be locked)
 	entry = SIMC_List_GetFirst(object->raw_children);
@@ -757,10 +770,18 @@ int EVDS_InternalObject_DestroyData(EVDS_OBJECT* object) {
 		}
 	}
 
+	//Destroy events
+	entry = SIMC_List_GetFirst(object->events);
+	while (entry) {
+		free(SIMC_List_GetData(object->events,entry));
+		entry = SIMC_List_GetNext(object->events,entry);
+	}
+
 	//Free resources
 	SIMC_List_Destroy(object->variables);
 	SIMC_List_Destroy(object->children);
 	SIMC_List_Destroy(object->raw_children);
+	SIMC_List_Destroy(object->events);
 	SIMC_SRW_Destroy(object->state_lock);
 	SIMC_SRW_Destroy(object->previous_state_lock);
 
@@ -818,6 +839,7 @@ int EVDS_InternalObject_DestroyData(EVDS_OBJECT* object) {
 int EVDS_Object_Create(EVDS_SYSTEM* system, EVDS_OBJECT* parent, EVDS_OBJECT** p_object)
 {
 	EVDS_OBJECT* object;
+	int i;
 	if (!system) return EVDS_ERROR_BAD_PARAMETER;
 	if (!p_object) return EVDS_ERROR_BAD_PARAMETER;
 
@@ -845,11 +867,15 @@ int EVDS_Object_Create(EVDS_SYSTEM* system, EVDS_OBJECT* parent, EVDS_OBJECT** p
 	object->previous_state_lock = SIMC_SRW_Create();
 #endif
 	object->uid = 100000+(system->uid_counter++); //FIXME: could it be more arbitrary
+	object->mass_dirty = 1;
+	object->gravity_dirty = 1;
+	object->active_generation = -1;
 
 	//Variables list
 	SIMC_List_Create(&object->variables,0);
 	SIMC_List_Create(&object->children,1);
 	SIMC_List_Create(&object->raw_children,1);
+	SIMC_List_Create(&object->events,1);
 
 	//Add to the list of objects, and add to parent
 	object->object_entry = SIMC_List_Append(system->objects,object);
@@ -868,6 +894,16 @@ int EVDS_Object_Create(EVDS_SYSTEM* system, EVDS_OBJECT* parent, EVDS_OBJECT** p
 		EVDS_StateVector_Initialize(&object->previous_state,object);
 		EVDS_StateVector_Initialize(&object->state,object);
 	}
+
+	//Objects start at system time (real time unless set by EVDS_System_SetTime())
+	EVDS_System_GetTime(system,&object->state.time);
+	object->previous_state.time = object->state.time;
+
+	//Dense output starts at the initial state
+	for (i = 0; i < EVDS_DENSE_OUTPUT_SIZE; i++) {
+		memcpy(&object->dense_output[i].start,&object->state,sizeof(EVDS_STATE_VECTOR));
+		memcpy(&object->dense_output[i].end,&object->state,sizeof(EVDS_STATE_VECTOR));
+	}
 	return EVDS_OK;
 }
 
@@ -1052,6 +1088,7 @@ int EVDS_Object_CopySingle(EVDS_OBJECT* source, EVDS_OBJECT* parent, EVDS_OBJECT
 	object->state.angular_velocity.coordinate_system = object->parent;
 	object->state.angular_acceleration.coordinate_system = object->parent;
 	//if (object->state.velocity.pcoordinate_system) object->state.velocity.pcoordinate_system = parent;
+	EVDS_InternalObject_PublishState(object,0);
 
 	//Copy variables
 	entry = SIMC_List_GetFirst(source->variables);
@@ -1299,6 +1336,7 @@ int EVDS_Object_SetCallback_OnSolve(EVDS_OBJECT* object, EVDS_Callback_Solve* p_
 #endif
 
 	object->solve = p_callback;
+	EVDS_InternalObject_InvalidateChildren(object);
 	return EVDS_OK;
 }
 
@@ -1320,6 +1358,7 @@ int EVDS_Object_SetCallback_OnIntegrate(EVDS_OBJECT* object, EVDS_Callback_Integ
 #endif
 
 	object->integrate = p_callback;
+	EVDS_InternalObject_InvalidateChildren(object);
 	return EVDS_OK;
 }
 
@@ -1517,6 +1556,24 @@ int EVDS_Object_AddVariable(EVDS_OBJECT* object, const char* name, EVDS_VARIABLE
 		variable->parent = 0;
 		variable->object = object;
 		variable->list_entry = SIMC_List_Append(object->variables,variable);
+
+		//Track changes to variables which define mass properties
+		variable->mass_property =
+			(strcmp(name,"mass") == 0) || (strcmp(name,"total_mass") == 0) ||
+			(strcmp(name,"cm") == 0) || (strcmp(name,"total_cm") == 0) ||
+			(strcmp(name,"jx") == 0) || (strcmp(name,"jy") == 0) || (strcmp(name,"jz") == 0) ||
+			(strcmp(name,"total_ix") == 0) || (strcmp(name,"total_iy") == 0) || (strcmp(name,"total_iz") == 0);
+
+		//Track changes to variables which define gravitational field (and built-in atmosphere, radiation)
+		variable->gravity_property =
+			(strcmp(name,"mass") == 0) || (strcmp(name,"geometry.radius") == 0) ||
+			(strcmp(name,"gravity.mu") == 0) || (strcmp(name,"gravity.j2") == 0) ||
+			(strcmp(name,"gravity.rs") == 0) || (strcmp(name,"gravitational_field") == 0) ||
+			(strcmp(name,"gravity.degree") == 0) || (strcmp(name,"gravity.tolerance") == 0) ||
+			(strcmp(name,"gravity.grid_altitude") == 0) || (strcmp(name,"gravity.grid_layers") == 0) ||
+			(strcmp(name,"gravity.grid_step") == 0) || (strncmp(name,"atmosphere.",11) == 0) ||
+			(strncmp(name,"radiation.",10) == 0);
+		if (variable->gravity_property) EVDS_InternalObject_InvalidateGravity(object);
 	}
 
 	//Write back variable
@@ -2124,6 +2181,8 @@ int EVDS_Object_SetParent(EVDS_OBJECT* object, EVDS_OBJECT* new_parent) {
 	if (object->parent && object->parent_entry) {
 		SIMC_List_GetFirst(object->parent->children);
 		SIMC_List_Remove(object->parent->children,object->parent_entry);
+		EVDS_InternalObject_InvalidateChildren(object->parent);
+		EVDS_InternalObject_InvalidateMass(object->parent);
 	}
 	if (object->parent && object->rparent_entry) {
 		SIMC_List_GetFirst(object->parent->raw_children);
@@ -2149,11 +2208,15 @@ int EVDS_Object_SetParent(EVDS_OBJECT* object, EVDS_OBJECT* new_parent) {
 		//FIXME: fix "parent_level" recursively in all objects
 
 	SIMC_SRW_LeaveRead(object->state_lock);
+	if (object->contains_planets) EVDS_InternalObject_MarkPlanet(new_parent);
+	EVDS_InternalObject_InvalidateState(object);
 
 	//Add object to new parents list
 	object->rparent_entry = SIMC_List_Append(new_parent->raw_children,object);
 	if (object->parent_entry) { //Object was listed amongst initialized children in old parent
 		object->parent_entry = SIMC_List_Append(new_parent->children,object);
+		EVDS_InternalObject_InvalidateChildren(new_parent);
+		EVDS_InternalObject_InvalidateMass(new_parent);
 	}
 	return EVDS_OK;
 }
@@ -2241,6 +2304,215 @@ int EVDS_Object_GetStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark mass properties of the object and all its parents as changed.
+///
+/// The entire chain of parents is always marked: objects whose solver does not aggregate
+/// mass properties never clear their flag, so a dirty object may have a clean parent.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_InvalidateMass(EVDS_OBJECT* object) {
+	while (object) {
+		object->mass_dirty = 1;
+		object = object->parent;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark structure of the object and all its parents as changed.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_InvalidateChildren(EVDS_OBJECT* object) {
+	while (object) {
+		object->children_generation++;
+		object = object->parent;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark public state of the object as changed.
+///
+/// Assigns a new state version to the object (unique within the system, and larger than
+/// any version assigned before). Invalidates all cached data which depends on positions of
+/// objects (for example positions of planets resolved by EVDS_Environment_GetGravitationalField()).
+///
+/// If the object is a planet or contains planets, data built from positions of all planets
+/// (such as the gravity tree) is invalidated as well.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_InvalidateState(EVDS_OBJECT* object) {
+#ifndef EVDS_SINGLETHREADED
+#	ifdef _WIN32
+	object->state_version = InterlockedIncrement(&object->system->state_generation);
+	if (object->contains_planets) InterlockedIncrement(&object->system->planet_generation);
+#	else
+	object->state_version = __sync_add_and_fetch(&object->system->state_generation,1);
+	if (object->contains_planets) __sync_fetch_and_add(&object->system->planet_generation,1);
+#	endif
+#else
+	object->state_version = ++object->system->state_generation;
+	if (object->contains_planets) object->system->planet_generation++;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark the object and all its parents as containing a planet.
+///
+/// Positions of planets change only when state of such objects changes. The mark is
+/// never removed, so an object which no longer contains planets only causes extra
+/// rebuilds of data built from positions of planets.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_MarkPlanet(EVDS_OBJECT* object) {
+	while (object && (!object->contains_planets)) {
+		object->contains_planets = 1;
+		object = object->parent;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get latest state version of the object and all its parents.
+///
+/// Position of the object in any other coordinates only changes when the returned version
+/// (or version of the target coordinates) changes. Must be read before the state itself,
+/// so a concurrent change is never missed.
+////////////////////////////////////////////////////////////////////////////////
+long EVDS_InternalObject_GetStateVersion(EVDS_OBJECT* object) {
+	long version = 0;
+	while (object) {
+		if (object->state_version > version) version = object->state_version;
+		object = object->parent;
+	}
+	return version;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark data of the object stored in snapshots as changed.
+///
+/// Must be called every time state vector, sleeping state or a variable of the object
+/// changes. Assigns a new version to the data of the object, incremental snapshots only
+/// copy objects whose version differs from their base snapshot (see EVDS_SNAPSHOT).
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_InvalidateSnapshot(EVDS_OBJECT* object) {
+#ifndef EVDS_SINGLETHREADED
+#	ifdef _WIN32
+	object->snapshot_version = InterlockedIncrement(&object->system->snapshot_version);
+#	else
+	object->snapshot_version = __sync_add_and_fetch(&object->system->snapshot_version,1);
+#	endif
+#else
+	object->snapshot_version = ++object->system->snapshot_version;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark parameters of the objects gravitational field as changed.
+///
+/// Cached gravity descriptor of the object is rebuilt on next use. If the object is a planet,
+/// data built from all planets (such as the gravity tree) is invalidated as well.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_InvalidateGravity(EVDS_OBJECT* object) {
+	object->gravity_dirty = 1;
+	if (strcmp(object->type,"planet") != 0) return;
+#ifndef EVDS_SINGLETHREADED
+#	ifdef _WIN32
+	InterlockedIncrement(&object->system->gravity_generation);
+#	else
+	__sync_fetch_and_add(&object->system->gravity_generation,1);
+#	endif
+#else
+	object->system->gravity_generation++;
+#endif
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Clear velocities and accelerations of the state vector (object at rest).
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_ClearMotion(EVDS_STATE_VECTOR* state) {
+	state->velocity.x = 0.0;
+	state->velocity.y = 0.0;
+	state->velocity.z = 0.0;
+	state->acceleration.x = 0.0;
+	state->acceleration.y = 0.0;
+	state->acceleration.z = 0.0;
+	state->angular_velocity.x = 0.0;
+	state->angular_velocity.y = 0.0;
+	state->angular_velocity.z = 0.0;
+	state->angular_acceleration.x = 0.0;
+	state->angular_acceleration.y = 0.0;
+	state->angular_acceleration.z = 0.0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Publish latest state vector into the dense output ring buffer.
+///
+/// If the step is continuous (state vector was advanced in time within the same coordinate
+/// system), the segment spans from previous state vector to the current one. Otherwise the
+/// segment only contains the current state vector.
+///
+/// State vector may be changed from any thread (for example by EVDS_Object_SetPosition()),
+/// so writers are serialized by the state lock. Readers never take the lock, they retry
+/// reading a segment if it was changed while being read.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_PublishState(EVDS_OBJECT* object, int continuous) {
+	unsigned int index;
+	EVDS_DENSE_OUTPUT_SEGMENT* segment;
+
+	//Only one writer may publish at a time
+	SIMC_SRW_EnterWrite(object->state_lock);
+	index = (object->dense_output_head + 1) % EVDS_DENSE_OUTPUT_SIZE;
+	segment = &object->dense_output[index];
+
+	//Check if segment can start from the previous state
+	if ((object->previous_state.time >= object->state.time) ||
+		(object->previous_state.position.coordinate_system != object->state.position.coordinate_system)) {
+		continuous = 0;
+	}
+
+	//Write the segment (sequence is odd while writing)
+	segment->sequence++;
+	EVDS_MEMORY_BARRIER();
+	if (continuous) {
+		memcpy(&segment->start,&object->previous_state,sizeof(EVDS_STATE_VECTOR));
+	} else {
+		memcpy(&segment->start,&object->state,sizeof(EVDS_STATE_VECTOR));
+	}
+	memcpy(&segment->end,&object->state,sizeof(EVDS_STATE_VECTOR));
+
+	//Sleeping objects do not move during the segment
+	if (object->sleeping) {
+		EVDS_InternalObject_ClearMotion(&segment->start);
+		EVDS_InternalObject_ClearMotion(&segment->end);
+	}
+	EVDS_MEMORY_BARRIER();
+	segment->sequence++;
+	object->dense_output_head = index;
+	SIMC_SRW_LeaveWrite(object->state_lock);
+
+	//Data cached for the previous state is no longer valid
+	EVDS_InternalObject_InvalidateState(object);
+	EVDS_InternalObject_InvalidateSnapshot(object);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Read a copy of dense output segment without locking.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalObject_ReadDenseOutput(EVDS_OBJECT* object, unsigned int index, EVDS_DENSE_OUTPUT_SEGMENT* segment) {
+	unsigned int sequence;
+	do {
+		sequence = object->dense_output[index].sequence;
+		EVDS_MEMORY_BARRIER();
+		memcpy(segment,(void*)&object->dense_output[index],sizeof(EVDS_DENSE_OUTPUT_SEGMENT));
+		EVDS_MEMORY_BARRIER();
+	} while ((sequence & 1) || (sequence != object->dense_output[index].sequence));
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Set state vector of an object.
 ///
@@ -2254,6 +2526,8 @@ int EVDS_Object_GetStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
 /// @note No automatic conversion is performed. The state vector must be correctly defined
 ///       when passed into this function.
 ///
+/// Sleeping object is woken up when its state vector is set (unless object is static).
+///
 /// Example of use:
 /// ~~~{.c}
 ///		EVDS_STATE_VECTOR state;
@@ -2285,6 +2559,19 @@ int EVDS_Object_SetStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
 	EVDS_ASSERT(vector->angular_velocity.coordinate_system == object->parent);
 	EVDS_ASSERT(vector->angular_acceleration.coordinate_system == object->parent);
 
+	//Sleeping objects are woken up when state is changed
+	if (object->sleeping && (!object->is_static)) {
+		object->sleeping = 0;
+		object->quiet_time = 0.0;
+	}
+
+	//Moving the object changes mass properties of its parent
+	if (object->parent &&
+		(memcmp(&object->state.position.x,&vector->position.x,3*sizeof(EVDS_REAL)) ||
+		 memcmp(object->state.orientation.q,vector->orientation.q,4*sizeof(EVDS_REAL)))) {
+		EVDS_InternalObject_InvalidateMass(object->parent);
+	}
+
 	//Set previous state vector
 	SIMC_SRW_EnterWrite(object->state_lock);
 	SIMC_SRW_EnterRead(object->previous_state_lock);
@@ -2314,6 +2601,9 @@ int EVDS_Object_SetStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
 #ifndef EVDS_SINGLETHREADED
 	memcpy(&object->private_state,vector,sizeof(EVDS_STATE_VECTOR)); //FIXME: this must be locked!!
 #endif
+
+	//Publish dense output for interpolation
+	EVDS_InternalObject_PublishState(object,1);
 	return EVDS_OK;
 }
 
@@ -2338,6 +2628,230 @@ int EVDS_InternalObject_SetPrivateStateVector(EVDS_OBJECT* object, EVDS_STATE_VE
 #endif
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Put object to sleep.
+///
+/// Sleeping objects are skipped by propagators: their state vector is not integrated (only
+/// its time is advanced, see EVDS_Object_AdvanceSleeping()),
+/// which makes them free of cost per step. Objects are still solved (EVDS_Object_Solve()),
+/// so their children may wake them up.
+///
+/// Object is woken up by EVDS_Object_Wake() (for example when a rocket engine produces
+/// thrust), or when its state vector is changed with EVDS_Object_SetStateVector().
+///
+/// Objects may also fall asleep automatically, see EVDS_System_SetSleepThresholds().
+///
+/// @param[in] object Pointer to object
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_Sleep(EVDS_OBJECT* object) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+	object->sleeping = 1;
+	EVDS_InternalObject_InvalidateSnapshot(object);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Wake up object and all of its parents.
+///
+/// Must be called by any object that starts applying force to its parent (parents
+/// are woken up as well). Static objects remain sleeping.
+///
+/// @param[in] object Pointer to object
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_Wake(EVDS_OBJECT* object) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+	while (object) {
+		if ((object->sleeping && (!object->is_static)) || (object->quiet_time != 0.0)) {
+			EVDS_InternalObject_InvalidateSnapshot(object);
+		}
+		if (!object->is_static) object->sleeping = 0;
+		object->quiet_time = 0.0;
+		object = object->parent;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if object is sleeping.
+///
+/// @param[in] object Pointer to object
+/// @param[out] is_sleeping 1 will be written here if object is sleeping, 0 otherwise
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "is_sleeping" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_IsSleeping(EVDS_OBJECT* object, int* is_sleeping) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!is_sleeping) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+	*is_sleeping = object->sleeping;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Mark object as static.
+///
+/// Static objects never move and always sleep (EVDS_Object_Wake() does not affect them).
+/// Their state vector may still be changed with EVDS_Object_SetStateVector().
+///
+/// @param[in] object Pointer to object
+/// @param[in] is_static 1 if object is static, 0 otherwise
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_SetStatic(EVDS_OBJECT* object, int is_static) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+	if (object->is_static == is_static) return EVDS_OK;
+	object->is_static = is_static;
+	object->sleeping = is_static;
+	object->quiet_time = 0.0;
+	EVDS_InternalObject_InvalidateSnapshot(object);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Declare that forces and torques of the object do not depend on parent state.
+///
+/// If forces and torques returned by the objects integration callback only depend on the
+/// state computed during EVDS_Object_Solve() (for example thrust of a rocket engine), the
+/// parent rigid body will evaluate them once per step and reuse the result for every stage
+/// of the integrator, instead of calling EVDS_Object_Integrate() for each stage.
+///
+/// The callback must not depend on the state vector passed into the parents integration
+/// callback, otherwise the results will be incorrect.
+///
+/// @param[in] object Pointer to object
+/// @param[in] is_independent 1 if forces do not depend on parent state, 0 otherwise
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_SetStateIndependent(EVDS_OBJECT* object, int is_independent) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+	if (object->state_independent == is_independent) return EVDS_OK;
+	object->state_independent = is_independent;
+	EVDS_InternalObject_InvalidateChildren(object);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Update automatic sleeping state of the object.
+///
+/// Must be called by propagators after object state was propagated by delta_time. If
+/// velocity, angular velocity and acceleration in the new state remain under the thresholds
+/// (see EVDS_System_SetSleepThresholds()) for long enough, object falls asleep.
+///
+/// @param[in] object Pointer to object
+/// @param[in] state New state of the object
+/// @param[in] delta_time Time step
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "state" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_UpdateSleeping(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, EVDS_REAL delta_time) {
+	EVDS_REAL v2,w2,a2;
+	EVDS_SYSTEM* system;
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!state) return EVDS_ERROR_BAD_PARAMETER;
+	system = object->system;
+	if (system->sleep_time <= 0.0) return EVDS_OK;
+
+	//Check if object is quiet
+	EVDS_Vector_Dot(&v2,&state->velocity,&state->velocity);
+	EVDS_Vector_Dot(&w2,&state->angular_velocity,&state->angular_velocity);
+	EVDS_Vector_Dot(&a2,&state->acceleration,&state->acceleration);
+	if ((v2 <= system->sleep_velocity*system->sleep_velocity) &&
+		(w2 <= system->sleep_angular_velocity*system->sleep_angular_velocity) &&
+		(a2 <= system->sleep_acceleration*system->sleep_acceleration)) {
+		object->quiet_time += delta_time;
+		if (object->quiet_time >= system->sleep_time) object->sleeping = 1;
+		EVDS_InternalObject_InvalidateSnapshot(object);
+	} else if (object->quiet_time != 0.0) {
+		object->quiet_time = 0.0;
+		EVDS_InternalObject_InvalidateSnapshot(object);
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Advance time of a sleeping object by one step.
+///
+/// Must be called by propagators for every sleeping object instead of propagating it.
+/// The object stays at rest, but its state vector time follows the rest of the system,
+/// so the object continues from the current time once it is woken up. The step is
+/// published into dense output as an interval during which the object is at rest.
+///
+/// @param[in] object Pointer to object
+/// @param[in] delta_time Time step
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_AdvanceSleeping(EVDS_OBJECT* object, EVDS_REAL delta_time) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+#endif
+
+	//Previous state is the same state at the start of the step
+	SIMC_SRW_EnterWrite(object->state_lock);
+	SIMC_SRW_EnterRead(object->previous_state_lock);
+	memcpy(&object->previous_state,&object->state,sizeof(EVDS_STATE_VECTOR));
+	SIMC_SRW_LeaveRead(object->previous_state_lock);
+	object->state.time += delta_time / 86400.0;
+	SIMC_SRW_LeaveWrite(object->state_lock);
+#ifndef EVDS_SINGLETHREADED
+	object->private_state.time = object->state.time;
+#endif
+
+	//Publish dense output for interpolation
+	EVDS_InternalObject_PublishState(object,1);
+	return EVDS_OK;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Set userdata pointer.
 ///
@@ -2495,6 +3009,8 @@ int EVDS_InternalObject_SetPosition(EVDS_OBJECT* object, int use_cm, EVDS_OBJECT
 		object->state.position.pcoordinate_system = 0;
 		object->state.position.vcoordinate_system = 0;
 	SIMC_SRW_LeaveWrite(object->state_lock);
+	EVDS_InternalObject_PublishState(object,0);
+	EVDS_InternalObject_InvalidateMass(object->parent);
 	return EVDS_OK;
 }
 
@@ -2527,6 +3043,7 @@ int EVDS_InternalObject_SetVelocity(EVDS_OBJECT* object, int use_cm, EVDS_OBJECT
 		object->state.velocity.pcoordinate_system = 0;
 		object->state.velocity.vcoordinate_system = 0;
 	SIMC_SRW_LeaveWrite(object->state_lock);
+	EVDS_InternalObject_PublishState(object,0);
 	return EVDS_OK;
 }
 
@@ -2546,6 +3063,7 @@ int EVDS_InternalObject_SetAngularVelocity(EVDS_OBJECT* object, EVDS_OBJECT* tar
 		object->state.angular_velocity.pcoordinate_system = 0;
 		object->state.angular_velocity.vcoordinate_system = 0;
 	SIMC_SRW_LeaveWrite(object->state_lock);
+	EVDS_InternalObject_PublishState(object,0);
 	return EVDS_OK;
 }
 
@@ -2557,6 +3075,8 @@ int EVDS_InternalObject_SetOrientationQuaternion(EVDS_OBJECT* object, int use_cm
 	SIMC_SRW_EnterWrite(object->state_lock);
 		EVDS_Quaternion_Convert(&object->state.orientation,q,object->parent);
 	SIMC_SRW_LeaveWrite(object->state_lock);
+	EVDS_InternalObject_PublishState(object,0);
+	EVDS_InternalObject_InvalidateMass(object->parent);
 	return EVDS_OK;
 }
 
@@ -2877,6 +3397,7 @@ int EVDS_Object_SetStateTime(EVDS_OBJECT* object, double mjd_time) {
 	SIMC_SRW_EnterWrite(object->state_lock);
 	object->state.time = mjd_time;
 	SIMC_SRW_LeaveWrite(object->state_lock);
+	EVDS_InternalObject_PublishState(object,0);
 	return EVDS_OK;
 }
 
@@ -2920,9 +3441,15 @@ int EVDS_Object_GetPreviousStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* v
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief Get a state vector linearly interpolated between current and previous state vectors.
+/// @brief Get a state vector interpolated along the last step of the object.
+///
+/// This can be used for computing smooth object positions between two physics steps.
+/// The state vector is interpolated along a cubic Hermite spline for position and
+/// velocity, and along a spherical quadrangle curve for orientation (see
+/// EVDS_StateVector_InterpolateHermite()).
 ///
-/// This can be used for computing object positions linearly interpolated between two points.
+/// This function does not take the state lock and can be called from rendering or
+/// telemetry threads while object is being propagated.
 ///
 /// Example of use:
 /// ~~~{.c}
@@ -2941,40 +3468,133 @@ int EVDS_Object_GetPreviousStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* v
 /// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_Object_GetInterpolatedStateVector(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector, EVDS_REAL t) {
-	EVDS_STATE_VECTOR v1,v2;
+	EVDS_DENSE_OUTPUT_SEGMENT segment;
 	if (!object) return EVDS_ERROR_BAD_PARAMETER;
 	if (!vector) return EVDS_ERROR_BAD_PARAMETER;
 #ifndef EVDS_SINGLETHREADED
 	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
 
-	EVDS_Object_GetPreviousStateVector(object,&v1);
-	EVDS_Object_GetStateVector(object,&v2);
-	EVDS_StateVector_Interpolate(vector,&v1,&v2,t);
+	EVDS_InternalObject_ReadDenseOutput(object,object->dense_output_head,&segment);
+	EVDS_StateVector_InterpolateHermite(vector,&segment.start,&segment.end,t);
 	return EVDS_OK;
 }
 
-/*int EVDS_Object_StartRendering(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get a state vector interpolated at the given time.
+///
+/// The state vector is evaluated from the dense output of the last few steps of the object
+/// (see EVDS_Object_GetInterpolatedStateVector()). Time is clamped to the interval covered
+/// by the dense output: if time is past the last step, latest state vector is returned.
+///
+/// This function does not take the state lock and can be called from rendering or
+/// telemetry threads while object is being propagated.
+///
+/// Example of use:
+/// ~~~{.c}
+///		EVDS_STATE_VECTOR state;
+///		EVDS_Object_GetStateVectorAtTime(object,render_mjd,&state);
+/// ~~~
+///
+/// @param[in] object Pointer to object
+/// @param[in] mjd_time Time (MJD) at which state vector must be evaluated
+/// @param[out] vector State vector will be copied by this pointer
+///
+/// @returns Error code, a copy of state vector
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "vector" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_GetStateVectorAtTime(EVDS_OBJECT* object, double mjd_time, EVDS_STATE_VECTOR* vector) {
+	EVDS_DENSE_OUTPUT_SEGMENT segment;
+	unsigned int head,i;
+	EVDS_REAL t;
 	if (!object) return EVDS_ERROR_BAD_PARAMETER;
 	if (!vector) return EVDS_ERROR_BAD_PARAMETER;
 #ifndef EVDS_SINGLETHREADED
 	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
 
+	//Find latest segment that starts before the given time (or the oldest one)
+	head = object->dense_output_head;
+	for (i = 0; i < EVDS_DENSE_OUTPUT_SIZE; i++) {
+		EVDS_InternalObject_ReadDenseOutput(object,(head + EVDS_DENSE_OUTPUT_SIZE - i) % EVDS_DENSE_OUTPUT_SIZE,&segment);
+		if (mjd_time >= segment.start.time) break;
+	}
+
+	//Evaluate state vector in the segment
+	if (segment.end.time > segment.start.time) {
+		t = (mjd_time - segment.start.time) / (segment.end.time - segment.start.time);
+	} else {
+		t = 1.0;
+	}
+	EVDS_StateVector_InterpolateHermite(vector,&segment.start,&segment.end,t);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Start rendering object from the given state vector.
+///
+/// All coordinate conversions performed in the calling thread will use the given state
+/// vector for this object instead of its current state vector, until EVDS_Object_EndRendering()
+/// is called. This allows rendering threads to draw the entire hierarchy at an interpolated
+/// state:
+/// ~~~{.c}
+///		EVDS_STATE_VECTOR state;
+///		EVDS_Object_GetStateVectorAtTime(object,render_mjd,&state);
+///		EVDS_Object_StartRendering(object,&state);
+///		//...convert and draw...
+///		EVDS_Object_EndRendering(object);
+/// ~~~
+///
+/// @note Only one thread can render an object at once.
+///
+/// @param[in] object Pointer to object
+/// @param[in] vector State vector from which object must be rendered
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "vector" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Object_StartRendering(EVDS_OBJECT* object, EVDS_STATE_VECTOR* vector) {
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!vector) return EVDS_ERROR_BAD_PARAMETER;
+#ifndef EVDS_SINGLETHREADED
+	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+
 	memcpy(&object->render_state,vector,sizeof(EVDS_STATE_VECTOR));
 	object->render_thread = SIMC_Thread_GetUniqueID();
+#endif
 	return EVDS_OK;
 }
 
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief End rendering object.
+///
+/// See EVDS_Object_StartRendering().
+///
+/// @param[in] object Pointer to object
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "object" is null
+/// @retval EVDS_ERROR_INVALID_OBJECT Object was destroyed
+////////////////////////////////////////////////////////////////////////////////
 int EVDS_Object_EndRendering(EVDS_OBJECT* object) {
 	if (!object) return EVDS_ERROR_BAD_PARAMETER;
 #ifndef EVDS_SINGLETHREADED
 	if (object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
-#endif
 
 	object->render_thread = SIMC_THREAD_BAD_ID;
+#endif
 	return EVDS_OK;
-}*/
+}
 
 
 ////////////////////////////////////////////////////////////////////////////////
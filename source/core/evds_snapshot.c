@@ -0,0 +1,418 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include "evds.h"
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Collect all mutable variables from the list (recursively).
+///
+/// If "variables" is null, variables are only counted.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSnapshot_CollectVariables(SIMC_LIST* list, EVDS_VARIABLE** variables, int* count, size_t* size) {
+	SIMC_LIST_ENTRY* entry;
+	if (!list) return;
+
+	entry = SIMC_List_GetFirst(list);
+	while (entry) {
+		EVDS_VARIABLE* variable = (EVDS_VARIABLE*)SIMC_List_GetData(list,entry);
+		if ((variable->type == EVDS_VARIABLE_TYPE_FLOAT) ||
+			(variable->type == EVDS_VARIABLE_TYPE_VECTOR) ||
+			(variable->type == EVDS_VARIABLE_TYPE_QUATERNION)) {
+			if (variables) variables[*count] = variable;
+			*count = *count + 1;
+			*size = *size + variable->value_size;
+		}
+		EVDS_InternalSnapshot_CollectVariables(variable->list,variables,count,size);
+		entry = SIMC_List_GetNext(list,entry);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Read current state of the object into snapshot object state
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSnapshot_ReadObjectState(EVDS_OBJECT* object, EVDS_SNAPSHOT_OBJECT_STATE* object_state) {
+	memset(object_state,0,sizeof(EVDS_SNAPSHOT_OBJECT_STATE)); //Clear padding
+	SIMC_SRW_EnterRead(object->state_lock);
+	memcpy(&object_state->state,&object->state,sizeof(EVDS_STATE_VECTOR));
+	SIMC_SRW_LeaveRead(object->state_lock);
+	object_state->quiet_time = object->quiet_time;
+	object_state->sleeping = object->sleeping;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Write block (state of the object is already read)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSnapshot_WriteBlock(EVDS_SNAPSHOT* snapshot, EVDS_SNAPSHOT_BLOCK* block,
+									  EVDS_SNAPSHOT_OBJECT_STATE* object_state, unsigned char* data) {
+	int i;
+	memcpy(data,object_state,sizeof(EVDS_SNAPSHOT_OBJECT_STATE));
+	data += sizeof(EVDS_SNAPSHOT_OBJECT_STATE);
+
+	for (i = block->first_variable; i < block->first_variable + block->variable_count; i++) {
+		EVDS_VARIABLE* variable = snapshot->variables[i];
+		memcpy(data,variable->value,variable->value_size);
+		data += variable->value_size;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Restore object from the block
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSnapshot_ReadBlock(EVDS_SNAPSHOT* snapshot, EVDS_SNAPSHOT_BLOCK* block, unsigned char* data) {
+	int i;
+	EVDS_OBJECT* object = block->object;
+	EVDS_SNAPSHOT_OBJECT_STATE* object_state = (EVDS_SNAPSHOT_OBJECT_STATE*)data;
+
+	//Restore state vector (previous state is reset, interpolation must not cross the rollback)
+	SIMC_SRW_EnterWrite(object->state_lock);
+	SIMC_SRW_EnterWrite(object->previous_state_lock);
+		memcpy(&object->state,&object_state->state,sizeof(EVDS_STATE_VECTOR));
+		memcpy(&object->previous_state,&object_state->state,sizeof(EVDS_STATE_VECTOR));
+	SIMC_SRW_LeaveWrite(object->previous_state_lock);
+	SIMC_SRW_LeaveWrite(object->state_lock);
+#ifndef EVDS_SINGLETHREADED
+	memcpy(&object->private_state,&object_state->state,sizeof(EVDS_STATE_VECTOR));
+#endif
+	object->quiet_time = object_state->quiet_time;
+	object->sleeping = object_state->sleeping;
+	EVDS_InternalObject_PublishState(object,0);
+
+	//Restore variables
+	data += sizeof(EVDS_SNAPSHOT_OBJECT_STATE);
+	for (i = block->first_variable; i < block->first_variable + block->variable_count; i++) {
+		EVDS_VARIABLE* variable = snapshot->variables[i];
+		if (memcmp(variable->value,data,variable->value_size)) {
+			//Restored values invalidate data cached from them
+			if (variable->mass_property) EVDS_InternalObject_InvalidateMass(object);
+			if (variable->gravity_property) EVDS_InternalObject_InvalidateGravity(object);
+			memcpy(variable->value,data,variable->value_size);
+		}
+		data += variable->value_size;
+	}
+
+	//Object data is same as when the block was saved
+	object->snapshot_version = block->version;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create new snapshot of the system.
+///
+/// Snapshot stores state vectors, sleeping state and values of all floating point, vector and
+/// quaternion variables of all initialized objects in the system. Layout of the snapshot is
+/// computed here, and a single contiguous buffer is preallocated for all the data. The snapshot
+/// is empty until EVDS_System_Snapshot() is called. String variables are not stored (see
+/// EVDS_SNAPSHOT).
+///
+/// Snapshot can be saved and restored any number of times, but it must be recreated if objects
+/// were created, initialized or destroyed in the system after it was created.
+///
+/// Example of use:
+/// ~~~{.c}
+///		EVDS_SNAPSHOT* snapshot;
+///		EVDS_Snapshot_Create(system,&snapshot);
+///		EVDS_System_Snapshot(system,snapshot);
+///		for (i = 0; i < 100; i++) EVDS_Object_Solve(propagator,0.1); //Predict
+///		EVDS_System_Restore(system,snapshot); //Rollback
+/// ~~~
+///
+/// @param[in] system Pointer to system
+/// @param[out] p_snapshot Pointer to the new snapshot will be written here
+///
+/// @returns Error code, pointer to snapshot
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "p_snapshot" is null
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the snapshot
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Snapshot_Create(EVDS_SYSTEM* system, EVDS_SNAPSHOT** p_snapshot) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_SNAPSHOT* snapshot;
+	int block_count,variable_count;
+	size_t size;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_snapshot) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Compute size of the snapshot
+	block_count = 0;
+	variable_count = 0;
+	size = 0;
+	entry = SIMC_List_GetFirst(system->objects);
+	while (entry) {
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(system->objects,entry);
+		if (object->initialized) {
+			block_count++;
+			size += sizeof(EVDS_SNAPSHOT_OBJECT_STATE);
+			EVDS_InternalSnapshot_CollectVariables(object->variables,0,&variable_count,&size);
+		}
+		entry = SIMC_List_GetNext(system->objects,entry);
+	}
+
+	//Create snapshot
+	snapshot = (EVDS_SNAPSHOT*)malloc(sizeof(EVDS_SNAPSHOT));
+	*p_snapshot = snapshot;
+	if (!snapshot) return EVDS_ERROR_MEMORY;
+	memset(snapshot,0,sizeof(EVDS_SNAPSHOT));
+	snapshot->system = system;
+	snapshot->size = size;
+
+	//Preallocate memory
+	snapshot->blocks = (EVDS_SNAPSHOT_BLOCK*)malloc(sizeof(EVDS_SNAPSHOT_BLOCK)*(block_count+1));
+	snapshot->variables = (EVDS_VARIABLE**)malloc(sizeof(EVDS_VARIABLE*)*(variable_count+1));
+	snapshot->buffer = (unsigned char*)malloc(size+1);
+	if ((!snapshot->blocks) || (!snapshot->variables) || (!snapshot->buffer)) {
+		EVDS_Snapshot_Destroy(snapshot);
+		*p_snapshot = 0;
+		return EVDS_ERROR_MEMORY;
+	}
+
+	//Compute layout
+	size = 0;
+	entry = SIMC_List_GetFirst(system->objects);
+	while (entry) {
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(system->objects,entry);
+		if (object->initialized && (snapshot->block_count < block_count)) {
+			EVDS_SNAPSHOT_BLOCK* block = &snapshot->blocks[snapshot->block_count++];
+			block->object = object;
+			block->offset = size;
+			block->first_variable = snapshot->variable_count;
+			block->data = snapshot->buffer + block->offset;
+
+			size += sizeof(EVDS_SNAPSHOT_OBJECT_STATE);
+			EVDS_InternalSnapshot_CollectVariables(object->variables,snapshot->variables,&snapshot->variable_count,&size);
+			block->variable_count = snapshot->variable_count - block->first_variable;
+			block->size = size - block->offset;
+		}
+		entry = SIMC_List_GetNext(system->objects,entry);
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create new incremental snapshot.
+///
+/// Incremental snapshot has the same layout as the base snapshot. When it is saved, only data of
+/// objects which differ from the base snapshot is copied; data of all other objects is shared with
+/// the base snapshot (copy-on-write). This makes repeated checkpoints cheap when most of the
+/// system is unchanged since the base snapshot was saved.
+///
+/// Base snapshot must be a full snapshot. It must not be destroyed before the incremental snapshot.
+/// If base snapshot is saved again, incremental snapshot becomes invalid until it is saved again.
+///
+/// @param[in] base Base snapshot (created by EVDS_Snapshot_Create())
+/// @param[out] p_snapshot Pointer to the new snapshot will be written here
+///
+/// @returns Error code, pointer to snapshot
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "base" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "p_snapshot" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "base" is an incremental snapshot
+/// @retval EVDS_ERROR_MEMORY Could not allocate memory for the snapshot
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Snapshot_CreateIncremental(EVDS_SNAPSHOT* base, EVDS_SNAPSHOT** p_snapshot) {
+	int i;
+	EVDS_SNAPSHOT* snapshot;
+	if (!base) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_snapshot) return EVDS_ERROR_BAD_PARAMETER;
+	if (base->base) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Create snapshot
+	snapshot = (EVDS_SNAPSHOT*)malloc(sizeof(EVDS_SNAPSHOT));
+	*p_snapshot = snapshot;
+	if (!snapshot) return EVDS_ERROR_MEMORY;
+	memset(snapshot,0,sizeof(EVDS_SNAPSHOT));
+	snapshot->system = base->system;
+	snapshot->base = base;
+	snapshot->size = base->size;
+
+	//Copy layout of the base snapshot
+	snapshot->blocks = (EVDS_SNAPSHOT_BLOCK*)malloc(sizeof(EVDS_SNAPSHOT_BLOCK)*(base->block_count+1));
+	snapshot->variables = (EVDS_VARIABLE**)malloc(sizeof(EVDS_VARIABLE*)*(base->variable_count+1));
+	snapshot->buffer = (unsigned char*)malloc(base->size+1);
+	if ((!snapshot->blocks) || (!snapshot->variables) || (!snapshot->buffer)) {
+		EVDS_Snapshot_Destroy(snapshot);
+		*p_snapshot = 0;
+		return EVDS_ERROR_MEMORY;
+	}
+	memcpy(snapshot->blocks,base->blocks,sizeof(EVDS_SNAPSHOT_BLOCK)*base->block_count);
+	memcpy(snapshot->variables,base->variables,sizeof(EVDS_VARIABLE*)*base->variable_count);
+	snapshot->block_count = base->block_count;
+	snapshot->variable_count = base->variable_count;
+	for (i = 0; i < snapshot->block_count; i++) {
+		snapshot->blocks[i].data = snapshot->buffer + snapshot->blocks[i].offset;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy snapshot.
+///
+/// @param[in] snapshot Snapshot to destroy
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "snapshot" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Snapshot_Destroy(EVDS_SNAPSHOT* snapshot) {
+	if (!snapshot) return EVDS_ERROR_BAD_PARAMETER;
+	if (snapshot->blocks) free(snapshot->blocks);
+	if (snapshot->variables) free(snapshot->variables);
+	if (snapshot->buffer) free(snapshot->buffer);
+	free(snapshot);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get size of data stored in the snapshot.
+///
+/// For full snapshots this is size of the entire buffer. For incremental snapshots this
+/// is the size of data which differed from the base snapshot when it was saved.
+///
+/// @param[in] snapshot Snapshot
+/// @param[out] size Size of the data in bytes will be written here
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "snapshot" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "size" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Snapshot_GetSize(EVDS_SNAPSHOT* snapshot, size_t* size) {
+	if (!snapshot) return EVDS_ERROR_BAD_PARAMETER;
+	if (!size) return EVDS_ERROR_BAD_PARAMETER;
+	*size = snapshot->stored_size;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Save state of the system into the snapshot.
+///
+/// Copies state vectors and all mutable variables of the objects into the preallocated buffer
+/// of the snapshot. No memory is allocated by this call. System must not be solved while
+/// the snapshot is being saved.
+///
+/// Incremental snapshot only copies objects which were changed since the base snapshot was
+/// saved. Objects are marked as changed by all functions which write their state vector,
+/// sleeping state or variables, so unchanged objects are skipped without reading their data.
+///
+/// @param[in] system Pointer to system
+/// @param[in] snapshot Snapshot created for this system
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "snapshot" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER Snapshot was created for a different system
+/// @retval EVDS_ERROR_BAD_STATE Base snapshot of the incremental snapshot was never saved
+/// @retval EVDS_ERROR_INVALID_OBJECT One of the objects in the snapshot was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_Snapshot(EVDS_SYSTEM* system, EVDS_SNAPSHOT* snapshot) {
+	int i;
+	EVDS_SNAPSHOT_OBJECT_STATE object_state;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!snapshot) return EVDS_ERROR_BAD_PARAMETER;
+	if (snapshot->system != system) return EVDS_ERROR_BAD_PARAMETER;
+	if (snapshot->base && (!snapshot->base->saved)) return EVDS_ERROR_BAD_STATE;
+#ifndef EVDS_SINGLETHREADED
+	for (i = 0; i < snapshot->block_count; i++) {
+		if (snapshot->blocks[i].object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+	}
+#endif
+
+	snapshot->stored_size = 0;
+	for (i = 0; i < snapshot->block_count; i++) {
+		EVDS_SNAPSHOT_BLOCK* block = &snapshot->blocks[i];
+		block->version = block->object->snapshot_version;
+
+		//Share blocks of objects unchanged since the base snapshot was saved
+		if (snapshot->base) {
+			EVDS_SNAPSHOT_BLOCK* base_block = &snapshot->base->blocks[i];
+			if (base_block->version == block->version) {
+				block->data = base_block->data;
+				continue;
+			}
+		}
+
+		//Copy block into own buffer
+		EVDS_InternalSnapshot_ReadObjectState(block->object,&object_state);
+		block->data = snapshot->buffer + block->offset;
+		EVDS_InternalSnapshot_WriteBlock(snapshot,block,&object_state,block->data);
+		snapshot->stored_size += block->size;
+	}
+
+	snapshot->time = system->time;
+	snapshot->generation++;
+	snapshot->saved = 1;
+	if (snapshot->base) snapshot->base_generation = snapshot->base->generation;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Restore state of the system from the snapshot.
+///
+/// Restores state vectors, sleeping state and all mutable variables of the objects. Previous
+/// state of every object is reset to the restored state, so interpolation for rendering does
+/// not cross the rollback. System must not be solved while the snapshot is being restored.
+///
+/// @param[in] system Pointer to system
+/// @param[in] snapshot Snapshot created for this system
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "snapshot" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER Snapshot was created for a different system
+/// @retval EVDS_ERROR_BAD_STATE Snapshot was never saved
+/// @retval EVDS_ERROR_BAD_STATE Base snapshot was saved again after the incremental snapshot was saved
+/// @retval EVDS_ERROR_INVALID_OBJECT One of the objects in the snapshot was destroyed
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_Restore(EVDS_SYSTEM* system, EVDS_SNAPSHOT* snapshot) {
+	int i;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!snapshot) return EVDS_ERROR_BAD_PARAMETER;
+	if (snapshot->system != system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!snapshot->saved) return EVDS_ERROR_BAD_STATE;
+	if (snapshot->base && (snapshot->base_generation != snapshot->base->generation)) return EVDS_ERROR_BAD_STATE;
+#ifndef EVDS_SINGLETHREADED
+	for (i = 0; i < snapshot->block_count; i++) {
+		if (snapshot->blocks[i].object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
+	}
+#endif
+
+	for (i = 0; i < snapshot->block_count; i++) {
+		EVDS_InternalSnapshot_ReadBlock(snapshot,&snapshot->blocks[i],snapshot->blocks[i].data);
+	}
+	system->time = snapshot->time;
+	return EVDS_OK;
+}
@@ -167,10 +167,28 @@ int EVDS_System_CleanupObjects(EVDS_SYSTEM* system) {
 /// @retval EVDS_ERROR_MEMORY Error while allocating a data structure
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_System_Create(EVDS_SYSTEM** p_system)
+{
+	if (!p_system) return EVDS_ERROR_BAD_PARAMETER;
+	return EVDS_InternalSystem_Create(p_system,0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Create new system, optionally sharing setup with a template system.
+///
+/// If template system is specified, the new system will have the same solvers
+/// registered, same global callbacks, time and sleep thresholds. Databases of the
+/// template system are copied in memory instead of being loaded again, so the new
+/// system owns its databases and the template system can be destroyed independently.
+///
+/// Solvers are not copied: they are static structures which are registered by
+/// every system that uses them.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalSystem_Create(EVDS_SYSTEM** p_system, EVDS_SYSTEM* template_system)
 {
 	EVDS_OBJECT* inertial_space;
 	EVDS_SYSTEM* system;
-	if (!p_system) return EVDS_ERROR_BAD_PARAMETER;
+	SIMC_LIST_ENTRY* entry;
 
 	//Create new system
 	system = (EVDS_SYSTEM*)malloc(sizeof(EVDS_SYSTEM));
@@ -183,6 +201,9 @@ int EVDS_System_Create(EVDS_SYSTEM** p_system)
 	SIMC_Thread_Initialize();
 	SIMC_List_Create(&system->deleted_objects,1);
 	system->cleanup_working = SIMC_Lock_Create();
+	system->gravity_tree_lock = SIMC_Lock_Create();
+	system->soi_index_lock = SIMC_Lock_Create();
+	system->shadow_cache_lock = SIMC_Lock_Create();
 #endif
 
 	//Set system to realtime by default
@@ -200,7 +221,45 @@ int EVDS_System_Create(EVDS_SYSTEM** p_system)
 	system->inertial_space = inertial_space;
 
 	//Load built-in databases
-	EVDS_System_DatabaseFromString(system,EVDS_Internal_Database); //FIXME
+	if (!template_system) {
+		EVDS_System_DatabaseFromString(system,EVDS_Internal_Database); //FIXME
+		return EVDS_OK;
+	}
+
+	//Copy databases of the template system
+	entry = SIMC_List_GetFirst(template_system->databases);
+	while (entry) {
+		EVDS_VARIABLE* database;
+		EVDS_VARIABLE* source = (EVDS_VARIABLE*)SIMC_List_GetData(template_system->databases,entry);
+		int error_code = EVDS_Variable_Create(system,source->name,EVDS_VARIABLE_TYPE_NESTED,&database);
+		if (error_code == EVDS_OK) error_code = EVDS_Variable_Copy(source,database);
+		if (error_code != EVDS_OK) {
+			SIMC_List_Stop(template_system->databases,entry);
+			if (database) EVDS_InternalVariable_DestroyData(database);
+			EVDS_System_Destroy(system);
+			*p_system = 0;
+			return error_code;
+		}
+		SIMC_List_Append(system->databases,database);
+		entry = SIMC_List_GetNext(template_system->databases,entry);
+	}
+
+	//Register same solvers
+	entry = SIMC_List_GetFirst(template_system->solvers);
+	while (entry) {
+		EVDS_Solver_Register(system,(EVDS_SOLVER*)SIMC_List_GetData(template_system->solvers,entry));
+		entry = SIMC_List_GetNext(template_system->solvers,entry);
+	}
+
+	//Copy global settings
+	system->OnInitialize = template_system->OnInitialize;
+	system->time = template_system->time;
+	system->sleep_velocity = template_system->sleep_velocity;
+	system->sleep_angular_velocity = template_system->sleep_angular_velocity;
+	system->sleep_acceleration = template_system->sleep_acceleration;
+	system->sleep_time = template_system->sleep_time;
+	system->deterministic = template_system->deterministic;
+	system->gravity_tree_angle = template_system->gravity_tree_angle;
 	return EVDS_OK;
 }
 
@@ -266,8 +325,16 @@ int EVDS_System_Destroy(EVDS_SYSTEM* system)
 #ifndef EVDS_SINGLETHREADED
 	SIMC_Lock_Leave(system->cleanup_working);
 	SIMC_Lock_Destroy(system->cleanup_working);
+	SIMC_Lock_Destroy(system->gravity_tree_lock);
+	SIMC_Lock_Destroy(system->soi_index_lock);
+	SIMC_Lock_Destroy(system->shadow_cache_lock);
 	SIMC_List_Destroy(system->deleted_objects);
 #endif
+	if (system->gravity_tree) EVDS_InternalEnvironment_DestroyTree(system->gravity_tree);
+	if (system->gravity_tree_retired) EVDS_InternalEnvironment_DestroyTree(system->gravity_tree_retired);
+	if (system->soi_index) EVDS_InternalEnvironment_DestroyIndex(system->soi_index);
+	if (system->soi_index_retired) EVDS_InternalEnvironment_DestroyIndex(system->soi_index_retired);
+	if (system->shadow_cache) EVDS_InternalEnvironment_DestroyShadowCache(system->shadow_cache);
 
 	//Clean up lookup tables
 	entry = system->object_types->first;
@@ -277,10 +344,10 @@ int EVDS_System_Destroy(EVDS_SYSTEM* system)
 		entry = entry->next;
 	}
 
-	//Clean up materials database
+	//Clean up databases
 	entry = system->databases->first;
 	while (entry) {
-		//free(entry->data); FIXME
+		EVDS_InternalVariable_DestroyData((EVDS_VARIABLE*)entry->data);
 		entry = entry->next;
 	}
 
@@ -326,6 +393,216 @@ int EVDS_System_GetTime(EVDS_SYSTEM* system, EVDS_REAL* time) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Set thresholds for automatic sleeping of objects.
+///
+/// Objects which have velocity, angular velocity and acceleration below the thresholds
+/// for longer than "time" seconds will fall asleep and will not be propagated until
+/// woken up (see EVDS_Object_Sleep()).
+///
+/// Automatic sleeping is disabled by default (time threshold is zero).
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+/// @param[in] velocity Maximum velocity of a quiet object [m/s]
+/// @param[in] angular_velocity Maximum angular velocity of a quiet object [rad/s]
+/// @param[in] acceleration Maximum acceleration of a quiet object [m/s2]
+/// @param[in] time Time object must remain quiet before it falls asleep [sec], 0 to disable
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_SetSleepThresholds(EVDS_SYSTEM* system, EVDS_REAL velocity, EVDS_REAL angular_velocity,
+								   EVDS_REAL acceleration, EVDS_REAL time) {
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	system->sleep_velocity = velocity;
+	system->sleep_angular_velocity = angular_velocity;
+	system->sleep_acceleration = acceleration;
+	system->sleep_time = time;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Enable or disable deterministic (lockstep) execution mode.
+///
+/// In deterministic mode results of the simulation only depend on its inputs and on order of
+/// API calls, and not on timing of threads. This allows running several copies of the same
+/// system in lockstep (for example in distributed sessions). The following is guaranteed:
+///  - Objects are always initialized in a blocking way, even if non-blocking initialization
+///    was requested by EVDS_Object_Initialize(). Order of objects in lists of children and lists
+///    of objects by type (which define order in which objects are solved and forces are summed)
+///    then only depends on order of calls, and not on timing of initialization threads.
+///  - Each member of an ensemble is always solved by a single thread (see EVDS_Ensemble_Solve()),
+///    so results do not depend on number of threads.
+///
+/// New objects take their initial time from the system time, so EVDS_System_SetTime() must be
+/// called with the same time in all copies before any objects are created. Otherwise objects
+/// start at the real time of their creation.
+///
+/// Deterministic mode does not make floating point math identical between different machines.
+/// Copies of the system only produce bit-identical results if they run the same build of the
+/// library with the same floating point environment (instruction set, compiler flags and math
+/// library). All math in EVDS is done in double precision regardless of this mode. Deterministic
+/// mode does not affect performance of the simulation, only loading of objects.
+///
+/// Use EVDS_System_GetStateHash() to detect when systems running in lockstep have diverged.
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+/// @param[in] deterministic Non-zero to enable deterministic mode
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_SetDeterministic(EVDS_SYSTEM* system, int deterministic) {
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	system->deterministic = deterministic;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Enable or disable tree-based computation of gravitational field.
+///
+/// By default EVDS_Environment_GetGravitationalField() computes field of every planet in
+/// the system, so computing mutual gravity of \f$N\f$ planets costs \f$O(N^2)\f$. When
+/// the tree is enabled, planets are sorted into an octree (Barnes-Hut tree), and groups of
+/// planets which are far enough away from the query point are replaced with a point mass
+/// in their center of mass. The cost of a query becomes \f$O(log N)\f$.
+///
+/// A node of the tree is approximated if its size divided by distance from the query point
+/// to the node is smaller than the opening angle. Smaller angles give more accurate results,
+/// typical values are between 0.3 and 1.0.
+///
+/// The tree is built in the root inertial space by the first query, and is shared by queries
+/// in all coordinates. It is rebuilt when public state of a planet (or of coordinates which
+/// contain planets) changes, which happens once per step, or when planets or their gravitational
+/// parameters change. State of other objects does not affect the tree. Planets which are not
+/// point masses (have spherical harmonics, sphere of influence, or custom gravitational field)
+/// and the planets in the nodes which are not approximated are computed exactly using their
+/// latest state.
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+/// @param[in] opening_angle Opening angle of the tree (0 to disable the tree)
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "opening_angle" is negative
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_SetGravityTree(EVDS_SYSTEM* system, EVDS_REAL opening_angle) {
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (opening_angle < 0.0) return EVDS_ERROR_BAD_PARAMETER;
+	system->gravity_tree_angle = opening_angle;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add data to the state hash (FNV-1a)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSystem_Hash(unsigned int* hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		*hash = (*hash ^ bytes[i])*16777619U;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add values of all variables in the list to the state hash (recursively)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalSystem_HashVariables(unsigned int* hash, SIMC_LIST* list) {
+	SIMC_LIST_ENTRY* entry;
+	if (!list) return;
+
+	entry = SIMC_List_GetFirst(list);
+	while (entry) {
+		EVDS_VARIABLE* variable = (EVDS_VARIABLE*)SIMC_List_GetData(list,entry);
+		EVDS_InternalSystem_Hash(hash,variable->name,sizeof(variable->name));
+		switch (variable->type) {
+			case EVDS_VARIABLE_TYPE_FLOAT:
+				EVDS_InternalSystem_Hash(hash,variable->value,sizeof(EVDS_REAL));
+			break;
+			case EVDS_VARIABLE_TYPE_VECTOR:
+				EVDS_InternalSystem_Hash(hash,&((EVDS_VECTOR*)variable->value)->x,3*sizeof(EVDS_REAL));
+			break;
+			case EVDS_VARIABLE_TYPE_QUATERNION:
+				EVDS_InternalSystem_Hash(hash,((EVDS_QUATERNION*)variable->value)->q,4*sizeof(EVDS_REAL));
+			break;
+			case EVDS_VARIABLE_TYPE_STRING:
+#ifndef EVDS_SINGLETHREADED
+				SIMC_Lock_Enter(variable->lock);
+#endif
+				EVDS_InternalSystem_Hash(hash,variable->value,variable->value_size);
+#ifndef EVDS_SINGLETHREADED
+				SIMC_Lock_Leave(variable->lock);
+#endif
+			break;
+		}
+		EVDS_InternalSystem_HashVariables(hash,variable->list);
+		entry = SIMC_List_GetNext(list,entry);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get hash of state vectors and variables of all objects in the system.
+///
+/// Hash is computed from unique identifiers and exact binary values of state vectors (time,
+/// position, velocity, acceleration, orientation, angular velocity and angular acceleration)
+/// and values of all floating point, vector, quaternion and string variables (for example
+/// mass of the fuel remaining in tanks) of all initialized objects in the system. Two systems
+/// running in lockstep (see
+/// EVDS_System_SetDeterministic()) will have same hash until their states diverge, so only the hash
+/// needs to be exchanged to detect desynchronization.
+///
+/// Root inertial space is not included into the hash (its state never changes).
+///
+/// @note Hash only depends on objects created in same order in both systems.
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+/// @param[out] hash Hash of the systems state will be written here
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "hash" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_System_GetStateHash(EVDS_SYSTEM* system, unsigned int* hash) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_STATE_VECTOR state;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!hash) return EVDS_ERROR_BAD_PARAMETER;
+
+	*hash = 2166136261U;
+	entry = SIMC_List_GetFirst(system->objects);
+	while (entry) {
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(system->objects,entry);
+		if (object->initialized && (object != system->inertial_space)) {
+			SIMC_SRW_EnterRead(object->state_lock);
+			memcpy(&state,&object->state,sizeof(EVDS_STATE_VECTOR));
+			SIMC_SRW_LeaveRead(object->state_lock);
+
+			//Only values are hashed (coordinate systems are pointers)
+			EVDS_InternalSystem_Hash(hash,&object->uid,sizeof(unsigned int));
+			EVDS_InternalSystem_Hash(hash,&state.time,sizeof(double));
+			EVDS_InternalSystem_Hash(hash,&state.position.x,3*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_Hash(hash,&state.velocity.x,3*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_Hash(hash,&state.acceleration.x,3*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_Hash(hash,state.orientation.q,4*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_Hash(hash,&state.angular_velocity.x,3*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_Hash(hash,&state.angular_acceleration.x,3*sizeof(EVDS_REAL));
+			EVDS_InternalSystem_HashVariables(hash,object->variables);
+		}
+		entry = SIMC_List_GetNext(system->objects,entry);
+	}
+	return EVDS_OK;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Register a new solver.
 ///
@@ -125,12 +125,12 @@ int EVDS_Variable_Copy(EVDS_VARIABLE* source, EVDS_VARIABLE* variable) {
 		case EVDS_VARIABLE_TYPE_VECTOR: {
 			EVDS_VECTOR value;
 			EVDS_Variable_GetVector(source,&value);
-			EVDS_Variable_SetVector(source,&value);
+			EVDS_Variable_SetVector(variable,&value);
 		} break;
 		case EVDS_VARIABLE_TYPE_QUATERNION: {
 			EVDS_QUATERNION value;
 			EVDS_Variable_GetQuaternion(source,&value);
-			EVDS_Variable_SetQuaternion(source,&value);
+			EVDS_Variable_SetQuaternion(variable,&value);
 		} break;
 		case EVDS_VARIABLE_TYPE_NESTED: {
 			size_t length;
@@ -173,7 +173,28 @@ int EVDS_Variable_Copy(EVDS_VARIABLE* source, EVDS_VARIABLE* variable) {
 			variable->value = source->value;
 		} break;
 		case EVDS_VARIABLE_TYPE_FUNCTION: {
-			//FIXME
+			char name[65];
+			SIMC_LIST_ENTRY* entry;
+			EVDS_VARIABLE* source_value;
+			EVDS_VARIABLE* value;
+			EVDS_VARIABLE_FUNCTION* function = (EVDS_VARIABLE_FUNCTION*)variable->value;
+
+			//Copy constant value and all data entries, then rebuild function table
+			function->constant_value = ((EVDS_VARIABLE_FUNCTION*)source->value)->constant_value;
+			function->data = 0;
+			function->data_count = 0;
+
+			entry = SIMC_List_GetFirst(source->list);
+			while (entry) {
+				source_value = (EVDS_VARIABLE*)SIMC_List_GetData(source->list,entry);
+				strncpy(name,source_value->name,64); name[64] = 0;
+				
+				EVDS_Variable_AddNested(variable,name,source_value->type,&value);
+				EVDS_Variable_Copy(source_value,value);
+
+				entry = SIMC_List_GetNext(source->list,entry);
+			}
+			EVDS_ERRCHECK(EVDS_InternalVariable_InitializeFunction(variable,function));
 		} break;
 	}
 
@@ -792,6 +813,17 @@ int EVDS_Variable_SetReal(EVDS_VARIABLE* variable, EVDS_REAL value) {
 	if (variable->object && variable->object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
 
+	//Changing mass properties invalidates aggregated mass properties of the object
+	if (variable->mass_property && (*((double*)variable->value) != value)) {
+		EVDS_InternalObject_InvalidateMass(variable->object);
+	}
+	//Changing gravity parameters invalidates cached gravitational field of the object
+	if (variable->gravity_property && (*((double*)variable->value) != value)) {
+		EVDS_InternalObject_InvalidateGravity(variable->object);
+	}
+	if (variable->object && (*((double*)variable->value) != value)) {
+		EVDS_InternalObject_InvalidateSnapshot(variable->object);
+	}
 	*((double*)variable->value) = value;
 	return EVDS_OK;
 }
@@ -1012,6 +1044,14 @@ int EVDS_Variable_SetVector(EVDS_VARIABLE* variable, EVDS_VECTOR* value) {
 	if (variable->object && variable->object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
 
+	//Changing mass properties invalidates aggregated mass properties of the object
+	if (variable->mass_property &&
+		((((EVDS_VECTOR*)variable->value)->x != value->x) ||
+		 (((EVDS_VECTOR*)variable->value)->y != value->y) ||
+		 (((EVDS_VECTOR*)variable->value)->z != value->z))) {
+		EVDS_InternalObject_InvalidateMass(variable->object);
+	}
+	if (variable->object) EVDS_InternalObject_InvalidateSnapshot(variable->object);
 	memcpy((EVDS_VECTOR*)variable->value,value,sizeof(EVDS_VECTOR));
 	return EVDS_OK;
 }
@@ -1038,6 +1078,7 @@ int EVDS_Variable_SetQuaternion(EVDS_VARIABLE* variable, EVDS_QUATERNION* value)
 	if (variable->object && variable->object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
 
+	if (variable->object) EVDS_InternalObject_InvalidateSnapshot(variable->object);
 	memcpy((EVDS_QUATERNION*)variable->value,value,sizeof(EVDS_QUATERNION));
 	return EVDS_OK;
 }
@@ -1110,6 +1151,7 @@ int EVDS_Variable_SetFunctionPointer(EVDS_VARIABLE* variable, void* data) {
 #ifndef EVDS_SINGLETHREADED
 	if (variable->object && variable->object->destroyed) return EVDS_ERROR_INVALID_OBJECT;
 #endif
+	if (variable->gravity_property) EVDS_InternalObject_InvalidateGravity(variable->object);
 	variable->value = data;
 	return EVDS_OK;
 }
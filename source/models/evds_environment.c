@@ -20,12 +20,1170 @@
 /// Further information about the GNU Lesser General Public License can also be found on
 /// the world wide web at http://www.gnu.org.
 ////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
 #include "evds.h"
 #include "math.h"
 
+//Spherical harmonics models up to this degree are evaluated without heap allocations
+#define EVDS_INTERNAL_HARMONICS_STACK_DEGREE 32
+//Largest number of planets relevant to a single query (all planets are checked if exceeded)
+#define EVDS_INTERNAL_RELEVANT_PLANETS 64
+//Number of positions computed at once by built-in atmosphere models
+#define EVDS_INTERNAL_ATMOSPHERE_BATCH 64
 
 
 
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if coordinate transformations into the given coordinates use private state.
+///
+/// Objects which are integrated or rendered by the current thread are converted using
+/// state vectors private to that thread, so such conversions must not be cached.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_IsPrivate(EVDS_OBJECT* coordinates) {
+#ifndef EVDS_SINGLETHREADED
+	SIMC_THREAD_ID thread_id = SIMC_Thread_GetUniqueID();
+	while (coordinates) {
+		if ((coordinates->integrate_thread == thread_id) ||
+			(coordinates->render_thread == thread_id)) return 1;
+		coordinates = coordinates->parent;
+	}
+#endif
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get position of the planet in target coordinates.
+///
+/// If gravity descriptor is given, the position is resolved once and shared by all
+/// queries in same coordinates until the planet, the target coordinates or one of their
+/// parents publishes a new state. Orientation of the planet is only resolved if requested.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_GetPlanetPosition(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity,
+												EVDS_OBJECT* target_coordinates, EVDS_VECTOR* position,
+												EVDS_QUATERNION* orientation) {
+	EVDS_STATE_VECTOR planet_state;
+	EVDS_PLANET_POSITION* cache = gravity ? gravity->position : 0;
+	long version = 0;
+
+	//Check if position can be cached at all
+	if (cache && (EVDS_InternalEnvironment_IsPrivate(planet->parent) ||
+				  EVDS_InternalEnvironment_IsPrivate(target_coordinates))) {
+		cache = 0;
+	}
+
+	//Use position resolved by a previous query
+	if (cache) {
+		int is_valid;
+		long target_version = EVDS_InternalObject_GetStateVersion(target_coordinates);
+		version = EVDS_InternalObject_GetStateVersion(planet);
+		if (target_version > version) version = target_version;
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(cache->lock);
+#endif
+		is_valid = (cache->coordinates == target_coordinates) &&
+				   (cache->version == version) &&
+				   (cache->oriented || !orientation);
+		if (is_valid) {
+			EVDS_Vector_Copy(position,&cache->position);
+			if (orientation) EVDS_Quaternion_Copy(orientation,&cache->orientation);
+		}
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(cache->lock);
+#endif
+		if (is_valid) return;
+	}
+
+	//Get planet state and position in target coordinates
+	EVDS_Object_GetStateVector(planet,&planet_state);
+	EVDS_Vector_Convert(position,&planet_state.position,target_coordinates);
+	if (orientation) EVDS_Quaternion_Convert(orientation,&planet_state.orientation,target_coordinates);
+
+	//Remember position (version was read before state, so a concurrent change is never missed)
+	if (cache) {
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(cache->lock);
+#endif
+		cache->coordinates = target_coordinates;
+		cache->version = version;
+		cache->oriented = orientation != 0;
+		EVDS_Vector_Copy(&cache->position,position);
+		if (orientation) EVDS_Quaternion_Copy(&cache->orientation,orientation);
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(cache->lock);
+#endif
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute gravitational field of a spherical harmonics model.
+///
+/// Uses recursions for the fully normalized solid spherical harmonics \f$\bar{V}_{nm}\f$,
+/// \f$\bar{W}_{nm}\f$ (Cunningham, Montenbruck and Gill), which remain stable for high
+/// degree and order. Every term of the recursions is computed once per call: three
+/// neighbouring columns of order \f$m\f$ are kept, which is all the gradient requires.
+///
+/// Position must be given in planet-fixed coordinates, acceleration is returned in
+/// same coordinates.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the recursions of a high degree model
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetHarmonicsField(EVDS_REAL* C, EVDS_REAL* S, int degree,
+											   EVDS_REAL mu, EVDS_REAL radius, EVDS_VECTOR* position,
+											   EVDS_REAL* phi, EVDS_VECTOR* field) {
+	EVDS_REAL stack_buffer[6*(EVDS_INTERNAL_HARMONICS_STACK_DEGREE+2)];
+	EVDS_REAL *buffer,*V[3],*W[3];
+	EVDS_REAL r2,rho,x0,y0,z0;
+	EVDS_REAL Vmm,Wmm;
+	EVDS_REAL u,ax,ay,az;
+	int n,m,k;
+
+	//Get buffer for three columns of the recursions
+	if (degree > EVDS_INTERNAL_HARMONICS_STACK_DEGREE) {
+		buffer = (EVDS_REAL*)malloc(6*(degree+2)*sizeof(EVDS_REAL));
+		if (!buffer) return EVDS_ERROR_MEMORY;
+	} else {
+		buffer = stack_buffer;
+	}
+	for (k = 0; k < 3; k++) {
+		V[k] = buffer + (2*k+0)*(degree+2);
+		W[k] = buffer + (2*k+1)*(degree+2);
+	}
+
+	//Scaled coordinates
+	r2 = position->x*position->x + position->y*position->y + position->z*position->z;
+	rho = radius*radius/r2;
+	x0 = position->x*radius/r2;
+	y0 = position->y*radius/r2;
+	z0 = position->z*radius/r2;
+
+	//Compute columns of recursions, accumulate terms of the previous column
+	u = 0.0; ax = 0.0; ay = 0.0; az = 0.0;
+	Vmm = radius/sqrt(r2);
+	Wmm = 0.0;
+	for (m = 0; m <= degree+1; m++) {
+		EVDS_REAL* Vc = V[m % 3];
+		EVDS_REAL* Wc = W[m % 3];
+
+		//Sectorial term
+		if (m > 0) {
+			EVDS_REAL f = sqrt(((m == 1) ? 2.0 : 1.0)*(2.0*m+1.0)/(2.0*m));
+			EVDS_REAL Vt = f*(x0*Vmm - y0*Wmm);
+			Wmm = f*(x0*Wmm + y0*Vmm);
+			Vmm = Vt;
+		}
+		Vc[m] = Vmm;
+		Wc[m] = Wmm;
+
+		//Zonal and tesseral terms
+		for (n = m+1; n <= degree+1; n++) {
+			EVDS_REAL a = sqrt((2.0*n+1.0)*(2.0*n-1.0)/((n-m)*(EVDS_REAL)(n+m)));
+			Vc[n] = a*z0*Vc[n-1];
+			Wc[n] = a*z0*Wc[n-1];
+			if (n >= m+2) {
+				EVDS_REAL b = sqrt((2.0*n+1.0)*(n+m-1.0)*(n-m-1.0)/((2.0*n-3.0)*(n+m)*(EVDS_REAL)(n-m)));
+				Vc[n] -= b*rho*Vc[n-2];
+				Wc[n] -= b*rho*Wc[n-2];
+			}
+		}
+
+		//Accumulate potential and acceleration of order m-1
+		if (m > 0) {
+			int mm = m-1;
+			EVDS_REAL* Vp = V[(mm+2) % 3]; //Order mm-1 (not used for mm = 0)
+			EVDS_REAL* Wp = W[(mm+2) % 3];
+			EVDS_REAL* V0 = V[mm % 3];
+			EVDS_REAL* W0 = W[mm % 3];
+			EVDS_REAL* Vn = Vc;
+			EVDS_REAL* Wn = Wc;
+
+			for (n = mm; n <= degree; n++) {
+				EVDS_REAL c = C[n*(n+1)/2+mm];
+				EVDS_REAL s = S[n*(n+1)/2+mm];
+				EVDS_REAL kz = sqrt((2.0*n+1.0)*(n+mm+1.0)/((2.0*n+3.0)*(n-mm+1.0)));
+
+				u += c*V0[n] + s*W0[n];
+				az += (n-mm+1.0)*kz*(-c*V0[n+1] - s*W0[n+1]);
+				if (mm == 0) {
+					EVDS_REAL k1 = sqrt((2.0*n+1.0)*(n+1.0)*(n+2.0)/(2.0*(2.0*n+3.0)));
+					ax += -c*k1*Vn[n+1];
+					ay += -c*k1*Wn[n+1];
+				} else {
+					EVDS_REAL kp = sqrt((2.0*n+1.0)*(n+mm+1.0)*(n+mm+2.0)/(2.0*n+3.0));
+					EVDS_REAL km = sqrt(((mm == 1) ? 2.0 : 1.0)*(2.0*n+1.0)/((2.0*n+3.0)*(n-mm+1.0)*(n-mm+2.0)));
+					EVDS_REAL q = (n-mm+2.0)*(n-mm+1.0)*km;
+					ax += 0.5*(kp*(-c*Vn[n+1] - s*Wn[n+1]) + q*( c*Vp[n+1] + s*Wp[n+1]));
+					ay += 0.5*(kp*(-c*Wn[n+1] + s*Vn[n+1]) + q*(-c*Wp[n+1] + s*Vp[n+1]));
+				}
+			}
+		}
+	}
+	if (buffer != stack_buffer) free(buffer);
+
+	//Write back potential and acceleration
+	*phi = -u*mu/radius;
+	EVDS_Vector_Set(field,EVDS_VECTOR_ACCELERATION,position->coordinate_system,
+		ax*mu/(radius*radius),ay*mu/(radius*radius),az*mu/(radius*radius));
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add gravitational field of a single planet in the given position.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory to evaluate the gravity model
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetPlanetField(EVDS_OBJECT* planet, EVDS_VECTOR* position,
+											EVDS_REAL* total_phi, EVDS_VECTOR* total_field) {
+	EVDS_OBJECT* target_coordinates = position->coordinate_system;
+	EVDS_PLANET_GRAVITY* gravity; //Parameters of gravitational field
+	EVDS_PLANET_GRAVITY uncached_gravity;
+	EVDS_PLANET_GRID* grid; //Gravity grid of the planet
+	EVDS_QUATERNION Gq;
+	EVDS_REAL* C;
+	EVDS_REAL* S;
+	EVDS_REAL harmonics_radius;
+	int degree,error_code;
+
+	//Initialize temporary vectors
+	EVDS_REAL r2,r;
+	EVDS_VECTOR G0,Gr,Gn,Ga;
+	EVDS_REAL Gphi = 0.0;
+	EVDS_Vector_Initialize(G0);
+	EVDS_Vector_Initialize(Gr);
+	EVDS_Vector_Initialize(Gn);
+	EVDS_Vector_Initialize(Ga);
+
+	//Get planets parameters (read them directly if planet is not handled by planet solver)
+	error_code = EVDS_InternalPlanet_GetGravity(planet,&gravity);
+	if (error_code == EVDS_ERROR_BAD_STATE) {
+		memset(&uncached_gravity,0,sizeof(EVDS_PLANET_GRAVITY));
+		EVDS_InternalPlanet_ReadGravity(planet,&uncached_gravity);
+		gravity = 0;
+	} else if (error_code != EVDS_OK) {
+		return error_code;
+	}
+
+	//Select spherical harmonics model (loaded coefficients or J2 only)
+	degree = 0;
+	if (gravity && (gravity->degree > 0)) {
+		C = gravity->C;
+		S = gravity->S;
+		degree = gravity->degree;
+		harmonics_radius = gravity->harmonics_radius;
+	} else {
+		EVDS_PLANET_GRAVITY* parameters = gravity ? gravity : &uncached_gravity;
+		C = parameters->zonal_C;
+		S = parameters->zonal_S;
+		if (parameters->has_j2 && parameters->has_radius) degree = 2;
+		harmonics_radius = parameters->radius;
+	}
+
+	//Get planet position (and orientation for non-spherical models) in position vector coordinates
+	EVDS_InternalEnvironment_GetPlanetPosition(planet,gravity,target_coordinates,&G0,degree ? &Gq : 0);
+	if (!gravity) gravity = &uncached_gravity;
+
+	//Calculate radius-vector
+	EVDS_Vector_Subtract(&Gr,position,&G0);
+	EVDS_Vector_Dot(&r2,&Gr,&Gr);
+	r = sqrt(r2);
+
+	//Check if inside the planet itself
+	if (gravity->has_radius && (r < gravity->radius*0.9)) {
+		return EVDS_OK; //Too close to the planet
+	}
+
+	//Check if position of source vector matches with planets position
+	if (r2 < EVDS_EPS) {
+		return EVDS_OK; //Planets dont pull themselves
+	}
+
+	//Check if outside of sphere of influence
+	if (gravity->has_rs && (r2 > gravity->rs*gravity->rs)) {
+		return EVDS_OK; //Too far for gravity to have a meaningful influence
+	}
+
+	//Compute gravity acceleration from custom callback or stock code
+	if (gravity->callback) {
+		gravity->callback(planet,&Gr,&Gphi,&Ga);
+		EVDS_Vector_Add(total_field,total_field,&Ga);
+		*total_phi += Gphi;
+	} else {
+		if (!gravity->has_mu) {
+			return EVDS_OK; //Not enough information to compute gravity for this planet
+		}
+
+		//Truncate series where terms become too small to matter
+		if (degree && (gravity->max_degree > 0) && (degree > gravity->max_degree)) {
+			degree = gravity->max_degree;
+		}
+		if (degree && (gravity->tolerance > 0.0) && (r > harmonics_radius)) {
+			EVDS_REAL useful_degree = log(gravity->tolerance)/log(harmonics_radius/r);
+			if (useful_degree < 2.0) useful_degree = 2.0;
+			if (useful_degree < degree) degree = (int)useful_degree;
+		}
+		
+		if (degree > 0) { //Non-spherical model
+			EVDS_VECTOR local_Gr;
+
+			//Compute field in planet-fixed coordinates (interpolate from grid if possible), rotate back
+			EVDS_Vector_RotateConjugated(&local_Gr,&Gr,&Gq);
+			grid = gravity->grid;
+			if ((!grid) || (grid->generation != gravity->generation) ||
+				(EVDS_InternalPlanet_GetGridField(grid,&local_Gr,&Gphi,&Ga) != EVDS_OK)) {
+				EVDS_ERRCHECK(EVDS_InternalEnvironment_GetHarmonicsField(C,S,degree,gravity->mu,harmonics_radius,&local_Gr,&Gphi,&Ga));
+			}
+			EVDS_Vector_Rotate(&Ga,&Ga,&Gq);
+		} else { //Spherical model
+			//Potential
+			Gphi = -gravity->mu/r;
+
+			//Acceleration
+			EVDS_Vector_Normalize(&Gn,&Gr);
+			EVDS_Vector_Multiply(&Ga,&Gn,-gravity->mu/r2);
+		}
+
+		//Reinterpret vector as acceleration, add to total acceleration
+		Ga.derivative_level = EVDS_VECTOR_ACCELERATION;
+		EVDS_Vector_Add(total_field,total_field,&Ga);
+		*total_phi += Gphi;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy tree of planets
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_DestroyTree(EVDS_GRAVITY_TREE* tree) {
+	if (tree->planets) free(tree->planets);
+	if (tree->positions) free(tree->positions);
+	if (tree->mu) free(tree->mu);
+	if (tree->next) free(tree->next);
+	if (tree->exact) free(tree->exact);
+	if (tree->nodes) free(tree->nodes);
+	free(tree);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get child node of the gravity tree which contains the point (create it if required)
+///
+/// Returns -1 if there is not enough memory for the new node.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetTreeChild(EVDS_GRAVITY_TREE* tree, int index, EVDS_REAL* point) {
+	EVDS_GRAVITY_TREE_NODE* node = &tree->nodes[index];
+	EVDS_GRAVITY_TREE_NODE* child;
+	EVDS_REAL center[3],size;
+	int octant = 0;
+	int i;
+
+	//Find octant
+	for (i = 0; i < 3; i++) {
+		if (point[i] > node->center[i]) octant |= (1 << i);
+	}
+	if (node->children[octant] >= 0) return node->children[octant];
+
+	//Compute size of the new node
+	size = 0.5*node->size;
+	for (i = 0; i < 3; i++) {
+		center[i] = node->center[i] + ((octant & (1 << i)) ? size : -size);
+	}
+
+	//Allocate new node
+	if (tree->node_count == tree->node_capacity) {
+		EVDS_GRAVITY_TREE_NODE* nodes = (EVDS_GRAVITY_TREE_NODE*)realloc(tree->nodes,
+			2*tree->node_capacity*sizeof(EVDS_GRAVITY_TREE_NODE));
+		if (!nodes) return -1;
+		tree->nodes = nodes;
+		tree->node_capacity *= 2;
+	}
+	child = &tree->nodes[tree->node_count];
+	memset(child,0,sizeof(EVDS_GRAVITY_TREE_NODE));
+	for (i = 0; i < 3; i++) child->center[i] = center[i];
+	for (i = 0; i < 8; i++) child->children[i] = -1;
+	child->size = size;
+	child->leaf = 1;
+	child->planet = -1;
+	tree->nodes[index].children[octant] = tree->node_count;
+	return tree->node_count++;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build tree of planets in the root inertial space.
+///
+/// Tree must be zeroed before it is built.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the tree
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_BuildTree(EVDS_SYSTEM* system, EVDS_GRAVITY_TREE* tree) {
+	SIMC_LIST* planets;
+	SIMC_LIST_ENTRY* entry;
+	EVDS_REAL min[3],max[3];
+	int count,index,i;
+
+	//Remember for which state the tree is built (read before any state, so no changes are missed)
+	tree->planet_generation = system->planet_generation;
+	tree->gravity_generation = system->gravity_generation;
+
+	//Allocate space for all planets
+	count = 0;
+	EVDS_System_GetObjectsByType(system,"planet",&planets);
+	entry = SIMC_List_GetFirst(planets);
+	while (entry) {
+		count++;
+		entry = SIMC_List_GetNext(planets,entry);
+	}
+	if (count == 0) return EVDS_OK;
+	tree->planets = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	tree->positions = (EVDS_REAL*)malloc(3*count*sizeof(EVDS_REAL));
+	tree->mu = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	tree->next = (int*)malloc(count*sizeof(int));
+	tree->exact = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	if ((!tree->planets) || (!tree->positions) || (!tree->mu) || (!tree->next) || (!tree->exact)) {
+		return EVDS_ERROR_MEMORY;
+	}
+
+	//Sort planets into point masses and planets which must be computed exactly
+	entry = SIMC_List_GetFirst(planets);
+	while (entry && (tree->planet_count + tree->exact_count < count)) {
+		EVDS_PLANET_GRAVITY* gravity;
+		EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
+		entry = SIMC_List_GetNext(planets,entry);
+
+		if ((EVDS_InternalPlanet_GetGravity(planet,&gravity) != EVDS_OK) ||
+			(gravity->callback) || (gravity->has_rs) || (gravity->degree > 0) || 
+			(gravity->has_j2 && gravity->has_radius)) {
+			tree->exact[tree->exact_count++] = planet;
+		} else if (gravity->has_mu) {
+			EVDS_VECTOR position;
+			index = tree->planet_count++;
+			EVDS_InternalEnvironment_GetPlanetPosition(planet,0,system->inertial_space,&position,0);
+			tree->planets[index] = planet;
+			tree->mu[index] = gravity->mu;
+			tree->positions[3*index+0] = position.x;
+			tree->positions[3*index+1] = position.y;
+			tree->positions[3*index+2] = position.z;
+		}
+	}
+	if (entry) SIMC_List_Stop(planets,entry);
+	if (tree->planet_count == 0) return EVDS_OK;
+
+	//Create root node which covers all planets
+	for (i = 0; i < 3; i++) {
+		min[i] = tree->positions[i];
+		max[i] = tree->positions[i];
+	}
+	for (index = 1; index < tree->planet_count; index++) {
+		for (i = 0; i < 3; i++) {
+			if (tree->positions[3*index+i] < min[i]) min[i] = tree->positions[3*index+i];
+			if (tree->positions[3*index+i] > max[i]) max[i] = tree->positions[3*index+i];
+		}
+	}
+	tree->node_capacity = 2*tree->planet_count + 8;
+	tree->nodes = (EVDS_GRAVITY_TREE_NODE*)malloc(tree->node_capacity*sizeof(EVDS_GRAVITY_TREE_NODE));
+	if (!tree->nodes) return EVDS_ERROR_MEMORY;
+	memset(&tree->nodes[0],0,sizeof(EVDS_GRAVITY_TREE_NODE));
+	for (i = 0; i < 3; i++) {
+		tree->nodes[0].center[i] = 0.5*(min[i]+max[i]);
+		if (0.5*(max[i]-min[i]) > tree->nodes[0].size) tree->nodes[0].size = 0.5*(max[i]-min[i]);
+	}
+	for (i = 0; i < 8; i++) tree->nodes[0].children[i] = -1;
+	tree->nodes[0].size = tree->nodes[0].size*1.001 + 1.0;
+	tree->nodes[0].leaf = 1;
+	tree->nodes[0].planet = -1;
+	tree->node_count = 1;
+
+	//Insert planets into the tree
+	for (index = 0; index < tree->planet_count; index++) {
+		EVDS_REAL* point = &tree->positions[3*index];
+		int node = 0;
+		int depth = 0;
+		while (1) {
+			if (tree->nodes[node].leaf) {
+				int moved = tree->nodes[node].planet;
+				if ((moved < 0) || (depth >= EVDS_GRAVITY_TREE_MAX_DEPTH)) {
+					tree->next[index] = moved;
+					tree->nodes[node].planet = index;
+					break;
+				}
+
+				//Split the leaf, move its planet down
+				tree->nodes[node].leaf = 0;
+				tree->nodes[node].planet = -1;
+				i = EVDS_InternalEnvironment_GetTreeChild(tree,node,&tree->positions[3*moved]);
+				if (i < 0) return EVDS_ERROR_MEMORY;
+				tree->nodes[i].planet = moved;
+				tree->next[moved] = -1;
+			}
+			node = EVDS_InternalEnvironment_GetTreeChild(tree,node,point);
+			if (node < 0) return EVDS_ERROR_MEMORY;
+			depth++;
+		}
+	}
+
+	//Compute mass and center of mass of every node (children always follow parents)
+	for (index = tree->node_count-1; index >= 0; index--) {
+		EVDS_GRAVITY_TREE_NODE* node = &tree->nodes[index];
+		node->mu = 0.0;
+		node->cm[0] = 0.0;
+		node->cm[1] = 0.0;
+		node->cm[2] = 0.0;
+		if (node->leaf) {
+			int planet = node->planet;
+			while (planet >= 0) {
+				node->mu += tree->mu[planet];
+				for (i = 0; i < 3; i++) node->cm[i] += tree->mu[planet]*tree->positions[3*planet+i];
+				planet = tree->next[planet];
+			}
+		} else {
+			int octant;
+			for (octant = 0; octant < 8; octant++) {
+				EVDS_GRAVITY_TREE_NODE* child;
+				if (node->children[octant] < 0) continue;
+				child = &tree->nodes[node->children[octant]];
+				node->mu += child->mu;
+				for (i = 0; i < 3; i++) node->cm[i] += child->mu*child->cm[i];
+			}
+		}
+		if (node->mu > 0.0) {
+			for (i = 0; i < 3; i++) node->cm[i] /= node->mu;
+		}
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get tree of planets, rebuild it if it is outdated.
+///
+/// The tree is rebuilt when the set of planets or their gravity changes, or when public
+/// state of any planet (or of coordinates containing planets) changes, so it is built once
+/// per step. State of other objects does not affect the tree.
+///
+/// Published tree is never modified, so queries use it without any locks. A new tree is
+/// built in a separate buffer under the tree lock, and the previous tree is only freed by
+/// the next rebuild.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the tree
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetTree(EVDS_SYSTEM* system, EVDS_GRAVITY_TREE** p_tree) {
+	EVDS_GRAVITY_TREE* tree = system->gravity_tree;
+	int error_code = EVDS_OK;
+
+	//Use published tree if it is still valid
+	if (tree && (tree->gravity_generation == system->gravity_generation) &&
+				(tree->planet_generation == system->planet_generation)) {
+		*p_tree = tree;
+		return EVDS_OK;
+	}
+
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(system->gravity_tree_lock);
+#endif
+	//Check again, tree may have been rebuilt by another thread
+	tree = system->gravity_tree;
+	if ((!tree) || (tree->gravity_generation != system->gravity_generation) ||
+				   (tree->planet_generation != system->planet_generation)) {
+		tree = (EVDS_GRAVITY_TREE*)malloc(sizeof(EVDS_GRAVITY_TREE));
+		if (tree) {
+			memset(tree,0,sizeof(EVDS_GRAVITY_TREE));
+			error_code = EVDS_InternalEnvironment_BuildTree(system,tree);
+		} else {
+			error_code = EVDS_ERROR_MEMORY;
+		}
+
+		if (error_code == EVDS_OK) {
+			//Tree must be complete before it is published
+			EVDS_MEMORY_BARRIER();
+			if (system->gravity_tree_retired) EVDS_InternalEnvironment_DestroyTree(system->gravity_tree_retired);
+			system->gravity_tree_retired = system->gravity_tree;
+			system->gravity_tree = tree;
+		} else if (tree) {
+			EVDS_InternalEnvironment_DestroyTree(tree);
+		}
+	}
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(system->gravity_tree_lock);
+#endif
+
+	*p_tree = tree;
+	return error_code;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add gravitational field of all planets in the tree.
+///
+/// Nodes which are far enough away are approximated by a point mass, planets in the
+/// remaining leaves are computed exactly.
+///
+/// The tree is walked in root inertial space, only the query point is converted into it.
+/// Field of approximated nodes is rotated back into coordinates of the position.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory to evaluate gravity model of a planet
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetTreeField(EVDS_SYSTEM* system, EVDS_GRAVITY_TREE* tree, EVDS_REAL angle,
+										  EVDS_VECTOR* position, EVDS_REAL* total_phi, EVDS_VECTOR* total_field) {
+	int stack[7*EVDS_GRAVITY_TREE_MAX_DEPTH+8];
+	int stack_size = 0;
+	EVDS_VECTOR point,far_field;
+	EVDS_REAL g[3] = { 0.0, 0.0, 0.0 };
+	int i;
+
+	//Planets which are always computed exactly
+	for (i = 0; i < tree->exact_count; i++) {
+		EVDS_ERRCHECK(EVDS_InternalEnvironment_GetPlanetField(tree->exact[i],position,total_phi,total_field));
+	}
+
+	//Walk the tree
+	if (tree->node_count == 0) return EVDS_OK;
+	EVDS_Vector_Convert(&point,position,system->inertial_space);
+	stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		EVDS_GRAVITY_TREE_NODE* node = &tree->nodes[stack[--stack_size]];
+		EVDS_REAL d[3],distance;
+		if (node->mu <= 0.0) continue;
+
+		//Compute leaves exactly
+		if (node->leaf) {
+			int planet = node->planet;
+			while (planet >= 0) {
+				EVDS_ERRCHECK(EVDS_InternalEnvironment_GetPlanetField(tree->planets[planet],position,total_phi,total_field));
+				planet = tree->next[planet];
+			}
+			continue;
+		}
+
+		//Find distance from the query point to the node
+		d[0] = fabs(point.x - node->center[0]) - node->size;
+		d[1] = fabs(point.y - node->center[1]) - node->size;
+		d[2] = fabs(point.z - node->center[2]) - node->size;
+		for (i = 0; i < 3; i++) if (d[i] < 0.0) d[i] = 0.0;
+		distance = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+
+		//Approximate node by a point mass, or check its children
+		if (2.0*node->size < angle*distance) {
+			EVDS_REAL r2,r;
+			d[0] = point.x - node->cm[0];
+			d[1] = point.y - node->cm[1];
+			d[2] = point.z - node->cm[2];
+			r2 = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+			r = sqrt(r2);
+			*total_phi -= node->mu/r;
+			for (i = 0; i < 3; i++) g[i] -= node->mu*d[i]/(r2*r);
+		} else {
+			for (i = 0; i < 8; i++) {
+				if (node->children[i] >= 0) stack[stack_size++] = node->children[i];
+			}
+		}
+	}
+
+	//Rotate field of approximated nodes into coordinates of the position
+	EVDS_Vector_Set(&far_field,EVDS_VECTOR_DIRECTION,system->inertial_space,g[0],g[1],g[2]);
+	EVDS_Vector_Convert(&far_field,&far_field,position->coordinate_system);
+	total_field->x += far_field.x;
+	total_field->y += far_field.y;
+	total_field->z += far_field.z;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy index of spheres of influence
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_DestroyIndex(EVDS_SOI_INDEX* index) {
+	if (index->planets) free(index->planets);
+	if (index->positions) free(index->positions);
+	if (index->radii) free(index->radii);
+	if (index->parent) free(index->parent);
+	if (index->first_child) free(index->first_child);
+	if (index->next) free(index->next);
+	free(index);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build index of spheres of influence of all planets in the system.
+///
+/// Index must be zeroed before it is built.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the index
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_BuildIndex(EVDS_SYSTEM* system, EVDS_SOI_INDEX* index) {
+	SIMC_LIST* planets;
+	SIMC_LIST_ENTRY* entry;
+	int count,i,j;
+
+	//Remember for which state the index is built (read before any state, so no changes are missed)
+	index->planet_generation = system->planet_generation;
+	index->gravity_generation = system->gravity_generation;
+	index->first_root = -1;
+	index->first_global = -1;
+
+	//Allocate space for all planets
+	count = 0;
+	EVDS_System_GetObjectsByType(system,"planet",&planets);
+	entry = SIMC_List_GetFirst(planets);
+	while (entry) {
+		count++;
+		entry = SIMC_List_GetNext(planets,entry);
+	}
+	if (count == 0) return EVDS_OK;
+	index->planets = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	index->positions = (EVDS_REAL*)malloc(3*count*sizeof(EVDS_REAL));
+	index->radii = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	index->parent = (int*)malloc(count*sizeof(int));
+	index->first_child = (int*)malloc(count*sizeof(int));
+	index->next = (int*)malloc(count*sizeof(int));
+	if ((!index->planets) || (!index->positions) || (!index->radii) ||
+		(!index->parent) || (!index->first_child) || (!index->next)) {
+		return EVDS_ERROR_MEMORY;
+	}
+
+	//Resolve positions and spheres of influence of all planets
+	entry = SIMC_List_GetFirst(planets);
+	while (entry && (index->planet_count < count)) {
+		EVDS_VECTOR position;
+		EVDS_PLANET_GRAVITY* gravity;
+		EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
+		entry = SIMC_List_GetNext(planets,entry);
+
+		//Cached positions are not used, they are kept for queries in other coordinates
+		i = index->planet_count++;
+		if (EVDS_InternalPlanet_GetGravity(planet,&gravity) != EVDS_OK) gravity = 0;
+		EVDS_InternalEnvironment_GetPlanetPosition(planet,0,system->inertial_space,&position,0);
+		index->planets[i] = planet;
+		index->positions[3*i+0] = position.x;
+		index->positions[3*i+1] = position.y;
+		index->positions[3*i+2] = position.z;
+		index->radii[i] = 0.0;
+		if (gravity && gravity->has_rs && (gravity->rs > 0.0)) {
+			index->radii[i] = gravity->rs;
+		}
+		index->parent[i] = -1;
+		index->first_child[i] = -1;
+		index->next[i] = -1;
+	}
+	if (entry) SIMC_List_Stop(planets,entry);
+
+	//Find smallest sphere of influence which fully contains every sphere of influence
+	for (i = 0; i < index->planet_count; i++) {
+		if (index->radii[i] <= 0.0) continue;
+		for (j = 0; j < index->planet_count; j++) {
+			EVDS_REAL d[3];
+			int parent = index->parent[i];
+			if ((j == i) || (index->radii[j] < index->radii[i])) continue;
+			if ((index->radii[j] == index->radii[i]) && (j > i)) continue; //Equal spheres are ordered
+			if ((parent >= 0) && (index->radii[j] >= index->radii[parent])) continue;
+
+			d[0] = index->positions[3*j+0] - index->positions[3*i+0];
+			d[1] = index->positions[3*j+1] - index->positions[3*i+1];
+			d[2] = index->positions[3*j+2] - index->positions[3*i+2];
+			if (sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]) + index->radii[i] <= index->radii[j]) {
+				index->parent[i] = j;
+			}
+		}
+	}
+
+	//Link planets into lists (in reverse, so lists keep order of planets)
+	for (i = index->planet_count-1; i >= 0; i--) {
+		if (index->radii[i] <= 0.0) {
+			index->next[i] = index->first_global;
+			index->first_global = i;
+		} else if (index->parent[i] < 0) {
+			index->next[i] = index->first_root;
+			index->first_root = i;
+		} else {
+			index->next[i] = index->first_child[index->parent[i]];
+			index->first_child[index->parent[i]] = i;
+		}
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get index of spheres of influence, rebuild it if it is outdated.
+///
+/// The index is rebuilt when the set of planets or their gravity changes, or when public
+/// state of any planet (or of coordinates containing planets) changes, so it is built once
+/// per step. State of other objects does not affect the index.
+///
+/// Published index is never modified, so queries use it without any locks. A new index is
+/// built in a separate buffer under the index lock, and the previous index is only freed by
+/// the next rebuild.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the index
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetIndex(EVDS_SYSTEM* system, EVDS_SOI_INDEX** p_index) {
+	EVDS_SOI_INDEX* index = system->soi_index;
+	int error_code = EVDS_OK;
+
+	//Use published index if it is still valid
+	if (index && (index->gravity_generation == system->gravity_generation) &&
+				 (index->planet_generation == system->planet_generation)) {
+		*p_index = index;
+		return EVDS_OK;
+	}
+
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(system->soi_index_lock);
+#endif
+	//Check again, index may have been rebuilt by another thread
+	index = system->soi_index;
+	if ((!index) || (index->gravity_generation != system->gravity_generation) ||
+					(index->planet_generation != system->planet_generation)) {
+		index = (EVDS_SOI_INDEX*)malloc(sizeof(EVDS_SOI_INDEX));
+		if (index) {
+			memset(index,0,sizeof(EVDS_SOI_INDEX));
+			error_code = EVDS_InternalEnvironment_BuildIndex(system,index);
+		} else {
+			error_code = EVDS_ERROR_MEMORY;
+		}
+
+		if (error_code == EVDS_OK) {
+			//Index must be complete before it is published
+			EVDS_MEMORY_BARRIER();
+			if (system->soi_index_retired) EVDS_InternalEnvironment_DestroyIndex(system->soi_index_retired);
+			system->soi_index_retired = system->soi_index;
+			system->soi_index = index;
+		} else if (index) {
+			EVDS_InternalEnvironment_DestroyIndex(index);
+		}
+	}
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(system->soi_index_lock);
+#endif
+
+	*p_index = index;
+	return error_code;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find planets relevant to a sphere around the point (in root inertial space).
+///
+/// See EVDS_InternalEnvironment_GetRelevantPlanets().
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_QueryIndex(EVDS_SOI_INDEX* index, EVDS_REAL* point, EVDS_REAL radius,
+										EVDS_OBJECT** planets, int capacity, int* count,
+										EVDS_OBJECT** p_dominant) {
+	EVDS_REAL min_distance2;
+	int node,dominant,total;
+
+	//Planets without sphere of influence are always relevant
+	total = 0;
+	node = index->first_global;
+	while (node >= 0) {
+		if (total < capacity) planets[total] = index->planets[node];
+		total++;
+		node = index->next[node];
+	}
+
+	//Descend into spheres of influence which intersect the query sphere
+	dominant = -1;
+	node = index->first_root;
+	while (node >= 0) {
+		EVDS_REAL dx = point[0] - index->positions[3*node+0];
+		EVDS_REAL dy = point[1] - index->positions[3*node+1];
+		EVDS_REAL dz = point[2] - index->positions[3*node+2];
+		EVDS_REAL reach = index->radii[node] + radius;
+		if (dx*dx + dy*dy + dz*dz <= reach*reach) {
+			if (total < capacity) planets[total] = index->planets[node];
+			total++;
+			if ((dominant < 0) || (index->radii[node] < index->radii[dominant])) dominant = node;
+			if (index->first_child[node] >= 0) {
+				node = index->first_child[node];
+				continue;
+			}
+		}
+
+		//Move to the next sphere on this level, or go back up
+		while ((node >= 0) && (index->next[node] < 0)) node = index->parent[node];
+		if (node >= 0) node = index->next[node];
+	}
+
+	//Find nearest planet if point is not inside any sphere of influence
+	if (dominant < 0) {
+		min_distance2 = 0.0;
+		for (node = 0; node < index->planet_count; node++) {
+			EVDS_REAL dx = point[0] - index->positions[3*node+0];
+			EVDS_REAL dy = point[1] - index->positions[3*node+1];
+			EVDS_REAL dz = point[2] - index->positions[3*node+2];
+			if ((dominant < 0) || (dx*dx + dy*dy + dz*dz < min_distance2)) {
+				min_distance2 = dx*dx + dy*dy + dz*dz;
+				dominant = node;
+			}
+		}
+	}
+	if (p_dominant) *p_dominant = (dominant >= 0) ? index->planets[dominant] : 0;
+
+	//Write back number of relevant planets
+	if (count) *count = total;
+	if (total > capacity) return EVDS_ERROR_MEMORY;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find planets relevant to the given position.
+///
+/// Relevant planets are all planets without sphere of influence, and all planets whose sphere
+/// of influence contains the position (or intersects sphere of the given radius around it).
+/// Up to the given number of them is written into the array (which may be 0 if only the
+/// dominant planet is required).
+///
+/// Dominant planet is the planet with the smallest sphere of influence containing the
+/// position, or the nearest planet if position is not inside of any sphere of influence.
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_MEMORY Not all relevant planets fit into the array (dominant planet is valid)
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the index (no planets are returned)
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetRelevantPlanets(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_REAL radius,
+												EVDS_OBJECT** planets, int capacity, int* count,
+												EVDS_OBJECT** p_dominant) {
+	EVDS_SOI_INDEX* index;
+	EVDS_VECTOR point;
+	EVDS_REAL point_xyz[3];
+	int error_code;
+
+	//Get index (queries do not lock it)
+	error_code = EVDS_InternalEnvironment_GetIndex(system,&index);
+	if (error_code != EVDS_OK) {
+		if (count) *count = 0;
+		if (p_dominant) *p_dominant = 0;
+		return error_code;
+	}
+
+	//Index is shared by all coordinates, only the query point is converted
+	EVDS_Vector_Convert(&point,position,system->inertial_space);
+	point_xyz[0] = point.x;
+	point_xyz[1] = point.y;
+	point_xyz[2] = point.z;
+	return EVDS_InternalEnvironment_QueryIndex(index,point_xyz,radius,planets,capacity,count,p_dominant);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get function pointer stored in the planet variable (or 0 if not defined).
+////////////////////////////////////////////////////////////////////////////////
+void* EVDS_InternalEnvironment_GetCallback(EVDS_OBJECT* planet, const char* name) {
+	EVDS_VARIABLE* callback_var;
+	void* callback = 0;
+	if (!planet) return 0;
+	if (EVDS_Object_GetVariable(planet,name,&callback_var) != EVDS_OK) return 0;
+	EVDS_Variable_GetFunctionPointer(callback_var,&callback);
+	return callback;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get transformation of positions from source to target coordinates.
+///
+/// Conversion of positions between coordinates is a rotation followed by translation,
+/// so it is resolved once and then applied to any number of positions. Transformation
+/// is stored as 3x3 rotation matrix (row by row) followed by translation.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_GetTransform(EVDS_OBJECT* source, EVDS_OBJECT* target, EVDS_REAL* transform) {
+	EVDS_VECTOR v;
+	int i;
+
+	//Rotation (axes of the source coordinates in target coordinates)
+	for (i = 0; i < 3; i++) {
+		EVDS_Vector_Set(&v,EVDS_VECTOR_DIRECTION,source,i == 0,i == 1,i == 2);
+		EVDS_Vector_Convert(&v,&v,target);
+		transform[0*3+i] = v.x;
+		transform[1*3+i] = v.y;
+		transform[2*3+i] = v.z;
+	}
+
+	//Translation (origin of the source coordinates in target coordinates)
+	EVDS_Vector_Set(&v,EVDS_VECTOR_POSITION,source,0.0,0.0,0.0);
+	EVDS_Vector_Convert(&v,&v,target);
+	transform[9]  = v.x;
+	transform[10] = v.y;
+	transform[11] = v.z;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Add gravitational field of the planet in a batch of positions.
+///
+/// Planets with spherical gravity are computed by a single loop over all positions,
+/// with position of the planet resolved once. Other planets are computed position
+/// by position.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory to evaluate the gravity model
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEnvironment_GetPlanetFieldBatch(EVDS_OBJECT* planet, EVDS_OBJECT* coordinates, int count,
+												 EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z, EVDS_REAL* phi,
+												 EVDS_REAL* gx, EVDS_REAL* gy, EVDS_REAL* gz) {
+	EVDS_PLANET_GRAVITY* gravity;
+	EVDS_PLANET_GRAVITY uncached_gravity;
+	EVDS_VECTOR G0;
+	EVDS_REAL px,py,pz,mu,min_r2,max_r2;
+	int i,error_code;
+
+	//Get planets parameters (read them directly if planet is not handled by planet solver)
+	error_code = EVDS_InternalPlanet_GetGravity(planet,&gravity);
+	if (error_code == EVDS_ERROR_BAD_STATE) {
+		memset(&uncached_gravity,0,sizeof(EVDS_PLANET_GRAVITY));
+		EVDS_InternalPlanet_ReadGravity(planet,&uncached_gravity);
+		gravity = &uncached_gravity;
+	} else if (error_code != EVDS_OK) {
+		return error_code;
+	}
+
+	//Non-spherical models are computed for every position separately
+	if (gravity->callback || (gravity->degree > 0) || (gravity->has_j2 && gravity->has_radius)) {
+		for (i = 0; i < count; i++) {
+			EVDS_VECTOR position,field;
+			EVDS_REAL Gphi = 0.0;
+			EVDS_Vector_Set(&position,EVDS_VECTOR_POSITION,coordinates,x[i],y[i],z[i]);
+			EVDS_Vector_Set(&field,EVDS_VECTOR_ACCELERATION,coordinates,0.0,0.0,0.0);
+			EVDS_ERRCHECK(EVDS_InternalEnvironment_GetPlanetField(planet,&position,&Gphi,&field));
+			gx[i] += field.x;
+			gy[i] += field.y;
+			gz[i] += field.z;
+			if (phi) phi[i] += Gphi;
+		}
+		return EVDS_OK;
+	}
+	if (!gravity->has_mu) return EVDS_OK; //Not enough information to compute gravity for this planet
+
+	//Get planet position in coordinates of the batch
+	EVDS_InternalEnvironment_GetPlanetPosition(planet,(gravity == &uncached_gravity) ? 0 : gravity,
+		coordinates,&G0,0);
+	px = G0.x;
+	py = G0.y;
+	pz = G0.z;
+	mu = gravity->mu;
+
+	//Range of distances at which planet pulls (see EVDS_InternalEnvironment_GetPlanetField)
+	min_r2 = EVDS_EPS;
+	if (gravity->has_radius && ((0.81*gravity->radius*gravity->radius) > min_r2)) {
+		min_r2 = 0.81*gravity->radius*gravity->radius;
+	}
+	max_r2 = gravity->has_rs ? gravity->rs*gravity->rs : -1.0;
+
+	//Spherical model, written without branches so the loop can be vectorized
+	for (i = 0; i < count; i++) {
+		EVDS_REAL dx = x[i] - px;
+		EVDS_REAL dy = y[i] - py;
+		EVDS_REAL dz = z[i] - pz;
+		EVDS_REAL r2 = dx*dx + dy*dy + dz*dz;
+		EVDS_REAL r = sqrt(r2);
+		int pulls = (r2 >= min_r2) && ((max_r2 < 0.0) || (r2 <= max_r2));
+		EVDS_REAL k_phi = pulls ? mu/r : 0.0;
+		EVDS_REAL k = pulls ? mu/(r2*r) : 0.0;
+		gx[i] -= k*dx;
+		gy[i] -= k*dy;
+		gz[i] -= k*dz;
+		if (phi) phi[i] -= k_phi;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute built-in planet atmosphere at many altitudes.
+///
+/// Layer is selected by counting layer bases below the geopotential altitude, and the
+/// isothermal and gradient layers differ only by a select, so the loop has no branches
+/// and can be vectorized.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_GetLayeredAtmosphere(EVDS_PLANET_ATMOSPHERE* atmosphere, int count, EVDS_REAL* altitude,
+												   EVDS_REAL* density, EVDS_REAL* pressure, EVDS_REAL* temperature) {
+	int i,j;
+	for (i = 0; i < count; i++) {
+		EVDS_REAL h = altitude[i]/(1.0 + altitude[i]*atmosphere->inverse_geopotential_radius);
+		EVDS_REAL dh,L,Tb,T,P;
+		int layer = 0;
+		for (j = 1; j < atmosphere->layers; j++) layer += (h >= atmosphere->base_altitude[j]);
+
+		dh = h - atmosphere->base_altitude[layer];
+		L = atmosphere->lapse_rate[layer];
+		Tb = atmosphere->base_temperature[layer];
+		T = Tb + L*dh;
+		P = exp(atmosphere->log_pressure[layer] - atmosphere->lapse_constant*((L != 0.0) ? log(T/Tb)/L : dh/Tb));
+
+		temperature[i] = T;
+		pressure[i] = P;
+		density[i] = P/(atmosphere->gas_constant*T);
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Fill parameters of the atmosphere from the built-in model output.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_SetAtmosphere(EVDS_PLANET_ATMOSPHERE* atmosphere, EVDS_REAL density, EVDS_REAL pressure,
+											EVDS_REAL temperature, EVDS_ENVIRONMENT_ATMOSPHERE* parameters) {
+	int i;
+	parameters->density = density;
+	parameters->pressure = pressure;
+	parameters->temperature = temperature;
+	parameters->concentration = pressure/(1.380649e-23*temperature);
+	for (i = 0; i < EVDS_ENVIRONMENT_SPECIES_MAX; i++) {
+		parameters->partial_density[i] = density*atmosphere->mass_fraction[i];
+		parameters->partial_concentration[i] = parameters->concentration*atmosphere->mole_fraction[i];
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find dominant planet for every position in a batch.
+///
+/// Positions are transformed into the root inertial space with a single transformation,
+/// and index of spheres of influence is looked up once for the whole batch. If the index
+/// cannot be built, no position has a dominant planet.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_GetDominantPlanets(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+												 EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+												 EVDS_OBJECT** dominant) {
+	EVDS_SOI_INDEX* index;
+	EVDS_REAL T[12];
+	int i;
+
+	if (EVDS_InternalEnvironment_GetIndex(system,&index) != EVDS_OK) {
+		for (i = 0; i < count; i++) dominant[i] = 0;
+		return;
+	}
+
+	EVDS_InternalEnvironment_GetTransform(coordinates,system->inertial_space,T);
+	for (i = 0; i < count; i++) {
+		EVDS_REAL point[3];
+		point[0] = T[0]*x[i] + T[1]*y[i] + T[2]*z[i] + T[9];
+		point[1] = T[3]*x[i] + T[4]*y[i] + T[5]*z[i] + T[10];
+		point[2] = T[6]*x[i] + T[7]*y[i] + T[8]*z[i] + T[11];
+		EVDS_InternalEnvironment_QueryIndex(index,point,0.0,0,0,0,&dominant[i]);
+	}
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Returns gravitational field in the given position.
 ///
@@ -46,8 +1204,14 @@
 /// mass				| Mass of the planet (in \f$kg\f$)
 /// gravity.mu			| Gravitational parameter of the planet (in \f$m^3 s^{-2}\f$)
 /// gravity.j2			| Second spherical harmonic \f$J_2\f$
+/// gravity.harmonics	| Normalized spherical harmonics coefficients (or name of database entry)
+/// gravity.degree		| Maximum degree of spherical harmonics used in computations
+/// gravity.tolerance	| Relative magnitude of terms at which spherical harmonics are truncated
+/// gravity.grid_altitude	| Altitude covered by the precomputed gravity grid
+/// gravity.grid_layers	| Number of radial layers of the gravity grid
+/// gravity.grid_step	| Angular step of the gravity grid (in degrees)
 /// gravity.rs			| Sphere of influence
-/// geometry.radius		| Planet radius (required if 'j2' is specified)
+/// geometry.radius		| Planet radius (required if 'j2' is specified without harmonics)
 /// gravitational_field | Function pointer to EVDS_Callback_GetGravitationalField
 ///
 /// Gravitational field is returned as an acceleration vector in same coordinates as position.
@@ -55,6 +1219,18 @@
 /// when an object is outside of this sphere. This may be unwanted if small perturbations must
 /// be accounted for.
 ///
+/// Spheres of influence are kept in a hierarchical index in the root inertial space, so planets
+/// whose sphere of influence does not contain the position are skipped without converting
+/// their position into coordinates of the query.
+///
+/// If gravity tree is enabled with EVDS_System_SetGravityTree(), far away groups of planets
+/// are approximated by point masses.
+///
+/// Parameters of planets handled by the planet solver are not looked up for every query: they
+/// are cached in a descriptor, which is rebuilt when any of the variables listed above changes.
+/// Planet positions are resolved once and shared by all queries until state of any object
+/// in the system changes.
+///
 /// Additionally the gravitational potential field in the current location is returned, unless
 /// no pointer to write the value back is given.
 ///
@@ -64,49 +1240,57 @@
 ///		\mathbf{g} &=& -\frac{\mu}{r^2}
 /// \f}
 ///
-/// If perturbation factor \f$J_2\f$ is specified, the spherical harmonics are used to calculate
-/// total gravitational field:
+/// If spherical harmonics coefficients or perturbation factor \f$J_2\f$ are specified, the
+/// spherical harmonics are used to calculate total gravitational field:
 /// \f{eqnarray*}{
-///		\Phi &=& -\frac{\mu}{r}[1 + 
-///			\sum\limits_{n=2}^\infty (\frac{R}{\mu})^n
-///			\sum\limits_{m=0}^n P_{nm} sin(\theta)
-///				[C_{nm} cos(m \lambda) + S_{nm} sin(m \lambda)]
-///			] \\
+///		\Phi &=& -\frac{\mu}{R}
+///			\sum\limits_{n=0}^N \sum\limits_{m=0}^n
+///				\left[\bar{C}_{nm} \bar{V}_{nm} + \bar{S}_{nm} \bar{W}_{nm}\right] \\
+///		\bar{V}_{nm} &=& \left(\frac{R}{r}\right)^{n+1} \bar{P}_{nm}(sin(\theta)) cos(m \lambda) \\
+///		\bar{W}_{nm} &=& \left(\frac{R}{r}\right)^{n+1} \bar{P}_{nm}(sin(\theta)) sin(m \lambda) \\
 ///		\mathbf{g} &=& -\nabla\Phi
 /// \f}
 /// where:
-///  - \f$R\f$ is the planets radius.
-///  - \f$P_{nm}\f$ is the Legendre associated function.
-///  - \f$C_{nm}\f$, \f$S_{nm}\f$ are the spherical harmonics.
-///  - \f$\theta\f$ is the geocentric latitude.
-///  - \f$\lambda\f$ is the geocentric longitude.
+///  - \f$R\f$ is the reference radius of the model.
+///  - \f$\bar{P}_{nm}\f$ is the fully normalized associated Legendre function.
+///  - \f$\bar{C}_{nm}\f$, \f$\bar{S}_{nm}\f$ are the fully normalized spherical harmonics
+///    coefficients (\f$\bar{C}_{00} = 1\f$).
+///  - \f$\theta\f$ is the geocentric latitude in planet-fixed coordinates.
+///  - \f$\lambda\f$ is the geocentric longitude in planet-fixed coordinates.
 ///
-/// To simplify spherical harmonics, only \f$J_2\f$ harmonic can be used:
-/// \f{eqnarray*}{
-///		sin(\theta) &=& sin(arcsin(\frac{z}{\sqrt{x^2 + y^2 + z^2}}))
-///			= \frac{z}{r} \\
-///		n &=& 2 \\
-///		C_{20} &=& J_2 \\
-///		C_{21} &=& 0 \\
-///		C_{22} &=& 0 \\
-///		P_{20} &=& \frac{3}{2}
-/// \f}
+/// Planet-fixed coordinates are defined by orientation of the planet. Both the sums and the
+/// gradient are computed with recursions for \f$\bar{V}_{nm}\f$, \f$\bar{W}_{nm}\f$,
+/// which are stable for high degree and order.
 ///
-/// Therefore the equations for gravitational field become:
-/// \f{eqnarray*}{
-///		\Phi &=& -\frac{\mu}{r}\left[1 + (\frac{R}{\mu})^2 P_{20} \cdot sin(\theta)\cdot C_{20}\right] \\
-///			&=& -\frac{\mu}{r}\left[1 + (\frac{R}{\mu})^2 \frac{3}{2} J_2 
-///				\frac{z}{r} \right] \\
-///		\mathbf{g}_x &=& -\frac{\partial \Phi}{\partial x} = \frac{R^2}{\mu} \frac{3}{2} J_2
-///			\frac{x z}{r^4} -
-///			\frac{x}{r^2} \Phi \\
-///		\mathbf{g}_y &=& -\frac{\partial \Phi}{\partial y} = \frac{R^2}{\mu} \frac{3}{2} J_2
-///			\frac{y z}{r^4} -
-///			\frac{y}{r^2} \Phi \\
-///		\mathbf{g}_z &=& -\frac{\partial \Phi}{\partial z} = \frac{R^2}{\mu} \frac{3}{2} J_2
-///			\left[ \frac{1}{r} - \frac{z^2}{r^4} \right] -
-///			\frac{z}{r^2} \Phi
-/// \f}
+/// Coefficients are loaded when planet is initialized from the "gravity.harmonics" variable.
+/// It either contains coefficients as nested variables, or names an entry in the "gravity"
+/// database which contains them:
+/// ~~~{.xml}
+///	<database name="gravity">
+///		<entry name="earth" radius="6378136.3">
+///			<coefficient n="2" m="0" c="-4.84165371736e-4" s="0" />
+///			<coefficient n="2" m="2" c="2.43914352398e-6" s="-1.40016683654e-6" />
+///			...
+///		</entry>
+///	</database>
+/// ~~~
+/// Reference radius is read from the "radius" attribute, planet radius is used otherwise.
+///
+/// If only \f$J_2\f$ is specified, a degree 2 model with \f$\bar{C}_{20} = -J_2/\sqrt{5}\f$
+/// is used, and planet radius is the reference radius.
+///
+/// Degree of the model may be limited with the "gravity.degree" variable. If "gravity.tolerance"
+/// variable is specified, the series is additionally truncated at degree \f$N\f$ at which
+/// \f$(R/r)^N\f$ falls below the tolerance, so fewer terms are computed at high altitudes.
+///
+/// When many objects move around the same planet, a gravity grid may be precomputed instead
+/// by specifying "gravity.grid_altitude". The grid is a spherical shell in planet-fixed
+/// coordinates from the reference radius up to the given altitude, with "gravity.grid_layers"
+/// layers (16 by default) and nodes every "gravity.grid_step" degrees in latitude and longitude
+/// (2 by default). Non-spherical part of the field is interpolated from the grid using tricubic
+/// interpolation, and spherical part is computed exactly. Largest error of acceleration found
+/// at the centers of grid cells is written into "gravity.grid_error" variable of the planet.
+/// Queries outside of the grid use the model directly.
 ///
 /// If \f$J_2\f$ factor is not specified and planet is defined as an ellipsoid, WGS84-like
 /// gravity model for ellipsoid is used.
@@ -134,6 +1318,7 @@
 ///
 /// @returns Error code
 /// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_MEMORY Not enough memory to evaluate gravity model of a planet
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_Environment_GetGravitationalField(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_REAL* phi, EVDS_VECTOR* field) {
 	EVDS_OBJECT* target_coordinates;
@@ -141,6 +1326,9 @@ int EVDS_Environment_GetGravitationalField(EVDS_SYSTEM* system, EVDS_VECTOR* pos
 	SIMC_LIST_ENTRY* entry;
 	EVDS_VECTOR total_field;
 	EVDS_REAL total_phi;
+	EVDS_OBJECT* relevant_planets[EVDS_INTERNAL_RELEVANT_PLANETS];
+	int relevant_count,i;
+	int error_code = EVDS_OK;
 
 	//Check input and fetch list of planets
 	if (!system) return EVDS_ERROR_BAD_PARAMETER;
@@ -152,133 +1340,829 @@ int EVDS_Environment_GetGravitationalField(EVDS_SYSTEM* system, EVDS_VECTOR* pos
 	EVDS_Vector_Set(&total_field,EVDS_VECTOR_ACCELERATION,target_coordinates,0.0,0.0,0.0);
 	total_phi = 0.0;
 
-	//Iterate through all planets
-	entry = SIMC_List_GetFirst(planets);
-	while (entry) {
-		EVDS_VARIABLE* mass_var; //Planet mass
-		EVDS_REAL mass;
-		EVDS_VARIABLE* mu_var; //Gravitational parameter
-		EVDS_REAL mu;
-		EVDS_VARIABLE* j2_var; //First spherical harmonic
-		EVDS_REAL j2;
-		EVDS_VARIABLE* radius_var; //Planet radius
-		EVDS_REAL radius;
-		EVDS_VARIABLE* rs_var; //Sphere of influence
-		EVDS_REAL rs;
-		EVDS_VARIABLE* callback_var; //Custom field
-		EVDS_Callback_GetGravitationalField* callback;
-
-		//Planet state vector
-		EVDS_STATE_VECTOR planet_state;
-		EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
-
-		//Initialize temporary vectors
-		EVDS_REAL r2,r;
-		EVDS_VECTOR G0,Gr,Gn,Ga;
-		EVDS_REAL Gphi = 0.0;
-		EVDS_Vector_Initialize(G0);
-		EVDS_Vector_Initialize(Gr);
-		EVDS_Vector_Initialize(Gn);
-		EVDS_Vector_Initialize(Ga);
-
-		//Get planet state and position in position vector coordinates
-		EVDS_Object_GetStateVector(planet,&planet_state);
-		EVDS_Vector_Convert(&G0,&planet_state.position,target_coordinates);
-
-		//Get planets parameters
-		EVDS_Object_GetRealVariable(planet,"gravity.mu",&mu,&mu_var);
-		EVDS_Object_GetRealVariable(planet,"gravity.j2",&j2,&j2_var);
-		EVDS_Object_GetRealVariable(planet,"gravity.rs",&rs,&rs_var);
-		EVDS_Object_GetRealVariable(planet,"mass",&mass,&mass_var);
-		EVDS_Object_GetRealVariable(planet,"geometry.radius",&radius,&radius_var);
-
-		//Get custom gravitational field callback
-		if (EVDS_Object_GetVariable(planet,"gravitational_field",&callback_var) == EVDS_OK) {
-			EVDS_Variable_GetFunctionPointer(callback_var,(void**)(&callback));
-		} else {
-			callback = 0;
+	//Use tree of planets if enabled
+	if (system->gravity_tree_angle > 0.0) {
+		EVDS_GRAVITY_TREE* tree;
+		error_code = EVDS_InternalEnvironment_GetTree(system,&tree);
+		if (error_code == EVDS_OK) {
+			error_code = EVDS_InternalEnvironment_GetTreeField(system,tree,system->gravity_tree_angle,
+				position,&total_phi,&total_field);
+		}
+	} else if (EVDS_InternalEnvironment_GetRelevantPlanets(system,position,0.0,
+				relevant_planets,EVDS_INTERNAL_RELEVANT_PLANETS,&relevant_count,0) == EVDS_OK) {
+		//Iterate through planets whose sphere of influence contains the position
+		for (i = 0; (i < relevant_count) && (error_code == EVDS_OK); i++) {
+			error_code = EVDS_InternalEnvironment_GetPlanetField(relevant_planets[i],position,&total_phi,&total_field);
 		}
+	} else {
+		//Iterate through all planets
+		entry = SIMC_List_GetFirst(planets);
+		while (entry) {
+			EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
+			error_code = EVDS_InternalEnvironment_GetPlanetField(planet,position,&total_phi,&total_field);
+			if (error_code != EVDS_OK) {
+				SIMC_List_Stop(planets,entry);
+				break;
+			}
+			entry = SIMC_List_GetNext(planets,entry);
+		}
+	}
+	if (error_code != EVDS_OK) return error_code;
+
+	//Write back information
+	if (phi) *phi = total_phi;
+	if (field) EVDS_Vector_Copy(field,&total_field);
+	return EVDS_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns gravitational field in many positions at once.
+///
+/// All positions are given in the same coordinates as separate arrays of components.
+/// Planets which may contribute to any of the positions are found once for the whole
+/// batch, using the index of spheres of influence and a sphere which bounds all positions.
+/// Planets with spherical gravity are evaluated with a single loop over all positions,
+/// other planets are computed as by EVDS_Environment_GetGravitationalField().
+///
+/// Gravity tree is not used by batch queries, all relevant planets are computed exactly.
+///
+/// Gravitational field is returned in same coordinates as positions. Potential is only
+/// returned if "phi" array is given.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] coordinates Coordinates in which positions are given
+/// @param[in] count Number of positions
+/// @param[in] x Array of X coordinates of positions
+/// @param[in] y Array of Y coordinates of positions
+/// @param[in] z Array of Z coordinates of positions
+/// @param[out] phi Array of gravitational potentials (may be null)
+/// @param[out] gx Array of X components of gravitational field
+/// @param[out] gy Array of Y components of gravitational field
+/// @param[out] gz Array of Z components of gravitational field
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "coordinates" or one of the arrays is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+/// @retval EVDS_ERROR_MEMORY Not enough memory to evaluate gravity model of a planet
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetGravitationalFieldBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+												EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z, EVDS_REAL* phi,
+												EVDS_REAL* gx, EVDS_REAL* gy, EVDS_REAL* gz) {
+	EVDS_OBJECT* relevant_planets[EVDS_INTERNAL_RELEVANT_PLANETS];
+	EVDS_VECTOR center;
+	EVDS_REAL min[3],max[3],radius;
+	int relevant_count,i;
+	int error_code = EVDS_OK;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!coordinates) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!x) || (!y) || (!z)) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!gx) || (!gy) || (!gz)) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Start accumulating total field and potential
+	for (i = 0; i < count; i++) {
+		gx[i] = 0.0;
+		gy[i] = 0.0;
+		gz[i] = 0.0;
+		if (phi) phi[i] = 0.0;
+	}
+	if (count == 0) return EVDS_OK;
 
-		//Calculate radius-vector
-		EVDS_Vector_Subtract(&Gr,position,&G0);
-		EVDS_Vector_Dot(&r2,&Gr,&Gr);
-		r = sqrtf(r2);
+	//Find sphere which bounds all positions
+	min[0] = max[0] = x[0];
+	min[1] = max[1] = y[0];
+	min[2] = max[2] = z[0];
+	for (i = 1; i < count; i++) {
+		if (x[i] < min[0]) min[0] = x[i];
+		if (x[i] > max[0]) max[0] = x[i];
+		if (y[i] < min[1]) min[1] = y[i];
+		if (y[i] > max[1]) max[1] = y[i];
+		if (z[i] < min[2]) min[2] = z[i];
+		if (z[i] > max[2]) max[2] = z[i];
+	}
+	EVDS_Vector_Set(&center,EVDS_VECTOR_POSITION,coordinates,
+		0.5*(min[0]+max[0]),0.5*(min[1]+max[1]),0.5*(min[2]+max[2]));
+	radius = 0.5*sqrt((max[0]-min[0])*(max[0]-min[0]) + 
+					  (max[1]-min[1])*(max[1]-min[1]) +
+					  (max[2]-min[2])*(max[2]-min[2]));
 
-		//Check if inside the planet itself
-		if (radius_var && (r < radius*0.9)) {
+	//Add field of all planets which may pull any of the positions
+	if (EVDS_InternalEnvironment_GetRelevantPlanets(system,&center,radius,
+			relevant_planets,EVDS_INTERNAL_RELEVANT_PLANETS,&relevant_count,0) == EVDS_OK) {
+		for (i = 0; (i < relevant_count) && (error_code == EVDS_OK); i++) {
+			error_code = EVDS_InternalEnvironment_GetPlanetFieldBatch(relevant_planets[i],coordinates,count,x,y,z,phi,gx,gy,gz);
+		}
+	} else {
+		SIMC_LIST* planets;
+		SIMC_LIST_ENTRY* entry;
+		EVDS_System_GetObjectsByType(system,"planet",&planets);
+		entry = SIMC_List_GetFirst(planets);
+		while (entry) {
+			EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
+			error_code = EVDS_InternalEnvironment_GetPlanetFieldBatch(planet,coordinates,count,x,y,z,phi,gx,gy,gz);
+			if (error_code != EVDS_OK) {
+				SIMC_List_Stop(planets,entry);
+				break;
+			}
 			entry = SIMC_List_GetNext(planets,entry);
-			continue; //Too close to the planet
 		}
+	}
+	return error_code;
+}
 
-		//Check if position of source vector matches with planets position
-		if (r2 < EVDS_EPS) {
-			entry = SIMC_List_GetNext(planets,entry);
-			continue; //Planets dont pull themselves
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns magnetic field in the given position.
+///
+/// Magnetic field is computed by the planet which dominates in the given position: the planet
+/// with the smallest sphere of influence ("gravity.rs" variable) containing the position, or
+/// the nearest planet. Planets are found using the index of spheres of influence, so only
+/// planets near the position are looked at.
+///
+/// The field is computed by the callback stored in "magnetic_field" function pointer
+/// variable of the planet (see EVDS_Callback_GetMagneticField). Callback receives position
+/// in coordinates of the planet. If planet has no callback, the field is zero.
+///
+/// Magnetic field is returned in same coordinates as position.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] position Position, in which magnetic field must be calculated
+/// @param[out] field Magnetic field in the position
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "position" or "field" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetMagneticField(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_VECTOR* field) {
+	EVDS_OBJECT* planet;
+	EVDS_Callback_GetMagneticField* callback;
+	EVDS_VECTOR r,planet_field;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!position) return EVDS_ERROR_BAD_PARAMETER;
+	if (!field) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Zero field unless planet provides one
+	EVDS_Vector_Set(field,EVDS_VECTOR_DIRECTION,position->coordinate_system,0.0,0.0,0.0);
+	EVDS_InternalEnvironment_GetRelevantPlanets(system,position,0.0,0,0,0,&planet);
+	callback = (EVDS_Callback_GetMagneticField*)EVDS_InternalEnvironment_GetCallback(planet,"magnetic_field");
+	if (!callback) return EVDS_OK;
+
+	//Compute field in planet coordinates
+	EVDS_Vector_Set(&planet_field,EVDS_VECTOR_DIRECTION,planet,0.0,0.0,0.0);
+	EVDS_Vector_Convert(&r,position,planet);
+	EVDS_ERRCHECK(callback(planet,&r,&planet_field));
+	EVDS_Vector_Convert(field,&planet_field,position->coordinate_system);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns magnetic field in many positions at once.
+///
+/// All positions are given in the same coordinates as separate arrays of components.
+/// Dominant planet is found for every position (see EVDS_Environment_GetMagneticField()),
+/// but conversion of positions into coordinates of the planet and back is resolved once
+/// per planet.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] coordinates Coordinates in which positions are given
+/// @param[in] count Number of positions
+/// @param[in] x Array of X coordinates of positions
+/// @param[in] y Array of Y coordinates of positions
+/// @param[in] z Array of Z coordinates of positions
+/// @param[out] bx Array of X components of magnetic field
+/// @param[out] by Array of Y components of magnetic field
+/// @param[out] bz Array of Z components of magnetic field
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "coordinates" or one of the arrays is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+/// @retval EVDS_ERROR_MEMORY Unable to allocate temporary storage
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetMagneticFieldBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+										   EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+										   EVDS_REAL* bx, EVDS_REAL* by, EVDS_REAL* bz) {
+	EVDS_OBJECT** dominant;
+	EVDS_OBJECT* planet = 0;
+	EVDS_Callback_GetMagneticField* callback = 0;
+	EVDS_REAL T[12];
+	int i,error_code = EVDS_OK;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!coordinates) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!x) || (!y) || (!z)) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!bx) || (!by) || (!bz)) return EVDS_ERROR_BAD_PARAMETER;
+	if (count == 0) return EVDS_OK;
+
+	//Find dominant planet for every position
+	dominant = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	if (!dominant) return EVDS_ERROR_MEMORY;
+	EVDS_InternalEnvironment_GetDominantPlanets(system,coordinates,count,x,y,z,dominant);
+
+	for (i = 0; i < count; i++) {
+		EVDS_VECTOR r,planet_field;
+
+		//Resolve callback and transformation when dominant planet changes
+		if ((i == 0) || (dominant[i] != planet)) {
+			planet = dominant[i];
+			callback = (EVDS_Callback_GetMagneticField*)EVDS_InternalEnvironment_GetCallback(planet,"magnetic_field");
+			if (callback) EVDS_InternalEnvironment_GetTransform(planet,coordinates,T);
 		}
+		bx[i] = 0.0;
+		by[i] = 0.0;
+		bz[i] = 0.0;
+		if (!callback) continue;
 
-		//Check if outside of sphere of influence
-		if (rs_var && (r2 > rs*rs)) {
-			entry = SIMC_List_GetNext(planets,entry);
-			continue; //Too far for gravity to have a meaningful influence
+		//Compute field in planet coordinates (inverse transformation of position)
+		EVDS_Vector_Set(&r,EVDS_VECTOR_POSITION,planet,
+			T[0]*(x[i]-T[9]) + T[3]*(y[i]-T[10]) + T[6]*(z[i]-T[11]),
+			T[1]*(x[i]-T[9]) + T[4]*(y[i]-T[10]) + T[7]*(z[i]-T[11]),
+			T[2]*(x[i]-T[9]) + T[5]*(y[i]-T[10]) + T[8]*(z[i]-T[11]));
+		EVDS_Vector_Set(&planet_field,EVDS_VECTOR_DIRECTION,planet,0.0,0.0,0.0);
+		error_code = callback(planet,&r,&planet_field);
+		if (error_code != EVDS_OK) break;
+
+		//Rotate field back into coordinates of the batch
+		if (planet_field.coordinate_system != planet) {
+			EVDS_Vector_Convert(&planet_field,&planet_field,coordinates);
+			bx[i] = planet_field.x;
+			by[i] = planet_field.y;
+			bz[i] = planet_field.z;
+		} else {
+			bx[i] = T[0]*planet_field.x + T[1]*planet_field.y + T[2]*planet_field.z;
+			by[i] = T[3]*planet_field.x + T[4]*planet_field.y + T[5]*planet_field.z;
+			bz[i] = T[6]*planet_field.x + T[7]*planet_field.y + T[8]*planet_field.z;
+		}
+	}
+	free(dominant);
+	return error_code;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns parameters of the atmosphere in the given position.
+///
+/// Atmosphere is computed by the planet which dominates in the given position (see
+/// EVDS_Environment_GetMagneticField()), by the callback stored in "atmospheric_data"
+/// function pointer variable of the planet (see EVDS_Callback_GetAtmosphericData).
+/// Callback receives position in coordinates of the planet.
+///
+/// If planet has no callback, built-in atmosphere model selected by "atmosphere.model"
+/// variable of the planet is used:
+/// Model			| Description
+/// ----------------|--------------------------------------
+/// @c us76			| U.S. Standard Atmosphere 1976 (lower 86 km, isothermal above)
+/// @c exponential	| Isothermal atmosphere with exponential falloff of density with altitude
+///
+/// Altitude for built-in models is measured from the sphere with radius "geometry.radius".
+/// See EVDS_InternalPlanet_ReadAtmosphere() for parameters of the models.
+/// If planet has neither callback nor built-in model, all parameters are zero (vacuum).
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] position Position, in which atmosphere must be calculated
+/// @param[out] parameters Parameters of the atmosphere
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "position" or "parameters" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetAtmosphericParameters(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_ENVIRONMENT_ATMOSPHERE* parameters) {
+	EVDS_OBJECT* planet;
+	EVDS_Callback_GetAtmosphericData* callback;
+	EVDS_PLANET_ATMOSPHERE* atmosphere;
+	EVDS_PLANET_ATMOSPHERE uncached_atmosphere;
+	EVDS_REAL altitude,density,pressure,temperature;
+	EVDS_VECTOR r;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!position) return EVDS_ERROR_BAD_PARAMETER;
+	if (!parameters) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Vacuum unless planet provides an atmosphere
+	memset(parameters,0,sizeof(EVDS_ENVIRONMENT_ATMOSPHERE));
+	EVDS_InternalEnvironment_GetRelevantPlanets(system,position,0.0,0,0,0,&planet);
+	if (!planet) return EVDS_OK;
+	callback = (EVDS_Callback_GetAtmosphericData*)EVDS_InternalEnvironment_GetCallback(planet,"atmospheric_data");
+
+	//Compute atmosphere in planet coordinates
+	EVDS_Vector_Convert(&r,position,planet);
+	if (callback) return callback(planet,&r,parameters);
+
+	//Get built-in model (read it directly if planet is not handled by planet solver)
+	if (EVDS_InternalPlanet_GetAtmosphere(planet,&atmosphere) != EVDS_OK) {
+		EVDS_InternalPlanet_ReadAtmosphere(planet,&uncached_atmosphere);
+		atmosphere = &uncached_atmosphere;
+	}
+	if (atmosphere->layers == 0) return EVDS_OK;
+
+	//Compute built-in atmosphere
+	EVDS_Vector_Length(&altitude,&r);
+	altitude -= atmosphere->radius;
+	EVDS_InternalEnvironment_GetLayeredAtmosphere(atmosphere,1,&altitude,&density,&pressure,&temperature);
+	EVDS_InternalEnvironment_SetAtmosphere(atmosphere,density,pressure,temperature,parameters);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns parameters of the atmosphere in many positions at once.
+///
+/// All positions are given in the same coordinates as separate arrays of components.
+/// Dominant planet is found for every position (see EVDS_Environment_GetAtmosphericParameters()),
+/// but conversion of positions into coordinates of the planet is resolved once per planet.
+///
+/// Built-in atmosphere models are computed for runs of positions with the same dominant
+/// planet at once, without calling into the model for every position.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] coordinates Coordinates in which positions are given
+/// @param[in] count Number of positions
+/// @param[in] x Array of X coordinates of positions
+/// @param[in] y Array of Y coordinates of positions
+/// @param[in] z Array of Z coordinates of positions
+/// @param[out] parameters Array of atmosphere parameters (one per position)
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "coordinates" or one of the arrays is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+/// @retval EVDS_ERROR_MEMORY Unable to allocate temporary storage
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetAtmosphericParametersBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+												   EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+												   EVDS_ENVIRONMENT_ATMOSPHERE* parameters) {
+	EVDS_OBJECT** dominant;
+	EVDS_OBJECT* planet;
+	EVDS_Callback_GetAtmosphericData* callback;
+	EVDS_PLANET_ATMOSPHERE* atmosphere;
+	EVDS_PLANET_ATMOSPHERE uncached_atmosphere;
+	EVDS_REAL altitude[EVDS_INTERNAL_ATMOSPHERE_BATCH];
+	EVDS_REAL density[EVDS_INTERNAL_ATMOSPHERE_BATCH];
+	EVDS_REAL pressure[EVDS_INTERNAL_ATMOSPHERE_BATCH];
+	EVDS_REAL temperature[EVDS_INTERNAL_ATMOSPHERE_BATCH];
+	EVDS_REAL T[12];
+	int i,j,k,n,error_code = EVDS_OK;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!coordinates) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!x) || (!y) || (!z) || (!parameters)) return EVDS_ERROR_BAD_PARAMETER;
+	if (count == 0) return EVDS_OK;
+
+	//Find dominant planet for every position
+	dominant = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	if (!dominant) return EVDS_ERROR_MEMORY;
+	EVDS_InternalEnvironment_GetDominantPlanets(system,coordinates,count,x,y,z,dominant);
+	memset(parameters,0,count*sizeof(EVDS_ENVIRONMENT_ATMOSPHERE));
+
+	//Process runs of positions with same dominant planet
+	for (i = 0; i < count; i = j) {
+		planet = dominant[i];
+		for (j = i+1; (j < count) && (dominant[j] == planet); j++);
+		if (!planet) continue;
+
+		//Resolve callback, built-in model and transformation once per run
+		callback = (EVDS_Callback_GetAtmosphericData*)EVDS_InternalEnvironment_GetCallback(planet,"atmospheric_data");
+		atmosphere = 0;
+		if (!callback) {
+			if (EVDS_InternalPlanet_GetAtmosphere(planet,&atmosphere) != EVDS_OK) {
+				EVDS_InternalPlanet_ReadAtmosphere(planet,&uncached_atmosphere);
+				atmosphere = &uncached_atmosphere;
+			}
+			if (atmosphere->layers == 0) continue;
 		}
+		EVDS_InternalEnvironment_GetTransform(planet,coordinates,T);
 
-		//Compute gravity acceleration from custom callback or stock code
+		//Compute atmosphere by the callback in planet coordinates (inverse transformation of position)
 		if (callback) {
-			callback(planet,&Gr,&Gphi,&Ga);
-			EVDS_Vector_Add(&total_field,&total_field,&Ga);
-			total_phi += Gphi;
-		} else {
-			//Calculate mu for the planet
-			if (!mu_var) {
-				if (mass_var) {
-					mu = 6.6738480e-11 * mass;
-				} else {
-					entry = SIMC_List_GetNext(planets,entry);
-					continue; //Not enough information to compute gravity for this planet
-				}
+			for (k = i; k < j; k++) {
+				EVDS_VECTOR r;
+				EVDS_Vector_Set(&r,EVDS_VECTOR_POSITION,planet,
+					T[0]*(x[k]-T[9]) + T[3]*(y[k]-T[10]) + T[6]*(z[k]-T[11]),
+					T[1]*(x[k]-T[9]) + T[4]*(y[k]-T[10]) + T[7]*(z[k]-T[11]),
+					T[2]*(x[k]-T[9]) + T[5]*(y[k]-T[10]) + T[8]*(z[k]-T[11]));
+				error_code = callback(planet,&r,&parameters[k]);
+				if (error_code != EVDS_OK) break;
+			}
+			if (error_code != EVDS_OK) break;
+			continue;
+		}
+
+		//Compute built-in atmosphere in blocks (distance to planet center does not depend on rotation)
+		for (k = i; k < j; k += n) {
+			int m;
+			n = ((j-k) < EVDS_INTERNAL_ATMOSPHERE_BATCH) ? (j-k) : EVDS_INTERNAL_ATMOSPHERE_BATCH;
+			for (m = 0; m < n; m++) {
+				EVDS_REAL dx = x[k+m] - T[9];
+				EVDS_REAL dy = y[k+m] - T[10];
+				EVDS_REAL dz = z[k+m] - T[11];
+				altitude[m] = sqrt(dx*dx + dy*dy + dz*dz) - atmosphere->radius;
 			}
-			
-			if (j2_var && radius_var) { //Non-spherical model
-				EVDS_REAL x = Gr.x;
-				EVDS_REAL y = Gr.y;
-				EVDS_REAL z = Gr.z;
-				EVDS_REAL sinlat = z/r;
-
-				//Potential
-				Gphi = -(mu/r)*(1 + (radius*radius/(mu*mu))*(3.0/2.0)*j2*sinlat);
-
-				//Acceleration
-				Ga.coordinate_system = Gr.coordinate_system;
-				Ga.x = (radius*radius/mu)*(3.0/2.0)*j2*
-					(x*z/(r2*r2)) -
-					Gphi*x/r2;
-
-				Ga.y = (radius*radius/mu)*(3.0/2.0)*j2*
-					(y*z/(r2*r2)) -
-					Gphi*y/r2;
-
-				Ga.z = (radius*radius/mu)*(3.0/2.0)*j2*
-					(1/r - z*z/(r2*r2)) -
-					Gphi*z/r2;
-			} { //Spherical model  else
-				//Potential
-				Gphi = -mu/r;
-
-				//Acceleration
-				EVDS_Vector_Normalize(&Gn,&Gr);
-				EVDS_Vector_Multiply(&Ga,&Gn,-mu/r2);
+			EVDS_InternalEnvironment_GetLayeredAtmosphere(atmosphere,n,altitude,density,pressure,temperature);
+			for (m = 0; m < n; m++) {
+				EVDS_InternalEnvironment_SetAtmosphere(atmosphere,density[m],pressure[m],temperature[m],&parameters[k+m]);
 			}
+		}
+	}
+	free(dominant);
+	return error_code;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy cached geometry of the star and occluders
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_DestroyShadowCache(EVDS_SHADOW_CACHE* cache) {
+	if (cache->occluders) free(cache->occluders);
+	if (cache->positions) free(cache->positions);
+	if (cache->axes) free(cache->axes);
+	if (cache->distances) free(cache->distances);
+	if (cache->radii) free(cache->radii);
+	free(cache);
+}
 
-			//Reinterpret vector as acceleration, add to total acceleration
-			Ga.derivative_level = EVDS_VECTOR_ACCELERATION;
-			EVDS_Vector_Add(&total_field,&total_field,&Ga);
-			total_phi += Gphi;
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build cached geometry of the star and occluders.
+///
+/// Cache must be zeroed before it is built.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_BuildShadowCache(EVDS_SYSTEM* system, EVDS_SHADOW_CACHE* cache) {
+	SIMC_LIST* planets;
+	SIMC_LIST_ENTRY* entry;
+	EVDS_VARIABLE* variable;
+	EVDS_VECTOR position;
+	int count,i;
+
+	//Remember for which state the cache is built (read before any state, so no changes are missed)
+	cache->state_generation = system->state_generation;
+	cache->gravity_generation = system->gravity_generation;
+
+	//Find the brightest star
+	count = 0;
+	EVDS_System_GetObjectsByType(system,"planet",&planets);
+	entry = SIMC_List_GetFirst(planets);
+	while (entry) {
+		EVDS_REAL luminosity;
+		EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
+		entry = SIMC_List_GetNext(planets,entry);
+		count++;
+
+		if ((EVDS_Object_GetRealVariable(planet,"radiation.luminosity",&luminosity,0) == EVDS_OK) &&
+			(luminosity > cache->luminosity)) {
+			cache->star = planet;
+			cache->luminosity = luminosity;
 		}
+	}
+	cache->planet_count = count;
+	if ((!cache->star) || (count == 0)) return;
+
+	//Position and parameters of the star
+	EVDS_InternalEnvironment_GetPlanetPosition(cache->star,0,system->inertial_space,&position,0);
+	cache->star_position[0] = position.x;
+	cache->star_position[1] = position.y;
+	cache->star_position[2] = position.z;
+	EVDS_Object_GetRealVariable(cache->star,"geometry.radius",&cache->star_radius,0);
+	if (EVDS_Object_GetVariable(cache->star,"radiation.shadow_model",&variable) == EVDS_OK) {
+		char model[256] = { 0 };
+		EVDS_Variable_GetString(variable,model,255,0);
+		cache->cylindrical = strcmp(model,"cylindrical") == 0;
+	}
+
+	//Allocate space for all occluders
+	cache->occluders = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	cache->positions = (EVDS_REAL*)malloc(3*count*sizeof(EVDS_REAL));
+	cache->axes = (EVDS_REAL*)malloc(3*count*sizeof(EVDS_REAL));
+	cache->distances = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+	cache->radii = (EVDS_REAL*)malloc(count*sizeof(EVDS_REAL));
+
+	//Every other planet with a surface may cast a shadow
+	entry = SIMC_List_GetFirst(planets);
+	while (entry) {
+		EVDS_REAL radius,d[3],distance;
+		EVDS_OBJECT* planet = SIMC_List_GetData(planets,entry);
 		entry = SIMC_List_GetNext(planets,entry);
+		if ((planet == cache->star) || (cache->occluder_count >= count)) continue;
+
+		if ((EVDS_Object_GetRealVariable(planet,"geometry.radius",&radius,0) != EVDS_OK) ||
+			(radius <= 0.0)) continue;
+		EVDS_InternalEnvironment_GetPlanetPosition(planet,0,system->inertial_space,&position,0);
+		d[0] = position.x - cache->star_position[0];
+		d[1] = position.y - cache->star_position[1];
+		d[2] = position.z - cache->star_position[2];
+		distance = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+		if (distance <= EVDS_EPS) continue;
+
+		i = cache->occluder_count++;
+		cache->occluders[i] = planet;
+		cache->positions[3*i+0] = position.x;
+		cache->positions[3*i+1] = position.y;
+		cache->positions[3*i+2] = position.z;
+		cache->axes[3*i+0] = d[0]/distance;
+		cache->axes[3*i+1] = d[1]/distance;
+		cache->axes[3*i+2] = d[2]/distance;
+		cache->distances[i] = distance;
+		cache->radii[i] = radius;
 	}
+}
 
-	//Write back information
-	if (phi) *phi = total_phi;
-	if (field) EVDS_Vector_Copy(field,&total_field);
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get cached geometry of the star and occluders, rebuild it if it is outdated.
+///
+/// The cache is rebuilt when the set of planets or their parameters change, or when public
+/// state of any object changes. Integrator stages use private state vectors, so all stages
+/// of a step share the same cache.
+///
+/// Must be called with the shadow cache lock held.
+////////////////////////////////////////////////////////////////////////////////
+EVDS_SHADOW_CACHE* EVDS_InternalEnvironment_GetShadowCache(EVDS_SYSTEM* system) {
+	EVDS_SHADOW_CACHE* cache = system->shadow_cache;
+	if ((!cache) || (cache->gravity_generation != system->gravity_generation) ||
+		(cache->state_generation != system->state_generation)) {
+		if (cache) EVDS_InternalEnvironment_DestroyShadowCache(cache);
+		cache = (EVDS_SHADOW_CACHE*)malloc(sizeof(EVDS_SHADOW_CACHE));
+		memset(cache,0,sizeof(EVDS_SHADOW_CACHE));
+		EVDS_InternalEnvironment_BuildShadowCache(system,cache);
+		system->shadow_cache = cache;
+	}
+	return cache;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute radiation of the star and shadows in a point (in root inertial space).
+///
+/// Every occluder is tested by either the cylindrical or the conical shadow model. The
+/// conical model treats the star and the occluder as disks of apparent radii \f$a\f$
+/// and \f$b\f$ with angular separation \f$c\f$ between their centers (Montenbruck and Gill):
+/// \f{eqnarray*}{
+///		\nu &=& 1, c \geq a + b \\
+///		\nu &=& 0, c \leq b - a \\
+///		\nu &=& 1 - \frac{b^2}{a^2}, c \leq a - b \\
+///		\nu &=& 1 - \frac{A}{\pi a^2}, \mbox{otherwise}
+/// \f}
+///
+/// where \f$A\f$ is the area where disks overlap. Illumination is given by the deepest
+/// shadow. Occluders which lie farther from the star than the point (by more than their radius)
+/// are rejected by a single dot product with the cached shadow axis.
+///
+/// Direction towards the star is written in root inertial space.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEnvironment_GetShadow(EVDS_SHADOW_CACHE* cache, EVDS_REAL* point,
+										EVDS_ENVIRONMENT_RADIATION* parameters, EVDS_REAL* direction) {
+	EVDS_REAL ds[3],distance,a;
+	int i;
+
+	//No radiation without a star
+	direction[0] = 0.0;
+	direction[1] = 0.0;
+	direction[2] = 0.0;
+	if (!cache->star) return;
+
+	//Direction and distance to the star
+	ds[0] = cache->star_position[0] - point[0];
+	ds[1] = cache->star_position[1] - point[1];
+	ds[2] = cache->star_position[2] - point[2];
+	distance = sqrt(ds[0]*ds[0] + ds[1]*ds[1] + ds[2]*ds[2]);
+	if (distance <= EVDS_EPS) return;
+	direction[0] = ds[0]/distance;
+	direction[1] = ds[1]/distance;
+	direction[2] = ds[2]/distance;
+	a = (cache->star_radius < distance) ? asin(cache->star_radius/distance) : 0.5*EVDS_PI;
+
+	//Fully illuminated unless an occluder is found
+	parameters->star = cache->star;
+	parameters->illumination = 1.0;
+	parameters->shadow_function = EVDS_PI;
+	parameters->shadow_margin = distance;
+	for (i = 0; i < cache->occluder_count; i++) {
+		EVDS_REAL r[3],axial,lateral,occluder_distance,b,c,nu,f,margin;
+		EVDS_REAL R = cache->radii[i];
+		r[0] = point[0] - cache->positions[3*i+0];
+		r[1] = point[1] - cache->positions[3*i+1];
+		r[2] = point[2] - cache->positions[3*i+2];
+
+		//Reject occluders which are behind the point
+		axial = r[0]*cache->axes[3*i+0] + r[1]*cache->axes[3*i+1] + r[2]*cache->axes[3*i+2];
+		if (axial < -R) {
+			if (-axial - R < parameters->shadow_margin) parameters->shadow_margin = -axial - R;
+			continue;
+		}
+		occluder_distance = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+
+		//Point inside the occluder
+		if (occluder_distance <= R) {
+			nu = 0.0;
+			f = (occluder_distance - R)/R;
+			margin = 0.0;
+		} else if (cache->cylindrical) {
+			lateral = occluder_distance*occluder_distance - axial*axial;
+			lateral = (lateral > 0.0) ? sqrt(lateral) : 0.0;
+			nu = ((axial > 0.0) && (lateral < R)) ? 0.0 : 1.0;
+			f = ((axial > 0.0) ? lateral - R : occluder_distance - R)/occluder_distance;
+			margin = fabs(lateral - R);
+		} else {
+			b = asin(R/occluder_distance);
+			c = -(r[0]*direction[0] + r[1]*direction[1] + r[2]*direction[2])/occluder_distance;
+			c = acos((c > 1.0) ? 1.0 : ((c < -1.0) ? -1.0 : c));
+			f = c - b;
+
+			if (c >= a + b) { //Sunlight
+				nu = 1.0;
+				margin = (c - a - b)*occluder_distance;
+			} else if (c <= b - a) { //Umbra
+				nu = 0.0;
+				margin = (b - a - c)*occluder_distance;
+			} else if (c <= a - b) { //Annular eclipse
+				nu = 1.0 - (b*b)/(a*a);
+				margin = (a - b - c)*occluder_distance;
+			} else { //Penumbra
+				EVDS_REAL x = (c*c + a*a - b*b)/(2.0*c);
+				EVDS_REAL y = sqrt((a*a > x*x) ? a*a - x*x : 0.0);
+				EVDS_REAL xa = x/a, xb = (c - x)/b;
+				EVDS_REAL A = a*a*acos((xa > 1.0) ? 1.0 : ((xa < -1.0) ? -1.0 : xa)) +
+							  b*b*acos((xb > 1.0) ? 1.0 : ((xb < -1.0) ? -1.0 : xb)) - c*y;
+				nu = 1.0 - A/(EVDS_PI*a*a);
+				margin = 0.0;
+			}
+		}
+
+		//Deepest shadow defines illumination
+		if (nu < parameters->illumination) parameters->illumination = nu;
+		if (margin < parameters->shadow_margin) parameters->shadow_margin = margin;
+		if (f < parameters->shadow_function) {
+			parameters->shadow_function = f;
+			parameters->occluder = cache->occluders[i];
+		}
+	}
+
+	//Flux of the star and pressure on an absorbing surface
+	parameters->flux = parameters->illumination*cache->luminosity/(4.0*EVDS_PI*distance*distance);
+	parameters->pressure = parameters->flux/EVDS_C;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns parameters of the radiation environment in the given position.
+///
+/// If the planet which dominates in the given position (see EVDS_Environment_GetMagneticField())
+/// has a callback stored in "radiation_data" function pointer variable (see EVDS_Callback_GetRadiationData),
+/// the radiation environment is computed by the callback. Callback receives position in
+/// coordinates of the planet.
+///
+/// Otherwise the built-in model is used. Radiation is emitted by the planet with the largest
+/// "radiation.luminosity" variable (the star), and may be eclipsed by any other planet
+/// with "geometry.radius" variable:
+/// Name						| Description
+/// ----------------------------|------------------------------------
+/// radiation.luminosity		| Total radiated power of the star [W]
+/// radiation.shadow_model		| Shadow model: "conical" (default) or "cylindrical"
+/// geometry.radius				| Radius of the star or of the occluding planet
+///
+/// Positions of the star and occluders are cached until public state of any object
+/// changes, so queries made from every stage of the integrator only convert the
+/// query point. If there is no star, parameters are zeroed.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] position Position, in which radiation environment must be calculated
+/// @param[out] parameters Parameters of the radiation environment
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "position" or "parameters" is null
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetRadiationParameters(EVDS_SYSTEM* system, EVDS_VECTOR* position, EVDS_ENVIRONMENT_RADIATION* parameters) {
+	EVDS_OBJECT* planet;
+	EVDS_Callback_GetRadiationData* callback;
+	EVDS_VECTOR r;
+	EVDS_REAL point[3],direction[3];
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!position) return EVDS_ERROR_BAD_PARAMETER;
+	if (!parameters) return EVDS_ERROR_BAD_PARAMETER;
+
+	//Use radiation model of the planet if it provides one
+	memset(parameters,0,sizeof(EVDS_ENVIRONMENT_RADIATION));
+	EVDS_InternalEnvironment_GetRelevantPlanets(system,position,0.0,0,0,0,&planet);
+	callback = (EVDS_Callback_GetRadiationData*)EVDS_InternalEnvironment_GetCallback(planet,"radiation_data");
+	if (callback) {
+		EVDS_Vector_Convert(&r,position,planet);
+		return callback(planet,&r,parameters);
+	}
+
+	//Compute built-in model in root inertial space
+	EVDS_Vector_Convert(&r,position,system->inertial_space);
+	point[0] = r.x;
+	point[1] = r.y;
+	point[2] = r.z;
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(system->shadow_cache_lock);
+#endif
+	EVDS_InternalEnvironment_GetShadow(EVDS_InternalEnvironment_GetShadowCache(system),point,parameters,direction);
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(system->shadow_cache_lock);
+#endif
+
+	//Direction towards the star in coordinates of the query
+	EVDS_Vector_Set(&r,EVDS_VECTOR_DIRECTION,system->inertial_space,direction[0],direction[1],direction[2]);
+	EVDS_Vector_Convert(&parameters->direction,&r,position->coordinate_system);
 	return EVDS_OK;
-}
\ No newline at end of file
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Returns parameters of the radiation environment in many positions at once.
+///
+/// All positions are given in the same coordinates as separate arrays of components.
+/// Dominant planet is found for every position (see EVDS_Environment_GetRadiationParameters()),
+/// but conversion of positions into coordinates of the planet is resolved once per planet.
+/// Positions where the built-in model is used are transformed into root inertial space
+/// with a single transformation, and the shadow cache is locked once for the whole batch.
+///
+/// @param[in] system Pointer to the system object
+/// @param[in] coordinates Coordinates in which positions are given
+/// @param[in] count Number of positions
+/// @param[in] x Array of X coordinates of positions
+/// @param[in] y Array of Y coordinates of positions
+/// @param[in] z Array of Z coordinates of positions
+/// @param[out] parameters Array of radiation environment parameters (one per position)
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_BAD_PARAMETER "system", "coordinates" or one of the arrays is null
+/// @retval EVDS_ERROR_BAD_PARAMETER "count" is negative
+/// @retval EVDS_ERROR_MEMORY Unable to allocate temporary storage
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Environment_GetRadiationParametersBatch(EVDS_SYSTEM* system, EVDS_OBJECT* coordinates, int count,
+												 EVDS_REAL* x, EVDS_REAL* y, EVDS_REAL* z,
+												 EVDS_ENVIRONMENT_RADIATION* parameters) {
+	EVDS_OBJECT** dominant;
+	EVDS_OBJECT* planet = 0;
+	EVDS_Callback_GetRadiationData* callback = 0;
+	EVDS_SHADOW_CACHE* cache;
+	EVDS_REAL T[12],Ti[12];
+	int i,has_builtin = 0,error_code = EVDS_OK;
+	if (!system) return EVDS_ERROR_BAD_PARAMETER;
+	if (!coordinates) return EVDS_ERROR_BAD_PARAMETER;
+	if (count < 0) return EVDS_ERROR_BAD_PARAMETER;
+	if ((!x) || (!y) || (!z) || (!parameters)) return EVDS_ERROR_BAD_PARAMETER;
+	if (count == 0) return EVDS_OK;
+
+	//Find dominant planet for every position
+	dominant = (EVDS_OBJECT**)malloc(count*sizeof(EVDS_OBJECT*));
+	if (!dominant) return EVDS_ERROR_MEMORY;
+	EVDS_InternalEnvironment_GetDominantPlanets(system,coordinates,count,x,y,z,dominant);
+
+	for (i = 0; i < count; i++) {
+		EVDS_VECTOR r;
+
+		//Resolve callback and transformation when dominant planet changes
+		if ((i == 0) || (dominant[i] != planet)) {
+			planet = dominant[i];
+			callback = (EVDS_Callback_GetRadiationData*)EVDS_InternalEnvironment_GetCallback(planet,"radiation_data");
+			if (callback) EVDS_InternalEnvironment_GetTransform(planet,coordinates,T);
+		}
+		memset(&parameters[i],0,sizeof(EVDS_ENVIRONMENT_RADIATION));
+		if (!callback) {
+			dominant[i] = 0; //Computed by the built-in model below
+			has_builtin = 1;
+			continue;
+		}
+
+		//Compute radiation environment in planet coordinates (inverse transformation of position)
+		EVDS_Vector_Set(&r,EVDS_VECTOR_POSITION,planet,
+			T[0]*(x[i]-T[9]) + T[3]*(y[i]-T[10]) + T[6]*(z[i]-T[11]),
+			T[1]*(x[i]-T[9]) + T[4]*(y[i]-T[10]) + T[7]*(z[i]-T[11]),
+			T[2]*(x[i]-T[9]) + T[5]*(y[i]-T[10]) + T[8]*(z[i]-T[11]));
+		error_code = callback(planet,&r,&parameters[i]);
+		if (error_code != EVDS_OK) break;
+	}
+
+	//Compute built-in model in root inertial space
+	if (has_builtin && (error_code == EVDS_OK)) {
+		EVDS_InternalEnvironment_GetTransform(coordinates,system->inertial_space,Ti);
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(system->shadow_cache_lock);
+#endif
+		cache = EVDS_InternalEnvironment_GetShadowCache(system);
+		for (i = 0; i < count; i++) {
+			EVDS_REAL point[3],d[3];
+			if (dominant[i]) continue;
+			point[0] = Ti[0]*x[i] + Ti[1]*y[i] + Ti[2]*z[i] + Ti[9];
+			point[1] = Ti[3]*x[i] + Ti[4]*y[i] + Ti[5]*z[i] + Ti[10];
+			point[2] = Ti[6]*x[i] + Ti[7]*y[i] + Ti[8]*z[i] + Ti[11];
+			EVDS_InternalEnvironment_GetShadow(cache,point,&parameters[i],d);
+
+			//Direction towards the star in coordinates of the query (inverse rotation)
+			EVDS_Vector_Set(&parameters[i].direction,EVDS_VECTOR_DIRECTION,coordinates,
+				Ti[0]*d[0] + Ti[3]*d[1] + Ti[6]*d[2],
+				Ti[1]*d[0] + Ti[4]*d[1] + Ti[7]*d[2],
+				Ti[2]*d[0] + Ti[5]*d[1] + Ti[8]*d[2]);
+		}
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(system->shadow_cache_lock);
+#endif
+	}
+	free(dominant);
+	return error_code;
+}
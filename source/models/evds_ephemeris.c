@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+#ifdef _WIN32
+#	include <windows.h>
+#else
+#	include <sys/types.h>
+#	include <sys/stat.h>
+#	include <sys/mman.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+//Size of the ephemeris file header
+#define EVDS_INTERNAL_EPHEMERIS_HEADER 40
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Map ephemeris file into memory.
+///
+/// Ephemeris file holds Chebyshev polynomial coefficients for positions of one or more
+/// bodies over consecutive time segments of equal length (similar to JPL DE ephemerides).
+/// All values are stored in native byte order:
+/// Offset	| Type		| Description
+/// --------|-----------|-------------------------------------------------------
+/// 0		| char[8]	| Signature "EVDSEPH1"
+/// 8		| double	| Start of the first segment (MJD)
+/// 16		| double	| Length of every segment (days)
+/// 24		| int32		| Number of segments
+/// 28		| int32		| Number of coefficients per component (degree + 1)
+/// 32		| int32		| Number of bodies
+/// 36		| int32		| Reserved (zero)
+/// 40		| double[]	| Coefficients
+///
+/// Coefficients are stored by segment, body, component (X, Y, Z) and degree. Positions
+/// are in meters, in coordinates of the parent of the body.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_FILE Unable to open or map the file
+/// @retval EVDS_ERROR_SYNTAX File is not an ephemeris file or is truncated
+/// @retval EVDS_ERROR_BAD_PARAMETER Body is not in the file
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalEphemeris_Load(const char* filename, int body, EVDS_EPHEMERIS* ephemeris) {
+	unsigned char* data;
+	int header[4];
+	double times[2];
+	double required_size;
+
+	//Map file into memory
+	memset(ephemeris,0,sizeof(EVDS_EPHEMERIS));
+#ifdef _WIN32
+	{
+		LARGE_INTEGER size;
+		ephemeris->file = CreateFileA(filename,GENERIC_READ,FILE_SHARE_READ,0,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,0);
+		if (ephemeris->file == INVALID_HANDLE_VALUE) return EVDS_ERROR_FILE;
+		if ((!GetFileSizeEx(ephemeris->file,&size)) || (size.QuadPart < EVDS_INTERNAL_EPHEMERIS_HEADER)) {
+			CloseHandle(ephemeris->file);
+			return EVDS_ERROR_SYNTAX;
+		}
+		ephemeris->size = (size_t)size.QuadPart;
+		ephemeris->mapping = CreateFileMappingA(ephemeris->file,0,PAGE_READONLY,0,0,0);
+		if (!ephemeris->mapping) {
+			CloseHandle(ephemeris->file);
+			return EVDS_ERROR_FILE;
+		}
+		ephemeris->data = MapViewOfFile(ephemeris->mapping,FILE_MAP_READ,0,0,0);
+		if (!ephemeris->data) {
+			CloseHandle(ephemeris->mapping);
+			CloseHandle(ephemeris->file);
+			return EVDS_ERROR_FILE;
+		}
+	}
+#else
+	{
+		struct stat file_stat;
+		int file = open(filename,O_RDONLY);
+		if (file < 0) return EVDS_ERROR_FILE;
+		if ((fstat(file,&file_stat) != 0) || (file_stat.st_size < EVDS_INTERNAL_EPHEMERIS_HEADER)) {
+			close(file);
+			return EVDS_ERROR_SYNTAX;
+		}
+		ephemeris->size = (size_t)file_stat.st_size;
+		ephemeris->data = mmap(0,ephemeris->size,PROT_READ,MAP_SHARED,file,0);
+		close(file);
+		if (ephemeris->data == MAP_FAILED) {
+			ephemeris->data = 0;
+			return EVDS_ERROR_FILE;
+		}
+	}
+#endif
+
+	//Read header
+	data = (unsigned char*)ephemeris->data;
+	memcpy(times,data+8,sizeof(times));
+	memcpy(header,data+24,sizeof(header));
+	ephemeris->start = times[0];
+	ephemeris->segment_length = times[1];
+	ephemeris->segments = header[0];
+	ephemeris->coefficients_count = header[1];
+	ephemeris->bodies = header[2];
+	ephemeris->body = body;
+	ephemeris->segment = -1;
+	ephemeris->coefficients = (double*)(data + EVDS_INTERNAL_EPHEMERIS_HEADER);
+
+	//Check if header is valid and file holds all coefficients
+	required_size = EVDS_INTERNAL_EPHEMERIS_HEADER +
+		8.0*ephemeris->segments*ephemeris->bodies*3.0*ephemeris->coefficients_count;
+	if ((memcmp(data,"EVDSEPH1",8) != 0) || (ephemeris->segment_length <= 0.0) ||
+		(ephemeris->segments <= 0) || (ephemeris->bodies <= 0) || (ephemeris->coefficients_count <= 0) ||
+		(ephemeris->coefficients_count > EVDS_EPHEMERIS_MAX_COEFFICIENTS) ||
+		(required_size > (double)ephemeris->size)) {
+		EVDS_InternalEphemeris_Unload(ephemeris);
+		return EVDS_ERROR_SYNTAX;
+	}
+	if ((body < 0) || (body >= ephemeris->bodies)) {
+		EVDS_InternalEphemeris_Unload(ephemeris);
+		return EVDS_ERROR_BAD_PARAMETER;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Unmap ephemeris file.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEphemeris_Unload(EVDS_EPHEMERIS* ephemeris) {
+	if (!ephemeris->data) return;
+#ifdef _WIN32
+	UnmapViewOfFile(ephemeris->data);
+	CloseHandle(ephemeris->mapping);
+	CloseHandle(ephemeris->file);
+#else
+	munmap(ephemeris->data,ephemeris->size);
+#endif
+	ephemeris->data = 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute position and velocity of the body from ephemeris.
+///
+/// Chebyshev polynomials and their derivatives are computed once and shared by all
+/// three components. Time outside of the ephemeris is clamped to its first or last segment.
+///
+/// Position is returned in meters, velocity in meters per second.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalEphemeris_Evaluate(EVDS_EPHEMERIS* ephemeris, EVDS_REAL mjd, EVDS_REAL* position, EVDS_REAL* velocity) {
+	double T[EVDS_EPHEMERIS_MAX_COEFFICIENTS];
+	double dT[EVDS_EPHEMERIS_MAX_COEFFICIENTS];
+	double *c,t,segment_start;
+	int i,k,n,segment;
+
+	//Find segment (segment of the previous evaluation is checked first)
+	segment = ephemeris->segment;
+	segment_start = ephemeris->start + segment*ephemeris->segment_length;
+	if ((segment < 0) || (mjd < segment_start) || (mjd >= segment_start + ephemeris->segment_length)) {
+		segment = (int)floor((mjd - ephemeris->start)/ephemeris->segment_length);
+		if (segment < 0) segment = 0;
+		if (segment > ephemeris->segments-1) segment = ephemeris->segments-1;
+		segment_start = ephemeris->start + segment*ephemeris->segment_length;
+		ephemeris->segment = segment;
+	}
+
+	//Normalized time inside the segment
+	t = 2.0*(mjd - segment_start)/ephemeris->segment_length - 1.0;
+	if (t < -1.0) t = -1.0;
+	if (t > 1.0) t = 1.0;
+
+	//Chebyshev polynomials and their derivatives
+	n = ephemeris->coefficients_count;
+	T[0] = 1.0;
+	dT[0] = 0.0;
+	if (n > 1) {
+		T[1] = t;
+		dT[1] = 1.0;
+	}
+	for (k = 2; k < n; k++) {
+		T[k] = 2.0*t*T[k-1] - T[k-2];
+		dT[k] = 2.0*T[k-1] + 2.0*t*dT[k-1] - dT[k-2];
+	}
+
+	//Sum series for every component
+	c = ephemeris->coefficients + ((size_t)segment*ephemeris->bodies + ephemeris->body)*3*n;
+	for (i = 0; i < 3; i++) {
+		double p = 0.0, v = 0.0;
+		for (k = 0; k < n; k++) {
+			p += c[k]*T[k];
+			v += c[k]*dT[k];
+		}
+		position[i] = p;
+		velocity[i] = v*2.0/(ephemeris->segment_length*86400.0);
+		c += n;
+	}
+}
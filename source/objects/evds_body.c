@@ -39,9 +39,21 @@
 ///  - Moments of inertia are considered quasiconstant (\f$\frac{dI}{dt} = 0\f$).
 ///  - Dynamic properties (moments of inertia, mass, center of mass) are assumed.
 ///		to have linear change over integration period (if a change occurs).
+///  - Total mass properties are only recomputed when mass properties of the body or its children
+///    change, or children are moved, attached or detached. Cached totals are used otherwise.
+///  - Passive subtrees (rigidly attached parts without solvers, or rigid bodies made only of such
+///    parts) are compiled into the cached mass properties of the body. They are not integrated
+///    and are only solved when their mass properties change, so cost of every step scales with
+///    the number of active parts (engines, tanks, gimbals, etc).
+///  - Forces of children declared state independent (see EVDS_Object_SetStateIndependent(),
+///    for example rocket engines) are evaluated once per step and reused for every stage
+///    of the integrator.
 ///
 ///	Additional advanced features:
 ///	 - Basic drag model for vessel and its children bodies which do not provide aerodynamic forces.
+///	 - Solar radiation pressure with eclipses by planets (if "srp.coefficient" is defined).
+///	   Radiation environment is evaluated once per step and reused by every stage of the
+///	   integrator, unless the body is close enough to a shadow boundary to cross it during the step.
 ///	 - First-order realtime reentry heating model for vessel and its children.
 ///
 ///
@@ -78,6 +90,12 @@
 ///	iyy				| Moment of inertia (principial axis Y)
 ///	izz				| Moment of inertia (principial axis Z)
 ///
+/// Solar radiation pressure is only computed if these variables are defined:
+/// Name			| Description
+/// ----------------|------------------------------------
+///	srp.coefficient	| Radiation pressure coefficient (1 for absorbing surface, 2 for mirror)
+///	srp.area		| Cross-section area (cannonball model). If not defined, area of the bodys own mesh projected towards the star is used
+///
 /// 
 /// Equations
 /// --------------------------------------------------------------------------------
@@ -182,9 +200,21 @@
 /// See EVDS_Callback_GetAtmosphericData() for information about equations related to atmospheric
 /// model.
 ///
-///	### Solar Drag ###
-/// See EVDS_Callback_GetRadiationData() for information about equations related to solar radiation
-/// model.
+///	### Solar Radiation Pressure ###
+/// See EVDS_Environment_GetRadiationParameters() for information about equations related to solar
+/// radiation and eclipse model.
+///
+/// \f{eqnarray*}{
+///		a &=& -\frac{P C_r A}{m} \hat{s}
+/// \f}
+///
+/// where:
+///  - \f$P\f$ is the radiation pressure (including shadowing by planets).
+///  - \f$C_r\f$ is the radiation pressure coefficient.
+///  - \f$A\f$ is the cross-section area. For the mesh it is computed as \f$A = \frac{1}{2} \sum |n_i \cdot \hat{s}| A_i\f$,
+///    which is exact for closed convex bodies.
+///  - \f$m\f$ is the mass of the rigid body.
+///  - \f$\hat{s}\f$ is the unit vector towards the star.
 ///
 /// ### Realtime Heating Model ###
 /// (not implemented yet)
@@ -192,10 +222,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 #include "evds.h"
 
 
 #ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_SOLVER_RIGID_CHILD_TAG {
+	EVDS_OBJECT* object;			//Child object
+	int is_active;					//Child or any object in its subtree has active behavior
+	int has_mass;					//Child has mass properties defined
+	EVDS_VARIABLE *m;				//Total mass of the child (or mass)
+	EVDS_VARIABLE *cm;				//Total center of mass of the child (or center of mass)
+	EVDS_VARIABLE *Ix, *Iy, *Iz;	//Total moment of inertia of the child (or radius of gyration squared)
+	int is_gyration;				//Tensor is radius of gyration squared (must be multiplied by mass)
+	int is_state_independent;		//Forces of the child do not depend on state of this body
+	int has_derivative;				//Cached forces of the child are valid for current step
+	EVDS_STATE_VECTOR_DERIVATIVE derivative; //Cached forces and torques of the child
+} EVDS_SOLVER_RIGID_CHILD;
+
 typedef struct EVDS_SOLVER_RIGID_USERDATA_TAG {
 	//Is this body static?
 	int is_static;
@@ -218,12 +262,185 @@ typedef struct EVDS_SOLVER_RIGID_USERDATA_TAG {
 
 	//Vessel-specific variables
 	EVDS_VARIABLE *detach;			//Detach vessel from current parent
+
+	//Solar radiation pressure (radiation environment is evaluated once per step)
+	EVDS_VARIABLE *srp_coefficient;	//Radiation pressure coefficient (or 0 if not computed)
+	EVDS_VARIABLE *srp_area;		//Cross-section area (or 0 if computed from mesh)
+	EVDS_MESH* srp_mesh;			//Mesh used to compute cross-section area (or 0)
+	EVDS_REAL srp_cross_section;	//Cross-section area towards the star at the beginning of the step
+	EVDS_VECTOR radiation_position;	//Position in which radiation environment was evaluated
+	EVDS_ENVIRONMENT_RADIATION radiation; //Radiation environment at the beginning of the step
+	int has_radiation;				//Radiation environment at the beginning of the step is valid
+
+	//Children and their mass properties (rebuilt when structure of children changes)
+	EVDS_SOLVER_RIGID_CHILD* children;
+	int children_count;
+	int children_generation;		//Generation of the list of children when cache was built
 } EVDS_SOLVER_RIGID_USERDATA;
 #endif
 
 
 
 
+//Forward declaration
+extern EVDS_SOLVER EVDS_Solver_RigidBody;
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if object or any object in its subtree has active behavior.
+///
+/// Passive objects are rigidly attached objects which have no solver (or are
+/// rigid bodies themselves) and no custom callbacks. Such objects can never produce
+/// forces or torques, so they only contribute mass properties to the parent body.
+///
+/// The result is cached in the object until its children generation changes. The
+/// generation is incremented on the object and all its parents whenever callbacks
+/// are set or the structure of the subtree changes.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalRigidBody_IsActive(EVDS_OBJECT* object) {
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+	int generation,is_active;
+
+	//Check if cached result is still valid
+	generation = object->children_generation;
+	if (object->active_generation == generation) return object->is_active;
+
+	//Check the object itself and then the subtree
+	is_active = 0;
+	if (object->solve || object->integrate) is_active = 1;
+	if (object->solver && (object->solver != &EVDS_Solver_RigidBody)) is_active = 1;
+	if (!is_active) {
+		EVDS_Object_GetChildren(object,&children);
+		entry = SIMC_List_GetFirst(children);
+		while (entry) {
+			if (EVDS_InternalRigidBody_IsActive((EVDS_OBJECT*)SIMC_List_GetData(children,entry))) {
+				SIMC_List_Stop(children,entry);
+				is_active = 1;
+				break;
+			}
+			entry = SIMC_List_GetNext(children,entry);
+		}
+	}
+
+	object->is_active = is_active;
+	object->active_generation = generation;
+	return is_active;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build cache of all children and their mass property variables.
+///
+/// Passive subtrees (see EVDS_InternalRigidBody_IsActive()) are compiled into the
+/// cached mass properties of this body: they are not integrated, and are only solved
+/// when their mass properties have changed.
+///
+/// Forces of children which were declared state independent (see EVDS_Object_SetStateIndependent())
+/// are evaluated once per step and reused for every stage of the integrator.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalRigidBody_UpdateChildren(EVDS_OBJECT* object, EVDS_SOLVER_RIGID_USERDATA* userdata) {
+	int count;
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+	userdata->children_generation = object->children_generation;
+
+	//Allocate space for all children
+	count = 0;
+	EVDS_ERRCHECK(EVDS_Object_GetChildren(object,&children));
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		count++;
+		entry = SIMC_List_GetNext(children,entry);
+	}
+	if (userdata->children) free(userdata->children);
+	userdata->children = (EVDS_SOLVER_RIGID_CHILD*)malloc(sizeof(EVDS_SOLVER_RIGID_CHILD)*(count+1));
+	userdata->children_count = 0;
+	if (!userdata->children) return EVDS_ERROR_MEMORY;
+
+	//Find variables of every child
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
+		EVDS_SOLVER_RIGID_CHILD* cache = &userdata->children[userdata->children_count];
+		if (userdata->children_count >= count) { //List has grown while it was being counted
+			SIMC_List_Stop(children,entry);
+			break;
+		}
+		userdata->children_count++;
+		cache->object = child;
+		cache->is_active = EVDS_InternalRigidBody_IsActive(child);
+		cache->is_state_independent = child->state_independent;
+		cache->has_derivative = 0;
+		cache->has_mass = 0;
+		cache->is_gyration = 0;
+		entry = SIMC_List_GetNext(children,entry);
+
+		//Get mass and center of mass
+		if ((EVDS_Object_GetVariable(child,"total_mass",&cache->m) != EVDS_OK) &&
+			(EVDS_Object_GetVariable(child,"mass",&cache->m) != EVDS_OK)) continue;
+		if ((EVDS_Object_GetVariable(child,"total_cm",&cache->cm) != EVDS_OK) &&
+			(EVDS_Object_GetVariable(child,"cm",&cache->cm) != EVDS_OK)) continue;
+
+		//Get moments of inertia
+		if ((EVDS_Object_GetVariable(child,"total_ix",&cache->Ix) != EVDS_OK) ||
+			(EVDS_Object_GetVariable(child,"total_iy",&cache->Iy) != EVDS_OK) ||
+			(EVDS_Object_GetVariable(child,"total_iz",&cache->Iz) != EVDS_OK)) {
+			cache->is_gyration = 1;
+			if ((EVDS_Object_GetVariable(child,"jx",&cache->Ix) != EVDS_OK) ||
+				(EVDS_Object_GetVariable(child,"jy",&cache->Iy) != EVDS_OK) ||
+				(EVDS_Object_GetVariable(child,"jz",&cache->Iz) != EVDS_OK)) continue;
+		}
+		cache->has_mass = 1;
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate radiation environment and cross-section area at the beginning of the step.
+///
+/// Radiation environment remains valid for all stages of the integrator as long as the body
+/// stays closer to the evaluated position than half of the distance to the nearest shadow
+/// boundary (see EVDS_ENVIRONMENT_RADIATION). Cross-section of the mesh is computed once per step.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalRigidBody_UpdateRadiation(EVDS_SYSTEM* system, EVDS_OBJECT* object, EVDS_SOLVER_RIGID_USERDATA* userdata) {
+	EVDS_STATE_VECTOR state;
+	EVDS_VECTOR direction;
+	int i;
+
+	//Radiation environment in current position
+	EVDS_Object_GetStateVector(object,&state);
+	EVDS_ERRCHECK(EVDS_Environment_GetRadiationParameters(system,&state.position,&userdata->radiation));
+	EVDS_Vector_Copy(&userdata->radiation_position,&state.position);
+	if ((!userdata->radiation.star) && (userdata->radiation.pressure <= 0.0)) return EVDS_OK;
+	userdata->has_radiation = 1;
+
+	//Cross-section area (cannonball model)
+	if (userdata->srp_area) {
+		EVDS_Variable_GetReal(userdata->srp_area,&userdata->srp_cross_section);
+		return EVDS_OK;
+	}
+
+	//Cross-section area of the mesh towards the star (zero if body has no geometry)
+	userdata->srp_cross_section = 0.0;
+	if ((!userdata->srp_mesh) && (EVDS_Mesh_Generate(object,&userdata->srp_mesh,16.0f,
+			EVDS_MESH_USE_DIVISIONS | EVDS_MESH_SKIP_VERTICES | EVDS_MESH_SKIP_INDICES | EVDS_MESH_SKIP_EDGES) != EVDS_OK)) {
+		userdata->srp_mesh = 0;
+		return EVDS_OK;
+	}
+	EVDS_Vector_Convert(&direction,&userdata->radiation.direction,object);
+	for (i = 0; i < userdata->srp_mesh->num_triangles; i++) {
+		EVDS_MESH_TRIANGLE* triangle = &userdata->srp_mesh->triangles[i];
+		userdata->srp_cross_section += 0.5*triangle->area*fabs(
+			triangle->triangle_normal.x*direction.x +
+			triangle->triangle_normal.y*direction.y +
+			triangle->triangle_normal.z*direction.z);
+	}
+	return EVDS_OK;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Rigid body solver
 ///
@@ -247,10 +464,9 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 	EVDS_VECTOR cIx,cIy,cIz;
 	EVDS_STATE_VECTOR state;
 
-	//List of children
-	SIMC_LIST* children;
-	SIMC_LIST_ENTRY* entry;
+	//Cached children
 	EVDS_SOLVER_RIGID_USERDATA* userdata;
+	int i;
 	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
 
 	//Fetch variables which have not yet been initialized
@@ -260,15 +476,29 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 	if (!userdata->cm) EVDS_ERRCHECK(EVDS_Object_GetVariable(object,"cm",&userdata->cm));
 	userdata->is_consistent = 1;
 
-	//Solve all children first
-	EVDS_ERRCHECK(EVDS_Object_GetChildren(object,&children));
-	entry = SIMC_List_GetFirst(children);
-	while (entry) {
-		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
-		EVDS_Object_Solve(child,delta_time);
-		entry = SIMC_List_GetNext(children,entry);
+	//Rebuild cache of children if structure of children has changed
+	if (userdata->children_generation != object->children_generation) {
+		EVDS_ERRCHECK(EVDS_InternalRigidBody_UpdateChildren(object,userdata));
+	}
+
+	//Solve all children first (passive children only if their mass properties have changed)
+	for (i = 0; i < userdata->children_count; i++) {
+		EVDS_SOLVER_RIGID_CHILD* cache = &userdata->children[i];
+		cache->has_derivative = 0; //Forces must be evaluated again for the new step
+		if (cache->is_active || cache->object->mass_dirty) {
+			EVDS_Object_Solve(cache->object,delta_time);
+		}
 	}
 
+	//Radiation environment for the new step
+	userdata->has_radiation = 0;
+	if (userdata->srp_coefficient && (!userdata->is_static)) {
+		EVDS_ERRCHECK(EVDS_InternalRigidBody_UpdateRadiation(system,object,userdata));
+	}
+
+	//Mass properties are only aggregated again if they have changed (cached values are used otherwise)
+	if (!object->mass_dirty) return EVDS_OK;
+
 	//Prepare to accumulate all state variables
 	EVDS_Variable_GetVector(userdata->cm,&cm);
 	CMx = cm.x;		CMy = cm.y;		CMz = cm.z;
@@ -285,54 +515,21 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 	M = m; dM = 0.0;
 
 	//Accumulate variables in children
-	entry = SIMC_List_GetFirst(children);
-	while (entry) {
-		int error_code;
-		EVDS_VARIABLE* v_cm;
-		EVDS_VARIABLE* v_mass;
-		EVDS_VARIABLE *v_jx, *v_jy, *v_jz;
-		EVDS_VARIABLE *v_ix, *v_iy, *v_iz;
-
-		//Skip objects with no mass
-		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
-		if ((EVDS_Object_GetVariable(child,"total_mass",&v_mass) != EVDS_OK) &&
-			(EVDS_Object_GetVariable(child,"mass",&v_mass) != EVDS_OK)) {
-			entry = SIMC_List_GetNext(children,entry);
-			continue;
-		}
-		EVDS_Variable_GetReal(v_mass,&m);
-
-		//Get center of mass
-		if ((EVDS_Object_GetVariable(child,"total_cm",&v_cm) != EVDS_OK) &&
-			(EVDS_Object_GetVariable(child,"cm",&v_cm) != EVDS_OK)) {
-			entry = SIMC_List_GetNext(children,entry);
-			continue;
-		}
-		EVDS_Variable_GetVector(v_cm,&cm);
-		//EVDS_Variable_GetVector(child_userdata->dCM,&dcm);
-
-		//Get moments of inertia
-		error_code  = EVDS_Object_GetVariable(child,"total_ix",&v_ix);
-		error_code += EVDS_Object_GetVariable(child,"total_iy",&v_iy);
-		error_code += EVDS_Object_GetVariable(child,"total_iz",&v_iz);
-		if (error_code != EVDS_OK) {
-			if ((EVDS_Object_GetVariable(child,"jx",&v_jx) != EVDS_OK) ||
-				(EVDS_Object_GetVariable(child,"jy",&v_jy) != EVDS_OK) ||
-				(EVDS_Object_GetVariable(child,"jz",&v_jz) != EVDS_OK)) {
-				entry = SIMC_List_GetNext(children,entry);
-				continue;
-			}
-
-			EVDS_Variable_GetVector(v_jx,&Ix1);
-			EVDS_Variable_GetVector(v_jy,&Iy1);
-			EVDS_Variable_GetVector(v_jz,&Iz1);
+	for (i = 0; i < userdata->children_count; i++) {
+		EVDS_SOLVER_RIGID_CHILD* cache = &userdata->children[i];
+		EVDS_OBJECT* child = cache->object;
+		if (!cache->has_mass) continue;
+
+		//Get mass, center of mass and moments of inertia
+		EVDS_Variable_GetReal(cache->m,&m);
+		EVDS_Variable_GetVector(cache->cm,&cm);
+		EVDS_Variable_GetVector(cache->Ix,&Ix1);
+		EVDS_Variable_GetVector(cache->Iy,&Iy1);
+		EVDS_Variable_GetVector(cache->Iz,&Iz1);
+		if (cache->is_gyration) {
 			EVDS_Vector_Multiply(&Ix1,&Ix1,m);
 			EVDS_Vector_Multiply(&Iy1,&Iy1,m);
 			EVDS_Vector_Multiply(&Iz1,&Iz1,m);
-		} else {
-			EVDS_Variable_GetVector(v_ix,&Ix1);
-			EVDS_Variable_GetVector(v_iy,&Iy1);
-			EVDS_Variable_GetVector(v_iz,&Iz1);
 		}
 
 		//Convert CM to correct coordinates
@@ -372,7 +569,6 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 		EVDS_Vector_Add(&Ix,&Ix,&cIx);
 		EVDS_Vector_Add(&Iy,&Iy,&cIy);
 		EVDS_Vector_Add(&Iz,&Iz,&cIz);
-		entry = SIMC_List_GetNext(children,entry);
 	}
 
 	//Store variables
@@ -392,6 +588,9 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 	EVDS_Variable_SetVector(userdata->Ix1,&Ix1);
 	EVDS_Variable_SetVector(userdata->Iy1,&Iy1);
 	EVDS_Variable_SetVector(userdata->Iz1,&Iz1);
+
+	//Storing totals has marked parents dirty, but this object is now up to date
+	object->mass_dirty = 0;
 	return EVDS_OK;
 }
 
@@ -403,8 +602,7 @@ int EVDS_InternalRigidBody_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object,
 								  EVDS_REAL delta_time, EVDS_STATE_VECTOR* state, EVDS_STATE_VECTOR_DERIVATIVE* derivative) {
-	//State variables and parent coordinate system reference
-	EVDS_OBJECT *parent_coordinates;
+	//State variables
 	EVDS_VECTOR cm,Ix,Iy,Iz,Ix1,Iy1,Iz1;
 	EVDS_VECTOR Ga;
 	EVDS_REAL mass;
@@ -417,10 +615,14 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 	EVDS_VECTOR w; //Angular velocity in local coordinates
 	EVDS_VECTOR Iw;
 
-	//List of children
-	SIMC_LIST* children;
-	SIMC_LIST_ENTRY* entry;
+	//Fictious accelerations
+	EVDS_VECTOR r_cm; //Position of CM relative to body origin (in parent coordinates)
+	EVDS_VECTOR euler_a; //Euler acceleration of body origin around CM
+	EVDS_VECTOR centripetal_a; //Centripetal acceleration of body origin around CM
+
+	//Cached children
 	EVDS_SOLVER_RIGID_USERDATA* userdata;
+	int i;
 	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
 	
 	//Copy velocities, reset accelerations
@@ -442,7 +644,6 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 	EVDS_Variable_GetVector(userdata->Ix1,&Ix1);
 	EVDS_Variable_GetVector(userdata->Iy1,&Iy1);
 	EVDS_Variable_GetVector(userdata->Iz1,&Iz1);
-	EVDS_Object_GetParent(object,&parent_coordinates); //Move in parent coordinates
 
 	//Sanity check on mass
 	if (mass <= EVDS_EPS) return EVDS_OK;
@@ -452,24 +653,40 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 	EVDS_Vector_Initialize(cm_alpha);
 	EVDS_Vector_Initialize(w);
 	EVDS_Vector_Initialize(Iw);
+	EVDS_Vector_Initialize(r_cm);
+	EVDS_Vector_Initialize(euler_a);
+	EVDS_Vector_Initialize(centripetal_a);
 
 	//Begin accumulating forces
 	EVDS_Vector_Set(&cm_force,EVDS_VECTOR_FORCE,object,0,0,0);
 	EVDS_Vector_Set(&cm_torque,EVDS_VECTOR_TORQUE,object,0,0,0);
 
-	//Iterate through children
-	EVDS_ERRCHECK(EVDS_Object_GetChildren(object,&children));
-	entry = SIMC_List_GetFirst(children);
-	while (entry) {
+	//Rebuild cache of children if structure of children has changed
+	if (userdata->children_generation != object->children_generation) {
+		EVDS_ERRCHECK(EVDS_InternalRigidBody_UpdateChildren(object,userdata));
+	}
+
+	//Iterate through active children (passive children produce no forces)
+	for (i = 0; i < userdata->children_count; i++) {
 		EVDS_VECTOR force;
 		EVDS_VECTOR torque;
 		EVDS_VECTOR force_position;
 		EVDS_VECTOR torque_position;
 		EVDS_STATE_VECTOR_DERIVATIVE child_derivative;
-		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
-
-		//Get childrens forces (accelerations not supported)
-		EVDS_Object_Integrate(child,delta_time,0,&child_derivative); 
+		EVDS_SOLVER_RIGID_CHILD* cache = &userdata->children[i];
+		if (!cache->is_active) continue;
+
+		//Get childrens forces (accelerations not supported). Forces which do not depend
+		// on state of this body are only computed once per step
+		if (cache->is_state_independent) {
+			if (!cache->has_derivative) {
+				EVDS_Object_Integrate(cache->object,delta_time,0,&cache->derivative);
+				cache->has_derivative = 1;
+			}
+			memcpy(&child_derivative,&cache->derivative,sizeof(EVDS_STATE_VECTOR_DERIVATIVE));
+		} else {
+			EVDS_Object_Integrate(cache->object,delta_time,0,&child_derivative);
+		}
 		EVDS_Vector_Initialize(force);
 		EVDS_Vector_Initialize(torque);
 		EVDS_Vector_Initialize(force_position);
@@ -513,9 +730,16 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 		//Accumulate forces and torques
 		EVDS_Vector_Add(&cm_force,&cm_force,&force);
 		EVDS_Vector_Add(&cm_torque,&cm_torque,&torque);
-		
+	}
 
-		entry = SIMC_List_GetNext(children,entry);
+
+	//Static bodies do not move, they only pass forces and torques to their parent
+	if (userdata->is_static) {
+		EVDS_Vector_Copy(&derivative->force,&cm_force);
+		EVDS_Vector_SetPositionVector(&derivative->force,&cm);
+		EVDS_Vector_Copy(&derivative->torque,&cm_torque);
+		EVDS_Vector_SetPositionVector(&derivative->torque,&cm);
+		return EVDS_OK;
 	}
 
 
@@ -529,22 +753,14 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 	//Convert force to linear acceleration (a = F/m)
 	EVDS_Vector_Multiply(&cm_a,&cm_force,1/mass); //Apply scalar scale (1/m)
 	cm_a.derivative_level = EVDS_VECTOR_ACCELERATION; //Force-change to acceleration vector
-	EVDS_Vector_SetPositionVector(&cm_a,&cm); //Acceleration located in CM of rigid body
 
-	//Convert acceleration from body coordinates to inertial coordinates
-	EVDS_Vector_Convert(&cm_a,&cm_a,parent_coordinates);
-	//At this point acceleration contains extra components due to motion of CM frame
-	//an rotation of CM point in body frame. The will be removed later
+	//Rotate acceleration from body coordinates to inertial coordinates. Acceleration of
+	//the CM-centered frame cancels out, so no full conversion is required
+	EVDS_Vector_Rotate(&cm_a,&cm_a,&state->orientation);
 
 	//Apply acceleration to the object
 	EVDS_Vector_Add(&derivative->acceleration,&derivative->acceleration,&cm_a);
 
-	//Subtract acceleration of CM-centered coordinate frame (FIXME: optimize this out)
-	EVDS_Vector_Set(&cm_a,EVDS_VECTOR_ACCELERATION,object,0,0,0);
-	EVDS_Vector_SetPositionVector(&cm_a,&cm);
-	EVDS_Vector_Convert(&cm_a,&cm_a,parent_coordinates);
-	EVDS_Vector_Subtract(&derivative->acceleration,&derivative->acceleration,&cm_a);
-
 
 	//------------------------------------------------------------------
 	// Convert torque into angular acceleration
@@ -566,54 +782,54 @@ int EVDS_InternalRigidBody_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, E
 	cm_alpha.derivative_level = EVDS_VECTOR_ANGULAR_ACCELERATION;
 	EVDS_Vector_SetPositionVector(&cm_alpha,&cm);
 
-	//Move angular acceleration to inertial coordinates
-	EVDS_Vector_Convert(&cm_alpha,&cm_alpha,parent_coordinates);
+	//Move angular acceleration to inertial coordinates (angular acceleration is same in every point)
+	EVDS_Vector_Rotate(&cm_alpha,&cm_alpha,&state->orientation);
 
 	//Apply angular acceleration to the object
 	EVDS_Vector_Add(&derivative->angular_acceleration,&derivative->angular_acceleration,&cm_alpha);
 
-	//Subtract angular acceleration of CM-centered coordinate frame (FIXME: optimize this out)
-	EVDS_Vector_Set(&cm_alpha,EVDS_VECTOR_ANGULAR_ACCELERATION,object,0,0,0);
-	EVDS_Vector_SetPositionVector(&cm_alpha,&cm);
-	EVDS_Vector_Convert(&cm_alpha,&cm_alpha,parent_coordinates);
-	EVDS_Vector_Subtract(&derivative->angular_acceleration,&derivative->angular_acceleration,&cm_alpha);
-
 
 	//------------------------------------------------------------------
 	// Add fictious accelerations due to rotation around CM rather than body origin
 	//------------------------------------------------------------------
-	//{
-		//EVDS_REAL x,y,z;
-		//EVDS_Vector_Get(&cm,&x,&y,&z,parent_coordinates);
-		//printf("POSITION OF CM %.3f %.3f %.3f m\n",x,y,z);
-	//}
-
-	//Acceleration of bodies center of mass is zero in inertial coordinates (excluding additional forces)
-	EVDS_Vector_Set(&cm_a,EVDS_VECTOR_ACCELERATION,parent_coordinates,0,0,0);
-	EVDS_Vector_SetPositionVector(&cm_a,&cm);
-
-	//Convert to local acceleration (acceleration corresponding to zero inertial in CM, in local frame)
-	EVDS_Vector_Convert(&cm_a,&cm_a,object);
-	EVDS_Vector_SetPositionVector(&cm_a,&state->position);
-
-	//Add this acceleration to force center of mass acceleration to be zero
-	EVDS_Vector_Convert(&cm_a,&cm_a,parent_coordinates);
-	EVDS_Vector_Add(&derivative->acceleration,&derivative->acceleration,&cm_a);
+	//Body origin moves around center of mass, which has zero acceleration in inertial
+	//coordinates (excluding additional forces):
+	// a[O] = -(w' x r[CM/O] + w x (w x r[CM/O]) + 2 w x v[CM/O])
+	//Center of mass is fixed in body coordinates during the step, so Coriolis term is zero
+	EVDS_Vector_Rotate(&r_cm,&cm,&state->orientation);
+	EVDS_Vector_Cross(&euler_a,&state->angular_acceleration,&r_cm);
+	EVDS_Vector_Cross(&centripetal_a,&state->angular_velocity,&r_cm);
+	EVDS_Vector_Cross(&centripetal_a,&state->angular_velocity,&centripetal_a);
+	EVDS_Vector_Subtract(&derivative->acceleration,&derivative->acceleration,&euler_a);
+	EVDS_Vector_Subtract(&derivative->acceleration,&derivative->acceleration,&centripetal_a);
 
 
 	//------------------------------------------------------------------
 	// Add additional forces (envrionmental forces)
 	//------------------------------------------------------------------
 	//Calculate acceleration due to gravity
-	EVDS_Environment_GetGravitationalField(system,&state->position,0,&Ga);
+	EVDS_ERRCHECK(EVDS_Environment_GetGravitationalField(system,&state->position,0,&Ga));
 	EVDS_Vector_Add(&derivative->acceleration,&derivative->acceleration,&Ga);
 
+	//Calculate acceleration due to solar radiation pressure (radiation environment at the beginning
+	//of the step is used unless the body has moved close enough to a shadow boundary)
+	if (userdata->has_radiation) {
+		EVDS_ENVIRONMENT_RADIATION radiation;
+		EVDS_ENVIRONMENT_RADIATION* current = &userdata->radiation;
+		EVDS_VECTOR offset;
+		EVDS_REAL distance,Cr;
+
+		EVDS_Vector_Subtract(&offset,&state->position,&userdata->radiation_position);
+		EVDS_Vector_Length(&distance,&offset);
+		if (distance >= 0.5*userdata->radiation.shadow_margin) {
+			EVDS_ERRCHECK(EVDS_Environment_GetRadiationParameters(system,&state->position,&radiation));
+			current = &radiation;
+		}
 
-	//Do not move static bodies (FIXME: make static bodies more special)
-	if (userdata->is_static) {
-		derivative->acceleration.x = 0;
-		derivative->acceleration.y = 0;
-		derivative->acceleration.z = 0;
+		EVDS_Variable_GetReal(userdata->srp_coefficient,&Cr);
+		EVDS_Vector_Multiply(&Ga,&current->direction,-current->pressure*Cr*userdata->srp_cross_section/mass);
+		Ga.derivative_level = EVDS_VECTOR_ACCELERATION;
+		EVDS_Vector_Add(&derivative->acceleration,&derivative->acceleration,&Ga);
 	}
 	return EVDS_OK;
 }
@@ -645,10 +861,17 @@ int EVDS_InternalRigidBody_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver,
 		EVDS_Object_AddRealVariable(object,"mass",0.0,&userdata->m);
 	}
 
+	//Solar radiation pressure is only computed if coefficient is defined
+	EVDS_Object_GetRealVariable(object,"srp.coefficient",0,&userdata->srp_coefficient);
+	EVDS_Object_GetRealVariable(object,"srp.area",0,&userdata->srp_area);
+
 	//Set solverdata
 	userdata->is_static = is_static;
 	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
 
+	//Static bodies are never propagated
+	if (is_static) EVDS_Object_SetStatic(object,1);
+
 	//Inertia tensor components and center of mass will be fetched during first solver call
 	userdata->jx = 0;
 	userdata->jy = 0;
@@ -688,6 +911,8 @@ int EVDS_InternalRigidBody_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver,
 int EVDS_InternalRigidBody_Deinitialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
 	EVDS_SOLVER_RIGID_USERDATA* userdata;
 	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+	if (userdata->children) free(userdata->children);
+	if (userdata->srp_mesh) EVDS_Mesh_Destroy(userdata->srp_mesh);
 	free(userdata);
 	return EVDS_OK;
 }
@@ -547,6 +547,9 @@ int EVDS_InternalRocketEngine_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solve
 	memset(userdata,0,sizeof(EVDS_SOLVER_ENGINE_USERDATA));
 	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
 
+	//Engine thrust is computed by solver and does not depend on state of the vessel
+	EVDS_ERRCHECK(EVDS_Object_SetStateIndependent(object,1));
+
 	//Determine fuel tanks
 	EVDS_InternalRocketEngine_DetermineFuelTanks(userdata,system,object);
 	//Add all possible rocket engine variables
@@ -659,6 +662,9 @@ int EVDS_InternalRocketEngine_Solve_Basic(EVDS_SOLVER_ENGINE_USERDATA* userdata,
 		(vacuum_thrust*(1.0-atmospheric_pressure_bar)+atmospheric_thrust*(atmospheric_pressure_bar))*current_throttle;
 	EVDS_Variable_SetReal(userdata->current_thrust,current_thrust);
 
+	//Thrusting engine wakes up the vessel
+	if (current_thrust != 0.0) EVDS_Object_Wake(object);
+
 	//Calculate mass flow
 	current_mass_flow = current_thrust / (EVDS_G0 * current_isp);
 	EVDS_Variable_SetReal(userdata->current_mass_flow, current_mass_flow);
@@ -31,47 +31,55 @@
 
 
 
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_SOLVER_PLANET_DESCRIPTOR_TAG {
+	EVDS_PLANET_GRAVITY gravity;	//Parameters of gravitational field
+	EVDS_PLANET_ATMOSPHERE atmosphere; //Parameters of built-in atmosphere
+} EVDS_SOLVER_PLANET_DESCRIPTOR;
+
+typedef struct EVDS_SOLVER_PLANET_USERDATA_TAG {
+	EVDS_VARIABLE* is_static;		//Is planet static (not propagated)
+	EVDS_VARIABLE* grid_error;		//Accuracy of gravity grid (or 0)
+	EVDS_SOLVER_PLANET_DESCRIPTOR* volatile descriptor; //Published descriptor (never modified)
+	EVDS_SOLVER_PLANET_DESCRIPTOR* retired; //Previously published descriptor (may still be in use)
+	long generation;				//Generation of the latest descriptor
+	EVDS_PLANET_POSITION position;	//Cached position of the planet
+	EVDS_EPHEMERIS* ephemeris;		//Ephemeris of the planet (or 0)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_LOCK_ID lock;				//Lock for rebuilding the descriptor
+#endif
+} EVDS_SOLVER_PLANET_USERDATA;
+#endif
+
+//Forward declaration
+extern EVDS_SOLVER EVDS_Solver_Planet;
+
+
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief Get planet nearest to the object
+/// @brief Get planet nearest to the object.
+///
+/// Returns the planet with the smallest sphere of influence ("gravity.rs" variable) which
+/// contains the object. If object is not inside any sphere of influence, the nearest planet
+/// is returned.
+///
+/// Planets are found using the index of spheres of influence, so planets far from
+/// the object are not looked at.
+///
+/// @returns Error code
+/// @retval EVDS_OK Completed successfully
+/// @retval EVDS_ERROR_NOT_FOUND There are no planets in the system
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_Planet_GetNearest(EVDS_OBJECT* object, EVDS_OBJECT** p_planet) {
 	EVDS_SYSTEM* system;
-	SIMC_LIST_ENTRY* entry;
-	SIMC_LIST* planets;
-
-	//State vectors
-	EVDS_REAL  nearest_distance = 1.0/EVDS_EPS;
-	EVDS_OBJECT* nearest_planet = 0;
+	EVDS_OBJECT* nearest_planet;
 	EVDS_STATE_VECTOR state;
-	EVDS_Object_GetStateVector(object,&state);
+	if (!object) return EVDS_ERROR_BAD_PARAMETER;
+	if (!p_planet) return EVDS_ERROR_BAD_PARAMETER;
 
-	//Get list of planets
+	//Find planet which dominates in objects position
+	EVDS_Object_GetStateVector(object,&state);
 	EVDS_Object_GetSystem(object,&system);
-	EVDS_System_GetObjectsByType(system,"planet",&planets);
-	entry = SIMC_List_GetFirst(planets);
-	while (entry) {
-		EVDS_REAL distance;
-		EVDS_OBJECT* planet = (EVDS_OBJECT*)SIMC_List_GetData(planets,entry);
-
-		//Get state vector
-		EVDS_VECTOR direction;
-		EVDS_STATE_VECTOR planet_state;
-		EVDS_Object_GetStateVector(planet,&planet_state);
-
-		//Calculate distance
-		EVDS_Vector_Subtract(&direction,&planet_state.position,&state.position);
-		EVDS_Vector_Dot(&distance,&direction,&direction);
-		distance = sqrt(distance);
-
-		//Check if smallest
-		if (distance < nearest_distance) {
-			nearest_distance = distance;
-			nearest_planet = planet;
-		}
-
-		//Check next planet
-		entry = SIMC_List_GetNext(planets,entry);
-	}	
+	EVDS_InternalEnvironment_GetRelevantPlanets(system,&state.position,0.0,0,0,0,&nearest_planet);
 
 	//Write back planet
 	if (nearest_planet) {
@@ -84,13 +92,714 @@ int EVDS_Planet_GetNearest(EVDS_OBJECT* object, EVDS_OBJECT** p_planet) {
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// @brief Update planet position and state
+/// @brief Read parameters of planets gravitational field from its variables.
+///
+/// Used to build the gravity descriptor of planets, and directly by
+/// EVDS_Environment_GetGravitationalField() for planets which are not handled
+/// by the planet solver.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPlanet_ReadGravity(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity) {
+	EVDS_VARIABLE* mu_var;
+	EVDS_VARIABLE* mass_var;
+	EVDS_VARIABLE* j2_var;
+	EVDS_VARIABLE* radius_var;
+	EVDS_VARIABLE* rs_var;
+	EVDS_VARIABLE* callback_var;
+	EVDS_VARIABLE* degree_var;
+	EVDS_VARIABLE* tolerance_var;
+	EVDS_VARIABLE* grid_layers_var;
+	EVDS_VARIABLE* grid_step_var;
+	EVDS_REAL mass;
+	EVDS_REAL max_degree;
+	EVDS_REAL grid_layers;
+
+	//Get planets parameters
+	EVDS_Object_GetRealVariable(planet,"gravity.mu",&gravity->mu,&mu_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.j2",&gravity->j2,&j2_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.rs",&gravity->rs,&rs_var);
+	EVDS_Object_GetRealVariable(planet,"mass",&mass,&mass_var);
+	EVDS_Object_GetRealVariable(planet,"geometry.radius",&gravity->radius,&radius_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.degree",&max_degree,&degree_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.tolerance",&gravity->tolerance,&tolerance_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.grid_altitude",&gravity->grid_altitude,0);
+	EVDS_Object_GetRealVariable(planet,"gravity.grid_layers",&grid_layers,&grid_layers_var);
+	EVDS_Object_GetRealVariable(planet,"gravity.grid_step",&gravity->grid_step,&grid_step_var);
+	gravity->has_j2 = j2_var != 0;
+	gravity->has_rs = rs_var != 0;
+	gravity->has_radius = radius_var != 0;
+	gravity->max_degree = degree_var ? (int)(max_degree+0.5) : 0;
+	if (!tolerance_var) gravity->tolerance = 0.0;
+
+	//Coefficients of J2-only model
+	memset(gravity->zonal_C,0,sizeof(gravity->zonal_C));
+	memset(gravity->zonal_S,0,sizeof(gravity->zonal_S));
+	gravity->zonal_C[0] = 1.0;
+	if (gravity->has_j2) gravity->zonal_C[3] = -gravity->j2/sqrt(5.0);
+
+	//Parameters of gravity grid (16 layers, 2 degree step by default)
+	gravity->grid_layers = grid_layers_var ? (int)(grid_layers+0.5) : 16;
+	gravity->grid_step = EVDS_RAD(grid_step_var ? gravity->grid_step : 2.0);
+
+	//Calculate mu for the planet
+	gravity->has_mu = 1;
+	if (!mu_var) {
+		if (mass_var) {
+			gravity->mu = 6.6738480e-11 * mass;
+		} else {
+			gravity->has_mu = 0;
+		}
+	}
+
+	//Get custom gravitational field callback
+	gravity->callback = 0;
+	if (EVDS_Object_GetVariable(planet,"gravitational_field",&callback_var) == EVDS_OK) {
+		EVDS_Variable_GetFunctionPointer(callback_var,(void**)(&gravity->callback));
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Read parameters of built-in planet atmosphere from its variables.
+///
+/// Model is selected by "atmosphere.model" variable:
+///  - "us76": U.S. Standard Atmosphere 1976. Seven layers up to 86 km, atmosphere above
+///    is continued as isothermal (density is underestimated above ~120 km).
+///  - "exponential": density falls exponentially with altitude. Parameters are read from
+///    "atmosphere.density" (at surface, 1.225 kg/m3 by default), "atmosphere.scale_height"
+///    (8500 m by default), "atmosphere.temperature" (288.15 K by default) and
+///    "atmosphere.gas_constant" (specific, 287.053 J/(kg K) by default).
+///
+/// Altitude is measured from the sphere with radius "geometry.radius". Planet has no
+/// built-in atmosphere if model is not known or radius is not defined.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPlanet_ReadAtmosphere(EVDS_OBJECT* planet, EVDS_PLANET_ATMOSPHERE* atmosphere) {
+	EVDS_VARIABLE* model_var;
+	EVDS_VARIABLE* radius_var;
+	EVDS_VARIABLE* variable;
+	EVDS_REAL density,scale_height;
+	char model[256] = { 0 };
+	int i;
+
+	//Planet has no atmosphere unless model is selected
+	memset(atmosphere,0,sizeof(EVDS_PLANET_ATMOSPHERE));
+	if (EVDS_Object_GetVariable(planet,"atmosphere.model",&model_var) != EVDS_OK) return;
+	EVDS_Object_GetRealVariable(planet,"geometry.radius",&atmosphere->radius,&radius_var);
+	if (!radius_var) return;
+	EVDS_Variable_GetString(model_var,model,255,0);
+
+	if (strcmp(model,"us76") == 0) {
+		EVDS_REAL base_altitude[7] = { 0.0, 11000.0, 20000.0, 32000.0, 47000.0, 51000.0, 71000.0 };
+		EVDS_REAL lapse_rate[7] = { -0.0065, 0.0, 0.0010, 0.0028, 0.0, -0.0028, -0.0020 };
+
+		//Layers of the standard atmosphere (last layer is isothermal continuation above 86 km)
+		atmosphere->layers = 8;
+		for (i = 0; i < 7; i++) {
+			atmosphere->base_altitude[i] = base_altitude[i];
+			atmosphere->lapse_rate[i] = lapse_rate[i];
+		}
+		atmosphere->base_altitude[7] = 84852.0;
+		atmosphere->lapse_rate[7] = 0.0;
+		atmosphere->base_temperature[0] = 288.15;
+		atmosphere->log_pressure[0] = log(101325.0);
+		atmosphere->inverse_geopotential_radius = 1.0/6356766.0;
+		atmosphere->gas_constant = 8.31432/0.0289644;
+		atmosphere->lapse_constant = 9.80665/atmosphere->gas_constant;
+
+		//Composition of dry air
+		atmosphere->mole_fraction[EVDS_ENVIRONMENT_SPECIES_N2]  = 0.78084;
+		atmosphere->mole_fraction[EVDS_ENVIRONMENT_SPECIES_O2]  = 0.209476;
+		atmosphere->mole_fraction[EVDS_ENVIRONMENT_SPECIES_AR]  = 0.00934;
+		atmosphere->mole_fraction[EVDS_ENVIRONMENT_SPECIES_CO2] = 0.000314;
+		atmosphere->mass_fraction[EVDS_ENVIRONMENT_SPECIES_N2]  = 0.78084*28.0134/28.9644;
+		atmosphere->mass_fraction[EVDS_ENVIRONMENT_SPECIES_O2]  = 0.209476*31.9988/28.9644;
+		atmosphere->mass_fraction[EVDS_ENVIRONMENT_SPECIES_AR]  = 0.00934*39.948/28.9644;
+		atmosphere->mass_fraction[EVDS_ENVIRONMENT_SPECIES_CO2] = 0.000314*44.00995/28.9644;
+	} else if (strcmp(model,"exponential") == 0) {
+		//Read parameters of the model
+		EVDS_Object_GetRealVariable(planet,"atmosphere.density",&density,&variable);
+		if (!variable) density = 1.225;
+		EVDS_Object_GetRealVariable(planet,"atmosphere.scale_height",&scale_height,&variable);
+		if (!variable) scale_height = 8500.0;
+		EVDS_Object_GetRealVariable(planet,"atmosphere.temperature",&atmosphere->base_temperature[0],&variable);
+		if (!variable) atmosphere->base_temperature[0] = 288.15;
+		EVDS_Object_GetRealVariable(planet,"atmosphere.gas_constant",&atmosphere->gas_constant,&variable);
+		if (!variable) atmosphere->gas_constant = 287.053;
+		if ((scale_height <= 0.0) || (density <= 0.0) ||
+			(atmosphere->base_temperature[0] <= 0.0) || (atmosphere->gas_constant <= 0.0)) return;
+
+		//Single isothermal layer in which pressure falls by "e" every scale height
+		atmosphere->layers = 1;
+		atmosphere->log_pressure[0] = log(density*atmosphere->gas_constant*atmosphere->base_temperature[0]);
+		atmosphere->lapse_constant = atmosphere->base_temperature[0]/scale_height;
+	} else {
+		return;
+	}
+
+	//Precompute temperature and pressure at the base of every layer
+	for (i = 1; i < atmosphere->layers; i++) {
+		EVDS_REAL Tb = atmosphere->base_temperature[i-1];
+		EVDS_REAL L = atmosphere->lapse_rate[i-1];
+		EVDS_REAL dh = atmosphere->base_altitude[i] - atmosphere->base_altitude[i-1];
+		EVDS_REAL T = Tb + L*dh;
+
+		atmosphere->base_temperature[i] = T;
+		if (L != 0.0) {
+			atmosphere->log_pressure[i] = atmosphere->log_pressure[i-1] - atmosphere->lapse_constant*log(T/Tb)/L;
+		} else {
+			atmosphere->log_pressure[i] = atmosphere->log_pressure[i-1] - atmosphere->lapse_constant*dh/Tb;
+		}
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Load spherical harmonics coefficients of the planet.
+///
+/// Coefficients are read from "gravity.harmonics" variable, or from the entry of
+/// "gravity" database named by it. Missing coefficients are treated as zero.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed (or planet has no spherical harmonics)
+/// @retval EVDS_ERROR_NOT_FOUND Database entry with coefficients not found
+/// @retval EVDS_ERROR_BAD_STATE No reference radius for the coefficients
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the coefficients
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_LoadHarmonics(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity) {
+	EVDS_VARIABLE* variable;
+	EVDS_VARIABLE* attribute;
+	EVDS_VARIABLE_TYPE type;
+	SIMC_LIST* list;
+	SIMC_LIST_ENTRY* entry;
+	int degree = 0;
+
+	//Find coefficients
+	if (EVDS_Object_GetVariable(planet,"gravity.harmonics",&variable) != EVDS_OK) return EVDS_OK;
+	EVDS_Variable_GetType(variable,&type);
+	if (type == EVDS_VARIABLE_TYPE_STRING) {
+		EVDS_VARIABLE* database;
+		char name[256] = { 0 };
+		EVDS_Variable_GetString(variable,name,255,0);
+		EVDS_ERRCHECK(EVDS_System_GetDatabaseByName(planet->system,"gravity",&database));
+		EVDS_ERRCHECK(EVDS_Variable_GetNested(database,name,&variable));
+	}
+	EVDS_ERRCHECK(EVDS_Variable_GetList(variable,&list));
+
+	//Get reference radius
+	gravity->harmonics_radius = gravity->radius;
+	if (EVDS_Variable_GetAttribute(variable,"radius",&attribute) == EVDS_OK) {
+		EVDS_Variable_GetReal(attribute,&gravity->harmonics_radius);
+	} else if (!gravity->has_radius) {
+		return EVDS_ERROR_BAD_STATE;
+	}
+
+	//Find degree of the model
+	entry = SIMC_List_GetFirst(list);
+	while (entry) {
+		EVDS_REAL n;
+		EVDS_VARIABLE* coefficient = (EVDS_VARIABLE*)SIMC_List_GetData(list,entry);
+		if (EVDS_Variable_GetAttribute(coefficient,"n",&attribute) == EVDS_OK) {
+			EVDS_Variable_GetReal(attribute,&n);
+			if ((int)(n+0.5) > degree) degree = (int)(n+0.5);
+		}
+		entry = SIMC_List_GetNext(list,entry);
+	}
+	if (degree == 0) return EVDS_OK;
+
+	//Read coefficients into triangular arrays
+	gravity->C = (EVDS_REAL*)malloc((degree+1)*(degree+2)/2*sizeof(EVDS_REAL));
+	gravity->S = (EVDS_REAL*)malloc((degree+1)*(degree+2)/2*sizeof(EVDS_REAL));
+	if ((!gravity->C) || (!gravity->S)) {
+		if (gravity->C) free(gravity->C);
+		if (gravity->S) free(gravity->S);
+		gravity->C = 0;
+		gravity->S = 0;
+		return EVDS_ERROR_MEMORY;
+	}
+	gravity->degree = degree;
+	memset(gravity->C,0,(degree+1)*(degree+2)/2*sizeof(EVDS_REAL));
+	memset(gravity->S,0,(degree+1)*(degree+2)/2*sizeof(EVDS_REAL));
+
+	entry = SIMC_List_GetFirst(list);
+	while (entry) {
+		int n,m;
+		EVDS_REAL value;
+		EVDS_VARIABLE* coefficient = (EVDS_VARIABLE*)SIMC_List_GetData(list,entry);
+		entry = SIMC_List_GetNext(list,entry);
+
+		//Get degree and order
+		if (EVDS_Variable_GetAttribute(coefficient,"n",&attribute) != EVDS_OK) continue;
+		EVDS_Variable_GetReal(attribute,&value);
+		n = (int)(value+0.5);
+		if (EVDS_Variable_GetAttribute(coefficient,"m",&attribute) != EVDS_OK) continue;
+		EVDS_Variable_GetReal(attribute,&value);
+		m = (int)(value+0.5);
+		if ((n < 0) || (m < 0) || (m > n)) continue;
+
+		//Get coefficients
+		if (EVDS_Variable_GetAttribute(coefficient,"c",&attribute) == EVDS_OK) {
+			EVDS_Variable_GetReal(attribute,&gravity->C[n*(n+1)/2+m]);
+		}
+		if (EVDS_Variable_GetAttribute(coefficient,"s",&attribute) == EVDS_OK) {
+			EVDS_Variable_GetReal(attribute,&gravity->S[n*(n+1)/2+m]);
+		}
+	}
+	gravity->C[0] = 1.0;
+	gravity->S[0] = 0.0;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get weights of cubic Lagrange interpolation over four nodes.
+///
+/// Parameter t is the position relative to the first node, in units of node spacing.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPlanet_GetGridWeights(EVDS_REAL t, EVDS_REAL* w) {
+	w[0] = -(t-1.0)*(t-2.0)*(t-3.0)/6.0;
+	w[1] =  t*(t-2.0)*(t-3.0)/2.0;
+	w[2] = -t*(t-1.0)*(t-3.0)/2.0;
+	w[3] =  t*(t-1.0)*(t-2.0)/6.0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Interpolate gravitational field from the gravity grid.
+///
+/// Position must be given in planet-fixed coordinates. The non-spherical part of the field
+/// is interpolated with tricubic interpolation, the spherical part is computed exactly.
+/// Every value is interpolated over 4x4x4 nodes around the position. Nodes beyond the poles
+/// are taken from the opposite meridian, near the lowest and the highest layer the four
+/// nearest layers are used.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_NOT_FOUND Position is outside of the grid
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_GetGridField(EVDS_PLANET_GRID* grid, EVDS_VECTOR* position,
+									 EVDS_REAL* phi, EVDS_VECTOR* field) {
+	EVDS_REAL r2,r,u,v,w;
+	EVDS_REAL wr[4],wt[4],wn[4];
+	EVDS_REAL value[4] = { 0.0, 0.0, 0.0, 0.0 };
+	int layers = grid->layers;
+	int latitudes = grid->latitudes;
+	int longitudes = grid->longitudes;
+	int i,j,k,k0,a,b,c,n;
+
+	//Find position in the grid
+	r2 = position->x*position->x + position->y*position->y + position->z*position->z;
+	r = sqrt(r2);
+	u = (r - grid->radius)*(layers-1)/grid->altitude;
+	if ((u < 0.0) || (u > layers-1)) return EVDS_ERROR_NOT_FOUND;
+	v = (asin(position->z/r) + 0.5*EVDS_PI)/grid->step;
+	w = atan2(position->y,position->x)/grid->step;
+	if (w < 0.0) w += longitudes;
+
+	//Get cell and interpolation weights
+	k = (int)u; if (k > layers-2) k = layers-2;
+	j = (int)v; if (j > latitudes-2) j = latitudes-2;
+	i = (int)w; if (i > longitudes-1) i = longitudes-1;
+	k0 = k-1;
+	if (k0 < 0) k0 = 0;
+	if (k0 > layers-4) k0 = layers-4;
+	EVDS_InternalPlanet_GetGridWeights(u-k0,wr);
+	EVDS_InternalPlanet_GetGridWeights(v-j+1,wt);
+	EVDS_InternalPlanet_GetGridWeights(w-i+1,wn);
+
+	//Sum up contributions of neighbouring nodes
+	for (a = 0; a < 4; a++) {
+		int kk = k0+a;
+		for (b = 0; b < 4; b++) {
+			int jj = j-1+b;
+			int shift = 0;
+			if (jj < 0) { //Continue over the south pole
+				jj = -jj;
+				shift = longitudes/2;
+			}
+			if (jj > latitudes-1) { //Continue over the north pole
+				jj = 2*(latitudes-1)-jj;
+				shift = longitudes/2;
+			}
+			for (c = 0; c < 4; c++) {
+				int ii = (i-1+c+shift+longitudes) % longitudes;
+				EVDS_REAL* node = grid->nodes + ((kk*latitudes+jj)*longitudes+ii)*4;
+				EVDS_REAL weight = wr[a]*wt[b]*wn[c];
+				for (n = 0; n < 4; n++) value[n] += weight*node[n];
+			}
+		}
+	}
+
+	//Add spherical part
+	*phi = value[0] - grid->mu/r;
+	EVDS_Vector_Set(field,EVDS_VECTOR_ACCELERATION,position->coordinate_system,
+		value[1] - grid->mu*position->x/(r2*r),
+		value[2] - grid->mu*position->y/(r2*r),
+		value[3] - grid->mu*position->z/(r2*r));
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy gravity grid.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPlanet_DestroyGravityGrid(EVDS_PLANET_GRID* grid) {
+	if (!grid) return;
+	if (grid->nodes) free(grid->nodes);
+	free(grid);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Precompute gravity grid for the gravity descriptor of the planet.
+///
+/// The grid is a spherical shell in planet-fixed coordinates, which begins at the
+/// reference radius of the gravity model and covers "gravity.grid_altitude" above it.
+/// Nodes hold the non-spherical part of the field, so the grid is only built for planets
+/// with spherical harmonics or \f$J_2\f$ specified.
+///
+/// After the grid is built, the field is compared against the model at the center of every
+/// cell, and the largest difference in acceleration is kept as accuracy of the grid.
+///
+/// The grid is built in a new buffer and the descriptor is not modified. Building the grid
+/// is expensive, so it is only done when planet is initialized or solved, never by queries.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed (grid is 0 if it is not used by the planet)
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the grid
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_BuildGravityGrid(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY* gravity, EVDS_PLANET_GRID** p_grid) {
+	EVDS_PLANET_GRID* grid;
+	EVDS_REAL* C;
+	EVDS_REAL* S;
+	EVDS_REAL radius,layer_step;
+	int degree,i,j,k;
+
+	//Check if grid is used
+	*p_grid = 0;
+	if ((gravity->grid_altitude <= 0.0) || (!gravity->has_mu) || (gravity->callback)) return EVDS_OK;
+
+	//Select gravity model
+	if (gravity->degree > 0) {
+		C = gravity->C;
+		S = gravity->S;
+		degree = gravity->degree;
+		radius = gravity->harmonics_radius;
+	} else if (gravity->has_j2 && gravity->has_radius) {
+		C = gravity->zonal_C;
+		S = gravity->zonal_S;
+		degree = 2;
+		radius = gravity->radius;
+	} else {
+		return EVDS_OK;
+	}
+	if ((gravity->max_degree > 0) && (degree > gravity->max_degree)) degree = gravity->max_degree;
+
+	//Grid dimensions
+	grid = (EVDS_PLANET_GRID*)malloc(sizeof(EVDS_PLANET_GRID));
+	if (!grid) return EVDS_ERROR_MEMORY;
+	memset(grid,0,sizeof(EVDS_PLANET_GRID));
+	grid->generation = gravity->generation;
+	grid->mu = gravity->mu;
+	grid->altitude = gravity->grid_altitude;
+	grid->layers = gravity->grid_layers;
+	if (grid->layers < 4) grid->layers = 4;
+	grid->latitudes = (int)(EVDS_PI/gravity->grid_step + 0.5) + 1;
+	if (grid->latitudes < 5) grid->latitudes = 5;
+	grid->longitudes = 2*(grid->latitudes-1);
+	grid->step = EVDS_PI/(grid->latitudes-1);
+	grid->radius = radius;
+	layer_step = grid->altitude/(grid->layers-1);
+	grid->nodes = (EVDS_REAL*)malloc(grid->layers*grid->latitudes*grid->longitudes*4*sizeof(EVDS_REAL));
+	if (!grid->nodes) {
+		EVDS_InternalPlanet_DestroyGravityGrid(grid);
+		return EVDS_ERROR_MEMORY;
+	}
+
+	//Compute non-spherical part of the field in every node
+	for (k = 0; k < grid->layers; k++) {
+		for (j = 0; j < grid->latitudes; j++) {
+			for (i = 0; i < grid->longitudes; i++) {
+				EVDS_REAL* node = grid->nodes + ((k*grid->latitudes+j)*grid->longitudes+i)*4;
+				EVDS_REAL r = radius + k*layer_step;
+				EVDS_REAL latitude = j*grid->step - 0.5*EVDS_PI;
+				EVDS_REAL longitude = i*grid->step;
+				EVDS_VECTOR position,field;
+				EVDS_REAL phi;
+
+				EVDS_Vector_Set(&position,EVDS_VECTOR_POSITION,planet,
+					r*cos(latitude)*cos(longitude),r*cos(latitude)*sin(longitude),r*sin(latitude));
+				if (EVDS_InternalEnvironment_GetHarmonicsField(C,S,degree,grid->mu,radius,&position,&phi,&field) != EVDS_OK) {
+					EVDS_InternalPlanet_DestroyGravityGrid(grid);
+					return EVDS_ERROR_MEMORY;
+				}
+				node[0] = phi + grid->mu/r;
+				node[1] = field.x + grid->mu*position.x/(r*r*r);
+				node[2] = field.y + grid->mu*position.y/(r*r*r);
+				node[3] = field.z + grid->mu*position.z/(r*r*r);
+			}
+		}
+	}
+
+	//Estimate accuracy at centers of the cells
+	for (k = 0; k < grid->layers-1; k++) {
+		for (j = 0; j < grid->latitudes-1; j++) {
+			for (i = 0; i < grid->longitudes; i++) {
+				EVDS_REAL r = radius + (k+0.5)*layer_step;
+				EVDS_REAL latitude = (j+0.5)*grid->step - 0.5*EVDS_PI;
+				EVDS_REAL longitude = (i+0.5)*grid->step;
+				EVDS_VECTOR position,field,grid_field;
+				EVDS_REAL phi,error;
+
+				EVDS_Vector_Set(&position,EVDS_VECTOR_POSITION,planet,
+					r*cos(latitude)*cos(longitude),r*cos(latitude)*sin(longitude),r*sin(latitude));
+				if (EVDS_InternalEnvironment_GetHarmonicsField(C,S,degree,grid->mu,radius,&position,&phi,&field) != EVDS_OK) {
+					EVDS_InternalPlanet_DestroyGravityGrid(grid);
+					return EVDS_ERROR_MEMORY;
+				}
+				EVDS_InternalPlanet_GetGridField(grid,&position,&phi,&grid_field);
+				EVDS_Vector_Subtract(&field,&field,&grid_field);
+				EVDS_Vector_Length(&error,&field);
+				if (error > grid->error) grid->error = error;
+			}
+		}
+	}
+
+	*p_grid = grid;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Destroy descriptor of the planet along with its coefficients and grid.
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPlanet_DestroyDescriptor(EVDS_SOLVER_PLANET_DESCRIPTOR* descriptor) {
+	if (!descriptor) return;
+	if (descriptor->gravity.C) free(descriptor->gravity.C);
+	if (descriptor->gravity.S) free(descriptor->gravity.S);
+	EVDS_InternalPlanet_DestroyGravityGrid(descriptor->gravity.grid);
+	free(descriptor);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build new descriptor of the planet from its variables.
+///
+/// The descriptor is built in a new buffer, so descriptors which were published
+/// before are not touched. Gravity grid is not built (see EVDS_InternalPlanet_UpdateGravityGrid()).
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the descriptor
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_BuildDescriptor(EVDS_OBJECT* planet, EVDS_SOLVER_PLANET_USERDATA* userdata,
+										EVDS_SOLVER_PLANET_DESCRIPTOR** p_descriptor) {
+	EVDS_SOLVER_PLANET_DESCRIPTOR* descriptor;
+	int error_code;
+
+	descriptor = (EVDS_SOLVER_PLANET_DESCRIPTOR*)malloc(sizeof(EVDS_SOLVER_PLANET_DESCRIPTOR));
+	if (!descriptor) return EVDS_ERROR_MEMORY;
+	memset(descriptor,0,sizeof(EVDS_SOLVER_PLANET_DESCRIPTOR));
+	descriptor->gravity.position = &userdata->position;
+	descriptor->gravity.generation = ++userdata->generation;
+
+	EVDS_InternalPlanet_ReadGravity(planet,&descriptor->gravity);
+	EVDS_InternalPlanet_ReadAtmosphere(planet,&descriptor->atmosphere);
+	error_code = EVDS_InternalPlanet_LoadHarmonics(planet,&descriptor->gravity);
+	if (error_code != EVDS_OK) {
+		EVDS_InternalPlanet_DestroyDescriptor(descriptor);
+		return error_code;
+	}
+
+	*p_descriptor = descriptor;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if gravity grid built for one descriptor is valid for another one.
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_IsSameGrid(EVDS_PLANET_GRAVITY* a, EVDS_PLANET_GRAVITY* b) {
+	int size;
+	if ((a->has_mu != b->has_mu) || (a->mu != b->mu) || (a->callback != b->callback)) return 0;
+	if ((a->has_j2 != b->has_j2) || (a->j2 != b->j2)) return 0;
+	if ((a->has_radius != b->has_radius) || (a->radius != b->radius)) return 0;
+	if ((a->degree != b->degree) || (a->max_degree != b->max_degree)) return 0;
+	if ((a->grid_altitude != b->grid_altitude) || (a->grid_step != b->grid_step) ||
+		(a->grid_layers != b->grid_layers)) return 0;
+	if (a->degree == 0) return 1;
+
+	size = (a->degree+1)*(a->degree+2)/2*sizeof(EVDS_REAL);
+	return (a->harmonics_radius == b->harmonics_radius) &&
+		   (memcmp(a->C,b->C,size) == 0) && (memcmp(a->S,b->S,size) == 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get cached parameters of planets gravitational field.
+///
+/// The descriptor is rebuilt if any of the variables it was built from has changed.
+/// Descriptor of built-in atmosphere is rebuilt along with it.
+///
+/// The new descriptor is built in a separate buffer and published by replacing the
+/// pointer, so queries which already hold the previous descriptor keep using it without
+/// any locks. The previous descriptor is freed by the next rebuild.
+///
+/// Gravity grid is passed on to the new descriptor if the model it was built from did not
+/// change. Otherwise new descriptor has no gravity grid until the planet is solved again.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_STATE Object is not handled by the planet solver
+/// @retval EVDS_ERROR_MEMORY Not enough memory to rebuild the descriptor
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_GetGravity(EVDS_OBJECT* planet, EVDS_PLANET_GRAVITY** p_gravity) {
+	EVDS_SOLVER_PLANET_USERDATA* userdata;
+	EVDS_SOLVER_PLANET_DESCRIPTOR* descriptor;
+	int error_code = EVDS_OK;
+	if (planet->solver != &EVDS_Solver_Planet) return EVDS_ERROR_BAD_STATE;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(planet,(void**)&userdata));
+
+	//Rebuild descriptor (flag is reset first, so changes made while reading are not lost)
+	if (planet->gravity_dirty) {
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Enter(userdata->lock);
+#endif
+		if (planet->gravity_dirty) {
+			planet->gravity_dirty = 0;
+			error_code = EVDS_InternalPlanet_BuildDescriptor(planet,userdata,&descriptor);
+			if (error_code == EVDS_OK) {
+				EVDS_PLANET_GRAVITY* previous = &userdata->descriptor->gravity;
+				EVDS_PLANET_GRID* grid = previous->grid;
+
+				//Pass gravity grid on (queries still holding the previous descriptor stop using it)
+				if (grid && EVDS_InternalPlanet_IsSameGrid(previous,&descriptor->gravity)) {
+					previous->grid = 0;
+					grid->generation = descriptor->gravity.generation;
+					descriptor->gravity.grid = grid;
+				}
+
+				//Descriptor must be complete before it is published
+				EVDS_MEMORY_BARRIER();
+				EVDS_InternalPlanet_DestroyDescriptor(userdata->retired);
+				userdata->retired = userdata->descriptor;
+				userdata->descriptor = descriptor;
+			} else {
+				planet->gravity_dirty = 1;
+			}
+		}
+#ifndef EVDS_SINGLETHREADED
+		SIMC_Lock_Leave(userdata->lock);
+#endif
+		if (error_code != EVDS_OK) return error_code;
+	}
+	*p_gravity = &userdata->descriptor->gravity;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get cached parameters of built-in planet atmosphere.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_STATE Object is not handled by the planet solver
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_GetAtmosphere(EVDS_OBJECT* planet, EVDS_PLANET_ATMOSPHERE** p_atmosphere) {
+	EVDS_PLANET_GRAVITY* gravity;
+	EVDS_ERRCHECK(EVDS_InternalPlanet_GetGravity(planet,&gravity)); //Rebuilds both descriptors
+
+	//Atmosphere is stored in the same descriptor as the gravity
+	*p_atmosphere = &((EVDS_SOLVER_PLANET_DESCRIPTOR*)gravity)->atmosphere;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Build gravity grid for the current descriptor if it has none.
+///
+/// The grid is built while holding the lock which protects rebuilding of the descriptor,
+/// so the descriptor stays current (and is not freed) until the grid is attached to it.
+/// Queries do not take this lock and use the descriptor without the grid until then.
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_MEMORY Not enough memory for the grid
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_UpdateGravityGrid(EVDS_OBJECT* planet, EVDS_SOLVER_PLANET_USERDATA* userdata) {
+	EVDS_PLANET_GRAVITY* gravity;
+	EVDS_PLANET_GRID* grid = 0;
+	int error_code = EVDS_OK;
+
+	//Check if current descriptor needs a grid
+	gravity = &userdata->descriptor->gravity;
+	if ((gravity->grid_altitude <= 0.0) || (!gravity->has_mu) || (gravity->callback) || (gravity->grid)) return EVDS_OK;
+	if ((gravity->degree == 0) && (!(gravity->has_j2 && gravity->has_radius))) return EVDS_OK;
+
+	//Build grid in a separate buffer and attach it (grid must be complete before it is attached)
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Enter(userdata->lock);
+#endif
+	gravity = &userdata->descriptor->gravity;
+	if (!gravity->grid) {
+		error_code = EVDS_InternalPlanet_BuildGravityGrid(planet,gravity,&grid);
+		if (grid) {
+			EVDS_MEMORY_BARRIER();
+			gravity->grid = grid;
+		}
+	}
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Leave(userdata->lock);
+#endif
+	if (error_code != EVDS_OK) return error_code;
+	if (!grid) return EVDS_OK;
+
+	//Report accuracy of the grid
+	if (userdata->grid_error) {
+		EVDS_ERRCHECK(EVDS_Variable_SetReal(userdata->grid_error,grid->error));
+	} else {
+		EVDS_ERRCHECK(EVDS_Object_AddRealVariable(planet,"gravity.grid_error",grid->error,&userdata->grid_error));
+	}
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Update planet position and state.
+///
+/// Planets with an ephemeris are moved to the position and velocity given by the
+/// ephemeris at the current system time. Gravity grid is rebuilt if parameters of the
+/// planet have changed.
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalPlanet_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object, EVDS_REAL delta_time) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_SOLVER_PLANET_USERDATA* userdata;
+	EVDS_PLANET_GRAVITY* gravity;
+	EVDS_REAL is_static;
 	//FIXME: Manual orbital calculations
 
+	//Static planets and planets with ephemeris are not propagated
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+	EVDS_Variable_GetReal(userdata->is_static,&is_static);
+	EVDS_Object_SetStatic(object,(is_static >= 0.5) || userdata->ephemeris);
+
+	//Rebuild gravity descriptor and gravity grid outside of queries
+	EVDS_ERRCHECK(EVDS_InternalPlanet_GetGravity(object,&gravity));
+	EVDS_ERRCHECK(EVDS_InternalPlanet_UpdateGravityGrid(object,userdata));
+
+	//Update state from ephemeris
+	if (userdata->ephemeris) {
+		EVDS_STATE_VECTOR state;
+		EVDS_REAL mjd,position[3],velocity[3];
+
+		EVDS_System_GetTime(system,&mjd);
+		EVDS_InternalEphemeris_Evaluate(userdata->ephemeris,mjd,position,velocity);
+		EVDS_Object_GetStateVector(object,&state);
+		EVDS_Vector_Set(&state.position,EVDS_VECTOR_POSITION,object->parent,position[0],position[1],position[2]);
+		EVDS_Vector_Set(&state.velocity,EVDS_VECTOR_VELOCITY,object->parent,velocity[0],velocity[1],velocity[2]);
+		EVDS_ERRCHECK(EVDS_Object_SetStateVector(object,&state));
+	}
+
 	//Solve all children
-	SIMC_LIST_ENTRY* entry = SIMC_List_GetFirst(object->children);
+	entry = SIMC_List_GetFirst(object->children);
 	while (entry) {
 		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(object->children,entry);
 		EVDS_Object_Solve(child,delta_time);
@@ -106,16 +815,18 @@ int EVDS_InternalPlanet_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJ
 int EVDS_InternalPlanet_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object,
 								  EVDS_REAL delta_time, EVDS_STATE_VECTOR* state, EVDS_STATE_VECTOR_DERIVATIVE* derivative) {
 	EVDS_REAL is_static;
-	EVDS_Object_GetRealVariable(object,"is_static",&is_static,0);
+	EVDS_SOLVER_PLANET_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+	EVDS_Variable_GetReal(userdata->is_static,&is_static);
 
 	//Apply physics if planet is not static or updated via ephemeris
-	if (is_static < 0.5) {
+	if ((is_static < 0.5) && (!userdata->ephemeris)) {
 		//Update planets velocity
 		EVDS_Vector_Copy(&derivative->velocity,&state->velocity);
 		EVDS_Vector_Copy(&derivative->angular_velocity,&state->angular_velocity);
 
 		//Calculate acceleration due to gravity
-		EVDS_Environment_GetGravitationalField(system,&state->position,0,&derivative->acceleration);
+		EVDS_ERRCHECK(EVDS_Environment_GetGravitationalField(system,&state->position,0,&derivative->acceleration));
 	}
 	return EVDS_OK;
 }
@@ -125,20 +836,87 @@ int EVDS_InternalPlanet_Integrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS
 /// @brief Initialize solver
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalPlanet_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	EVDS_SOLVER_PLANET_USERDATA* userdata;
+	EVDS_SOLVER_PLANET_DESCRIPTOR* descriptor;
+	EVDS_VARIABLE* variable;
+	EVDS_REAL is_static;
+	int error_code;
 	if (EVDS_Object_CheckType(object,"planet") != EVDS_OK) return EVDS_IGNORE_OBJECT; 
 
+	//Create userdata
+	userdata = (EVDS_SOLVER_PLANET_USERDATA*)malloc(sizeof(EVDS_SOLVER_PLANET_USERDATA));
+	if (!userdata) return EVDS_ERROR_MEMORY;
+	memset(userdata,0,sizeof(EVDS_SOLVER_PLANET_USERDATA));
+#ifndef EVDS_SINGLETHREADED
+	userdata->lock = SIMC_Lock_Create();
+	userdata->position.lock = SIMC_Lock_Create();
+#endif
+	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
+
+	//Data built from positions of all planets depends on state of the planet and its parents
+	EVDS_InternalObject_MarkPlanet(object);
+
 	//Add non-optional variables
-	EVDS_Object_AddVariable(object,"is_static",EVDS_VARIABLE_TYPE_FLOAT,0);
+	EVDS_ERRCHECK(EVDS_Object_AddVariable(object,"is_static",EVDS_VARIABLE_TYPE_FLOAT,&userdata->is_static));
+
+	//Build gravity descriptor and precompute gravity grid
+	object->gravity_dirty = 0;
+	EVDS_ERRCHECK(EVDS_InternalPlanet_BuildDescriptor(object,userdata,&descriptor));
+	userdata->descriptor = descriptor;
+	EVDS_ERRCHECK(EVDS_InternalPlanet_UpdateGravityGrid(object,userdata));
+
+	//Map ephemeris of the planet
+	if (EVDS_Object_GetVariable(object,"ephemeris.file",&variable) == EVDS_OK) {
+		char filename[1024] = { 0 };
+		EVDS_REAL body;
+		EVDS_Variable_GetString(variable,filename,1023,0);
+		EVDS_Object_GetRealVariable(object,"ephemeris.body",&body,&variable);
+		if (!variable) body = 0.0;
+
+		userdata->ephemeris = (EVDS_EPHEMERIS*)malloc(sizeof(EVDS_EPHEMERIS));
+		if (!userdata->ephemeris) return EVDS_ERROR_MEMORY;
+		error_code = EVDS_InternalEphemeris_Load(filename,(int)(body+0.5),userdata->ephemeris);
+		if (error_code != EVDS_OK) {
+			free(userdata->ephemeris);
+			userdata->ephemeris = 0;
+			return error_code;
+		}
+	}
+
+	//Static planets and planets with ephemeris are never propagated
+	EVDS_Variable_GetReal(userdata->is_static,&is_static);
+	EVDS_Object_SetStatic(object,(is_static >= 0.5) || userdata->ephemeris);
 	return EVDS_CLAIM_OBJECT;
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Deinitialize solver
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPlanet_Deinitialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	EVDS_SOLVER_PLANET_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+#ifndef EVDS_SINGLETHREADED
+	SIMC_Lock_Destroy(userdata->lock);
+	SIMC_Lock_Destroy(userdata->position.lock);
+#endif
+	EVDS_InternalPlanet_DestroyDescriptor(userdata->descriptor);
+	EVDS_InternalPlanet_DestroyDescriptor(userdata->retired);
+	if (userdata->ephemeris) {
+		EVDS_InternalEphemeris_Unload(userdata->ephemeris);
+		free(userdata->ephemeris);
+	}
+	free(userdata);
+	return EVDS_OK;
+}
+
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
 EVDS_SOLVER EVDS_Solver_Planet = {
 	EVDS_InternalPlanet_Initialize, //OnInitialize
-	0, //OnDeinitialize
+	EVDS_InternalPlanet_Deinitialize, //OnDeinitialize
 	EVDS_InternalPlanet_Solve, //OnSolve
 	EVDS_InternalPlanet_Integrate, //OnIntegrate
 	0, //OnStateSave
@@ -0,0 +1,436 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+/// @page EVDS_Propagator_ABM Adams-Bashforth-Moulton Propagator
+///
+/// Fourth order Adams-Bashforth-Moulton predictor-corrector method (PECE mode). The
+/// propagator keeps a history of the last four state derivatives for every child object,
+/// so a single step only requires two calls to EVDS_Object_Integrate() instead of four
+/// calls made by the RK4 propagator:
+/// \f{eqnarray*}{
+///		y^*_{n+1} &=& y_n + \frac{h}{24} (55 f_n - 59 f_{n-1} + 37 f_{n-2} - 9 f_{n-3}) \\
+///		y_{n+1} &=& y_n + \frac{h}{24} (9 f(y^*_{n+1}) + 19 f_n - 5 f_{n-1} + f_{n-2})
+/// \f}
+///
+/// The history is filled with RK4 steps when the object is propagated for the first time.
+/// The propagator restarts (discards history and performs RK4 steps again) when:
+///  - Step size has changed.
+///  - State vector was changed from outside of the propagator (EVDS_Object_SetStateVector()).
+///  - Rocket engine in the object was ignited or shut down.
+///  - Estimated local error (Milne's estimate from difference between predictor and corrector)
+///    exceeds "error_tolerance" (in meters). This catches other discontinuities in the derivative,
+///    for example when a part of the vessel is detached.
+///
+/// Variable			| Description
+/// --------------------|-------------------------------------------------------
+/// error_tolerance		| Maximum local position error estimate before restart (default 0.1 m)
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PROPAGATOR_ABM_HISTORY_TAG {
+	EVDS_OBJECT* object;			//Object this history belongs to
+	int generation;					//Last step in which object was propagated
+	int powered;					//Was object powered during last step
+
+	//Derivative history ring
+	EVDS_STATE_VECTOR_DERIVATIVE derivative[4];
+	int head;						//Index of the newest derivative
+	int count;						//Number of derivatives in history
+	EVDS_REAL h;					//Step size used for the history
+
+	//Derivative at the end of last step
+	EVDS_STATE_VECTOR_DERIVATIVE current;
+	int has_current;
+
+	//Last state written by propagator (to detect external changes)
+	EVDS_REAL position[3];
+	EVDS_REAL velocity[3];
+} EVDS_PROPAGATOR_ABM_HISTORY;
+
+typedef struct EVDS_PROPAGATOR_ABM_USERDATA_TAG {
+	SIMC_LIST* histories;			//List of derivative histories for children
+	SIMC_LIST_ENTRY* cursor;		//Last used entry (histories are stored in order of children)
+	int generation;					//Current step counter
+
+	EVDS_VARIABLE* error_tolerance;
+} EVDS_PROPAGATOR_ABM_USERDATA;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find or create derivative history for the given child object
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_ABM_GetHistory(EVDS_PROPAGATOR_ABM_USERDATA* userdata, EVDS_OBJECT* object,
+										   EVDS_PROPAGATOR_ABM_HISTORY** p_history) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_ABM_HISTORY* history;
+
+	//Histories are usually requested in same order as they are stored
+	if (userdata->cursor) {
+		entry = SIMC_List_GetNext(userdata->histories,userdata->cursor);
+	} else {
+		entry = SIMC_List_GetFirst(userdata->histories);
+	}
+	if (entry) {
+		history = (EVDS_PROPAGATOR_ABM_HISTORY*)SIMC_List_GetData(userdata->histories,entry);
+		if (history->object == object) {
+			SIMC_List_Stop(userdata->histories,entry);
+			userdata->cursor = entry;
+			*p_history = history;
+			return EVDS_OK;
+		}
+		SIMC_List_Stop(userdata->histories,entry);
+	}
+
+	//Search entire list
+	entry = SIMC_List_GetFirst(userdata->histories);
+	while (entry) {
+		history = (EVDS_PROPAGATOR_ABM_HISTORY*)SIMC_List_GetData(userdata->histories,entry);
+		if (history->object == object) {
+			SIMC_List_Stop(userdata->histories,entry);
+			userdata->cursor = entry;
+			*p_history = history;
+			return EVDS_OK;
+		}
+		entry = SIMC_List_GetNext(userdata->histories,entry);
+	}
+
+	//Create new history
+	history = (EVDS_PROPAGATOR_ABM_HISTORY*)malloc(sizeof(EVDS_PROPAGATOR_ABM_HISTORY));
+	if (!history) return EVDS_ERROR_MEMORY;
+	memset(history,0,sizeof(EVDS_PROPAGATOR_ABM_HISTORY));
+	history->object = object;
+	userdata->cursor = SIMC_List_Append(userdata->histories,history);
+	*p_history = history;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove histories of objects which are no longer children of the propagator
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_ABM_RemoveStale(EVDS_PROPAGATOR_ABM_USERDATA* userdata) {
+	int restart;
+	do {
+		SIMC_LIST_ENTRY* entry = SIMC_List_GetFirst(userdata->histories);
+		restart = 0;
+
+		while (entry) {
+			EVDS_PROPAGATOR_ABM_HISTORY* history = SIMC_List_GetData(userdata->histories,entry);
+			if (history->generation != userdata->generation) {
+				free(history);
+				SIMC_List_Remove(userdata->histories,entry); //Stop iterating
+				userdata->cursor = 0;
+				restart = 1;
+				break;
+			} else {
+				entry = SIMC_List_GetNext(userdata->histories,entry);
+			}
+		}
+	} while (restart);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get derivative from history (0 is the newest one)
+////////////////////////////////////////////////////////////////////////////////
+EVDS_STATE_VECTOR_DERIVATIVE* EVDS_InternalPropagator_ABM_Derivative(EVDS_PROPAGATOR_ABM_HISTORY* history, int index) {
+	return &history->derivative[(history->head - index + 4) % 4];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief RK4 step (used to fill the history), f1 is the derivative at initial state
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_ABM_RK4(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+									 EVDS_STATE_VECTOR* state, EVDS_STATE_VECTOR_DERIVATIVE* state_derivative_1,
+									 EVDS_REAL h) {
+	EVDS_STATE_VECTOR state_temporary;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_2;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_3;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_4;
+
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,state_derivative_1,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_2);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_2,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_3);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_3,h);
+	EVDS_Object_Integrate(object,h,&state_temporary,&state_derivative_4);
+
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,state_derivative_1,1.0/6.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_2,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_3,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_4,1.0/6.0);
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Predictor-corrector step.
+///
+/// @returns Error code
+/// @retval EVDS_OK Step was accepted
+/// @retval EVDS_ERROR_INTERNAL Error estimate too large, propagator must restart
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_ABM_PECE(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+									 EVDS_PROPAGATOR_ABM_HISTORY* history, EVDS_STATE_VECTOR* state,
+									 EVDS_REAL h, EVDS_REAL error_tolerance) {
+	EVDS_REAL error;
+	EVDS_VECTOR difference;
+	EVDS_STATE_VECTOR state_predicted;
+	EVDS_STATE_VECTOR state_corrected;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_predicted;
+	EVDS_STATE_VECTOR_DERIVATIVE* f0 = EVDS_InternalPropagator_ABM_Derivative(history,0);
+	EVDS_STATE_VECTOR_DERIVATIVE* f1 = EVDS_InternalPropagator_ABM_Derivative(history,1);
+	EVDS_STATE_VECTOR_DERIVATIVE* f2 = EVDS_InternalPropagator_ABM_Derivative(history,2);
+	EVDS_STATE_VECTOR_DERIVATIVE* f3 = EVDS_InternalPropagator_ABM_Derivative(history,3);
+
+	//Predict (Adams-Bashforth)
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f0, 55.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f1,-59.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f2, 37.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f3, -9.0/24.0);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_predicted,state,&state_derivative,h);
+
+	//Evaluate
+	EVDS_Object_Integrate(object,h,&state_predicted,&state_derivative_predicted);
+
+	//Correct (Adams-Moulton)
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_predicted,9.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f0,19.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f1,-5.0/24.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,f2, 1.0/24.0);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_corrected,state,&state_derivative,h);
+
+	//Milne's estimate of the local error
+	EVDS_Vector_Subtract(&difference,&state_corrected.position,&state_predicted.position);
+	EVDS_Vector_Length(&error,&difference);
+	if ((19.0/270.0)*error > error_tolerance) return EVDS_ERROR_INTERNAL;
+
+	//Evaluate derivative at the new state (it will be used in next step)
+	EVDS_Object_Integrate(object,h,&state_corrected,&history->current);
+	history->has_current = 1;
+
+	//Accept step
+	memcpy(state,&state_corrected,sizeof(EVDS_STATE_VECTOR));
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate state of a single child object
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_ABM_Step(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+									  EVDS_PROPAGATOR_ABM_HISTORY* history, EVDS_STATE_VECTOR* state,
+									  EVDS_REAL h, EVDS_REAL error_tolerance) {
+	EVDS_STATE_VECTOR_DERIVATIVE* f0;
+
+	//Derivative at the beginning of the step
+	history->head = (history->head + 1) % 4;
+	f0 = EVDS_InternalPropagator_ABM_Derivative(history,0);
+	if (history->has_current) {
+		memcpy(f0,&history->current,sizeof(EVDS_STATE_VECTOR_DERIVATIVE));
+	} else {
+		EVDS_Object_Integrate(object,0.0,state,f0);
+	}
+	if (history->count < 4) history->count++;
+	history->has_current = 0;
+
+	//Use predictor-corrector if there is enough history
+	if (history->count == 4) {
+		if (EVDS_InternalPropagator_ABM_PECE(coordinate_system,object,history,state,h,error_tolerance) == EVDS_OK) {
+			return;
+		}
+
+		//Discontinuity in the derivative: restart from the current derivative
+		memcpy(&history->derivative[0],f0,sizeof(EVDS_STATE_VECTOR_DERIVATIVE));
+		history->head = 0;
+		history->count = 1;
+		f0 = &history->derivative[0];
+	}
+
+	//Fill history with RK4 steps
+	EVDS_InternalPropagator_ABM_RK4(coordinate_system,object,state,f0,h);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate state of all children
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_ABM_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+	int sleeping;
+	EVDS_REAL error_tolerance;
+	EVDS_PROPAGATOR_ABM_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(coordinate_system,(void**)&userdata));
+	EVDS_Variable_GetReal(userdata->error_tolerance,&error_tolerance);
+
+	//Start new step
+	userdata->generation++;
+	userdata->cursor = 0;
+
+	//Process all children
+	EVDS_Object_GetChildren(coordinate_system,&children);
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		int powered;
+		EVDS_STATE_VECTOR state;
+		EVDS_PROPAGATOR_ABM_HISTORY* history;
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
+
+		// Solve everything inside the child
+		if ((EVDS_Object_Solve(object,h) != EVDS_OK) ||
+			(EVDS_InternalPropagator_ABM_GetHistory(userdata,object,&history) != EVDS_OK)) {
+			// In case there is an error move to the next object in list.
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+		history->generation = userdata->generation;
+
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			history->count = 0;
+			history->has_current = 0;
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+
+		// Get initial state vector
+		EVDS_Object_GetStateVector(object,&state);
+
+		// Restart if state was changed by someone else, step size changed or engines were toggled
+		powered = EVDS_InternalPropagator_Kepler_IsPowered(object);
+		if ((history->h != h) || (history->powered != powered) ||
+			(state.position.x != history->position[0]) ||
+			(state.position.y != history->position[1]) ||
+			(state.position.z != history->position[2]) ||
+			(state.velocity.x != history->velocity[0]) ||
+			(state.velocity.y != history->velocity[1]) ||
+			(state.velocity.z != history->velocity[2])) {
+			history->count = 0;
+			history->has_current = 0;
+		}
+		history->h = h;
+		history->powered = powered;
+
+		// Propagate state
+		EVDS_InternalPropagator_ABM_Step(coordinate_system,object,history,&state,h,error_tolerance);
+
+		// Update object state vector
+		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
+		history->position[0] = state.position.x;
+		history->position[1] = state.position.y;
+		history->position[2] = state.position.z;
+		history->velocity[0] = state.velocity.x;
+		history->velocity[1] = state.velocity.y;
+		history->velocity[2] = state.velocity.z;
+
+		//Move to next object in list
+		entry = SIMC_List_GetNext(children,entry);
+	}
+
+	//Forget objects that left the propagator
+	EVDS_InternalPropagator_ABM_RemoveStale(userdata);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Initialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_ABM_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	EVDS_PROPAGATOR_ABM_USERDATA* userdata;
+	if (EVDS_Object_CheckType(object,"propagator_abm") != EVDS_OK) return EVDS_IGNORE_OBJECT;
+
+	//Create userdata
+	userdata = (EVDS_PROPAGATOR_ABM_USERDATA*)malloc(sizeof(EVDS_PROPAGATOR_ABM_USERDATA));
+	if (!userdata) return EVDS_ERROR_MEMORY;
+	memset(userdata,0,sizeof(EVDS_PROPAGATOR_ABM_USERDATA));
+	SIMC_List_Create(&userdata->histories,0);
+	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
+
+	//Add variables
+	EVDS_Object_AddRealVariable(object,"error_tolerance",0.1,&userdata->error_tolerance);
+	return EVDS_CLAIM_OBJECT;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Deinitialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_ABM_Deinitialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_ABM_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+
+	//Remove all histories
+	entry = SIMC_List_GetFirst(userdata->histories);
+	while (entry) {
+		free(SIMC_List_GetData(userdata->histories,entry));
+		entry = SIMC_List_GetNext(userdata->histories,entry);
+	}
+	SIMC_List_Destroy(userdata->histories);
+	free(userdata);
+	return EVDS_OK;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+EVDS_SOLVER EVDS_Propagator_ABM = {
+	EVDS_InternalPropagator_ABM_Initialize, //OnInitialize
+	EVDS_InternalPropagator_ABM_Deinitialize, //OnDeinitialize
+	EVDS_InternalPropagator_ABM_Solve, //OnSolve
+	0, //OnIntegrate
+	0, //OnStateSave
+	0, //OnStateLoad
+	0, //OnStartup
+	0, //OnShutdown
+};
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Register Adams-Bashforth-Moulton propagator solver
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_STATE Cannot register solvers in current state
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Propagator_ABM_Register(EVDS_SYSTEM* system) {
+	return EVDS_Solver_Register(system,&EVDS_Propagator_ABM);
+}
@@ -0,0 +1,544 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+/// @page EVDS_Propagator_Encke Encke/Cowell Hybrid Propagator
+///
+/// This propagator is intended for orbits which are dominated by the gravity of a single
+/// body, with small perturbations (non-spherical gravity, drag, third bodies). Instead of
+/// integrating the total acceleration (Cowell's method), only the deviation \f$\delta r\f$
+/// from a reference two-body orbit around the nearest planet is integrated with RK4.
+/// The reference orbit is evaluated analytically (see @ref EVDS_Propagator_Kepler), so the
+/// truncation error only depends on the perturbing acceleration and much larger steps
+/// can be taken for the same accuracy.
+///
+/// The deviation is integrated using Battin's formulation which avoids subtracting two
+/// nearly equal accelerations:
+/// \f{eqnarray*}{
+///		q &=& \frac{\delta r \cdot (\delta r - 2 r)}{r^2} \\
+///		f(q) &=& q \frac{3 + 3q + q^2}{1 + (1 + q)^{3/2}} \\
+///		\delta \ddot{r} &=& -\frac{\mu}{r_{osc}^3} \left( f(q) r + \delta r \right) + a_p
+/// \f}
+/// where \f$r\f$ is the true position, \f$r_{osc}\f$ is the position on the reference orbit and
+/// \f$a_p\f$ is the perturbing acceleration (total acceleration of the object minus the
+/// central body term).
+///
+/// The reference orbit is rectified (re-derived from the current state vector) when the
+/// deviation becomes larger than "rectification_ratio" of the reference radius, or when the
+/// state vector was changed from outside of the propagator.
+///
+/// The method is chosen before every step. Objects with a firing rocket engine are propagated
+/// with Cowell's method. If the perturbing acceleration measured during the previous step was
+/// larger than "cowell_ratio" of the central body acceleration, Cowell's method is used until
+/// the perturbation becomes small again, and the reference orbit is rectified after that.
+/// Planets and objects without a central body are always propagated with Cowell's method.
+///
+/// Variable				| Description
+/// ------------------------|-------------------------------------------------------
+/// rectification_ratio		| Maximum ratio of deviation to reference radius (default 0.01)
+/// cowell_ratio			| Ratio of perturbing to central acceleration above which Cowell's method is used (default 0.1)
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PROPAGATOR_ENCKE_ORBIT_TAG {
+	EVDS_OBJECT* object;			//Object propagated along this orbit
+	EVDS_OBJECT* body;				//Central body
+	int valid;						//Is reference orbit valid
+	int generation;					//Last step in which object was propagated
+
+	//Reference orbit
+	EVDS_REAL mu;					//Gravitational parameter of the central body
+	EVDS_REAL alpha;				//Reciprocal of semi-major axis
+	EVDS_REAL period;				//Orbital period (0 for open orbits)
+	EVDS_REAL r0[3];				//Position relative to central body at epoch
+	EVDS_REAL v0[3];				//Velocity relative to central body at epoch
+	EVDS_REAL t;					//Time since epoch
+	EVDS_REAL ratio;				//Perturbation ratio measured during the last step
+
+	//Deviation from reference orbit
+	EVDS_REAL dr[3];
+	EVDS_REAL dv[3];
+
+	//Last state written by propagator (to detect external changes)
+	EVDS_REAL position[3];
+	EVDS_REAL velocity[3];
+} EVDS_PROPAGATOR_ENCKE_ORBIT;
+
+typedef struct EVDS_PROPAGATOR_ENCKE_USERDATA_TAG {
+	SIMC_LIST* orbits;				//List of reference orbits for children
+	SIMC_LIST_ENTRY* cursor;		//Last used entry (orbits are stored in order of children)
+	int generation;					//Current step counter
+
+	EVDS_VARIABLE* rectification_ratio;
+	EVDS_VARIABLE* cowell_ratio;
+} EVDS_PROPAGATOR_ENCKE_USERDATA;
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Rectify reference orbit to pass through the current state of the object
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Encke_Rectify(EVDS_OBJECT* coordinate_system, EVDS_PROPAGATOR_ENCKE_ORBIT* orbit,
+										  EVDS_STATE_VECTOR* state) {
+	EVDS_REAL mu,mass,r0n,v0n2;
+	EVDS_VARIABLE* mu_var;
+	EVDS_VARIABLE* mass_var;
+	EVDS_VECTOR body_position,body_velocity;
+	EVDS_VECTOR r0,v0;
+	EVDS_OBJECT* body;
+	orbit->valid = 0;
+
+	//Find central body and its gravitational parameter
+	if (EVDS_Planet_GetNearest(orbit->object,&body) != EVDS_OK) return EVDS_ERROR_NOT_FOUND;
+	if (body == orbit->object) return EVDS_ERROR_NOT_FOUND;
+	EVDS_Object_GetRealVariable(body,"gravity.mu",&mu,&mu_var);
+	EVDS_Object_GetRealVariable(body,"mass",&mass,&mass_var);
+	if (!mu_var) {
+		if (!mass_var) return EVDS_ERROR_NOT_FOUND;
+		mu = 6.6738480e-11 * mass;
+	}
+	if (mu <= 0.0) return EVDS_ERROR_NOT_FOUND;
+
+	//Get state relative to the central body
+	EVDS_InternalPropagator_Kepler_GetBodyState(coordinate_system,body,&body_position,&body_velocity);
+	EVDS_Vector_Subtract(&r0,&state->position,&body_position);
+	EVDS_Vector_Subtract(&v0,&state->velocity,&body_velocity);
+	EVDS_Vector_Length(&r0n,&r0);
+	EVDS_Vector_Dot(&v0n2,&v0,&v0);
+	if (r0n < EVDS_EPS) return EVDS_ERROR_NOT_FOUND;
+
+	//Store new reference orbit, reset deviation
+	orbit->body = body;
+	orbit->mu = mu;
+	orbit->alpha = 2.0/r0n - v0n2/mu;
+	orbit->r0[0] = r0.x; orbit->r0[1] = r0.y; orbit->r0[2] = r0.z;
+	orbit->v0[0] = v0.x; orbit->v0[1] = v0.y; orbit->v0[2] = v0.z;
+	orbit->dr[0] = 0.0; orbit->dr[1] = 0.0; orbit->dr[2] = 0.0;
+	orbit->dv[0] = 0.0; orbit->dv[1] = 0.0; orbit->dv[2] = 0.0;
+	orbit->t = 0.0;
+	if (orbit->alpha > 1e-12) {
+		orbit->period = 2.0*EVDS_PI/sqrt(mu*orbit->alpha*orbit->alpha*orbit->alpha);
+	} else {
+		orbit->period = 0.0;
+	}
+	orbit->valid = 1;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find or create reference orbit for the given child object
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Encke_GetOrbit(EVDS_PROPAGATOR_ENCKE_USERDATA* userdata, EVDS_OBJECT* object,
+										   EVDS_PROPAGATOR_ENCKE_ORBIT** p_orbit) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_ENCKE_ORBIT* orbit;
+
+	//Orbits are usually requested in same order as they are stored
+	if (userdata->cursor) {
+		entry = SIMC_List_GetNext(userdata->orbits,userdata->cursor);
+	} else {
+		entry = SIMC_List_GetFirst(userdata->orbits);
+	}
+	if (entry) {
+		orbit = (EVDS_PROPAGATOR_ENCKE_ORBIT*)SIMC_List_GetData(userdata->orbits,entry);
+		if (orbit->object == object) {
+			SIMC_List_Stop(userdata->orbits,entry);
+			userdata->cursor = entry;
+			*p_orbit = orbit;
+			return EVDS_OK;
+		}
+		SIMC_List_Stop(userdata->orbits,entry);
+	}
+
+	//Search entire list
+	entry = SIMC_List_GetFirst(userdata->orbits);
+	while (entry) {
+		orbit = (EVDS_PROPAGATOR_ENCKE_ORBIT*)SIMC_List_GetData(userdata->orbits,entry);
+		if (orbit->object == object) {
+			SIMC_List_Stop(userdata->orbits,entry);
+			userdata->cursor = entry;
+			*p_orbit = orbit;
+			return EVDS_OK;
+		}
+		entry = SIMC_List_GetNext(userdata->orbits,entry);
+	}
+
+	//Create new orbit
+	orbit = (EVDS_PROPAGATOR_ENCKE_ORBIT*)malloc(sizeof(EVDS_PROPAGATOR_ENCKE_ORBIT));
+	if (!orbit) return EVDS_ERROR_MEMORY;
+	memset(orbit,0,sizeof(EVDS_PROPAGATOR_ENCKE_ORBIT));
+	orbit->object = object;
+	userdata->cursor = SIMC_List_Append(userdata->orbits,orbit);
+	*p_orbit = orbit;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove orbits of objects which are no longer children of the propagator
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Encke_RemoveStale(EVDS_PROPAGATOR_ENCKE_USERDATA* userdata) {
+	int restart;
+	do {
+		SIMC_LIST_ENTRY* entry = SIMC_List_GetFirst(userdata->orbits);
+		restart = 0;
+
+		while (entry) {
+			EVDS_PROPAGATOR_ENCKE_ORBIT* orbit = SIMC_List_GetData(userdata->orbits,entry);
+			if (orbit->generation != userdata->generation) {
+				free(orbit);
+				SIMC_List_Remove(userdata->orbits,entry); //Stop iterating
+				userdata->cursor = 0;
+				restart = 1;
+				break;
+			} else {
+				entry = SIMC_List_GetNext(userdata->orbits,entry);
+			}
+		}
+	} while (restart);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute derivative of the deviation from reference orbit.
+///
+/// Full state of the object is reconstructed from the reference orbit and the deviation,
+/// then the total acceleration is requested from the object.
+///
+/// @returns Ratio of perturbing acceleration to the central body acceleration
+////////////////////////////////////////////////////////////////////////////////
+EVDS_REAL EVDS_InternalPropagator_Encke_Derivative(EVDS_OBJECT* coordinate_system, EVDS_PROPAGATOR_ENCKE_ORBIT* orbit,
+												   EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, EVDS_REAL t,
+												   EVDS_REAL* dr, EVDS_REAL* dv,
+												   EVDS_STATE_VECTOR_DERIVATIVE* derivative, EVDS_REAL* ddv) {
+	int i;
+	EVDS_REAL ref_r[3],ref_v[3],r[3];
+	EVDS_REAL rn2,rn,rosc,q,fq,ap,ap2,ac;
+	EVDS_VECTOR body_position,body_velocity,acceleration;
+
+	//Reconstruct full state of the object
+	EVDS_InternalPropagator_Kepler_Evaluate(orbit->mu,orbit->alpha,orbit->period,
+		orbit->r0,orbit->v0,orbit->t+t,ref_r,ref_v);
+	EVDS_InternalPropagator_Kepler_GetBodyState(coordinate_system,orbit->body,&body_position,&body_velocity);
+	EVDS_Vector_Set(&state->position,EVDS_VECTOR_POSITION,coordinate_system,
+		body_position.x + ref_r[0] + dr[0],
+		body_position.y + ref_r[1] + dr[1],
+		body_position.z + ref_r[2] + dr[2]);
+	EVDS_Vector_Set(&state->velocity,EVDS_VECTOR_VELOCITY,coordinate_system,
+		body_velocity.x + ref_v[0] + dv[0],
+		body_velocity.y + ref_v[1] + dv[1],
+		body_velocity.z + ref_v[2] + dv[2]);
+
+	//Get total acceleration
+	EVDS_Object_Integrate(object,t,state,derivative);
+	EVDS_Vector_Convert(&acceleration,&derivative->acceleration,coordinate_system);
+
+	//True and reference radius
+	for (i = 0; i < 3; i++) r[i] = ref_r[i] + dr[i];
+	rn2 = r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+	rn = sqrt(rn2);
+	rosc = sqrt(ref_r[0]*ref_r[0] + ref_r[1]*ref_r[1] + ref_r[2]*ref_r[2]);
+
+	//Battin's f(q) function
+	q = (dr[0]*(dr[0] - 2.0*r[0]) + dr[1]*(dr[1] - 2.0*r[1]) + dr[2]*(dr[2] - 2.0*r[2]))/rn2;
+	fq = q*(3.0 + 3.0*q + q*q)/(1.0 + pow(1.0 + q,1.5));
+
+	//Perturbing acceleration and acceleration of the deviation
+	ap2 = 0.0;
+	for (i = 0; i < 3; i++) {
+		EVDS_REAL total = (i == 0 ? acceleration.x : (i == 1 ? acceleration.y : acceleration.z));
+		ap = total + orbit->mu*r[i]/(rn2*rn);
+		ap2 += ap*ap;
+		ddv[i] = -orbit->mu/(rosc*rosc*rosc)*(fq*r[i] + dr[i]) + ap;
+	}
+	ac = orbit->mu/rn2;
+	return sqrt(ap2)/ac;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate deviation from reference orbit with RK4
+///
+/// @returns Largest ratio of perturbing acceleration to the central body acceleration
+////////////////////////////////////////////////////////////////////////////////
+EVDS_REAL EVDS_InternalPropagator_Encke_Step(EVDS_OBJECT* coordinate_system, EVDS_PROPAGATOR_ENCKE_ORBIT* orbit,
+											 EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	int i;
+	EVDS_REAL ratio,max_ratio;
+	EVDS_REAL dr[3],dv[3];
+	EVDS_REAL k1v[3],k2v[3],k3v[3],k4v[3];
+	EVDS_REAL k1a[3],k2a[3],k3a[3],k4a[3];
+	EVDS_REAL ref_r[3],ref_v[3];
+	EVDS_VECTOR body_position,body_velocity;
+	EVDS_STATE_VECTOR state_temporary;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_2;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_3;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_4;
+
+	// f1 = f(0,y)
+	EVDS_StateVector_Copy(&state_temporary,state);
+	for (i = 0; i < 3; i++) { k1v[i] = orbit->dv[i]; }
+	max_ratio = EVDS_InternalPropagator_Encke_Derivative(coordinate_system,orbit,object,&state_temporary,0.0,
+		orbit->dr,orbit->dv,&state_derivative_1,k1a);
+
+	// f2 = f(t+0.5*h,y+0.5*h*f1)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_1,0.5*h);
+	for (i = 0; i < 3; i++) {
+		dr[i] = orbit->dr[i] + 0.5*h*k1v[i];
+		dv[i] = orbit->dv[i] + 0.5*h*k1a[i];
+		k2v[i] = dv[i];
+	}
+	ratio = EVDS_InternalPropagator_Encke_Derivative(coordinate_system,orbit,object,&state_temporary,0.5*h,
+		dr,dv,&state_derivative_2,k2a);
+	if (ratio > max_ratio) max_ratio = ratio;
+
+	// f3 = f(t+0.5h,y+0.5*h*f2)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_2,0.5*h);
+	for (i = 0; i < 3; i++) {
+		dr[i] = orbit->dr[i] + 0.5*h*k2v[i];
+		dv[i] = orbit->dv[i] + 0.5*h*k2a[i];
+		k3v[i] = dv[i];
+	}
+	ratio = EVDS_InternalPropagator_Encke_Derivative(coordinate_system,orbit,object,&state_temporary,0.5*h,
+		dr,dv,&state_derivative_3,k3a);
+	if (ratio > max_ratio) max_ratio = ratio;
+
+	// f4 = f(t+h,y+h*f3)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_3,h);
+	for (i = 0; i < 3; i++) {
+		dr[i] = orbit->dr[i] + h*k3v[i];
+		dv[i] = orbit->dv[i] + h*k3a[i];
+		k4v[i] = dv[i];
+	}
+	ratio = EVDS_InternalPropagator_Encke_Derivative(coordinate_system,orbit,object,&state_temporary,h,
+		dr,dv,&state_derivative_4,k4a);
+	if (ratio > max_ratio) max_ratio = ratio;
+
+	// Attitude: state = state + h*(1/6 f1 + 1/3 f2 + 1/3 f3 + 1/6 f4)
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_1,1.0/6.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_2,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_3,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_4,1.0/6.0);
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+
+	// Deviation from reference orbit
+	for (i = 0; i < 3; i++) {
+		orbit->dr[i] += h*(k1v[i] + 2.0*k2v[i] + 2.0*k3v[i] + k4v[i])/6.0;
+		orbit->dv[i] += h*(k1a[i] + 2.0*k2a[i] + 2.0*k3a[i] + k4a[i])/6.0;
+	}
+	orbit->t += h;
+
+	// Position and velocity
+	EVDS_InternalPropagator_Kepler_Evaluate(orbit->mu,orbit->alpha,orbit->period,
+		orbit->r0,orbit->v0,orbit->t,ref_r,ref_v);
+	EVDS_InternalPropagator_Kepler_GetBodyState(coordinate_system,orbit->body,&body_position,&body_velocity);
+	EVDS_Vector_Set(&state->position,EVDS_VECTOR_POSITION,coordinate_system,
+		body_position.x + ref_r[0] + orbit->dr[0],
+		body_position.y + ref_r[1] + orbit->dr[1],
+		body_position.z + ref_r[2] + orbit->dr[2]);
+	EVDS_Vector_Set(&state->velocity,EVDS_VECTOR_VELOCITY,coordinate_system,
+		body_velocity.x + ref_v[0] + orbit->dv[0],
+		body_velocity.y + ref_v[1] + orbit->dv[1],
+		body_velocity.z + ref_v[2] + orbit->dv[2]);
+	return max_ratio;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Encke propagator step
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Encke_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+	int sleeping,powered;
+	EVDS_REAL rectification_ratio,cowell_ratio;
+	EVDS_PROPAGATOR_ENCKE_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(coordinate_system,(void**)&userdata));
+	EVDS_Variable_GetReal(userdata->rectification_ratio,&rectification_ratio);
+	EVDS_Variable_GetReal(userdata->cowell_ratio,&cowell_ratio);
+
+	//Start new step
+	userdata->generation++;
+	userdata->cursor = 0;
+
+	//Process all children
+	EVDS_Object_GetChildren(coordinate_system,&children);
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		EVDS_STATE_VECTOR state;
+		EVDS_STATE_VECTOR state_temporary;
+		EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+		EVDS_REAL ddv[3];
+		EVDS_PROPAGATOR_ENCKE_ORBIT* orbit;
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
+
+		// Solve everything inside the child
+		if ((EVDS_Object_Solve(object,h) != EVDS_OK) ||
+			(EVDS_InternalPropagator_Encke_GetOrbit(userdata,object,&orbit) != EVDS_OK)) {
+			// In case there is an error move to the next object in list.
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+		orbit->generation = userdata->generation;
+
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			orbit->valid = 0;
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+
+		// Get initial state vector
+		EVDS_Object_GetStateVector(object,&state);
+		powered = EVDS_InternalPropagator_Kepler_IsPowered(object);
+
+		// Rectify if state was changed by someone else, or if deviation is too large
+		if (orbit->valid) {
+			EVDS_REAL dr2 = orbit->dr[0]*orbit->dr[0] + orbit->dr[1]*orbit->dr[1] + orbit->dr[2]*orbit->dr[2];
+			EVDS_REAL r02 = orbit->r0[0]*orbit->r0[0] + orbit->r0[1]*orbit->r0[1] + orbit->r0[2]*orbit->r0[2];
+			if ((state.position.x != orbit->position[0]) ||
+				(state.position.y != orbit->position[1]) ||
+				(state.position.z != orbit->position[2]) ||
+				(state.velocity.x != orbit->velocity[0]) ||
+				(state.velocity.y != orbit->velocity[1]) ||
+				(state.velocity.z != orbit->velocity[2]) ||
+				(dr2 > rectification_ratio*rectification_ratio*r02)) {
+				orbit->valid = 0;
+			}
+		}
+		if ((!orbit->valid) && (!powered) && (EVDS_Object_CheckType(object,"planet") != EVDS_OK)) {
+			EVDS_InternalPropagator_Encke_Rectify(coordinate_system,orbit,&state);
+		}
+
+		// Perturbation was large during the last step, check if it is still large
+		if (orbit->valid && (!powered) && (orbit->ratio > cowell_ratio)) {
+			EVDS_StateVector_Copy(&state_temporary,&state);
+			orbit->ratio = EVDS_InternalPropagator_Encke_Derivative(coordinate_system,orbit,object,
+				&state_temporary,0.0,orbit->dr,orbit->dv,&state_derivative,ddv);
+		}
+
+		// Propagate state with Encke's method, use Cowell's method while engine is firing
+		// or while perturbation is large
+		if (orbit->valid && (!powered) && (orbit->ratio <= cowell_ratio)) {
+			orbit->ratio = EVDS_InternalPropagator_Encke_Step(coordinate_system,orbit,object,&state,h);
+		} else {
+			EVDS_InternalPropagator_Kepler_Numerical(coordinate_system,object,&state,h);
+			orbit->valid = 0;
+		}
+
+		// Update object state vector
+		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
+		orbit->position[0] = state.position.x;
+		orbit->position[1] = state.position.y;
+		orbit->position[2] = state.position.z;
+		orbit->velocity[0] = state.velocity.x;
+		orbit->velocity[1] = state.velocity.y;
+		orbit->velocity[2] = state.velocity.z;
+
+		//Move to next object in list
+		entry = SIMC_List_GetNext(children,entry);
+	}
+
+	//Forget objects that left the propagator
+	EVDS_InternalPropagator_Encke_RemoveStale(userdata);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Initialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Encke_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	EVDS_PROPAGATOR_ENCKE_USERDATA* userdata;
+	if (EVDS_Object_CheckType(object,"propagator_encke") != EVDS_OK) return EVDS_IGNORE_OBJECT;
+
+	//Create userdata
+	userdata = (EVDS_PROPAGATOR_ENCKE_USERDATA*)malloc(sizeof(EVDS_PROPAGATOR_ENCKE_USERDATA));
+	if (!userdata) return EVDS_ERROR_MEMORY;
+	memset(userdata,0,sizeof(EVDS_PROPAGATOR_ENCKE_USERDATA));
+	SIMC_List_Create(&userdata->orbits,0);
+	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
+
+	//Add propagator parameters
+	EVDS_Object_AddRealVariable(object,"rectification_ratio",0.01,&userdata->rectification_ratio);
+	EVDS_Object_AddRealVariable(object,"cowell_ratio",0.1,&userdata->cowell_ratio);
+	return EVDS_CLAIM_OBJECT;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Deinitialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Encke_Deinitialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_ENCKE_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+
+	//Remove all orbits
+	entry = SIMC_List_GetFirst(userdata->orbits);
+	while (entry) {
+		free(SIMC_List_GetData(userdata->orbits,entry));
+		entry = SIMC_List_GetNext(userdata->orbits,entry);
+	}
+	SIMC_List_Destroy(userdata->orbits);
+	free(userdata);
+	return EVDS_OK;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+EVDS_SOLVER EVDS_Propagator_Encke = {
+	EVDS_InternalPropagator_Encke_Initialize, //OnInitialize
+	EVDS_InternalPropagator_Encke_Deinitialize, //OnDeinitialize
+	EVDS_InternalPropagator_Encke_Solve, //OnSolve
+	0, //OnIntegrate
+	0, //OnStateSave
+	0, //OnStateLoad
+	0, //OnStartup
+	0, //OnShutdown
+};
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Register Encke/Cowell hybrid propagator solver
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_STATE Cannot register solvers in current state
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Propagator_Encke_Register(EVDS_SYSTEM* system) {
+	return EVDS_Solver_Register(system,&EVDS_Propagator_Encke);
+}
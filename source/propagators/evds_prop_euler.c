@@ -29,20 +29,34 @@
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Forward euler integration method (single step)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_ForwardEuler_Step(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+											   EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;		//Derivative at initial state
+
+	// Find derivative
+	EVDS_Object_Integrate(object,h,state,&state_derivative);
+
+	// Calculate new final state
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Forward euler integration method
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalPropagator_ForwardEuler_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
 	SIMC_LIST* children;
 	SIMC_LIST_ENTRY* entry;
+	int sleeping;
 
 	//Process all children
 	EVDS_Object_GetChildren(coordinate_system,&children);
 	entry = SIMC_List_GetFirst(children);
 	while (entry) {
-		//Initial state, final derivative:
 		EVDS_STATE_VECTOR state;							//Initial state (t = 0)
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative;		//Derivative at initial state
 		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
 
 		// Solve everything inside the child
@@ -52,17 +66,23 @@ int EVDS_InternalPropagator_ForwardEuler_Solve(EVDS_SYSTEM* system, EVDS_SOLVER*
 			continue;
 		}
 
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+
 		// Get initial state vector
 		EVDS_Object_GetStateVector(object,&state);
 
-		// Find derivative
-		EVDS_Object_Integrate(object,h,&state,&state_derivative);
-
-		// Calculate new final state
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state,&state,&state_derivative,h);
+		// Propagate state (stopping at events)
+		EVDS_Event_Propagate(coordinate_system,object,&state,h,EVDS_InternalPropagator_ForwardEuler_Step);
 
 		// Update object state vector
 		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
 
 		//Move to next object in list
 		entry = SIMC_List_GetNext(children,entry);
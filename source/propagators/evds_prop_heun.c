@@ -29,25 +29,76 @@
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Heun propagator-corrector solver (single step)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Heun_Step(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+									   EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	EVDS_REAL error,mag2;
+	EVDS_VECTOR temporary;
+	EVDS_STATE_VECTOR state_0; //t = 0
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_0;
+	EVDS_STATE_VECTOR state_1; //t = h
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;
+	EVDS_STATE_VECTOR state_1n; //(new state) t = h
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_0n; //(new derivative) t = 0
+	EVDS_Vector_Initialize(temporary);
+
+	// Get initial state vector
+	EVDS_StateVector_Copy(&state_0,state);
+
+	// Calculate derivative at starting point (forward integration)
+	EVDS_Object_Integrate(object,0.0,&state_0,&state_derivative_0);
+
+	// Make a forward-integration estimate of final state (predictor)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_1,&state_0,&state_derivative_0,h);
+
+	// Iterative integration
+	error = 1e9;
+	while (error > 1e-5) {
+		// Calculate derivative in the final state
+		EVDS_Object_Integrate(object,h,&state_1,&state_derivative_1);
+
+		// Calculate new derivative at the starting point as average between two derivatives (corrector)
+		//d0' = (d0 + d1) / 2
+		EVDS_StateVector_Derivative_Initialize(&state_derivative_0n,coordinate_system);
+		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative_0n,&state_derivative_0n,&state_derivative_0,0.5);
+		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative_0n,&state_derivative_0n,&state_derivative_1,0.5);
+
+		// Calculate new final state
+		//s1' = s0 + d0' * dt
+		EVDS_StateVector_MultiplyByTimeAndAdd(&state_1n,&state_0,&state_derivative_0n,h);
+
+		// Estimate error (FIXME: better criteria)
+		error = 0;
+		EVDS_Vector_Subtract(&temporary,&state_1.position,&state_1n.position);
+		EVDS_Vector_Dot(&mag2,&temporary,&temporary); error += mag2;
+		EVDS_Vector_Subtract(&temporary,&state_1.velocity,&state_1n.velocity);
+		EVDS_Vector_Dot(&mag2,&temporary,&temporary); error += mag2;
+		error = sqrt(error);
+
+		// Set new final state
+		EVDS_StateVector_Copy(&state_1,&state_1n);
+	}
+
+	// Return final state
+	EVDS_StateVector_Copy(state,&state_1);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief Heun propagator-corrector solver
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalPropagator_Heun_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
 	SIMC_LIST* children;
 	SIMC_LIST_ENTRY* entry;
+	int sleeping;
 
 	//Process all children
 	EVDS_Object_GetChildren(coordinate_system,&children);
 	entry = SIMC_List_GetFirst(children);
 	while (entry) {
-		EVDS_REAL error,mag2;
-		EVDS_VECTOR temporary;
-		EVDS_STATE_VECTOR state_0; //t = 0
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_0;
-		EVDS_STATE_VECTOR state_1; //t = h
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;
-		EVDS_STATE_VECTOR state_1n; //(new state) t = h
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_0n; //(new derivative) t = 0
+		EVDS_STATE_VECTOR state;
 		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
 
 		// Solve everything inside the child
@@ -57,47 +108,24 @@ int EVDS_InternalPropagator_Heun_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver,
 			entry = SIMC_List_GetNext(children,entry);
 			continue;
 		}
-		EVDS_Vector_Initialize(temporary);
 
-		// Get initial state vector
-		EVDS_Object_GetStateVector(object,&state_0);
-
-		// Calculate derivative at starting point (forward integration)
-		EVDS_Object_Integrate(object,0.0,&state_0,&state_derivative_0);
-
-		// Make a forward-integration estimate of final state (predictor)
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state_1,&state_0,&state_derivative_0,h);
-
-		// Iterative integration
-		error = 1e9;
-		while (error > 1e-5) {
-			// Calculate derivative in the final state
-			EVDS_Object_Integrate(object,h,&state_1,&state_derivative_1);
-
-			// Calculate new derivative at the starting point as average between two derivatives (corrector)
-			//d0' = (d0 + d1) / 2
-			EVDS_StateVector_Derivative_Initialize(&state_derivative_0n,coordinate_system);
-			EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative_0n,&state_derivative_0n,&state_derivative_0,0.5);
-			EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative_0n,&state_derivative_0n,&state_derivative_1,0.5);
-
-			// Calculate new final state
-			//s1' = s0 + d0' * dt
-			EVDS_StateVector_MultiplyByTimeAndAdd(&state_1n,&state_0,&state_derivative_0n,h);
-
-			// Estimate error (FIXME: better criteria)
-			error = 0;
-			EVDS_Vector_Subtract(&temporary,&state_1.position,&state_1n.position);
-			EVDS_Vector_Dot(&mag2,&temporary,&temporary); error += mag2;
-			EVDS_Vector_Subtract(&temporary,&state_1.velocity,&state_1n.velocity);
-			EVDS_Vector_Dot(&mag2,&temporary,&temporary); error += mag2;
-			error = sqrt(error);
-
-			// Set new final state
-			EVDS_StateVector_Copy(&state_1,&state_1n);
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
 		}
+
+		// Get initial state vector
+		EVDS_Object_GetStateVector(object,&state);
+
+		// Propagate state (stopping at events)
+		EVDS_Event_Propagate(coordinate_system,object,&state,h,EVDS_InternalPropagator_Heun_Step);
 	
 		// Update object state vector
-		EVDS_Object_SetStateVector(object,&state_1);
+		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
 
 		//Move to next object in list
 		entry = SIMC_List_GetNext(children,entry);
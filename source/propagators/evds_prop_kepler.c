@@ -0,0 +1,549 @@
+////////////////////////////////////////////////////////////////////////////////
+/// @file
+////////////////////////////////////////////////////////////////////////////////
+/// Copyright (C) 2012-2013, Black Phoenix
+///
+/// This program is free software; you can redistribute it and/or modify it under
+/// the terms of the GNU Lesser General Public License as published by the Free Software
+/// Foundation; either version 2 of the License, or (at your option) any later
+/// version.
+///
+/// This program is distributed in the hope that it will be useful, but WITHOUT
+/// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+/// FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for more
+/// details.
+///
+/// You should have received a copy of the GNU Lesser General Public License along with
+/// this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+/// Place - Suite 330, Boston, MA  02111-1307, USA.
+///
+/// Further information about the GNU Lesser General Public License can also be found on
+/// the world wide web at http://www.gnu.org.
+////////////////////////////////////////////////////////////////////////////////
+/// @page EVDS_Propagator_Kepler Analytic Kepler ("on-rails") Propagator
+///
+/// This propagator moves unpowered objects along their osculating two-body orbit around
+/// the nearest planet (see EVDS_Planet_GetNearest()). Position and velocity are evaluated
+/// in closed form from the osculating state at epoch using the universal variable
+/// formulation of the Kepler problem, so the cost of a single step does not depend on the
+/// step size and no truncation error is accumulated between steps.
+///
+/// The universal anomaly \f$\chi\f$ is found from the universal Kepler equation:
+/// \f[
+///		\sqrt{\mu} \Delta t = \frac{r_0 v_{r0}}{\sqrt{\mu}} \chi^2 C(\alpha \chi^2) +
+///			(1 - \alpha r_0) \chi^3 S(\alpha \chi^2) + r_0 \chi
+/// \f]
+/// where \f$\alpha = 1/a\f$ is the reciprocal of the semi-major axis and \f$C(z)\f$, \f$S(z)\f$
+/// are the Stumpff functions. The equation is solved with the Laguerre-Conway iteration,
+/// which converges for elliptic, parabolic and hyperbolic orbits alike. For closed orbits
+/// time since epoch is wrapped by the orbital period.
+///
+/// The osculating orbit is re-derived from the objects state vector when:
+///  - Object is propagated for the first time.
+///  - State vector was changed from outside of the propagator (EVDS_Object_SetStateVector()).
+///  - Object has finished a powered flight segment.
+///
+/// Objects which have any active rocket engine (non-zero "current.thrust" variable in
+/// any of the "rocket_engine" children) are propagated numerically using RK4 integration
+/// until the burn ends. Planets and objects for which no central body with a known
+/// gravitational parameter is found are always propagated numerically.
+///
+/// Only the translational motion is analytic: attitude is propagated with the current
+/// angular velocity of the object. The central body is assumed to be moving without
+/// acceleration over the coast arc (patched conic approximation).
+////////////////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "evds.h"
+
+
+#ifndef DOXYGEN_INTERNAL_STRUCTS
+typedef struct EVDS_PROPAGATOR_KEPLER_ELEMENTS_TAG {
+	EVDS_OBJECT* object;			//Object propagated with these elements
+	EVDS_OBJECT* body;				//Central body
+	int valid;						//Are elements valid (object is coasting)
+	int generation;					//Last step in which object was propagated
+
+	//Osculating orbit
+	EVDS_REAL mu;					//Gravitational parameter of the central body
+	EVDS_REAL alpha;				//Reciprocal of semi-major axis
+	EVDS_REAL period;				//Orbital period (0 for open orbits)
+	EVDS_REAL r0[3];				//Position relative to central body at epoch
+	EVDS_REAL v0[3];				//Velocity relative to central body at epoch
+	EVDS_REAL t;					//Time since epoch
+
+	//Last state written by propagator (to detect external changes)
+	EVDS_REAL position[3];
+	EVDS_REAL velocity[3];
+} EVDS_PROPAGATOR_KEPLER_ELEMENTS;
+
+typedef struct EVDS_PROPAGATOR_KEPLER_USERDATA_TAG {
+	SIMC_LIST* elements;			//List of osculating elements for children
+	SIMC_LIST_ENTRY* cursor;		//Last used entry (elements are stored in order of children)
+	int generation;					//Current step counter
+} EVDS_PROPAGATOR_KEPLER_USERDATA;
+#endif
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Compute Stumpff functions C(z) and S(z)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_Stumpff(EVDS_REAL z, EVDS_REAL* c, EVDS_REAL* s) {
+	if (z > 1e-6) {
+		EVDS_REAL sz = sqrt(z);
+		*c = (1.0 - cos(sz))/z;
+		*s = (sz - sin(sz))/(sz*z);
+	} else if (z < -1e-6) {
+		EVDS_REAL sz = sqrt(-z);
+		*c = (cosh(sz) - 1.0)/(-z);
+		*s = (sinh(sz) - sz)/(sz*(-z));
+	} else { //Series expansion near parabolic orbit
+		*c = 1.0/2.0 - z/24.0 + z*z/720.0;
+		*s = 1.0/6.0 - z/120.0 + z*z/5040.0;
+	}
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Evaluate two-body position and velocity at time t from state at epoch.
+///
+/// @param[in] mu Gravitational parameter of the central body
+/// @param[in] alpha Reciprocal of semi-major axis
+/// @param[in] period Orbital period (0 for open orbits)
+/// @param[in] r0 Position relative to central body at epoch
+/// @param[in] v0 Velocity relative to central body at epoch
+/// @param[in] t Time since epoch
+/// @param[out] r Position relative to central body at time t
+/// @param[out] v Velocity relative to central body at time t
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_Evaluate(EVDS_REAL mu, EVDS_REAL alpha, EVDS_REAL period,
+											 EVDS_REAL* r0, EVDS_REAL* v0, EVDS_REAL t,
+											 EVDS_REAL* r, EVDS_REAL* v) {
+	int i;
+	EVDS_REAL f,g,fdot,gdot;
+	EVDS_REAL chi,z,c,s,rn;
+	EVDS_REAL sqrt_mu = sqrt(mu);
+	EVDS_REAL r0n = sqrt(r0[0]*r0[0] + r0[1]*r0[1] + r0[2]*r0[2]);
+	EVDS_REAL rv0 = (r0[0]*v0[0] + r0[1]*v0[1] + r0[2]*v0[2]) / sqrt_mu;
+
+	//Wrap time for closed orbits
+	if (period > 0.0) {
+		t = fmod(t,period);
+	}
+
+	//Initial guess for universal anomaly
+	if (alpha > 1e-12) {
+		chi = sqrt_mu*alpha*t;
+	} else {
+		chi = sqrt_mu*t/r0n;
+	}
+
+	//Laguerre-Conway iteration (n = 5)
+	for (i = 0; i < 32; i++) {
+		EVDS_REAL F,dF,ddF,delta,discriminant;
+		z = alpha*chi*chi;
+		EVDS_InternalPropagator_Kepler_Stumpff(z,&c,&s);
+
+		F   = rv0*chi*chi*c + (1.0 - alpha*r0n)*chi*chi*chi*s + r0n*chi - sqrt_mu*t;
+		dF  = rv0*chi*(1.0 - z*s) + (1.0 - alpha*r0n)*chi*chi*c + r0n;
+		ddF = rv0*(1.0 - z*c) + (1.0 - alpha*r0n)*chi*(1.0 - z*s);
+
+		discriminant = sqrt(fabs(16.0*dF*dF - 20.0*F*ddF));
+		delta = 5.0*F/(dF + (dF >= 0.0 ? discriminant : -discriminant));
+		chi -= delta;
+		if (fabs(delta) <= 1e-12*(1.0 + fabs(chi))) break;
+	}
+
+	//Lagrange coefficients
+	z = alpha*chi*chi;
+	EVDS_InternalPropagator_Kepler_Stumpff(z,&c,&s);
+	f = 1.0 - chi*chi*c/r0n;
+	g = t - chi*chi*chi*s/sqrt_mu;
+	for (i = 0; i < 3; i++) r[i] = f*r0[i] + g*v0[i];
+
+	rn = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+	fdot = sqrt_mu/(rn*r0n)*chi*(z*s - 1.0);
+	gdot = 1.0 - chi*chi*c/rn;
+	for (i = 0; i < 3; i++) v[i] = fdot*r0[i] + gdot*v0[i];
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Get state of the central body in propagator coordinates
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_GetBodyState(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* body,
+												 EVDS_VECTOR* position, EVDS_VECTOR* velocity) {
+	EVDS_STATE_VECTOR body_state;
+	EVDS_Object_GetStateVector(body,&body_state);
+	EVDS_Vector_Convert(position,&body_state.position,coordinate_system);
+	EVDS_Vector_Convert(velocity,&body_state.velocity,coordinate_system);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Derive osculating elements from the current state of the object
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_Initialize_Elements(EVDS_OBJECT* coordinate_system,
+													   EVDS_PROPAGATOR_KEPLER_ELEMENTS* elements,
+													   EVDS_STATE_VECTOR* state) {
+	EVDS_REAL mu,mass,r0n,v0n2;
+	EVDS_VARIABLE* mu_var;
+	EVDS_VARIABLE* mass_var;
+	EVDS_VECTOR body_position,body_velocity;
+	EVDS_VECTOR r0,v0;
+	EVDS_OBJECT* body;
+
+	//Find central body and its gravitational parameter
+	if (EVDS_Planet_GetNearest(elements->object,&body) != EVDS_OK) return EVDS_ERROR_NOT_FOUND;
+	if (body == elements->object) return EVDS_ERROR_NOT_FOUND;
+	EVDS_Object_GetRealVariable(body,"gravity.mu",&mu,&mu_var);
+	EVDS_Object_GetRealVariable(body,"mass",&mass,&mass_var);
+	if (!mu_var) {
+		if (!mass_var) return EVDS_ERROR_NOT_FOUND;
+		mu = 6.6738480e-11 * mass;
+	}
+	if (mu <= 0.0) return EVDS_ERROR_NOT_FOUND;
+
+	//Get state relative to the central body
+	EVDS_InternalPropagator_Kepler_GetBodyState(coordinate_system,body,&body_position,&body_velocity);
+	EVDS_Vector_Subtract(&r0,&state->position,&body_position);
+	EVDS_Vector_Subtract(&v0,&state->velocity,&body_velocity);
+	EVDS_Vector_Length(&r0n,&r0);
+	EVDS_Vector_Dot(&v0n2,&v0,&v0);
+	if (r0n < EVDS_EPS) return EVDS_ERROR_NOT_FOUND;
+
+	//Store osculating orbit
+	elements->body = body;
+	elements->mu = mu;
+	elements->alpha = 2.0/r0n - v0n2/mu;
+	elements->r0[0] = r0.x; elements->r0[1] = r0.y; elements->r0[2] = r0.z;
+	elements->v0[0] = v0.x; elements->v0[1] = v0.y; elements->v0[2] = v0.z;
+	elements->t = 0.0;
+	if (elements->alpha > 1e-12) {
+		elements->period = 2.0*EVDS_PI/sqrt(mu*elements->alpha*elements->alpha*elements->alpha);
+	} else {
+		elements->period = 0.0;
+	}
+	elements->valid = 1;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Find or create elements for the given child object
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_GetElements(EVDS_PROPAGATOR_KEPLER_USERDATA* userdata, EVDS_OBJECT* object,
+											   EVDS_PROPAGATOR_KEPLER_ELEMENTS** p_elements) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_KEPLER_ELEMENTS* elements;
+
+	//Elements are usually requested in same order as they are stored
+	if (userdata->cursor) {
+		entry = SIMC_List_GetNext(userdata->elements,userdata->cursor);
+	} else {
+		entry = SIMC_List_GetFirst(userdata->elements);
+	}
+	if (entry) {
+		elements = (EVDS_PROPAGATOR_KEPLER_ELEMENTS*)SIMC_List_GetData(userdata->elements,entry);
+		if (elements->object == object) {
+			SIMC_List_Stop(userdata->elements,entry);
+			userdata->cursor = entry;
+			*p_elements = elements;
+			return EVDS_OK;
+		}
+		SIMC_List_Stop(userdata->elements,entry);
+	}
+
+	//Search entire list
+	entry = SIMC_List_GetFirst(userdata->elements);
+	while (entry) {
+		elements = (EVDS_PROPAGATOR_KEPLER_ELEMENTS*)SIMC_List_GetData(userdata->elements,entry);
+		if (elements->object == object) {
+			SIMC_List_Stop(userdata->elements,entry);
+			userdata->cursor = entry;
+			*p_elements = elements;
+			return EVDS_OK;
+		}
+		entry = SIMC_List_GetNext(userdata->elements,entry);
+	}
+
+	//Create new elements
+	elements = (EVDS_PROPAGATOR_KEPLER_ELEMENTS*)malloc(sizeof(EVDS_PROPAGATOR_KEPLER_ELEMENTS));
+	if (!elements) return EVDS_ERROR_MEMORY;
+	memset(elements,0,sizeof(EVDS_PROPAGATOR_KEPLER_ELEMENTS));
+	elements->object = object;
+	userdata->cursor = SIMC_List_Append(userdata->elements,elements);
+	*p_elements = elements;
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Remove elements of objects which are no longer children of the propagator
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_RemoveStale(EVDS_PROPAGATOR_KEPLER_USERDATA* userdata) {
+	int restart;
+	do {
+		SIMC_LIST_ENTRY* entry = SIMC_List_GetFirst(userdata->elements);
+		restart = 0;
+
+		while (entry) {
+			EVDS_PROPAGATOR_KEPLER_ELEMENTS* elements = SIMC_List_GetData(userdata->elements,entry);
+			if (elements->generation != userdata->generation) {
+				free(elements);
+				SIMC_List_Remove(userdata->elements,entry); //Stop iterating
+				userdata->cursor = 0;
+				restart = 1;
+				break;
+			} else {
+				entry = SIMC_List_GetNext(userdata->elements,entry);
+			}
+		}
+	} while (restart);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Check if object or any of its children produce thrust
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_IsPowered(EVDS_OBJECT* object) {
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+
+	//Check rocket engine state
+	if (EVDS_Object_CheckType(object,"rocket_engine") == EVDS_OK) {
+		EVDS_REAL thrust;
+		EVDS_Object_GetRealVariable(object,"current.thrust",&thrust,0);
+		if (thrust != 0.0) return 1;
+	}
+
+	//Check children
+	EVDS_Object_GetChildren(object,&children);
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		EVDS_OBJECT* child = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
+		if (EVDS_InternalPropagator_Kepler_IsPowered(child)) {
+			SIMC_List_Stop(children,entry);
+			return 1;
+		}
+		entry = SIMC_List_GetNext(children,entry);
+	}
+	return 0;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Numerically integrate state of a powered object (RK4)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_Numerical(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+											  EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	EVDS_STATE_VECTOR state_temporary;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_2;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_3;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_4;
+
+	EVDS_Object_Integrate(object,0.0,state,&state_derivative_1);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_1,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_2);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_2,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_3);
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_3,h);
+	EVDS_Object_Integrate(object,h,&state_temporary,&state_derivative_4);
+
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_1,1.0/6.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_2,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_3,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_4,1.0/6.0);
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Propagate coasting object along its osculating orbit
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_Kepler_Analytic(EVDS_OBJECT* coordinate_system, EVDS_PROPAGATOR_KEPLER_ELEMENTS* elements,
+											 EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	EVDS_REAL r[3],v[3],rn;
+	EVDS_VECTOR body_position,body_velocity;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;
+
+	//Propagate attitude with current angular velocity
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_Vector_Copy(&state_derivative.angular_velocity,&state->angular_velocity);
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+
+	//Evaluate osculating orbit
+	elements->t += h;
+	EVDS_InternalPropagator_Kepler_Evaluate(elements->mu,elements->alpha,elements->period,
+		elements->r0,elements->v0,elements->t,r,v);
+	rn = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
+
+	//Write back state relative to central body
+	EVDS_InternalPropagator_Kepler_GetBodyState(coordinate_system,elements->body,&body_position,&body_velocity);
+	EVDS_Vector_Set(&state->position,EVDS_VECTOR_POSITION,coordinate_system,
+		body_position.x + r[0],body_position.y + r[1],body_position.z + r[2]);
+	EVDS_Vector_Set(&state->velocity,EVDS_VECTOR_VELOCITY,coordinate_system,
+		body_velocity.x + v[0],body_velocity.y + v[1],body_velocity.z + v[2]);
+	EVDS_Vector_Set(&state->acceleration,EVDS_VECTOR_ACCELERATION,coordinate_system,
+		-elements->mu*r[0]/(rn*rn*rn),-elements->mu*r[1]/(rn*rn*rn),-elements->mu*r[2]/(rn*rn*rn));
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Kepler propagator step
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
+	SIMC_LIST* children;
+	SIMC_LIST_ENTRY* entry;
+	int sleeping;
+	EVDS_PROPAGATOR_KEPLER_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(coordinate_system,(void**)&userdata));
+
+	//Start new step
+	userdata->generation++;
+	userdata->cursor = 0;
+
+	//Process all children
+	EVDS_Object_GetChildren(coordinate_system,&children);
+	entry = SIMC_List_GetFirst(children);
+	while (entry) {
+		EVDS_STATE_VECTOR state;
+		EVDS_PROPAGATOR_KEPLER_ELEMENTS* elements;
+		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
+
+		// Solve everything inside the child
+		if ((EVDS_Object_Solve(object,h) != EVDS_OK) ||
+			(EVDS_InternalPropagator_Kepler_GetElements(userdata,object,&elements) != EVDS_OK)) {
+			// In case there is an error move to the next object in list.
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+		elements->generation = userdata->generation;
+
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			elements->valid = 0;
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+
+		// Get initial state vector
+		EVDS_Object_GetStateVector(object,&state);
+
+		// Invalidate elements if state was changed by someone else
+		if (elements->valid &&
+			((state.position.x != elements->position[0]) ||
+			 (state.position.y != elements->position[1]) ||
+			 (state.position.z != elements->position[2]) ||
+			 (state.velocity.x != elements->velocity[0]) ||
+			 (state.velocity.y != elements->velocity[1]) ||
+			 (state.velocity.z != elements->velocity[2]))) {
+			elements->valid = 0;
+		}
+
+		// Powered objects and planets are propagated numerically
+		if ((EVDS_Object_CheckType(object,"planet") == EVDS_OK) ||
+			(EVDS_InternalPropagator_Kepler_IsPowered(object))) {
+			elements->valid = 0;
+		} else if (!elements->valid) {
+			EVDS_InternalPropagator_Kepler_Initialize_Elements(coordinate_system,elements,&state);
+		}
+
+		// Propagate state
+		if (elements->valid) {
+			EVDS_InternalPropagator_Kepler_Analytic(coordinate_system,elements,&state,h);
+		} else {
+			EVDS_InternalPropagator_Kepler_Numerical(coordinate_system,object,&state,h);
+		}
+
+		// Update object state vector
+		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
+		elements->position[0] = state.position.x;
+		elements->position[1] = state.position.y;
+		elements->position[2] = state.position.z;
+		elements->velocity[0] = state.velocity.x;
+		elements->velocity[1] = state.velocity.y;
+		elements->velocity[2] = state.velocity.z;
+
+		//Move to next object in list
+		entry = SIMC_List_GetNext(children,entry);
+	}
+
+	//Forget objects that left the propagator
+	EVDS_InternalPropagator_Kepler_RemoveStale(userdata);
+	return EVDS_OK;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Initialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_Initialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	EVDS_PROPAGATOR_KEPLER_USERDATA* userdata;
+	if (EVDS_Object_CheckType(object,"propagator_kepler") != EVDS_OK) return EVDS_IGNORE_OBJECT;
+
+	//Create userdata
+	userdata = (EVDS_PROPAGATOR_KEPLER_USERDATA*)malloc(sizeof(EVDS_PROPAGATOR_KEPLER_USERDATA));
+	if (!userdata) return EVDS_ERROR_MEMORY;
+	memset(userdata,0,sizeof(EVDS_PROPAGATOR_KEPLER_USERDATA));
+	SIMC_List_Create(&userdata->elements,0);
+	EVDS_ERRCHECK(EVDS_Object_SetSolverdata(object,userdata));
+	return EVDS_CLAIM_OBJECT;
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Deinitialize propagator
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_InternalPropagator_Kepler_Deinitialize(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object) {
+	SIMC_LIST_ENTRY* entry;
+	EVDS_PROPAGATOR_KEPLER_USERDATA* userdata;
+	EVDS_ERRCHECK(EVDS_Object_GetSolverdata(object,(void**)&userdata));
+
+	//Remove all elements
+	entry = SIMC_List_GetFirst(userdata->elements);
+	while (entry) {
+		free(SIMC_List_GetData(userdata->elements,entry));
+		entry = SIMC_List_GetNext(userdata->elements,entry);
+	}
+	SIMC_List_Destroy(userdata->elements);
+	free(userdata);
+	return EVDS_OK;
+}
+
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+EVDS_SOLVER EVDS_Propagator_Kepler = {
+	EVDS_InternalPropagator_Kepler_Initialize, //OnInitialize
+	EVDS_InternalPropagator_Kepler_Deinitialize, //OnDeinitialize
+	EVDS_InternalPropagator_Kepler_Solve, //OnSolve
+	0, //OnIntegrate
+	0, //OnStateSave
+	0, //OnStateLoad
+	0, //OnStartup
+	0, //OnShutdown
+};
+////////////////////////////////////////////////////////////////////////////////
+/// @brief Register analytic Kepler propagator solver
+///
+/// @param[in] system Pointer to EVDS_SYSTEM
+///
+/// @returns Error code
+/// @retval EVDS_OK Successfully completed
+/// @retval EVDS_ERROR_BAD_PARAMETER "system" is null
+/// @retval EVDS_ERROR_BAD_STATE Cannot register solvers in current state
+////////////////////////////////////////////////////////////////////////////////
+int EVDS_Propagator_Kepler_Register(EVDS_SYSTEM* system) {
+	return EVDS_Solver_Register(system,&EVDS_Propagator_Kepler);
+}
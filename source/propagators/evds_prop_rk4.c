@@ -29,26 +29,60 @@
 
 
 
+////////////////////////////////////////////////////////////////////////////////
+/// @brief RK4 integration method (single step)
+////////////////////////////////////////////////////////////////////////////////
+void EVDS_InternalPropagator_RK4_Step(EVDS_OBJECT* coordinate_system, EVDS_OBJECT* object,
+									  EVDS_STATE_VECTOR* state, EVDS_REAL h) {
+	//Final derivative:
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative;		//Derivative at initial state
+	//Variables for RK4:
+	EVDS_STATE_VECTOR state_temporary;					//Used in calculations
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;	//Four derivatives for RK4
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_2;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_3;
+	EVDS_STATE_VECTOR_DERIVATIVE state_derivative_4;
+
+	// f1 = f(0,y)
+	EVDS_Object_Integrate(object,0.0,state,&state_derivative_1);
+
+	// f2 = f(t+0.5*h,y+0.5*h*f1)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_1,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_2);
+
+	// f3 = f(t+0.5h,y+0.5*h*f2)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_2,0.5*h);
+	EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_3);
+
+	// f4 = f(t+h,y+h*f3)
+	EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,state,&state_derivative_3,h);
+	EVDS_Object_Integrate(object,h,&state_temporary,&state_derivative_4);
+
+	// state = state + h*(1/6 f1 + 1/3 f2 + 1/3 f3 + 1/6 f4)
+	EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_1,1.0/6.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_2,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_3,1.0/3.0);
+	EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_4,1.0/6.0);
+
+	// Calculate new final state
+	EVDS_StateVector_MultiplyByTimeAndAdd(state,state,&state_derivative,h);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 /// @brief RK4 integration method
 ////////////////////////////////////////////////////////////////////////////////
 int EVDS_InternalPropagator_RK4_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* coordinate_system, EVDS_REAL h) {
 	SIMC_LIST* children;
 	SIMC_LIST_ENTRY* entry;
+	int sleeping;
 
 	//Process all children
 	EVDS_Object_GetChildren(coordinate_system,&children);
 	entry = SIMC_List_GetFirst(children);
 	while (entry) {
-		//Initial state, final derivative:
 		EVDS_STATE_VECTOR state;							//Initial state (t = 0)
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative;		//Derivative at initial state
-		//Variables for RK4:
-		EVDS_STATE_VECTOR state_temporary;					//Used in calculations
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_1;	//Four derivatives for RK4
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_2;
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_3;
-		EVDS_STATE_VECTOR_DERIVATIVE state_derivative_4;
 		EVDS_OBJECT* object = (EVDS_OBJECT*)SIMC_List_GetData(children,entry);
 
 		// Solve everything inside the child
@@ -58,36 +92,23 @@ int EVDS_InternalPropagator_RK4_Solve(EVDS_SYSTEM* system, EVDS_SOLVER* solver,
 			continue;
 		}
 
+		// Sleeping objects keep their state vector, only its time is advanced
+		EVDS_Object_IsSleeping(object,&sleeping);
+		if (sleeping) {
+			EVDS_Object_AdvanceSleeping(object,h);
+			entry = SIMC_List_GetNext(children,entry);
+			continue;
+		}
+
 		// Get initial state vector
 		EVDS_Object_GetStateVector(object,&state);
-		
-		// f1 = f(0,y)
-		EVDS_Object_Integrate(object,0.0,&state,&state_derivative_1);
-
-		// f2 = f(t+0.5*h,y+0.5*h*f1)
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,&state,&state_derivative_1,0.5*h);
-		EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_2);
-
-		// f3 = f(t+0.5h,y+0.5*h*f2)
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,&state,&state_derivative_2,0.5*h);
-		EVDS_Object_Integrate(object,0.5*h,&state_temporary,&state_derivative_3);
-
-		// f4 = f(t+h,y+h*f3)
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state_temporary,&state,&state_derivative_3,h);
-		EVDS_Object_Integrate(object,h,&state_temporary,&state_derivative_4);
-
-		// state = state + h*(1/6 f1 + 1/3 f2 + 1/3 f3 + 1/6 f4)
-		EVDS_StateVector_Derivative_Initialize(&state_derivative,coordinate_system);
-		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_1,1.0/6.0);
-		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_2,1.0/3.0);
-		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_3,1.0/3.0);
-		EVDS_StateVector_Derivative_MultiplyAndAdd(&state_derivative,&state_derivative,&state_derivative_4,1.0/6.0);
 
-		// Calculate new final state
-		EVDS_StateVector_MultiplyByTimeAndAdd(&state,&state,&state_derivative,h);
+		// Propagate state (stopping at events)
+		EVDS_Event_Propagate(coordinate_system,object,&state,h,EVDS_InternalPropagator_RK4_Step);
 
 		// Update object state vector
 		EVDS_Object_SetStateVector(object,&state);
+		EVDS_Object_UpdateSleeping(object,&state,h);
 
 		//Move to next object in list
 		entry = SIMC_List_GetNext(children,entry);
@@ -120,7 +120,10 @@ if EVDS_STANDALONE ~= false then
       language "C"
       includedirs { "../include",
                     "../external/simc/include",
+                    "../external/nrlmsise-00",
                     "../tests" }
-      files { "../tests/**" }
+      files { "../tests/**",
+              "../addons/evds_wmm.c",
+              "../addons/evds_nrlmsise-00.c" }
       links { "evds", "simc" }
 end
@@ -42,8 +42,12 @@ int Test_InList(void* ptr, SIMC_LIST* list) {
 	return 0;
 }
 
+int Test_InitializeLoaded(EVDS_OBJECT_LOADEX* info, EVDS_OBJECT* object) {
+	return EVDS_Object_Initialize(object,1);
+}
+
 void main() {
-	//Test_EVDS_SYSTEM();
+	Test_EVDS_SYSTEM();
 	//Test_EVDS_VECTOR();
 	//Test_EVDS_QUATERNION();
 	//Test_EVDS_FRAMES();
@@ -51,5 +55,10 @@ void main() {
 	//Test_EVDS_MODIFIER();
 	//Test_EVDS_GIMBAL();
 	Test_EVDS_ROCKET_ENGINE();
+	Test_EVDS_RIGID_BODY();
+	Test_EVDS_PLANET();
+	Test_EVDS_PROPAGATORS();
+	Test_EVDS_WMM();
+	Test_EVDS_NRLMSISE_00();
 	getchar();
 }
\ No newline at end of file
@@ -37,6 +37,7 @@
 void Test_Failure(char* expr, char* result, char* file, int line);
 void Test_Passed(char* expr, char* result, char* file, int line);
 int Test_InList(void* ptr, SIMC_LIST* list);
+int Test_InitializeLoaded(EVDS_OBJECT_LOADEX* info, EVDS_OBJECT* object);
 
 //Test-related macros
 #define EQUAL_TO(expr,result) \
@@ -136,6 +137,12 @@ int Test_InList(void* ptr, SIMC_LIST* list);
 #define NEED_ARBITRARY_OBJECT() \
 	ERROR_CHECK(EVDS_Object_Create(system,0,&object));
 
+#define LOAD_INITIALIZED(parent,string) { \
+	EVDS_OBJECT_LOADEX info = { 0 }; \
+	info.OnLoadObject = Test_InitializeLoaded; \
+	info.description = string; \
+	ERROR_CHECK(EVDS_Object_LoadEx(parent,0,&info)); }
+
 
 //Various test files list
 void Test_EVDS_SYSTEM();
@@ -146,6 +153,11 @@ void Test_EVDS_FUNCTIONS();
 void Test_EVDS_MODIFIER();
 void Test_EVDS_GIMBAL();
 void Test_EVDS_ROCKET_ENGINE();
+void Test_EVDS_RIGID_BODY();
+void Test_EVDS_PLANET();
+void Test_EVDS_PROPAGATORS();
+void Test_EVDS_WMM();
+void Test_EVDS_NRLMSISE_00();
 
 //Disable annoying warnings
 #pragma warning(disable: 4101)
@@ -0,0 +1,305 @@
+#include "framework.h"
+#include "../addons/evds_wmm.h"
+#include "../addons/evds_nrlmsise-00.h"
+#include <nrlmsise-00.h>
+
+void Test_EVDS_WMM_GetNED(EVDS_OBJECT* earth, EVDS_REAL latitude, EVDS_REAL longitude, EVDS_REAL elevation,
+						  EVDS_REAL* north, EVDS_REAL* east, EVDS_REAL* down) {
+	EVDS_SYSTEM* system;
+	EVDS_GEODETIC_COORDINATE geocoord;
+	EVDS_VECTOR position,field,direction;
+	EVDS_REAL sin_lat = sin(EVDS_RAD(latitude));
+	EVDS_REAL cos_lat = cos(EVDS_RAD(latitude));
+	EVDS_REAL sin_lon = sin(EVDS_RAD(longitude));
+	EVDS_REAL cos_lon = cos(EVDS_RAD(longitude));
+
+	//Field in geodetic north, east and down components (nT)
+	EVDS_Object_GetSystem(earth,&system);
+	EVDS_Geodetic_Set(&geocoord,earth,latitude,longitude,elevation);
+	EVDS_Geodetic_ToVector(&position,&geocoord);
+	EVDS_Environment_GetMagneticField(system,&position,&field);
+	EVDS_Vector_Convert(&field,&field,earth);
+
+	EVDS_Vector_Set(&direction,EVDS_VECTOR_DIRECTION,earth,-sin_lat*cos_lon,-sin_lat*sin_lon,cos_lat);
+	EVDS_Vector_Dot(north,&field,&direction);
+	EVDS_Vector_Set(&direction,EVDS_VECTOR_DIRECTION,earth,-sin_lon,cos_lon,0.0);
+	EVDS_Vector_Dot(east,&field,&direction);
+	EVDS_Vector_Set(&direction,EVDS_VECTOR_DIRECTION,earth,-cos_lat*cos_lon,-cos_lat*sin_lon,-sin_lat);
+	EVDS_Vector_Dot(down,&field,&direction);
+	*north *= 1e9;
+	*east *= 1e9;
+	*down *= 1e9;
+}
+
+void Test_EVDS_WMM() {
+	START_TEST("World Magnetic Model") {
+		/// This test checks the field against test values published with WMM2020.
+		EVDS_WMM_MODEL* model;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* moon;
+		EVDS_REAL north,east,down;
+
+		/// Write WMM2020 coefficients
+		{
+			FILE* file = fopen("evds_test_wmm.cof","w");
+			fputs(
+"    2020.0            WMM-2020        12/10/2019\n"
+"  1  0  -29404.5       0.0        6.7        0.0\n"
+"  1  1   -1450.7    4652.9        7.7      -25.1\n"
+"  2  0   -2500.0       0.0      -11.5        0.0\n"
+"  2  1    2982.0   -2991.6       -7.1      -30.2\n"
+"  2  2    1676.8    -734.8       -2.2      -23.9\n"
+"  3  0    1363.9       0.0        2.8        0.0\n"
+"  3  1   -2381.0     -82.2       -6.2        5.7\n"
+"  3  2    1236.2     241.8        3.4       -1.0\n"
+"  3  3     525.7    -542.9      -12.2        1.1\n"
+"  4  0     903.1       0.0       -1.1        0.0\n"
+"  4  1     809.4     282.0       -1.6        0.2\n"
+"  4  2      86.2    -158.4       -6.0        6.9\n"
+"  4  3    -309.4     199.8        5.4        3.7\n"
+"  4  4      47.9    -350.1       -5.5       -5.6\n"
+"  5  0    -234.4       0.0       -0.3        0.0\n"
+"  5  1     363.1      47.7        0.6        0.1\n"
+"  5  2     187.8     208.4       -0.7        2.5\n"
+"  5  3    -140.7    -121.3        0.1       -0.9\n"
+"  5  4    -151.2      32.2        1.2        3.0\n"
+"  5  5      13.7      99.1        1.0        0.5\n"
+"  6  0      65.9       0.0       -0.6        0.0\n"
+"  6  1      65.6     -19.1       -0.4        0.1\n"
+"  6  2      73.0      25.0        0.5       -1.8\n"
+"  6  3    -121.5      52.7        1.4       -1.4\n"
+"  6  4     -36.2     -64.4       -1.4        0.9\n"
+"  6  5      13.5       9.0       -0.0        0.1\n"
+"  6  6     -64.7      68.1        0.8        1.0\n"
+"  7  0      80.6       0.0       -0.1        0.0\n"
+"  7  1     -76.8     -51.4       -0.3        0.5\n"
+"  7  2      -8.3     -16.8       -0.1        0.6\n"
+"  7  3      56.5       2.3        0.7       -0.7\n"
+"  7  4      15.8      23.5        0.2       -0.2\n"
+"  7  5       6.4      -2.2       -0.5       -1.2\n"
+"  7  6      -7.2     -27.2       -0.8        0.2\n"
+"  7  7       9.8      -1.9        1.0        0.3\n"
+"  8  0      23.6       0.0       -0.1        0.0\n"
+"  8  1       9.8       8.4        0.1       -0.3\n"
+"  8  2     -17.5     -15.3       -0.1        0.7\n"
+"  8  3      -0.4      12.8        0.5       -0.2\n"
+"  8  4     -21.1     -11.8       -0.1        0.5\n"
+"  8  5      15.3      14.9        0.4       -0.3\n"
+"  8  6      13.7       3.6        0.5       -0.5\n"
+"  8  7     -16.5      -6.9        0.0        0.4\n"
+"  8  8      -0.3       2.8        0.4        0.1\n"
+"  9  0       5.0       0.0       -0.1        0.0\n"
+"  9  1       8.2     -23.3       -0.2       -0.3\n"
+"  9  2       2.9      11.1       -0.0        0.2\n"
+"  9  3      -1.4       9.8        0.4       -0.4\n"
+"  9  4      -1.1      -5.1       -0.3        0.4\n"
+"  9  5     -13.3      -6.2       -0.0        0.1\n"
+"  9  6       1.1       7.8        0.3       -0.0\n"
+"  9  7       8.9       0.4       -0.0       -0.2\n"
+"  9  8      -9.3      -1.5       -0.0        0.5\n"
+"  9  9     -11.9       9.7       -0.4        0.2\n"
+" 10  0      -1.9       0.0        0.0        0.0\n"
+" 10  1      -6.2       3.4       -0.0       -0.0\n"
+" 10  2      -0.1      -0.2       -0.0        0.1\n"
+" 10  3       1.7       3.5        0.2       -0.3\n"
+" 10  4      -0.9       4.8       -0.1        0.1\n"
+" 10  5       0.6      -8.6       -0.2       -0.2\n"
+" 10  6      -0.9      -0.1       -0.0        0.1\n"
+" 10  7       1.9      -4.2       -0.1       -0.0\n"
+" 10  8       1.4      -3.4       -0.2       -0.1\n"
+" 10  9      -2.4      -0.1       -0.1        0.2\n"
+" 10 10      -3.9      -8.8       -0.0       -0.0\n"
+" 11  0       3.0       0.0       -0.0        0.0\n"
+" 11  1      -1.4      -0.0       -0.1       -0.0\n"
+" 11  2      -2.5       2.6       -0.0        0.1\n"
+" 11  3       2.4      -0.5        0.0        0.0\n"
+" 11  4      -0.9      -0.4       -0.0        0.2\n"
+" 11  5       0.3       0.6       -0.1       -0.0\n"
+" 11  6      -0.7      -0.2        0.0        0.0\n"
+" 11  7      -0.1      -1.7       -0.0        0.1\n"
+" 11  8       1.4      -1.6       -0.1       -0.0\n"
+" 11  9      -0.6      -3.0       -0.1       -0.1\n"
+" 11 10       0.2      -2.0       -0.1        0.0\n"
+" 11 11       3.1      -2.6       -0.1       -0.0\n"
+" 12  0      -2.0       0.0        0.0        0.0\n"
+" 12  1      -0.1      -1.2       -0.0       -0.0\n"
+" 12  2       0.5       0.5       -0.0        0.0\n"
+" 12  3       1.3       1.4        0.0       -0.1\n"
+" 12  4      -1.2      -1.8       -0.0        0.1\n"
+" 12  5       0.7       0.1       -0.0       -0.0\n"
+" 12  6       0.3       0.8        0.0        0.0\n"
+" 12  7       0.5      -0.2       -0.0        0.0\n"
+" 12  8      -0.2       0.6        0.0        0.1\n"
+" 12  9      -0.5       0.2        0.0       -0.0\n"
+" 12 10       0.1      -0.9       -0.0       -0.0\n"
+" 12 11      -1.1       0.0       -0.0        0.0\n"
+" 12 12      -0.3       0.5       -0.1       -0.1\n"
+"999999999999999999999999999999999999999999999999\n"
+			,file);
+			fclose(file);
+		}
+
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">3.986004418e14</parameter>"
+"        <parameter name=\"geometry.semimajor_axis\">6378137.0</parameter>"
+"        <parameter name=\"geometry.inverse_flattening\">298.257223563</parameter>"
+"    </object>"
+"</EVDS>",&earth));
+		ERROR_CHECK(EVDS_WMM_CreateModel(earth,"evds_test_wmm.cof",&model));
+		ERROR_CHECK(EVDS_Object_Initialize(earth,1));
+
+		/// Field at the epoch of the model (2020.0)
+		ERROR_CHECK(EVDS_System_SetTime(system,58849.0));
+		Test_EVDS_WMM_GetNED(earth,80.0,0.0,0.0,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(north,6570.4,1.0);
+		REAL_EQUAL_TO_EPS(east,-146.3,1.0);
+		REAL_EQUAL_TO_EPS(down,54606.0,1.0);
+		Test_EVDS_WMM_GetNED(earth,0.0,120.0,0.0,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(north,39624.3,1.0);
+		REAL_EQUAL_TO_EPS(east,109.9,1.0);
+		REAL_EQUAL_TO_EPS(down,-10932.5,1.0);
+		Test_EVDS_WMM_GetNED(earth,-80.0,240.0,0.0,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(north,5940.6,1.0);
+		REAL_EQUAL_TO_EPS(east,15772.1,1.0);
+		REAL_EQUAL_TO_EPS(down,-52480.8,1.0);
+		Test_EVDS_WMM_GetNED(earth,80.0,0.0,100e3,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(north,6261.8,1.0);
+		REAL_EQUAL_TO_EPS(east,-185.5,1.0);
+		REAL_EQUAL_TO_EPS(down,52429.1,1.0);
+
+		/// Field with secular variation (2022.5)
+		ERROR_CHECK(EVDS_System_SetTime(system,59762.625));
+		Test_EVDS_WMM_GetNED(earth,80.0,0.0,0.0,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(north,6529.9,1.0);
+		REAL_EQUAL_TO_EPS(east,1.1,1.0);
+		REAL_EQUAL_TO_EPS(down,54713.4,1.0);
+
+		/// Model can not be added to initialized planet without "magnetic_field" variable
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Moon\" type=\"planet\" x=\"3.8e8\">"
+"        <parameter name=\"gravity.mu\">4.9e12</parameter>"
+"    </object>"
+"</EVDS>",&moon));
+		ERROR_CHECK(EVDS_Object_Initialize(moon,1));
+		EQUAL_TO(EVDS_WMM_CreateModel(moon,"evds_test_wmm.cof",&model),EVDS_ERROR_BAD_STATE);
+		EQUAL_TO(EVDS_Object_GetVariable(moon,"magnetic_field",&variable),EVDS_ERROR_NOT_FOUND);
+		Test_EVDS_WMM_GetNED(earth,80.0,0.0,0.0,&north,&east,&down);
+		REAL_EQUAL_TO_EPS(down,54713.4,1.0);
+		ERROR_CHECK(EVDS_WMM_DestroyModel(model));
+		remove("evds_test_wmm.cof");
+	} END_TEST
+}
+
+
+//Analytic stand-in for NRLMSISE-00 (library is not linked into tests)
+void Test_EVDS_NRLMSISE_00_Model(struct nrlmsise_input *input, struct nrlmsise_output *output) {
+	double daily = cos(2.0*EVDS_PI*(input->lst - 14.0)/24.0);
+
+	memset(output,0,sizeof(struct nrlmsise_output));
+	output->d[5] = 1.2*exp(-input->alt/50.0)*(input->f107/150.0)*
+		(1.0 + 0.1*daily)*
+		(1.0 + 0.1*cos(EVDS_RAD(input->g_lat)))*
+		(1.0 + 0.2*sin(2.0*EVDS_PI*input->sec/86400.0));
+	output->t[1] = 800.0 + 0.5*input->alt + 20.0*daily;
+}
+
+void gtd7(struct nrlmsise_input *input, struct nrlmsise_flags *flags, struct nrlmsise_output *output) {
+	Test_EVDS_NRLMSISE_00_Model(input,output);
+}
+
+void gtd7d(struct nrlmsise_input *input, struct nrlmsise_flags *flags, struct nrlmsise_output *output) {
+	Test_EVDS_NRLMSISE_00_Model(input,output);
+}
+
+void Test_EVDS_NRLMSISE_00_Get(EVDS_OBJECT* earth, EVDS_REAL latitude, EVDS_REAL longitude, EVDS_REAL elevation,
+							   EVDS_ENVIRONMENT_ATMOSPHERE* cached, EVDS_ENVIRONMENT_ATMOSPHERE* direct) {
+	EVDS_SYSTEM* system;
+	EVDS_GEODETIC_COORDINATE geocoord;
+	EVDS_VECTOR position;
+
+	//Atmosphere from the planet callback and from the model itself
+	EVDS_Object_GetSystem(earth,&system);
+	EVDS_Geodetic_Set(&geocoord,earth,latitude,longitude,elevation);
+	EVDS_Geodetic_ToVector(&position,&geocoord);
+	EVDS_Environment_GetAtmosphericParameters(system,&position,cached);
+	EVDS_NRLMSISE_00_GetAtmosphericData(earth,&position,direct);
+}
+
+void Test_EVDS_NRLMSISE_00() {
+	START_TEST("NRLMSISE-00 atmosphere cache") {
+		/// This test checks interpolated atmosphere against direct evaluation of the model.
+		EVDS_NRLMSISE_00_CACHE* cache;
+		EVDS_NRLMSISE_00_CACHE* other_cache;
+		EVDS_ENVIRONMENT_ATMOSPHERE cached,direct,previous;
+		EVDS_OBJECT* earth;
+		void* userdata;
+		int i;
+		EVDS_REAL points[5][3] = {
+			{   0.0,    0.0,   0.0   },
+			{  45.3,   17.7, 123.4e3 },
+			{ -62.1, -140.5, 287.0e3 },
+			{  88.0,  200.0, 455.0e3 },
+			{  10.0,   95.0, 590.0e3 },
+		};
+
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">3.986004418e14</parameter>"
+"        <parameter name=\"geometry.semimajor_axis\">6378137.0</parameter>"
+"        <parameter name=\"geometry.inverse_flattening\">298.257223563</parameter>"
+"        <parameter name=\"nrlmsise-00_f107\">150.0</parameter>"
+"        <parameter name=\"nrlmsise-00_cache.altitude\">600e3</parameter>"
+"    </object>"
+"</EVDS>",&earth));
+		ERROR_CHECK(EVDS_NRLMSISE_00_CreateCache(earth,&cache));
+		ERROR_CHECK(EVDS_Object_Initialize(earth,1));
+		ERROR_CHECK(EVDS_Object_GetUserdata(earth,&userdata));
+		EQUAL_TO(userdata,cache);
+		EQUAL_TO(EVDS_NRLMSISE_00_CreateCache(earth,&other_cache),EVDS_ERROR_BAD_STATE);
+
+		/// Interpolated atmosphere must match the model
+		ERROR_CHECK(EVDS_System_SetTime(system,58849.25));
+		ERROR_CHECK(EVDS_NRLMSISE_00_UpdateCache(cache));
+		for (i = 0; i < 5; i++) {
+			Test_EVDS_NRLMSISE_00_Get(earth,points[i][0],points[i][1],points[i][2],&cached,&direct);
+			REAL_EQUAL_TO_EPS(cached.density/direct.density,1.0,3e-3);
+			REAL_EQUAL_TO_EPS(cached.temperature,direct.temperature,0.5);
+		}
+
+		/// Model is evaluated directly above the table
+		Test_EVDS_NRLMSISE_00_Get(earth,30.0,60.0,800e3,&cached,&direct);
+		REAL_EQUAL_TO_EPS(cached.density/direct.density,1.0,1e-12);
+
+		/// Table is rebuilt for new space weather once cache is updated
+		Test_EVDS_NRLMSISE_00_Get(earth,points[1][0],points[1][1],points[1][2],&previous,&direct);
+		ERROR_CHECK(EVDS_Object_GetVariable(earth,"nrlmsise-00_f107",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,300.0));
+		ERROR_CHECK(EVDS_NRLMSISE_00_UpdateCache(cache));
+		Test_EVDS_NRLMSISE_00_Get(earth,points[1][0],points[1][1],points[1][2],&cached,&direct);
+		REAL_EQUAL_TO_EPS(cached.density/previous.density,2.0,1e-9);
+		for (i = 0; i < 5; i++) {
+			Test_EVDS_NRLMSISE_00_Get(earth,points[i][0],points[i][1],points[i][2],&cached,&direct);
+			REAL_EQUAL_TO_EPS(cached.density/direct.density,1.0,3e-3);
+		}
+
+		/// Table is rebuilt when universal time changes by more than an hour
+		ERROR_CHECK(EVDS_System_SetTime(system,58849.25 + 3.0/24.0));
+		ERROR_CHECK(EVDS_NRLMSISE_00_UpdateCache(cache));
+		for (i = 0; i < 5; i++) {
+			Test_EVDS_NRLMSISE_00_Get(earth,points[i][0],points[i][1],points[i][2],&cached,&direct);
+			REAL_EQUAL_TO_EPS(cached.density/direct.density,1.0,3e-3);
+			REAL_EQUAL_TO_EPS(cached.temperature,direct.temperature,0.5);
+		}
+
+		/// Planet falls back to the model once cache is destroyed
+		ERROR_CHECK(EVDS_NRLMSISE_00_DestroyCache(cache));
+		ERROR_CHECK(EVDS_Object_GetUserdata(earth,&userdata));
+		EQUAL_TO(userdata,0);
+		Test_EVDS_NRLMSISE_00_Get(earth,points[2][0],points[2][1],points[2][2],&cached,&direct);
+		REAL_EQUAL_TO_EPS(cached.density/direct.density,1.0,1e-12);
+	} END_TEST
+}
@@ -936,4 +936,721 @@ void Test_EVDS_ROCKET_ENGINE() {
 		ERROR_CHECK(EVDS_Object_GetRealVariable(object,"fuel.mass",&real,&variable));
 		REAL_EQUAL_TO(real,0.0);
 	} END_TEST
-}
\ No newline at end of file
+}
+
+
+int Test_EVDS_RIGID_BODY_ThrusterCalls = 0;
+int Test_EVDS_RIGID_BODY_Thruster(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object,
+								  EVDS_REAL delta_time, EVDS_STATE_VECTOR* state, EVDS_STATE_VECTOR_DERIVATIVE* derivative) {
+	Test_EVDS_RIGID_BODY_ThrusterCalls++;
+	EVDS_Vector_Set(&derivative->force,EVDS_VECTOR_FORCE,object,1000.0,0,0);
+	return EVDS_OK;
+}
+
+extern EVDS_SOLVER EVDS_Solver_RigidBody;
+EVDS_Callback_Solve* Test_EVDS_RIGID_BODY_OriginalSolve = 0;
+EVDS_Callback_Integrate* Test_EVDS_RIGID_BODY_OriginalIntegrate = 0;
+EVDS_OBJECT* Test_EVDS_RIGID_BODY_CountedObject = 0;
+int Test_EVDS_RIGID_BODY_SolveCalls = 0;
+int Test_EVDS_RIGID_BODY_IntegrateCalls = 0;
+int Test_EVDS_RIGID_BODY_CountSolve(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object, EVDS_REAL delta_time) {
+	if (object == Test_EVDS_RIGID_BODY_CountedObject) Test_EVDS_RIGID_BODY_SolveCalls++;
+	return Test_EVDS_RIGID_BODY_OriginalSolve(system,solver,object,delta_time);
+}
+int Test_EVDS_RIGID_BODY_CountIntegrate(EVDS_SYSTEM* system, EVDS_SOLVER* solver, EVDS_OBJECT* object,
+										EVDS_REAL delta_time, EVDS_STATE_VECTOR* state, EVDS_STATE_VECTOR_DERIVATIVE* derivative) {
+	if (object == Test_EVDS_RIGID_BODY_CountedObject) Test_EVDS_RIGID_BODY_IntegrateCalls++;
+	return Test_EVDS_RIGID_BODY_OriginalIntegrate(system,solver,object,delta_time,state,derivative);
+}
+
+void Test_EVDS_RIGID_BODY() {
+	START_TEST("Rigid body (mass properties tracking)") {
+		EVDS_OBJECT* payload;
+		EVDS_VARIABLE* payload_mass;
+		EVDS_VARIABLE* total_mass;
+		EVDS_VARIABLE* total_cm;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Vessel\" type=\"vessel\">"
+"        <parameter name=\"mass\">1000</parameter>"
+"        <object name=\"Payload\" type=\"vessel\" x=\"3.0\">"
+"            <parameter name=\"mass\">500</parameter>"
+"        </object>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Payload",0,&payload));
+		ERROR_CHECK(EVDS_Object_GetVariable(payload,"mass",&payload_mass));
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"total_mass",&total_mass));
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"total_cm",&total_cm));
+
+		/// Mass properties are aggregated once and then cached
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		EQUAL_TO(object->mass_dirty,0);
+		ERROR_CHECK(EVDS_Variable_GetReal(total_mass,&real));
+		REAL_EQUAL_TO(real,1500.0);
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		EQUAL_TO(object->mass_dirty,0);
+
+		/// Writing same value does not invalidate mass properties
+		ERROR_CHECK(EVDS_Variable_SetReal(payload_mass,500.0));
+		EQUAL_TO(object->mass_dirty,0);
+
+		/// Changing mass of a child invalidates mass properties of the parent
+		ERROR_CHECK(EVDS_Variable_SetReal(payload_mass,1000.0));
+		EQUAL_TO(object->mass_dirty,1);
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		EQUAL_TO(object->mass_dirty,0);
+		ERROR_CHECK(EVDS_Variable_GetReal(total_mass,&real));
+		REAL_EQUAL_TO(real,2000.0);
+		ERROR_CHECK(EVDS_Variable_GetVector(total_cm,&vector));
+		VECTOR_EQUAL_TO(&vector,1.5,0,0);
+
+		/// Moving a child invalidates mass properties of the parent
+		ERROR_CHECK(EVDS_Object_SetPosition(payload,object,1.0,0,0));
+		EQUAL_TO(object->mass_dirty,1);
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Variable_GetVector(total_cm,&vector));
+		VECTOR_EQUAL_TO(&vector,0.5,0,0);
+
+		/// Detaching a child invalidates mass properties of the parent
+		ERROR_CHECK(EVDS_Object_SetParent(payload,root));
+		EQUAL_TO(object->mass_dirty,1);
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Variable_GetReal(total_mass,&real));
+		REAL_EQUAL_TO(real,1000.0);
+
+		/// Attaching a child back adds it to the aggregated mass properties again
+		ERROR_CHECK(EVDS_Object_SetParent(payload,object));
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Variable_GetReal(total_mass,&real));
+		REAL_EQUAL_TO(real,2000.0);
+	} END_TEST
+
+
+	START_TEST("Rigid body (passive parts)") {
+		EVDS_OBJECT* part;
+		EVDS_OBJECT* structure;
+		int i;
+		EVDS_STATE_VECTOR_DERIVATIVE derivative;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Vessel\" type=\"vessel\">"
+"        <parameter name=\"mass\">1000</parameter>"
+"        <object name=\"Structure\" type=\"rigid_body\" x=\"2.0\">"
+"            <parameter name=\"mass\">1000</parameter>"
+"            <object name=\"Part\">"
+"                <parameter name=\"mass\">500</parameter>"
+"            </object>"
+"        </object>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Part",0,&part));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Structure",0,&structure));
+
+		//Count calls of rigid body solver for the passive structure
+		Test_EVDS_RIGID_BODY_OriginalSolve = EVDS_Solver_RigidBody.OnSolve;
+		Test_EVDS_RIGID_BODY_OriginalIntegrate = EVDS_Solver_RigidBody.OnIntegrate;
+		EVDS_Solver_RigidBody.OnSolve = Test_EVDS_RIGID_BODY_CountSolve;
+		EVDS_Solver_RigidBody.OnIntegrate = Test_EVDS_RIGID_BODY_CountIntegrate;
+		Test_EVDS_RIGID_BODY_CountedObject = structure;
+		Test_EVDS_RIGID_BODY_SolveCalls = 0;
+		Test_EVDS_RIGID_BODY_IntegrateCalls = 0;
+
+		/// Passive parts contribute mass, but no forces
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Object_GetRealVariable(object,"total_mass",&real,&variable));
+		REAL_EQUAL_TO(real,2500.0);
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,0,0,0);
+
+		/// Passive structure is only solved once (to aggregate its mass) and never integrated
+		for (i = 0; i < 5; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+			ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		}
+		EQUAL_TO(Test_EVDS_RIGID_BODY_SolveCalls,1);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_IntegrateCalls,0);
+
+		/// Part becomes active when it gets custom behavior
+		ERROR_CHECK(EVDS_Object_SetCallback_OnIntegrate(part,Test_EVDS_RIGID_BODY_Thruster));
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,1000.0,0,0);
+		for (i = 0; i < 4; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+			ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		}
+		EQUAL_TO(Test_EVDS_RIGID_BODY_SolveCalls,6);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_IntegrateCalls,5);
+
+		/// Part becomes passive again when custom behavior is removed
+		ERROR_CHECK(EVDS_Object_SetCallback_OnIntegrate(part,0));
+		for (i = 0; i < 5; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+			ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		}
+		VECTOR_EQUAL_TO(&derivative.force,0,0,0);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_SolveCalls,6);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_IntegrateCalls,5);
+
+		EVDS_Solver_RigidBody.OnSolve = Test_EVDS_RIGID_BODY_OriginalSolve;
+		EVDS_Solver_RigidBody.OnIntegrate = Test_EVDS_RIGID_BODY_OriginalIntegrate;
+	} END_TEST
+
+	START_TEST("Rigid body (state independent forces)") {
+		EVDS_OBJECT* thruster;
+		EVDS_STATE_VECTOR_DERIVATIVE derivative;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Vessel\" type=\"vessel\">"
+"        <parameter name=\"mass\">1000</parameter>"
+"        <object name=\"Thruster\" />"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Thruster",0,&thruster));
+		ERROR_CHECK(EVDS_Object_SetCallback_OnIntegrate(thruster,Test_EVDS_RIGID_BODY_Thruster));
+		ERROR_CHECK(EVDS_Object_SetStateIndependent(thruster,1));
+
+		/// Forces are evaluated once per step and reused for all stages
+		Test_EVDS_RIGID_BODY_ThrusterCalls = 0;
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,1000.0,0,0);
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,1000.0,0,0);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_ThrusterCalls,1);
+
+		/// Next step evaluates forces again
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,1000.0,0,0);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_ThrusterCalls,2);
+
+		/// State dependent forces are evaluated for every stage
+		ERROR_CHECK(EVDS_Object_SetStateIndependent(thruster,0));
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.force,1000.0,0,0);
+		EQUAL_TO(Test_EVDS_RIGID_BODY_ThrusterCalls,4);
+	} END_TEST
+
+	START_TEST("Rigid body (rotation around center of mass)") {
+		EVDS_OBJECT* thruster;
+		EVDS_STATE_VECTOR_DERIVATIVE derivative;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Vessel\" type=\"vessel\">"
+"        <parameter name=\"mass\">1000</parameter>"
+"        <parameter name=\"jxx\">1</parameter>"
+"        <parameter name=\"jyy\">1</parameter>"
+"        <parameter name=\"jzz\">1</parameter>"
+"        <object name=\"Part\" x=\"2.0\">"
+"            <parameter name=\"mass\">1000</parameter>"
+"            <parameter name=\"jxx\">1</parameter>"
+"            <parameter name=\"jyy\">1</parameter>"
+"            <parameter name=\"jzz\">1</parameter>"
+"        </object>"
+"        <object name=\"Thruster\" />"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Thruster",0,&thruster));
+		ERROR_CHECK(EVDS_Object_SetCallback_OnIntegrate(thruster,Test_EVDS_RIGID_BODY_Thruster));
+
+		/// Vessel is rotated by 90 degrees, spins around Z axis and has angular acceleration
+		ERROR_CHECK(EVDS_Object_SetOrientation(object,root,0,0,EVDS_RAD(90.0)));
+		ERROR_CHECK(EVDS_Object_GetStateVector(object,&state));
+		EVDS_Vector_Set(&state.angular_velocity,EVDS_VECTOR_ANGULAR_VELOCITY,root,0,0,1.0);
+		EVDS_Vector_Set(&state.angular_acceleration,EVDS_VECTOR_ANGULAR_ACCELERATION,root,0,0,2.0);
+		ERROR_CHECK(EVDS_Object_SetStateVector(object,&state));
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"total_cm",&variable));
+		ERROR_CHECK(EVDS_Variable_GetVector(variable,&vector));
+		VECTOR_EQUAL_TO(&vector,1.0,0,0);
+
+		/// Thrust (0,0.5,0) plus acceleration of body origin around CM at (0,1,0):
+		/// centripetal -w x (w x r) = (0,1,0), Euler -w' x r = (2,0,0)
+		ERROR_CHECK(EVDS_Object_Integrate(object,0.0,0,&derivative));
+		VECTOR_EQUAL_TO(&derivative.acceleration,2.0,1.5,0);
+		VECTOR_EQUAL_TO(&derivative.angular_acceleration,0,0,0);
+	} END_TEST
+}
+
+
+void Test_EVDS_PLANET() {
+	START_TEST("Planet (cached gravity parameters)") {
+		EVDS_PLANET_GRAVITY* gravity;
+		EVDS_OBJECT* probe;
+		long version;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.rs\">1e9</parameter>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,1e7,0,0);
+
+		/// Spherical gravity field
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,&real,&vector1));
+		REAL_EQUAL_TO(real,-4e7);
+		VECTOR_EQUAL_TO(&vector1,-4.0,0,0);
+
+		/// Publishing state of other objects keeps cached position of the planet
+		ERROR_CHECK(EVDS_InternalPlanet_GetGravity(object,&gravity));
+		version = gravity->position->version;
+		ERROR_CHECK(EVDS_Object_Create(system,root,&probe));
+		ERROR_CHECK(EVDS_Object_Initialize(probe,1));
+		ERROR_CHECK(EVDS_Object_SetPosition(probe,root,2e7,0,0));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO(&vector1,-4.0,0,0);
+		EQUAL_TO(gravity->position->version,version);
+
+		/// Changing parameters of the planet updates the field
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"gravity.mu",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,2e14));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO(&vector1,-2.0,0,0);
+
+		/// Descriptor held by a query is not modified by the rebuild
+		REAL_EQUAL_TO(gravity->mu,4e14);
+
+		/// Moving the planet updates its cached position
+		ERROR_CHECK(EVDS_Object_SetPosition(object,root,5e6,0,0));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO(&vector1,-8.0,0,0);
+
+		/// Changing sphere of influence updates the field (no gravity outside of it)
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"gravity.rs",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,1e6));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO(&vector1,0,0,0);
+	} END_TEST
+
+	START_TEST("Planet (J2 gravity)") {
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.j2\">1e-3</parameter>"
+"        <parameter name=\"gravity.degree\">2</parameter>"
+"        <parameter name=\"geometry.radius\">6e6</parameter>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,6e6,0,8e6);
+
+		/// Field matches analytic J2 equations
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,&real,&vector1));
+		REAL_EQUAL_TO_EPS(real,-39993376.0,1e-6);
+		VECTOR_EQUAL_TO_EPS(&vector1,-2.3971488,0,-3.1996544,1e-9);
+
+		/// Degree of the model can be limited
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"gravity.degree",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,1));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-2.4,0,-3.2,1e-9);
+	} END_TEST
+
+	START_TEST("Planet (spherical harmonics)") {
+		ERROR_CHECK(EVDS_System_DatabaseFromString(system,
+"<EVDS>"
+"	<database name=\"gravity\">"
+"		<entry name=\"test\" radius=\"6e6\">"
+"			<coefficient n=\"2\" m=\"0\" c=\"-4.4721359549995794e-4\" s=\"0\" />"
+"		</entry>"
+"	</database>"
+"</EVDS>"));
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.harmonics\">test</parameter>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,6e6,0,8e6);
+
+		/// Normalized coefficient C20 is equivalent to J2
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,&real,&vector1));
+		REAL_EQUAL_TO_EPS(real,-39993376.0,1e-6);
+		VECTOR_EQUAL_TO_EPS(&vector1,-2.3971488,0,-3.1996544,1e-9);
+	} END_TEST
+
+	START_TEST("Planet (gravity grid)") {
+		EVDS_PLANET_GRAVITY* gravity;
+		EVDS_PLANET_GRID* grid;
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.j2\">1e-3</parameter>"
+"        <parameter name=\"geometry.radius\">6e6</parameter>"
+"        <parameter name=\"gravity.grid_altitude\">4e6</parameter>"
+"        <parameter name=\"gravity.rs\">1e9</parameter>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+
+		/// Accuracy of the grid is reported
+		ERROR_CHECK(EVDS_Object_GetRealVariable(object,"gravity.grid_error",&real,0));
+		EQUAL_TO((real > 0.0),1);
+		EQUAL_TO((real < 1e-5),1);
+
+		/// Field inside the grid is interpolated
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,5e6,1e6,5e6);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-5.4828579948,-1.0965715990,-5.4944866183,1e-5);
+
+		/// Field outside of the grid is computed directly
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,0,0,2e7);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,0,0,-0.99973,1e-9);
+
+		/// Queries do not rebuild the grid, field is computed directly until planet is solved
+		ERROR_CHECK(EVDS_InternalPlanet_GetGravity(object,&gravity));
+		grid = gravity->grid;
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"gravity.mu",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,2e14));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,5e6,1e6,5e6);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-2.7414289974,-0.5482857995,-2.7472433092,1e-5);
+		ERROR_CHECK(EVDS_InternalPlanet_GetGravity(object,&gravity));
+		EQUAL_TO((gravity->grid == 0),1);
+
+		/// Grid held by previous descriptor stays valid
+		REAL_EQUAL_TO(grid->mu,4e14);
+		EQUAL_TO((grid->nodes != 0),1);
+
+		/// Solving the planet builds grid for the new parameters
+		ERROR_CHECK(EVDS_Object_Solve(object,0.0));
+		EQUAL_TO((gravity->grid != 0),1);
+		EQUAL_TO(gravity->grid->generation,gravity->generation);
+		REAL_EQUAL_TO(gravity->grid->mu,2e14);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-2.7414289974,-0.5482857995,-2.7472433092,1e-5);
+		ERROR_CHECK(EVDS_Object_GetRealVariable(object,"gravity.grid_error",&real,0));
+		EQUAL_TO((real > 0.0),1);
+		EQUAL_TO((real < 0.5e-5),1);
+
+		/// Grid is kept if parameters it depends on did not change
+		grid = gravity->grid;
+		ERROR_CHECK(EVDS_Object_GetVariable(object,"gravity.rs",&variable));
+		ERROR_CHECK(EVDS_Variable_SetReal(variable,1e10));
+		ERROR_CHECK(EVDS_InternalPlanet_GetGravity(object,&gravity));
+		EQUAL_TO((gravity->grid == grid),1);
+		EQUAL_TO(grid->generation,gravity->generation);
+	} END_TEST
+
+	START_TEST("Planet (gravity tree)") {
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"    </object>"
+"    <object name=\"Moon 1\" type=\"planet\" x=\"1e10\" y=\"1e6\">"
+"        <parameter name=\"gravity.mu\">1e14</parameter>"
+"    </object>"
+"    <object name=\"Moon 2\" type=\"planet\" x=\"1e10\" y=\"-1e6\">"
+"        <parameter name=\"gravity.mu\">1e14</parameter>"
+"    </object>"
+"    <object name=\"Probe\" type=\"static_body\" />"
+"</EVDS>");
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Earth",0,&object));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,1e7,0,0);
+
+		/// Field computed with the tree matches the exact field
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector2));
+		ERROR_CHECK(EVDS_System_SetGravityTree(system,0.5));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,vector2.x,vector2.y,vector2.z,1e-12);
+
+		/// Tree is not rebuilt when objects other than planets move
+		{
+			EVDS_GRAVITY_TREE* tree = system->gravity_tree;
+			ERROR_CHECK(EVDS_System_GetObjectByName(system,"Probe",0,&object));
+			ERROR_CHECK(EVDS_Object_SetPosition(object,root,2e6,0,0));
+			ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+			EQUAL_TO((system->gravity_tree == tree),1);
+		}
+
+		/// Nearby planets always use their latest state
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Earth",0,&object));
+		ERROR_CHECK(EVDS_Object_SetPosition(object,root,5e6,0,0));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,vector2.x + 4.0 - 16.0,vector2.y,vector2.z,1e-12);
+	} END_TEST
+
+	START_TEST("Planet (gravity tree far cluster)") {
+		EVDS_REAL error,magnitude;
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Frame\" type=\"static_body\" x=\"-1e9\" y=\"2e9\" />"
+"    <object name=\"A\" type=\"planet\" x=\"5e9\" y=\"-1e9\" z=\"-1e9\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"    </object>"
+"    <object name=\"B\" type=\"planet\" x=\"7e9\" y=\"1e9\" z=\"-1e9\">"
+"        <parameter name=\"gravity.mu\">1e14</parameter>"
+"    </object>"
+"    <object name=\"C\" type=\"planet\" x=\"6e9\" y=\"-1e9\" z=\"1e9\">"
+"        <parameter name=\"gravity.mu\">2e14</parameter>"
+"    </object>"
+"    <object name=\"D\" type=\"planet\" x=\"7e9\" y=\"0\" z=\"1e9\">"
+"        <parameter name=\"gravity.mu\">3e14</parameter>"
+"    </object>"
+"</EVDS>");
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Frame",0,&object));
+		ERROR_CHECK(EVDS_Object_SetOrientation(object,root,0.3,0.2,0.1));
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,0,0,0);
+		EVDS_Vector_Convert(&vector,&vector,object);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector2));
+		EVDS_Vector_Length(&magnitude,&vector2);
+
+		/// Far cluster is replaced by a point mass, error is within the opening angle
+		ERROR_CHECK(EVDS_System_SetGravityTree(system,0.5));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		EQUAL_TO((vector1.coordinate_system == object),1);
+		EVDS_Vector_Subtract(&vector1,&vector1,&vector2);
+		EVDS_Vector_Length(&error,&vector1);
+		EQUAL_TO((error > 1e-6*magnitude),1);
+		EQUAL_TO((error < 0.5*0.5*magnitude),1);
+
+		/// Small opening angle opens the cluster and gives the exact field
+		ERROR_CHECK(EVDS_System_SetGravityTree(system,0.05));
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,vector2.x,vector2.y,vector2.z,1e-12*magnitude);
+	} END_TEST
+
+	START_TEST("Planet (spheres of influence)") {
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Sun\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">1e20</parameter>"
+"    </object>"
+"    <object name=\"Earth\" type=\"planet\" x=\"1e11\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.rs\">1e9</parameter>"
+"    </object>"
+"    <object name=\"Moon\" type=\"planet\" x=\"1.004e11\">"
+"        <parameter name=\"gravity.mu\">5e12</parameter>"
+"        <parameter name=\"gravity.rs\">6e7</parameter>"
+"    </object>"
+"    <object name=\"Probe\" type=\"static_body\" x=\"1.0041e11\" />"
+"</EVDS>");
+
+		/// Innermost sphere of influence dominates
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Probe",0,&object));
+		ERROR_CHECK(EVDS_Planet_GetNearest(object,&object));
+		EQUAL_TO(strcmp(object->name,"Moon"),0);
+
+		/// Index is not rebuilt when objects other than planets move
+		{
+			EVDS_SOI_INDEX* index = system->soi_index;
+			EVDS_OBJECT* probe;
+			ERROR_CHECK(EVDS_System_GetObjectByName(system,"Probe",0,&probe));
+			ERROR_CHECK(EVDS_Object_SetPosition(probe,root,1.005e11,0,0));
+			ERROR_CHECK(EVDS_Planet_GetNearest(probe,&object));
+			EQUAL_TO(strcmp(object->name,"Earth"),0);
+			EQUAL_TO((system->soi_index == index),1);
+
+			/// Index follows planets which moved further than any fixed margin
+			ERROR_CHECK(EVDS_System_GetObjectByName(system,"Moon",0,&object));
+			ERROR_CHECK(EVDS_Object_SetPosition(object,root,1.0045e11,0,0));
+			ERROR_CHECK(EVDS_Planet_GetNearest(probe,&object));
+			EQUAL_TO(strcmp(object->name,"Moon"),0);
+			EQUAL_TO((system->soi_index != index),1);
+			ERROR_CHECK(EVDS_System_GetObjectByName(system,"Moon",0,&object));
+			ERROR_CHECK(EVDS_Object_SetPosition(object,root,1.004e11,0,0));
+			ERROR_CHECK(EVDS_Object_SetPosition(probe,root,1.0041e11,0,0));
+		}
+
+		/// All planets whose sphere of influence contains the position pull it
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,1.0041e11,0,0);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-0.0622980375477,0,0,1e-12);
+
+		/// Planets are skipped outside of their spheres of influence
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,1.02e11,0,0);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-0.00961168781238,0,0,1e-12);
+		EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,3e10,0,0);
+		ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,0,&vector1));
+		VECTOR_EQUAL_TO_EPS(&vector1,-0.111111111111,0,0,1e-12);
+
+		/// Planets without environment models give vacuum
+		{
+			EVDS_ENVIRONMENT_ATMOSPHERE atmosphere;
+			atmosphere.density = 1.0;
+			ERROR_CHECK(EVDS_Environment_GetAtmosphericParameters(system,&vector,&atmosphere));
+			REAL_EQUAL_TO(atmosphere.density,0.0);
+			ERROR_CHECK(EVDS_Environment_GetMagneticField(system,&vector,&vector1));
+			VECTOR_EQUAL_TO(&vector1,0,0,0);
+		}
+	} END_TEST
+
+	START_TEST("Planet (batch queries)") {
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.j2\">1e-3</parameter>"
+"        <parameter name=\"geometry.radius\">6e6</parameter>"
+"    </object>"
+"    <object name=\"Moon\" type=\"planet\" x=\"3.8e8\">"
+"        <parameter name=\"gravity.mu\">5e12</parameter>"
+"        <parameter name=\"gravity.rs\">6e7</parameter>"
+"    </object>"
+"</EVDS>");
+
+		/// Batch query matches separate queries in every position
+		{
+			EVDS_REAL x[3] = { 6e6, 3.8e8, 0.0 };
+			EVDS_REAL y[3] = { 2e6, 1e7, 0.0 };
+			EVDS_REAL z[3] = { 8e6, 0.0, 1e8 };
+			EVDS_REAL phi[3],gx[3],gy[3],gz[3];
+			int i;
+			ERROR_CHECK(EVDS_Environment_GetGravitationalFieldBatch(system,root,3,x,y,z,phi,gx,gy,gz));
+			for (i = 0; i < 3; i++) {
+				EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[i],y[i],z[i]);
+				ERROR_CHECK(EVDS_Environment_GetGravitationalField(system,&vector,&real,&vector1));
+				REAL_EQUAL_TO_EPS(phi[i],real,1e-6);
+				VECTOR_EQUAL_TO_EPS(&vector1,gx[i],gy[i],gz[i],1e-12);
+			}
+		}
+	} END_TEST
+
+
+	START_TEST("Planet (built-in atmosphere)") {
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"gravity.rs\">1e9</parameter>"
+"        <parameter name=\"geometry.radius\">6378e3</parameter>"
+"        <parameter name=\"atmosphere.model\">us76</parameter>"
+"    </object>"
+"</EVDS>");
+
+		/// Standard atmosphere at sea level, in the tropopause and in the mesosphere
+		{
+			EVDS_ENVIRONMENT_ATMOSPHERE atmosphere;
+			EVDS_ENVIRONMENT_ATMOSPHERE batch[3];
+			EVDS_REAL x[3] = { 6378e3, 6389e3, 6428e3 };
+			EVDS_REAL y[3] = { 0.0, 0.0, 0.0 };
+			EVDS_REAL z[3] = { 0.0, 0.0, 0.0 };
+			int i;
+
+			EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,6378e3,0.0,0.0);
+			ERROR_CHECK(EVDS_Environment_GetAtmosphericParameters(system,&vector,&atmosphere));
+			REAL_EQUAL_TO_EPS(atmosphere.pressure,101325.0,1e-6);
+			REAL_EQUAL_TO_EPS(atmosphere.temperature,288.15,1e-9);
+			REAL_EQUAL_TO_EPS(atmosphere.density,1.225,1e-4);
+
+			EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,6389e3,0.0,0.0);
+			ERROR_CHECK(EVDS_Environment_GetAtmosphericParameters(system,&vector,&atmosphere));
+			REAL_EQUAL_TO_EPS(atmosphere.temperature,216.774,1e-3);
+			REAL_EQUAL_TO_EPS(atmosphere.pressure,22700.0,1.0);
+
+			/// Batch query matches separate queries
+			ERROR_CHECK(EVDS_Environment_GetAtmosphericParametersBatch(system,root,3,x,y,z,batch));
+			for (i = 0; i < 3; i++) {
+				EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[i],y[i],z[i]);
+				ERROR_CHECK(EVDS_Environment_GetAtmosphericParameters(system,&vector,&atmosphere));
+				REAL_EQUAL_TO_EPS(batch[i].density,atmosphere.density,1e-12);
+				REAL_EQUAL_TO_EPS(batch[i].temperature,atmosphere.temperature,1e-9);
+			}
+			REAL_EQUAL_TO_EPS(batch[2].temperature,270.65,1e-9);
+		}
+	} END_TEST
+
+
+	START_TEST("Planet (ephemeris)") {
+		/// Write ephemeris with a single segment of 10 days
+		{
+			FILE* file;
+			double times[2] = { 60000.0, 10.0 };
+			int header[4] = { 1, 3, 1, 0 };
+			double coefficients[9] = { 1e9, 2e8, 5e6,  0.0, 1e8, 0.0,  0.0, 0.0, 0.0 };
+			file = fopen("evds_test_ephemeris.bin","wb");
+			fwrite("EVDSEPH1",1,8,file);
+			fwrite(times,sizeof(double),2,file);
+			fwrite(header,sizeof(int),4,file);
+			fwrite(coefficients,sizeof(double),9,file);
+			fclose(file);
+		}
+
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Earth\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">4e14</parameter>"
+"        <parameter name=\"ephemeris.file\">evds_test_ephemeris.bin</parameter>"
+"    </object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+
+		/// Planet is moved along the ephemeris
+		ERROR_CHECK(EVDS_System_SetTime(system,60007.5));
+		ERROR_CHECK(EVDS_Object_Solve(root,0.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(object,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,1.0975e9,5e7,0.0,1e-3);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,2.1e8/432000.0,1e8/432000.0,0.0,1e-9);
+		remove("evds_test_ephemeris.bin");
+	} END_TEST
+
+	START_TEST("Planet (radiation and eclipses)") {
+		LOAD_INITIALIZED(root,
+"<EVDS version=\"34\">"
+"    <object name=\"Sun\" type=\"planet\">"
+"        <parameter name=\"gravity.mu\">1.327e20</parameter>"
+"        <parameter name=\"geometry.radius\">6.957e8</parameter>"
+"        <parameter name=\"radiation.luminosity\">3.828e26</parameter>"
+"    </object>"
+"    <object name=\"Earth\" type=\"planet\" x=\"1.496e11\">"
+"        <parameter name=\"gravity.mu\">3.986e14</parameter>"
+"        <parameter name=\"gravity.rs\">9.2e8</parameter>"
+"        <parameter name=\"geometry.radius\">6371e3</parameter>"
+"    </object>"
+"</EVDS>");
+
+		/// Sunlit side, umbra and penumbra of the planet
+		{
+			EVDS_ENVIRONMENT_RADIATION radiation;
+			EVDS_ENVIRONMENT_RADIATION batch[3];
+			EVDS_REAL x[3] = { 1.496e11-7000e3, 1.496e11+7000e3, 1.496e11+7000e3 };
+			EVDS_REAL y[3] = { 0.0, 0.0, 6370e3 };
+			EVDS_REAL z[3] = { 0.0, 0.0, 0.0 };
+			int i;
+
+			EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[0],y[0],z[0]);
+			ERROR_CHECK(EVDS_Environment_GetRadiationParameters(system,&vector,&radiation));
+			REAL_EQUAL_TO(radiation.illumination,1.0);
+			REAL_EQUAL_TO_EPS(radiation.flux,1361.26,1e-2);
+			REAL_EQUAL_TO_EPS(radiation.pressure,radiation.flux/EVDS_C,1e-15);
+			VECTOR_EQUAL_TO_EPS(&radiation.direction,-1.0,0.0,0.0,1e-12);
+
+			EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[1],y[1],z[1]);
+			ERROR_CHECK(EVDS_Environment_GetRadiationParameters(system,&vector,&radiation));
+			REAL_EQUAL_TO(radiation.illumination,0.0);
+			REAL_EQUAL_TO(radiation.flux,0.0);
+			EQUAL_TO(strcmp(radiation.occluder->name,"Earth"),0);
+
+			EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[2],y[2],z[2]);
+			ERROR_CHECK(EVDS_Environment_GetRadiationParameters(system,&vector,&radiation));
+			REAL_EQUAL_TO_EPS(radiation.illumination,0.4753,1e-4);
+			REAL_EQUAL_TO(radiation.shadow_margin,0.0);
+
+			/// Batch query matches separate queries
+			ERROR_CHECK(EVDS_Environment_GetRadiationParametersBatch(system,root,3,x,y,z,batch));
+			for (i = 0; i < 3; i++) {
+				EVDS_Vector_Set(&vector,EVDS_VECTOR_POSITION,root,x[i],y[i],z[i]);
+				ERROR_CHECK(EVDS_Environment_GetRadiationParameters(system,&vector,&radiation));
+				REAL_EQUAL_TO_EPS(batch[i].flux,radiation.flux,1e-9);
+				REAL_EQUAL_TO_EPS(batch[i].shadow_function,radiation.shadow_function,1e-12);
+			}
+		}
+	} END_TEST
+}
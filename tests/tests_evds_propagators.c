@@ -0,0 +1,455 @@
+#include "framework.h"
+
+int Test_EVDS_PROPAGATORS_Crossing(EVDS_OBJECT* object, EVDS_STATE_VECTOR* state, void* userdata, EVDS_REAL* value) {
+	*value = state->position.x;
+	return EVDS_OK;
+}
+
+int Test_EVDS_PROPAGATORS_OnCrossing(EVDS_OBJECT* object, EVDS_EVENT* event, EVDS_STATE_VECTOR* state, void* userdata) {
+	EVDS_STATE_VECTOR* event_state = (EVDS_STATE_VECTOR*)userdata;
+	EVDS_StateVector_Copy(&event_state[0],&event_state[1]);
+	EVDS_StateVector_Copy(&event_state[1],state);
+	return EVDS_OK;
+}
+
+void Test_EVDS_PROPAGATORS_Load(EVDS_SYSTEM* system, EVDS_OBJECT* root, char* type,
+								EVDS_OBJECT** p_propagator, EVDS_OBJECT** p_earth, EVDS_OBJECT** p_satellite) {
+	//Propagator (with Earth, if requested)
+	ERROR_CHECK(EVDS_Object_Create(system,root,p_propagator));
+	ERROR_CHECK(EVDS_Object_SetType(*p_propagator,type));
+	ERROR_CHECK(EVDS_Object_Initialize(*p_propagator,1));
+	if (p_earth) {
+		ERROR_CHECK(EVDS_Object_LoadFromString(*p_propagator,
+"<EVDS version=\"34\">"
+"	<object name=\"Earth\" type=\"planet\">"
+"		<parameter name=\"gravity.mu\">398600440000000</parameter>"
+"		<parameter name=\"geometry.radius\">6378145.0</parameter>"
+"	</object>"
+"</EVDS>",p_earth));
+		ERROR_CHECK(EVDS_Object_Initialize(*p_earth,1));
+	}
+
+	//Satellite is not initialized, so its state vector and children can be set first
+	ERROR_CHECK(EVDS_Object_LoadFromString(*p_propagator,
+"<EVDS version=\"34\">"
+"	<object name=\"Satellite\" type=\"vessel\">"
+"		<parameter name=\"mass\">1000</parameter>"
+"		<parameter name=\"jxx\">1</parameter>"
+"		<parameter name=\"jyy\">1</parameter>"
+"		<parameter name=\"jzz\">1</parameter>"
+"	</object>"
+"</EVDS>",p_satellite));
+}
+
+void Test_EVDS_PROPAGATORS_AddEngine(EVDS_OBJECT* satellite) {
+	//Children are not initialized until satellite is initialized
+	EVDS_OBJECT_LOADEX info = { 0 };
+	info.description =
+"<EVDS version=\"34\">"
+"	<object name=\"Oxidizer\" type=\"fuel_tank\">"
+"		<parameter name=\"fuel.type\">O2</parameter>"
+"		<parameter name=\"fuel.mass\">400</parameter>"
+"	</object>"
+"	<object name=\"Fuel\" type=\"fuel_tank\">"
+"		<parameter name=\"fuel.type\">H2</parameter>"
+"		<parameter name=\"fuel.mass\">100</parameter>"
+"	</object>"
+"	<object name=\"Rocket engine\" type=\"rocket_engine\">"
+"		<parameter name=\"mass\">100</parameter>"
+"		<parameter name=\"vacuum.isp\">400.0</parameter>"
+"		<parameter name=\"vacuum.thrust\">10000.0</parameter>"
+"	</object>"
+"</EVDS>";
+	ERROR_CHECK(EVDS_Object_LoadEx(satellite,0,&info));
+}
+
+void Test_EVDS_PROPAGATORS() {
+	START_TEST("Kepler propagator (circular orbit)") {
+		/// This test checks that coasting object follows an exact circular orbit when
+		/// propagated by the analytic Kepler propagator.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL period = 2*EVDS_PI*sqrt(r*r*r/mu);
+		int i;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_kepler",&propagator,&earth,&satellite);
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+
+		/// Propagate for a quarter of the orbit with large steps
+		for (i = 0; i < 10; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,0.025*period));
+		}
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,0,r,0,1e-3);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,-v,0,0,1e-6);
+
+		/// External change of the state vector must be picked up by the propagator
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,-r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,-v,0));
+		for (i = 0; i < 20; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,0.025*period));
+		}
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,r,0,0,1e-3);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,0,v,0,1e-6);
+	} END_TEST
+
+
+	START_TEST("Kepler propagator (powered flight)") {
+		/// Object with a firing engine must be integrated numerically, and must return to
+		/// the analytic solution along its new orbit once the engine is shut down.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_OBJECT* engine;
+		EVDS_VARIABLE* command_throttle;
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL n = v/r;
+		EVDS_REAL alpha,period;
+		EVDS_REAL r0[3],v0[3],r1[3],v1[3];
+		int i;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_kepler",&propagator,&earth,&satellite);
+		Test_EVDS_PROPAGATORS_AddEngine(satellite);
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Rocket engine",satellite,&engine));
+		ERROR_CHECK(EVDS_Object_GetVariable(engine,"command.throttle",&command_throttle));
+		EQUAL_TO(EVDS_InternalPropagator_Kepler_IsPowered(satellite),0);
+
+		/// Firing engine moves the object off the original orbit
+		ERROR_CHECK(EVDS_Variable_SetReal(command_throttle,1.0));
+		for (i = 0; i < 10; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		}
+		EQUAL_TO(EVDS_InternalPropagator_Kepler_IsPowered(satellite),1);
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		EQUAL_TO(fabs(state.velocity.x + v*sin(10.0*n)) > 10.0,1);
+
+		/// After engine shutdown the object coasts along the new osculating orbit
+		ERROR_CHECK(EVDS_Variable_SetReal(command_throttle,0.0));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		EQUAL_TO(EVDS_InternalPropagator_Kepler_IsPowered(satellite),0);
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		r0[0] = state.position.x; r0[1] = state.position.y; r0[2] = state.position.z;
+		v0[0] = state.velocity.x; v0[1] = state.velocity.y; v0[2] = state.velocity.z;
+		alpha = 2.0/sqrt(r0[0]*r0[0]+r0[1]*r0[1]+r0[2]*r0[2]) - (v0[0]*v0[0]+v0[1]*v0[1]+v0[2]*v0[2])/mu;
+		period = 2.0*EVDS_PI/sqrt(mu*alpha*alpha*alpha);
+
+		/// Large coasting steps must match the analytic solution exactly
+		for (i = 0; i < 10; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,0.025*period));
+		}
+		EVDS_InternalPropagator_Kepler_Evaluate(mu,alpha,period,r0,v0,0.25*period,r1,v1);
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,r1[0],r1[1],r1[2],1e-3);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,v1[0],v1[1],v1[2],1e-6);
+	} END_TEST
+
+
+	START_TEST("Encke propagator (circular orbit)") {
+		/// Without perturbations the deviation from reference orbit must stay zero,
+		/// so large steps must not introduce any truncation error.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL period = 2*EVDS_PI*sqrt(r*r*r/mu);
+		int i;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_encke",&propagator,&earth,&satellite);
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+
+		/// Propagate for half of the orbit with large steps
+		for (i = 0; i < 10; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,0.05*period));
+		}
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,-r,0,0,1e-2);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,0,-v,0,1e-5);
+	} END_TEST
+
+
+	START_TEST("Encke propagator (powered flight)") {
+		/// Trajectory with an engine burn and a coast after it must match the trajectory
+		/// computed with Cowell's method (RK4 propagator).
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_OBJECT* engine;
+		EVDS_VARIABLE* command_throttle;
+		EVDS_STATE_VECTOR result[2];
+		char* types[2] = { "propagator_encke", "propagator_rk4" };
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		int i,k;
+
+		for (k = 0; k < 2; k++) {
+			Test_EVDS_PROPAGATORS_Load(system,root,types[k],&propagator,&earth,&satellite);
+			Test_EVDS_PROPAGATORS_AddEngine(satellite);
+			ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+			ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+			ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+			ERROR_CHECK(EVDS_System_GetObjectByName(system,"Rocket engine",satellite,&engine));
+			ERROR_CHECK(EVDS_Object_GetVariable(engine,"command.throttle",&command_throttle));
+
+			/// Burn for one minute, then coast for ten minutes
+			ERROR_CHECK(EVDS_Variable_SetReal(command_throttle,1.0));
+			for (i = 0; i < 60; i++) {
+				ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+			}
+			ERROR_CHECK(EVDS_Variable_SetReal(command_throttle,0.0));
+			for (i = 0; i < 60; i++) {
+				ERROR_CHECK(EVDS_Object_Solve(propagator,10.0));
+			}
+			ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&result[k]));
+			ERROR_CHECK(EVDS_Object_Destroy(propagator));
+		}
+		VECTOR_EQUAL_TO_EPS(&result[0].position,result[1].position.x,result[1].position.y,result[1].position.z,1e-2);
+		VECTOR_EQUAL_TO_EPS(&result[0].velocity,result[1].velocity.x,result[1].velocity.y,result[1].velocity.z,1e-5);
+
+		/// Burn must have changed the orbit
+		EQUAL_TO(fabs(sqrt(result[0].position.x*result[0].position.x +
+						   result[0].position.y*result[0].position.y) - r) > 1e3,1);
+	} END_TEST
+
+
+	START_TEST("Adams-Bashforth-Moulton propagator (circular orbit)") {
+		/// Multistep propagator must follow the circular orbit closely after RK4 startup,
+		/// and restart correctly when state vector is changed externally.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL n = v/r;
+		int i;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_abm",&propagator,&earth,&satellite);
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+
+		/// Propagate for 10 minutes with 10 second steps
+		for (i = 0; i < 60; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,10.0));
+		}
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,r*cos(600.0*n),r*sin(600.0*n),0,1.0);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,-v*sin(600.0*n),v*cos(600.0*n),0,1e-3);
+
+		/// External change of the state vector must restart the propagator
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		for (i = 0; i < 60; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,10.0));
+		}
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,r*cos(600.0*n),r*sin(600.0*n),0,1.0);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,-v*sin(600.0*n),v*cos(600.0*n),0,1e-3);
+	} END_TEST
+
+
+	START_TEST("Event detection (RK4 propagator)") {
+		/// Event must be found exactly inside a large step, and the step must still
+		/// be completed to the full time.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* earth;
+		EVDS_OBJECT* satellite;
+		EVDS_EVENT* event;
+		EVDS_STATE_VECTOR event_state[2];
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL period = 2*EVDS_PI*sqrt(r*r*r/mu);
+		EVDS_REAL start_time;
+		int i;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_rk4",&propagator,&earth,&satellite);
+		ERROR_CHECK(EVDS_Object_SetPosition(satellite,propagator,r,0,0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,v,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		start_time = state.time;
+
+		/// Crossing of the Y axis happens after a quarter of the orbit
+		memset(event_state,0,sizeof(event_state));
+		ERROR_CHECK(EVDS_Event_Create(satellite,Test_EVDS_PROPAGATORS_Crossing,
+			Test_EVDS_PROPAGATORS_OnCrossing,event_state,&event));
+		for (i = 0; i < 90; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagator,0.01*period));
+		}
+		REAL_EQUAL_TO_EPS((event_state[0].time - start_time)*86400.0,0.25*period,1e-2);
+		REAL_EQUAL_TO_EPS((event_state[1].time - start_time)*86400.0,0.75*period,1e-2);
+		REAL_EQUAL_TO_EPS(event_state[0].position.x,0.0,1e-1);
+		REAL_EQUAL_TO_EPS(event_state[1].position.x,0.0,1e-1);
+
+		/// Steps are completed after the events
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		REAL_EQUAL_TO_EPS((state.time - start_time)*86400.0,0.9*period,1e-3);
+		ERROR_CHECK(EVDS_Event_Destroy(event));
+	} END_TEST
+
+
+	START_TEST("Sleeping and static objects") {
+		/// Sleeping objects must not be propagated until they are woken up, objects at
+		/// rest must fall asleep automatically once sleep thresholds are set.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* satellite;
+		EVDS_REAL start_time;
+		int sleeping;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_rk4",&propagator,0,&satellite);
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,1.0,0,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		start_time = state.time;
+
+		/// Sleeping object keeps its position, but its time follows the system
+		ERROR_CHECK(EVDS_Object_Sleep(satellite));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO(&state.position,0,0,0);
+		REAL_EQUAL_TO_EPS((state.time - start_time)*86400.0,1.0,1e-6);
+
+		/// Setting state vector wakes object up
+		ERROR_CHECK(EVDS_Object_SetStateVector(satellite,&state));
+		ERROR_CHECK(EVDS_Object_IsSleeping(satellite,&sleeping));
+		EQUAL_TO(sleeping,0);
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO(&state.position,1.0,0,0);
+		REAL_EQUAL_TO_EPS((state.time - start_time)*86400.0,2.0,1e-6);
+
+		/// Woken up object continues from the current time
+		ERROR_CHECK(EVDS_Object_Sleep(satellite));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_Wake(satellite));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO(&state.position,2.0,0,0);
+		REAL_EQUAL_TO_EPS((state.time - start_time)*86400.0,4.0,1e-6);
+
+		/// Object is at rest in dense output while sleeping
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,start_time + 2.25/86400.0,&state));
+		VECTOR_EQUAL_TO(&state.position,1.0,0,0);
+
+		/// Static object never wakes up
+		ERROR_CHECK(EVDS_Object_SetStatic(satellite,1));
+		ERROR_CHECK(EVDS_Object_Wake(satellite));
+		ERROR_CHECK(EVDS_Object_IsSleeping(satellite,&sleeping));
+		EQUAL_TO(sleeping,1);
+		ERROR_CHECK(EVDS_Object_SetStatic(satellite,0));
+		ERROR_CHECK(EVDS_Object_IsSleeping(satellite,&sleeping));
+		EQUAL_TO(sleeping,0);
+
+		/// Object at rest falls asleep after sleep time has passed
+		ERROR_CHECK(EVDS_System_SetSleepThresholds(system,0.01,0.01,0.01,2.0));
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,0,0,0));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_IsSleeping(satellite,&sleeping));
+		EQUAL_TO(sleeping,0);
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_IsSleeping(satellite,&sleeping));
+		EQUAL_TO(sleeping,1);
+	} END_TEST
+
+
+	START_TEST("Dense output interpolation") {
+		/// State vector must be available at any time within the last steps of the object.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* satellite;
+		EVDS_STATE_VECTOR sample[2];
+		EVDS_REAL start_time;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_rk4",&propagator,0,&satellite);
+		ERROR_CHECK(EVDS_Object_SetVelocity(satellite,propagator,1.0,0,0));
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		start_time = state.time;
+
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+
+		/// Interpolate inside last step
+		ERROR_CHECK(EVDS_Object_GetInterpolatedStateVector(satellite,&state,0.5));
+		VECTOR_EQUAL_TO_EPS(&state.position,1.5,0,0,1e-4);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,1.0,0,0,1e-4);
+
+		/// Interpolate at arbitrary time inside both steps
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,start_time + 0.25/86400.0,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,0.25,0,0,1e-4);
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,start_time + 1.75/86400.0,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,1.75,0,0,1e-4);
+
+		/// Time past the last step returns latest state
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,start_time + 5.0/86400.0,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,2.0,0,0,1e-4);
+
+		/// Interpolate halfway between two published samples
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&sample[0]));
+		ERROR_CHECK(EVDS_Object_Solve(propagator,1.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&sample[1]));
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,0.5*(sample[0].time + sample[1].time),&state));
+		REAL_EQUAL_TO_EPS((state.time - sample[0].time)*86400.0,0.5,1e-4);
+		REAL_EQUAL_TO_EPS(state.position.x,0.5*(sample[0].position.x + sample[1].position.x),1e-4);
+		VECTOR_EQUAL_TO_EPS(&state.position,3.5,0,0,1e-4);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,1.0,0,0,1e-4);
+	} END_TEST
+
+
+	START_TEST("Dense output interpolation (curved trajectory and rotation)") {
+		/// Position must follow a curved trajectory between published state vectors (a straight
+		/// line between them is off by kilometers), orientation must follow angular velocity.
+		EVDS_OBJECT* propagator;
+		EVDS_OBJECT* satellite;
+		EVDS_REAL mu = 398600440000000.0;
+		EVDS_REAL r = 7000e3;
+		EVDS_REAL v = sqrt(mu/r);
+		EVDS_REAL n = v/r;
+		EVDS_REAL alpha = 0.0005;
+		EVDS_REAL start_time,angle;
+
+		Test_EVDS_PROPAGATORS_Load(system,root,"propagator_rk4",&propagator,0,&satellite);
+		ERROR_CHECK(EVDS_Object_Initialize(satellite,1));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		start_time = state.time;
+
+		/// Publish two points on a circular orbit, while rotating with constant angular acceleration
+		EVDS_Vector_Set(&state.position,EVDS_VECTOR_POSITION,propagator,r,0,0);
+		EVDS_Vector_Set(&state.velocity,EVDS_VECTOR_VELOCITY,propagator,0,v,0);
+		EVDS_Vector_Set(&state.angular_velocity,EVDS_VECTOR_ANGULAR_VELOCITY,propagator,0,0,0);
+		EVDS_Quaternion_FromEuler(&state.orientation,propagator,0,0,0);
+		ERROR_CHECK(EVDS_Object_SetStateVector(satellite,&state));
+
+		state.time = start_time + 60.0/86400.0;
+		EVDS_Vector_Set(&state.position,EVDS_VECTOR_POSITION,propagator,r*cos(60.0*n),r*sin(60.0*n),0);
+		EVDS_Vector_Set(&state.velocity,EVDS_VECTOR_VELOCITY,propagator,-v*sin(60.0*n),v*cos(60.0*n),0);
+		EVDS_Vector_Set(&state.angular_velocity,EVDS_VECTOR_ANGULAR_VELOCITY,propagator,0,0,alpha*60.0);
+		EVDS_Quaternion_FromEuler(&state.orientation,propagator,0,0,0.5*alpha*60.0*60.0);
+		ERROR_CHECK(EVDS_Object_SetStateVector(satellite,&state));
+
+		/// Check state in the middle of the step
+		ERROR_CHECK(EVDS_Object_GetStateVectorAtTime(satellite,start_time + 30.0/86400.0,&state));
+		VECTOR_EQUAL_TO_EPS(&state.position,r*cos(30.0*n),r*sin(30.0*n),0,1.0);
+		VECTOR_EQUAL_TO_EPS(&state.velocity,-v*sin(30.0*n),v*cos(30.0*n),0,1e-3);
+		EVDS_Quaternion_ToEuler(&state.orientation,propagator,0,0,&angle);
+		REAL_EQUAL_TO_EPS(angle,0.5*alpha*30.0*30.0,1e-6);
+	} END_TEST
+}
@@ -42,6 +42,8 @@ void Test_EVDS_SYSTEM() {
 		EQUAL_TO(EVDS_System_SetUserdata(0,0), EVDS_ERROR_BAD_PARAMETER);
 		EQUAL_TO(EVDS_System_GetUserdata(system,0), EVDS_ERROR_BAD_PARAMETER);
 		EQUAL_TO(EVDS_System_GetUserdata(0,&object), EVDS_ERROR_BAD_PARAMETER);
+		EQUAL_TO(EVDS_System_SetDeterministic(0,1), EVDS_ERROR_BAD_PARAMETER);
+		EQUAL_TO(EVDS_System_GetStateHash(system,0), EVDS_ERROR_BAD_PARAMETER);
 	} END_TEST
 
 
@@ -79,4 +81,304 @@ void Test_EVDS_SYSTEM() {
 		ERROR_CHECK(EVDS_System_CleanupObjects(system)); //Will delete object
 		IS_NOT_IN_LIST(object,system->deleted_objects);
 	} END_TEST
-}
\ No newline at end of file
+
+
+	START_TEST("EVDS_Ensemble") {
+		EVDS_ENSEMBLE* ensemble;
+		EVDS_SYSTEM* member;
+		EVDS_REAL masses[8];
+		EVDS_REAL regenerated_masses[4];
+		EVDS_STATE_VECTOR states[8];
+		EVDS_VARIABLE* template_database;
+		EVDS_VARIABLE* database;
+		EVDS_VARIABLE* density;
+		EVDS_REAL value;
+		int i,count;
+
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"	<object name=\"Propagator\" type=\"propagator_rk4\">"
+"		<object name=\"Satellite\" type=\"vessel\" vx=\"1.0\">"
+"			<parameter name=\"mass\">1000</parameter>"
+"			<parameter name=\"jxx\">1</parameter>"
+"			<parameter name=\"jyy\">1</parameter>"
+"			<parameter name=\"jzz\">1</parameter>"
+"		</object>"
+"	</object>"
+"</EVDS>",&object));
+
+		ERROR_CHECK(EVDS_Ensemble_Create(system,&ensemble));
+		ERROR_CHECK(EVDS_Ensemble_AddDispersion(ensemble,"/Propagator/Satellite/mass",10.0));
+		ERROR_CHECK(EVDS_Ensemble_Generate(ensemble,8,1234));
+		ERROR_CHECK(EVDS_Ensemble_GetMemberCount(ensemble,&count));
+		EQUAL_TO(count,8);
+		ERROR_CHECK(EVDS_Ensemble_GetMember(ensemble,7,&member));
+		EQUAL_TO(EVDS_Ensemble_GetMember(ensemble,8,&member),EVDS_ERROR_NOT_FOUND);
+
+		/// Every member has its own copy of the template databases
+		ERROR_CHECK(EVDS_System_GetDatabaseByName(system,"material",&template_database));
+		ERROR_CHECK(EVDS_System_GetDatabaseByName(member,"material",&database));
+		EQUAL_TO((database != template_database),1);
+		ERROR_CHECK(EVDS_Variable_GetNested(database,"O2",&database));
+		ERROR_CHECK(EVDS_Variable_GetNested(database,"density",&density));
+		EQUAL_TO(density->type,EVDS_VARIABLE_TYPE_FUNCTION);
+		EQUAL_TO((density->list->first != 0) && (density->list->first->next != 0),1);
+		ERROR_CHECK(EVDS_Variable_GetReal(density,&value));
+		REAL_EQUAL_TO(value,1.429);
+
+		/// Every member has its own dispersed mass
+		ERROR_CHECK(EVDS_Ensemble_GetVariables(ensemble,"/Propagator/Satellite/mass",masses));
+		for (i = 0; i < 8; i++) {
+			REAL_EQUAL_TO_EPS(masses[i],1000.0,100.0);
+		}
+		EQUAL_TO((masses[0] != masses[1]),1);
+
+		/// All members are propagated
+		ERROR_CHECK(EVDS_Ensemble_Solve(ensemble,1.0,4));
+		ERROR_CHECK(EVDS_Ensemble_GetStateVectors(ensemble,"/Propagator/Satellite",states));
+		for (i = 0; i < 8; i++) {
+			VECTOR_EQUAL_TO(&states[i].position,1.0,0,0);
+		}
+
+		/// Worker threads are reused by following steps
+		for (i = 0; i < 99; i++) {
+			ERROR_CHECK(EVDS_Ensemble_Solve(ensemble,1.0,(i % 2) ? 4 : 2));
+		}
+		ERROR_CHECK(EVDS_Ensemble_GetStateVectors(ensemble,"/Propagator/Satellite",states));
+		for (i = 0; i < 8; i++) {
+			VECTOR_EQUAL_TO_EPS(&states[i].position,100.0,0,0,1e-6);
+		}
+		ERROR_CHECK(EVDS_Ensemble_GetWorkerCount(ensemble,&count));
+		EQUAL_TO(count,3);
+
+		/// Same seed produces same dispersions
+		ERROR_CHECK(EVDS_Ensemble_Generate(ensemble,4,1234));
+		ERROR_CHECK(EVDS_Ensemble_GetVariables(ensemble,"/Propagator/Satellite/mass",regenerated_masses));
+		for (i = 0; i < 4; i++) {
+			REAL_EQUAL_TO(regenerated_masses[i],masses[i]);
+		}
+		ERROR_CHECK(EVDS_Ensemble_Destroy(ensemble));
+	} END_TEST
+
+
+	START_TEST("EVDS_System_Snapshot") {
+		EVDS_SNAPSHOT* snapshot;
+		EVDS_SNAPSHOT* incremental;
+		EVDS_SNAPSHOT* other;
+		EVDS_OBJECT* satellite;
+		EVDS_OBJECT* station;
+		EVDS_VARIABLE* mass;
+		EVDS_REAL value;
+		size_t full_size,incremental_size;
+
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"	<object name=\"Propagator\" type=\"propagator_rk4\">"
+"		<object name=\"Satellite\" type=\"vessel\" vx=\"1.0\">"
+"			<parameter name=\"mass\">1000</parameter>"
+"			<parameter name=\"jxx\">1</parameter>"
+"			<parameter name=\"jyy\">1</parameter>"
+"			<parameter name=\"jzz\">1</parameter>"
+"		</object>"
+"		<object name=\"Station\" type=\"vessel\" x=\"100.0\">"
+"			<parameter name=\"mass\">5000</parameter>"
+"			<parameter name=\"jxx\">1</parameter>"
+"			<parameter name=\"jyy\">1</parameter>"
+"			<parameter name=\"jzz\">1</parameter>"
+"		</object>"
+"	</object>"
+"</EVDS>",&object));
+		ERROR_CHECK(EVDS_Object_Initialize(object,1));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Satellite",0,&satellite));
+		ERROR_CHECK(EVDS_System_GetObjectByName(system,"Station",0,&station));
+		ERROR_CHECK(EVDS_Object_GetVariable(satellite,"mass",&mass));
+
+		/// Snapshot must be saved before it can be restored
+		ERROR_CHECK(EVDS_Snapshot_Create(system,&snapshot));
+		EQUAL_TO(EVDS_System_Restore(system,snapshot),EVDS_ERROR_BAD_STATE);
+		ERROR_CHECK(EVDS_System_Snapshot(system,snapshot));
+		ERROR_CHECK(EVDS_Snapshot_GetSize(snapshot,&full_size));
+
+		/// Rollback restores state vectors and variables
+		ERROR_CHECK(EVDS_Object_Solve(object,1.0));
+		ERROR_CHECK(EVDS_Variable_SetReal(mass,900.0));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO(&state.position,1.0,0,0);
+
+		ERROR_CHECK(EVDS_System_Restore(system,snapshot));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		VECTOR_EQUAL_TO(&state.position,0,0,0);
+		ERROR_CHECK(EVDS_Variable_GetReal(mass,&value));
+		REAL_EQUAL_TO(value,1000.0);
+
+		/// Incremental snapshot only stores objects which have changed
+		ERROR_CHECK(EVDS_Snapshot_CreateIncremental(snapshot,&incremental));
+		ERROR_CHECK(EVDS_Variable_SetReal(mass,800.0));
+		ERROR_CHECK(EVDS_System_Snapshot(system,incremental));
+		ERROR_CHECK(EVDS_Snapshot_GetSize(incremental,&incremental_size));
+		EQUAL_TO((incremental_size > 0),1);
+		EQUAL_TO((incremental_size < full_size),1);
+
+		ERROR_CHECK(EVDS_System_Restore(system,snapshot));
+		ERROR_CHECK(EVDS_Variable_GetReal(mass,&value));
+		REAL_EQUAL_TO(value,1000.0);
+		ERROR_CHECK(EVDS_System_Restore(system,incremental));
+		ERROR_CHECK(EVDS_Variable_GetReal(mass,&value));
+		REAL_EQUAL_TO(value,800.0);
+		ERROR_CHECK(EVDS_Object_GetStateVector(station,&state));
+		VECTOR_EQUAL_TO(&state.position,100.0,0,0);
+
+		/// Incremental snapshot is invalidated when base snapshot is saved again
+		ERROR_CHECK(EVDS_System_Snapshot(system,snapshot));
+		EQUAL_TO(EVDS_System_Restore(system,incremental),EVDS_ERROR_BAD_STATE);
+
+		/// Only objects written since the base snapshot was saved are stored
+		ERROR_CHECK(EVDS_System_Snapshot(system,incremental));
+		ERROR_CHECK(EVDS_Snapshot_GetSize(incremental,&incremental_size));
+		EQUAL_TO(incremental_size,0);
+		ERROR_CHECK(EVDS_Object_SetPosition(station,root,200.0,0,0));
+		ERROR_CHECK(EVDS_System_Snapshot(system,incremental));
+		ERROR_CHECK(EVDS_Snapshot_GetSize(incremental,&incremental_size));
+		EQUAL_TO((incremental_size > 0),1);
+		EQUAL_TO((incremental_size < full_size),1);
+
+		/// Objects changed after restoring another snapshot are stored
+		ERROR_CHECK(EVDS_Snapshot_Create(system,&other));
+		ERROR_CHECK(EVDS_System_Snapshot(system,other));
+		ERROR_CHECK(EVDS_System_Restore(system,snapshot));
+		ERROR_CHECK(EVDS_System_Restore(system,other));
+		ERROR_CHECK(EVDS_Object_SetPosition(station,root,300.0,0,0));
+		ERROR_CHECK(EVDS_System_Snapshot(system,incremental));
+		ERROR_CHECK(EVDS_System_Restore(system,snapshot));
+		ERROR_CHECK(EVDS_Object_GetStateVector(station,&state));
+		VECTOR_EQUAL_TO(&state.position,100.0,0,0);
+		ERROR_CHECK(EVDS_System_Restore(system,incremental));
+		ERROR_CHECK(EVDS_Object_GetStateVector(station,&state));
+		VECTOR_EQUAL_TO(&state.position,300.0,0,0);
+
+		ERROR_CHECK(EVDS_Snapshot_Destroy(other));
+		ERROR_CHECK(EVDS_Snapshot_Destroy(incremental));
+		ERROR_CHECK(EVDS_Snapshot_Destroy(snapshot));
+	} END_TEST
+
+
+
+	START_TEST("Deterministic mode") {
+		EVDS_SNAPSHOT* snapshot;
+		EVDS_SYSTEM* systems[2];
+		EVDS_OBJECT* propagators[2];
+		EVDS_OBJECT* satellite;
+		EVDS_OBJECT* fuel_tank;
+		EVDS_VARIABLE* fuel_mass;
+		EVDS_REAL value;
+		unsigned int hash,initial_hash,restored_hash,hashes[2];
+		int i,j;
+
+		ERROR_CHECK(EVDS_System_SetDeterministic(system,1));
+		ERROR_CHECK(EVDS_Object_LoadFromString(root,
+"<EVDS version=\"34\">"
+"	<object name=\"Propagator\" type=\"propagator_rk4\">"
+"		<object name=\"Satellite\" type=\"vessel\" vx=\"1.0\">"
+"			<parameter name=\"mass\">1000</parameter>"
+"			<parameter name=\"jxx\">1</parameter>"
+"			<parameter name=\"jyy\">1</parameter>"
+"			<parameter name=\"jzz\">1</parameter>"
+"		</object>"
+"	</object>"
+"</EVDS>",&object));
+
+		/// Non-blocking initialization is blocking in deterministic mode
+		ERROR_CHECK(EVDS_Object_Initialize(object,0));
+		EQUAL_TO(object->initialized,1);
+
+		/// State hash changes with state and is restored with it
+		ERROR_CHECK(EVDS_System_GetStateHash(system,&initial_hash));
+		ERROR_CHECK(EVDS_System_GetStateHash(system,&hash));
+		EQUAL_TO(hash,initial_hash);
+
+		ERROR_CHECK(EVDS_Snapshot_Create(system,&snapshot));
+		ERROR_CHECK(EVDS_System_Snapshot(system,snapshot));
+		ERROR_CHECK(EVDS_Object_Solve(object,1.0));
+		ERROR_CHECK(EVDS_System_GetStateHash(system,&hash));
+		EQUAL_TO((hash != initial_hash),1);
+
+		ERROR_CHECK(EVDS_System_Restore(system,snapshot));
+		ERROR_CHECK(EVDS_System_GetStateHash(system,&restored_hash));
+		EQUAL_TO(restored_hash,initial_hash);
+		ERROR_CHECK(EVDS_Snapshot_Destroy(snapshot));
+
+		/// Two independently built systems stepped in lockstep have same hash after every step
+		for (i = 0; i < 2; i++) {
+			EVDS_OBJECT* system_root;
+			EVDS_OBJECT* engine;
+			EVDS_VARIABLE* command_throttle;
+			ERROR_CHECK(EVDS_System_Create(&systems[i]));
+			EVDS_Common_Register(systems[i]);
+			ERROR_CHECK(EVDS_System_SetDeterministic(systems[i],1));
+			ERROR_CHECK(EVDS_System_SetTime(systems[i],56000.0));
+			ERROR_CHECK(EVDS_System_GetRootInertialSpace(systems[i],&system_root));
+			ERROR_CHECK(EVDS_Object_LoadFromString(system_root,
+"<EVDS version=\"34\">"
+"	<object name=\"Propagator\" type=\"propagator_rk4\">"
+"		<object name=\"Satellite\" type=\"vessel\" vx=\"1.0\" vy=\"0.5\">"
+"			<parameter name=\"mass\">1000</parameter>"
+"			<parameter name=\"jxx\">1</parameter>"
+"			<parameter name=\"jyy\">1</parameter>"
+"			<parameter name=\"jzz\">1</parameter>"
+"			<object name=\"Oxidizer\" type=\"fuel_tank\">"
+"				<parameter name=\"fuel.type\">O2</parameter>"
+"				<parameter name=\"fuel.mass\">400</parameter>"
+"			</object>"
+"			<object name=\"Fuel\" type=\"fuel_tank\">"
+"				<parameter name=\"fuel.type\">H2</parameter>"
+"				<parameter name=\"fuel.mass\">100</parameter>"
+"			</object>"
+"			<object name=\"Rocket engine\" type=\"rocket_engine\">"
+"				<parameter name=\"mass\">100</parameter>"
+"				<parameter name=\"vacuum.isp\">400.0</parameter>"
+"				<parameter name=\"vacuum.thrust\">10000.0</parameter>"
+"			</object>"
+"		</object>"
+"	</object>"
+"</EVDS>",&propagators[i]));
+			ERROR_CHECK(EVDS_Object_Initialize(propagators[i],0));
+			ERROR_CHECK(EVDS_System_GetObjectByName(systems[i],"Rocket engine",0,&engine));
+			ERROR_CHECK(EVDS_Object_GetVariable(engine,"command.throttle",&command_throttle));
+			ERROR_CHECK(EVDS_Variable_SetReal(command_throttle,1.0));
+		}
+		for (j = 0; j < 20; j++) {
+			for (i = 0; i < 2; i++) {
+				ERROR_CHECK(EVDS_Object_Solve(propagators[i],0.1));
+				ERROR_CHECK(EVDS_System_GetStateHash(systems[i],&hashes[i]));
+			}
+			EQUAL_TO(hashes[0],hashes[1]);
+		}
+
+		/// Hash depends on variables (remaining fuel), not only on state vectors
+		ERROR_CHECK(EVDS_System_GetObjectByName(systems[1],"Fuel",0,&fuel_tank));
+		ERROR_CHECK(EVDS_Object_GetVariable(fuel_tank,"fuel.mass",&fuel_mass));
+		ERROR_CHECK(EVDS_Variable_GetReal(fuel_mass,&value));
+		EQUAL_TO((value < 100.0),1);
+		ERROR_CHECK(EVDS_Variable_SetReal(fuel_mass,value-1e-9));
+		ERROR_CHECK(EVDS_System_GetStateHash(systems[1],&hashes[1]));
+		EQUAL_TO((hashes[0] != hashes[1]),1);
+		ERROR_CHECK(EVDS_Variable_SetReal(fuel_mass,value));
+		ERROR_CHECK(EVDS_System_GetStateHash(systems[1],&hashes[1]));
+		EQUAL_TO(hashes[0],hashes[1]);
+
+		/// Perturbed system has a different hash
+		ERROR_CHECK(EVDS_System_GetObjectByName(systems[1],"Satellite",0,&satellite));
+		ERROR_CHECK(EVDS_Object_GetStateVector(satellite,&state));
+		state.velocity.y += 1e-9;
+		ERROR_CHECK(EVDS_Object_SetStateVector(satellite,&state));
+		for (i = 0; i < 2; i++) {
+			ERROR_CHECK(EVDS_Object_Solve(propagators[i],0.1));
+		}
+		ERROR_CHECK(EVDS_System_GetStateHash(systems[0],&hashes[0]));
+		ERROR_CHECK(EVDS_System_GetStateHash(systems[1],&hashes[1]));
+		EQUAL_TO((hashes[0] != hashes[1]),1);
+
+		ERROR_CHECK(EVDS_System_Destroy(systems[0]));
+		ERROR_CHECK(EVDS_System_Destroy(systems[1]));
+	} END_TEST
+}